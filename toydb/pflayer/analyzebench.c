@@ -0,0 +1,275 @@
+/* analyzebench.c
+ * Heap file statistics: how long HF_Analyze takes, in full and on a
+ * sample of the pages, and how good its numbers are.
+ *
+ * The table is bulk loaded into a heap file and analyzed twice, once
+ * reading every page and once reading -p percent of them. For each
+ * pass the bench prints the time and the PF physical reads (the file
+ * is reopened first), and the stats are saved and loaded back. For
+ * each column it then prints the exact number of distinct values next
+ * to the estimates of both passes. Last, -q random scans on
+ * the numeric columns ("col = x", a one-sided range and a two-sided
+ * range, each with x taken from a random record) are run, and their
+ * row counts are compared with HF_EstimateRows. The q-error of an
+ * estimate is max(est/actual, actual/est), both taken as at least 1;
+ * 1 is exact.
+ *
+ * Usage: analyzebench [-b poolSize] [-p samplePct] [-q queries] [-s seed]
+ *                     [table.txt]
+ *   -b  buffer pool size              (default 20)
+ *   -p  percent of the pages sampled  (default 10)
+ *   -q  queries of each kind          (default 100)
+ *   -s  random seed                   (default 1)
+ *   table defaults to ../../data/gradsum.txt
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "hf.h"
+#include "pftypes.h"
+#include "benchutil.h"
+
+#define NKINDS    3
+
+static const char *heapFile = "analyzebench.hf";
+
+// column col of line i, as HF_Analyze cuts it
+static const char *field(int i, int col, int *len) {
+    const char *s = lines[i], *end = lines[i] + lineLen[i];
+    for (int c = 0; c < col && s < end; c++) {
+        while (s < end && *s != ';')
+            s++;
+        if (s < end)
+            s++;
+    }
+    const char *e = s;
+    while (e < end && *e != ';')
+        e++;
+    *len = (int)(e - s);
+    return s;
+}
+
+struct value {
+    const char *s;
+    int len;
+};
+
+static int cmp_value(const void *x, const void *y) {
+    const struct value *a = x, *b = y;
+    int c = memcmp(a->s, b->s, a->len < b->len ? a->len : b->len);
+    return c ? c : a->len - b->len;
+}
+
+static long exact_distinct(int col) {
+    struct value *v = malloc(nlines * sizeof(struct value));
+    long n = 0, d = 0;
+    for (int i = 0; i < nlines; i++) {
+        v[n].s = field(i, col, &v[n].len);
+        if (v[n].len > 0)
+            n++;
+    }
+    qsort(v, n, sizeof(struct value), cmp_value);
+    for (long i = 0; i < n; i++)
+        d += i == 0 || cmp_value(&v[i - 1], &v[i]) != 0;
+    free(v);
+    return d;
+}
+
+// reopen the file so that the pass starts from an empty pool
+static int analyze(int *fd, int ncols, int pct, HF_Stats *stats, double *ms, int *reads) {
+    HF_CloseFile(*fd);
+    if ((*fd = HF_OpenFile((char *)heapFile)) < 0)
+        return *fd;
+    PF_ResetStats();
+    double t0 = now_ms();
+    int err = HF_Analyze(*fd, ncols, pct, stats);
+    *ms = now_ms() - t0;
+    *reads = PF_stats.physicalReads;
+    return err;
+}
+
+static double qerror(double est, long actual) {
+    double a = actual < 1 ? 1 : actual;
+    if (est < 1)
+        est = 1;
+    return est > a ? est / a : a / est;
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = "../../data/gradsum.txt";
+    int pool = 20, pct = 10, queries = 100;
+    unsigned seed = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "b:p:q:s:")) != -1) {
+        switch (opt) {
+        case 'b': pool = atoi(optarg); break;
+        case 'p': pct = atoi(optarg); break;
+        case 'q': queries = atoi(optarg); break;
+        case 's': seed = (unsigned)atoi(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-b poolSize] [-p samplePct] [-q queries] [-s seed] "
+                    "[table.txt]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind < argc)
+        path = argv[optind];
+    if (pool <= 0 || pool > PF_MAX_BUFS_LIMIT) {
+        fprintf(stderr, "pool size out of range (1..%d)\n", PF_MAX_BUFS_LIMIT);
+        return 1;
+    }
+    if (pct < 1 || pct > 100 || queries < 0) {
+        fprintf(stderr, "-p must be within 1..100, -q at least 0\n");
+        return 1;
+    }
+    if (read_table(path) <= 1) {
+        fprintf(stderr, "cannot read %s\n", path);
+        return 1;
+    }
+    srand(seed);
+
+    PF_Init();
+    PF_SetBufferSize(pool);
+    PF_SetReplacementPolicy(PF_REPL_LRU);
+
+    // 1. Load the table; the columns are those of its second line (the
+    //    first is the dump's title)
+    PF_DestroyFile((char *)heapFile);
+    if (HF_CreateFile((char *)heapFile) != HFE_OK) {
+        PF_PrintError("HF_CreateFile");
+        return 1;
+    }
+    int fd = HF_OpenFile((char *)heapFile);
+    int next = 0;
+    RID *rids;
+    int n;
+    if (fd < 0 || HF_BulkLoad(fd, next_line, &next, 100, &rids, &n) != HFE_OK) {
+        PF_PrintError("HF_BulkLoad");
+        return 1;
+    }
+    free(rids);
+    int ncols = 1;
+    for (int i = 0; i < lineLen[1]; i++)
+        ncols += lines[1][i] == ';';
+    if (ncols > HF_STATS_COLS)
+        ncols = HF_STATS_COLS;
+
+    // 2. Analyze in full and sampled, and check that the stats survive
+    //    a save and load
+    HF_Stats full, sample, loaded;
+    double ms[2];
+    int reads[2];
+    if (analyze(&fd, ncols, 100, &full, &ms[0], &reads[0]) != HFE_OK ||
+        analyze(&fd, ncols, pct, &sample, &ms[1], &reads[1]) != HFE_OK) {
+        PF_PrintError("HF_Analyze");
+        return 1;
+    }
+    int status = 0;
+    if (HF_SaveStats((char *)heapFile, &sample) != HFE_OK ||
+        HF_LoadStats((char *)heapFile, &loaded) != HFE_OK ||
+        memcmp(&loaded, &sample, sizeof(HF_Stats)) != 0) {
+        printf("WRONG: stats changed on save and load\n");
+        status = 1;
+    }
+
+    printf("analyzebench: %s, %d records, %d columns, %d pages, pool=%d\n",
+           path, nlines, ncols, full.pages, pool);
+    printf("%-8s %6s %9s %8s %9s %9s\n", "analyze", "pages", "ms", "reads", "rows", "avgLen");
+    printf("%-8s %6d %9.1f %8d %9ld %9.1f\n", "full", full.pagesRead, ms[0], reads[0],
+           full.rows, full.avgLen);
+    printf("%-4s%3d%% %6d %9.1f %8d %9ld %9.1f\n", "smp", pct, sample.pagesRead, ms[1],
+           reads[1], sample.rows, sample.avgLen);
+    if (full.rows != nlines) {
+        printf("WRONG: full analyze counted %ld records\n", full.rows);
+        status = 1;
+    }
+
+    // 3. Distinct values per column
+    printf("\n%4s %8s %8s %9s %9s %9s %9s %9s\n", "col", "nulls", "numeric", "distinct",
+           "hll", "err%", "sampled", "err%");
+    for (int c = 0; c < ncols; c++) {
+        long d = exact_distinct(c);
+        printf("%4d %8ld %8ld %9ld %9.0f %9.1f %9.0f %9.1f\n", c, full.col[c].nulls,
+               full.col[c].numeric, d, full.col[c].distinct,
+               d ? 100 * (full.col[c].distinct - d) / d : 0, sample.col[c].distinct,
+               d ? 100 * (sample.col[c].distinct - d) / d : 0);
+    }
+
+    // 4. Estimated against actual rows, on columns with numbers
+    int numCols[HF_STATS_COLS], nnum = 0;
+    for (int c = 0; c < ncols; c++) {
+        if (full.col[c].numeric > nlines / 2)
+            numCols[nnum++] = c;
+    }
+    if (nnum == 0 || queries == 0) {
+        HF_CloseFile(fd);
+        PF_DestroyFile((char *)heapFile);
+        return status;
+    }
+    static const char *kinds[NKINDS] = { "col = x", "col < x", "x <= col < y" };
+    printf("\n%-14s %9s %9s %9s %9s %9s\n", "query", "rows", "q full", "max", "q smp",
+           "max");
+    for (int k = 0; k < NKINDS; k++) {
+        double sum[2] = { 0, 0 }, max[2] = { 1, 1 };
+        long total = 0;
+        for (int q = 0; q < queries; q++) {
+            HF_ScanSpec spec;
+            HF_Scan sc;
+            RID rid;
+            char *rec;
+            int len, col = numCols[rand() % nnum];
+            double x[2];
+
+            // pick the constants from random records with a number there
+            for (int j = 0; j < 2; j++) {
+                const char *f;
+                do
+                    f = field(1 + rand() % (nlines - 1), col, &len);
+                while (len == 0);
+                x[j] = atof(f);
+            }
+            if (x[0] > x[1]) {
+                double t = x[0];
+                x[0] = x[1];
+                x[1] = t;
+            }
+            memset(&spec, 0, sizeof(spec));
+            spec.npreds = k == 2 ? 2 : 1;
+            spec.preds[0].col = spec.preds[1].col = col;
+            spec.preds[0].numeric = spec.preds[1].numeric = 1;
+            spec.preds[0].op = k == 0 ? HF_EQ : k == 1 ? HF_LT : HF_GE;
+            spec.preds[0].num = x[0];
+            spec.preds[1].op = HF_LT;
+            spec.preds[1].num = x[1];
+            spec.nproj = 1;
+            spec.proj[0] = col;
+
+            long actual = 0;
+            if (HF_OpenFileScanEx(fd, &sc, &spec) != HFE_OK) {
+                PF_PrintError("HF_OpenFileScanEx");
+                return 1;
+            }
+            while (HF_GetNextRec(fd, &sc, &rid, &rec, &len) == HFE_OK)
+                actual++;
+            HF_CloseFileScan(&sc);
+            total += actual;
+
+            double e[2] = { HF_EstimateRows(&full, &spec), HF_EstimateRows(&sample, &spec) };
+            for (int j = 0; j < 2; j++) {
+                double qe = qerror(e[j], actual);
+                sum[j] += qe;
+                if (qe > max[j])
+                    max[j] = qe;
+            }
+        }
+        printf("%-14s %9.0f %9.2f %9.1f %9.2f %9.1f\n", kinds[k], (double)total / queries,
+               sum[0] / queries, max[0], sum[1] / queries, max[1]);
+    }
+
+    HF_CloseFile(fd);
+    PF_DestroyFile((char *)heapFile);
+    remove("analyzebench.hf.stats");
+    return status;
+}
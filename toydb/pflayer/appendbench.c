@@ -0,0 +1,208 @@
+/* appendbench.c
+ * Append-only heap files: insert throughput, deletes as tombstones.
+ *
+ * The table, repeated -r times, is loaded into three files:
+ *   heap      - HF_InsertRec on a plain file
+ *   append    - HF_InsertRec on an append-only file (opts.append)
+ *   bulk      - HF_BulkLoad on a plain file, the sequential baseline
+ * The load is timed up to and including HF_CloseFile, so that every
+ * page is on disk. The bench prints the pages, the inserts per second,
+ * the MB of pages written per second and the PF page writes. The file
+ * is then reopened, -d percent of the records are deleted in random
+ * order, and a full scan and a vacuum follow. On the append-only file
+ * the deletes only read pages, and HF_OpenFileScan carries them out
+ * first; that is timed apart as "sync ms" and left out of "scan ms".
+ * The scan must find exactly the records left.
+ *
+ * Usage: appendbench [-b poolSize] [-r repeat] [-d percent] [-s seed]
+ *                    [table.txt]
+ *   -b  buffer pool size              (default 20)
+ *   -r  times the table is loaded     (default 4)
+ *   -d  percent of the records deleted (default 10)
+ *   -s  random seed                   (default 1)
+ *   table defaults to ../../data/studregn.txt
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "hf.h"
+#include "pftypes.h"
+#include "benchutil.h"
+
+#define NFILES    3
+
+static const char *heapFile = "appendbench.hf";
+
+// HF_RecordIter over the table, -r times
+struct table_iter {
+    long next;
+    long total;
+};
+
+static int next_repeat(void *ctx, char **record, int *recLen) {
+    struct table_iter *it = ctx;
+    if (it->next == it->total)
+        return 0;
+    int i = (int)(it->next++ % nlines);
+    *record = lines[i];
+    *recLen = lineLen[i];
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = "../../data/studregn.txt";
+    int pool = 20, repeat = 4, delPct = 10;
+    unsigned seed = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "b:r:d:s:")) != -1) {
+        switch (opt) {
+        case 'b': pool = atoi(optarg); break;
+        case 'r': repeat = atoi(optarg); break;
+        case 'd': delPct = atoi(optarg); break;
+        case 's': seed = (unsigned)atoi(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-b poolSize] [-r repeat] [-d percent] [-s seed] "
+                    "[table.txt]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind < argc)
+        path = argv[optind];
+    if (pool <= 0 || pool > PF_MAX_BUFS_LIMIT) {
+        fprintf(stderr, "pool size out of range (1..%d)\n", PF_MAX_BUFS_LIMIT);
+        return 1;
+    }
+    if (repeat < 1 || delPct < 0 || delPct > 100) {
+        fprintf(stderr, "-r must be at least 1, -d within 0..100\n");
+        return 1;
+    }
+    if (read_table(path) <= 0) {
+        fprintf(stderr, "cannot read %s\n", path);
+        return 1;
+    }
+    srand(seed);
+
+    PF_Init();
+    PF_SetBufferSize(pool);
+    PF_SetReplacementPolicy(PF_REPL_LRU);
+
+    // 1. The same deletes, in the same random order, for every file
+    int total = nlines * repeat;
+    int *order = malloc(total * sizeof(int));
+    int ndel = 0;
+    for (int i = 0; i < total; i++) {
+        if (rand() % 100 < delPct)
+            order[ndel++] = i;
+    }
+    for (int i = ndel - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        int t = order[i];
+        order[i] = order[j];
+        order[j] = t;
+    }
+
+    printf("appendbench: %s x%d, %d records, %d deleted, pool=%d\n",
+           path, repeat, total, ndel, pool);
+    printf("%-7s %6s %8s %7s %7s %8s %9s %9s %9s %9s %6s\n", "file", "pages", "kins/s", "MB/s",
+           "writes", "kdel/s", "del I/O", "sync ms", "scan ms", "vac ms", "after");
+
+    int status = 0;
+    for (int f = 0; f < NFILES; f++) {
+        static const char *names[NFILES] = { "heap", "append", "bulk" };
+        HF_FileOptions opts;
+        RID *rids = NULL;
+        int n = 0;
+
+        // 2. Load the file and close it
+        memset(&opts, 0, sizeof(opts));
+        opts.append = f == 1;
+        PF_DestroyFile((char *)heapFile);
+        if (HF_CreateFileEx((char *)heapFile, &opts) != HFE_OK) {
+            PF_PrintError("HF_CreateFileEx");
+            return 1;
+        }
+        int fd = HF_OpenFile((char *)heapFile);
+        if (fd < 0) {
+            PF_PrintError("HF_OpenFile");
+            return 1;
+        }
+        PF_ResetStats();
+        double t0 = now_ms();
+        if (f == 2) {
+            struct table_iter it = { 0, total };
+            if (HF_BulkLoad(fd, next_repeat, &it, 100, &rids, &n) != HFE_OK) {
+                PF_PrintError("HF_BulkLoad");
+                return 1;
+            }
+        } else {
+            rids = malloc(total * sizeof(RID));
+            for (n = 0; n < total; n++) {
+                int i = n % nlines;
+                int err = HF_InsertRec(fd, lines[i], lineLen[i], &rids[n]);
+                if (err != HFE_OK) {
+                    printf("HF_InsertRec error %d on record %d\n", err, n);
+                    return 1;
+                }
+            }
+        }
+        int pages = PF_NumPages(fd);
+        if (HF_CloseFile(fd) != HFE_OK) {
+            PF_PrintError("HF_CloseFile");
+            return 1;
+        }
+        double loadMs = now_ms() - t0;
+        int writes = PF_stats.physicalWrites;
+
+        // 3. Delete, scan and vacuum
+        fd = HF_OpenFile((char *)heapFile);
+        PF_ResetStats();
+        t0 = now_ms();
+        for (int k = 0; k < ndel; k++) {
+            int err = HF_DeleteRec(fd, rids[order[k]]);
+            if (err != HFE_OK) {
+                printf("HF_DeleteRec error %d on record %d\n", err, order[k]);
+                return 1;
+            }
+        }
+        double delMs = now_ms() - t0;
+        int delIO = PF_stats.physicalReads + PF_stats.physicalWrites;
+
+        HF_Scan scan;
+        RID rid;
+        char *rec;
+        int len, live = 0;
+        t0 = now_ms();
+        HF_OpenFileScan(fd, &scan);
+        double syncMs = now_ms() - t0;
+        t0 = now_ms();
+        while (HF_GetNextRec(fd, &scan, &rid, &rec, &len) == HFE_OK)
+            live++;
+        HF_CloseFileScan(&scan);
+        double scanMs = now_ms() - t0;
+
+        HF_VacuumStats vs;
+        memset(&vs, 0, sizeof(vs));
+        t0 = now_ms();
+        if (HF_Vacuum(fd, HF_VACUUM_SPARSE, NULL, NULL, &vs) != HFE_OK) {
+            PF_PrintError("HF_Vacuum");
+            return 1;
+        }
+        double vacMs = now_ms() - t0;
+
+        printf("%-7s %6d %8.1f %7.1f %7d %8.1f %9d %9.1f %9.1f %9.1f %6d", names[f],
+               pages, total / loadMs, (double)pages * PF_PAGE_SIZE / 1e3 / loadMs, writes,
+               ndel ? ndel / delMs : 0, delIO, syncMs, scanMs, vacMs, PF_NumPages(fd));
+        if (live != total - ndel) {
+            printf("  WRONG: scan found %d records", live);
+            status = 1;
+        }
+        printf("\n");
+        HF_CloseFile(fd);
+        free(rids);
+    }
+
+    PF_DestroyFile((char *)heapFile);
+    return status;
+}
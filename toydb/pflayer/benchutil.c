@@ -0,0 +1,52 @@
+/* benchutil.c
+ * Helpers shared by the benches; see benchutil.h.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "benchutil.h"
+
+#define MAX_LINE  4096
+
+char **lines;
+int *lineLen;
+int nlines;
+
+int read_table(const char *path) {
+    FILE *fp = fopen(path, "r");
+    char line[MAX_LINE];
+    int cap = 0;
+    if (!fp)
+        return -1;
+    nlines = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        size_t len = strlen(line);
+        while (len > 0 && (line[len-1] == '\n' || line[len-1] == '\r'))
+            line[--len] = '\0';
+        if (nlines == cap) {
+            cap = cap ? cap * 2 : 1024;
+            lines = realloc(lines, cap * sizeof(char *));
+            lineLen = realloc(lineLen, cap * sizeof(int));
+        }
+        lines[nlines] = strdup(line);
+        lineLen[nlines++] = (int)len;
+    }
+    fclose(fp);
+    return nlines;
+}
+
+int next_line(void *ctx, char **record, int *recLen) {
+    int *next = ctx;
+    if (*next == nlines)
+        return 0;
+    *record = lines[*next];
+    *recLen = lineLen[(*next)++];
+    return 1;
+}
+
+double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
@@ -0,0 +1,31 @@
+#ifndef BENCHUTIL_H
+#define BENCHUTIL_H
+
+/*
+ * Helpers shared by the benches: a data table read into memory, one
+ * record per line, and a clock.
+ */
+
+/* The table read by read_table, one line per record */
+extern char **lines;        /* The lines, without "\n" or trailing "\r"s */
+extern int *lineLen;        /* Length of each line */
+extern int nlines;          /* Number of lines */
+
+/*
+ * Read the table at path into lines, lineLen and nlines, replacing the
+ * table read before (its lines are not freed). Lines longer than 4095
+ * bytes are split. Returns the number of lines, or -1 if the file
+ * cannot be opened.
+ */
+int read_table(const char *path);
+
+/*
+ * HF_RecordIter over the table, for HF_BulkLoad: ctx is an int holding
+ * the next line, which starts at 0.
+ */
+int next_line(void *ctx, char **record, int *recLen);
+
+/* Monotonic clock in milliseconds */
+double now_ms(void);
+
+#endif
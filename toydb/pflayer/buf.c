@@ -1,6 +1,6 @@
 /* buf.c: buffer management routines. The interface routines are:
-PFbufGet(), PFbufUnfix(), PFbufAlloc(), PFbufReleaseFile(), PFbufUsed() and
-PFbufPrint() */
+PFbufGet(), PFbufUnfix(), PFbufAlloc(), PFbufReleaseFile(), PFbufDiscard(),
+PFbufUsed() and PFbufPrint() */
 #include <stdio.h>
 #include <stdlib.h>
 #include "pf.h"
@@ -109,9 +109,15 @@ ALGORITHM:
 	If free list is empty, and there are less than PF_MAX_BUFS 
 	number of pages allocated, then malloc() one.
 	Otherwise, choose a victim to write out, and then use that
-	page as the page to be used.
+	page as the page to be used. A copy of the victim is kept in
+	the victim cache (see vcache.c), if that is turned on.
 	If a victim cannot be chosen (because all the pages are fixed),
-	then return error.
+	then return error, unless some of them are only being read or
+	written by other threads: then wait for those and try again.
+
+	A dirty victim is written with PFlatch let go (see PFioBegin()),
+	fixed and marked "io" meanwhile, so that no other thread
+	takes it or fixes its page.
 
 AUTHOR: clc
 
@@ -127,7 +133,9 @@ GLOBAL VARIABLES MODIFIED:
 {
 PFbpage *tbpage;	/* temporary pointer to buffer page */
 int error;		/* error value returned*/
+int busy;		/* TRUE if a page is fixed only for I/O */
 
+again:
 	/* Set *bpage to the buffer page to be returned */
 	if (PFfreebpage != NULL){
 		/* Free list not empty, use the one from the free list. */
@@ -176,17 +184,35 @@ int error;		/* error value returned*/
 
 
 		if (tbpage == NULL){
-			/* couldn't find a free page */
+			/* couldn't find a free page; wait if another
+			thread is about to let one go */
+			busy = FALSE;
+			for (tbpage=PFfirstbpage; tbpage != NULL;
+					tbpage=tbpage->nextpage)
+				busy |= tbpage->io;
+			if (busy && PFioWait())
+				goto again;
 			PFerrno = PFE_NOBUF;
 			return(PFerrno);
 		}
 
 		/* write out the dirty page */
-		if (tbpage->dirty&&((error=(*writefcn)(tbpage->fd,
-				tbpage->page,&tbpage->fpage))!= PFE_OK))
-			return(error);
+		if (tbpage->dirty){
+			tbpage->fixed = tbpage->io = TRUE;
+			error = (*writefcn)(tbpage->fd,tbpage->page,
+					&tbpage->fpage);
+			tbpage->fixed = tbpage->io = FALSE;
+			PFioDone();
+			if (error != PFE_OK)
+				return(error);
+		}
 		tbpage->dirty = FALSE;
 
+		/* keep a compressed copy in the victim cache */
+		if ((error=PFvcacheInsert(tbpage->fd,tbpage->page,
+				&tbpage->fpage))!= PFE_OK)
+			return(error);
+
 		/* unlink from hash table */
 		if ((error=PFhashDelete(tbpage->fd,tbpage->page))!= PFE_OK)
 			return(error);
@@ -227,8 +253,16 @@ SPECIFICATIONS:
 		in pagenum;
 		PFpage *fpage;
 	which will write one page into the file.
+	If the page is in the victim cache, it is taken from there and
+	readfcn() is not called.
 	It is an error to read a page already fixed in the buffer.
 
+	The page is read with PFlatch let go. It is in the hash table,
+	fixed and marked "io" meanwhile; a thread that asks for it then
+	waits for the read to end and looks it up again (see PFioWait()).
+	Since writing a victim lets PFlatch go too, the page is also
+	looked up again once a buffer is found.
+
 RETURN VALUE:
 	PFE_OK	if no error.
 	PF error code if error.
@@ -241,7 +275,12 @@ GLOBAL VARIABLES MODIFIED:
 PFbpage *bpage;	/* pointer to buffer */
 int error;
 
-	if ((bpage=PFhashFind(fd,pagenum)) == NULL){
+	while ((bpage=PFhashFind(fd,pagenum)) != NULL && bpage->io)
+		/* another thread is reading or writing it */
+		if (!PFioWait())
+			break;
+
+	if (bpage == NULL){
 		/* page not in buffer. */
 		
 		/* allocate an empty page */
@@ -250,15 +289,11 @@ int error;
 			*fpage = NULL;
 			return(error);
 		}
-		
-		/* read the page */
-		if ((error=(*readfcn)(fd,pagenum,&bpage->fpage))!= PFE_OK){
-			/* error reading the page. put buffer back into 
-			the free list, and return gracefully */
+		if (PFhashFind(fd,pagenum) != NULL){
+			/* another thread got the page meanwhile */
 			PFbufUnlink(bpage);
 			PFbufInsertFree(bpage);
-			*fpage = NULL;
-			return(error);
+			return(PFbufGet(fd,pagenum,fpage,readfcn,writefcn));
 		}
 
 		/* insert new page into hash table */
@@ -267,6 +302,7 @@ int error;
 			/* put page into free list */
 			PFbufUnlink(bpage);
 			PFbufInsertFree(bpage);
+			*fpage = NULL;
 			return(error);
 		}
 
@@ -274,6 +310,26 @@ int error;
 		bpage->fd = fd;
 		bpage->page = pagenum;
 		bpage->dirty = FALSE;
+		bpage->io = FALSE;
+		
+		/* read the page, unless the victim cache still has it */
+		if (PFvcacheGet(fd,pagenum,&bpage->fpage))
+			PF_stats.tier2Hits++;
+		else {
+			bpage->fixed = bpage->io = TRUE;
+			error = (*readfcn)(fd,pagenum,&bpage->fpage);
+			bpage->fixed = bpage->io = FALSE;
+			PFioDone();
+			if (error != PFE_OK){
+				/* error reading the page. put buffer back
+				into the free list, and return gracefully */
+				PFhashDelete(fd,pagenum);
+				PFbufUnlink(bpage);
+				PFbufInsertFree(bpage);
+				*fpage = NULL;
+				return(error);
+			}
+		}
 	}
 	else if (bpage->fixed){
 		/* page already in memory, and is fixed, so we can't
@@ -309,8 +365,8 @@ RETURN VALUE:
 {
 PFbpage *bpage;
 
-	if ((bpage= PFhashFind(fd,pagenum))==NULL){
-		/* page not in buffer */
+	if ((bpage= PFhashFind(fd,pagenum))==NULL || bpage->io){
+		/* page not in buffer (or still being read) */
 		PFerrno = PFE_PAGENOTINBUF;
 		return(PFerrno);
 	}
@@ -369,6 +425,16 @@ int error;
 	if ((error=PFbufInternalAlloc(&bpage,writefcn))!= PFE_OK)
 		/* can't get any buffer */
 		return(error);
+	if (PFhashFind(fd,pagenum) != NULL){
+		/* another thread got the page while a victim was written */
+		PFbufUnlink(bpage);
+		PFbufInsertFree(bpage);
+		PFerrno = PFE_PAGEINBUF;
+		return(PFerrno);
+	}
+
+	/* a new page must not be shadowed by an old cached copy */
+	PFvcacheDelete(fd,pagenum);
 	
 	/* put ourselves into the hash table */
 	if ((error=PFhashInsert(fd,pagenum,bpage))!= PFE_OK){
@@ -384,6 +450,7 @@ int error;
 	bpage->page = pagenum;
 	bpage->fixed = TRUE;
 	bpage->dirty = FALSE;
+	bpage->io = FALSE;
 
 	*fpage = &bpage->fpage;
 	return(PFE_OK);
@@ -446,6 +513,52 @@ int error;		/* error code */
 		}
 		else	bpage = bpage->nextpage;
 	}
+
+	/* the file descriptor may be reused, so drop cached copies too */
+	PFvcacheReleaseFile(fd);
+	return(PFE_OK);
+}
+
+
+int PFbufDiscard(fd,firstpage)
+int fd;		/* file descriptor */
+int firstpage;	/* first page number to drop */
+/****************************************************************************
+SPECIFICATIONS:
+	Drop the pages of file "fd" numbered "firstpage" or more from
+	the buffer, without writing them out, and put their buffers
+	into the free list. Used when the end of a file is cut off.
+
+RETURN VALUE:
+	PFE_OK if no error.
+	PFE_PAGEFIXED if one of the pages is fixed (nothing is dropped).
+*****************************************************************************/
+{
+PFbpage *bpage;	/* ptr to buffer pages to search */
+PFbpage *temppage;
+
+	/* none may be fixed */
+	for (bpage = PFfirstbpage; bpage != NULL; bpage = bpage->nextpage)
+		if (bpage->fd == fd && bpage->page >= firstpage && bpage->fixed){
+			PFerrno = PFE_PAGEFIXED;
+			return(PFerrno);
+		}
+
+	bpage = PFfirstbpage;
+	while (bpage != NULL){
+		if (bpage->fd == fd && bpage->page >= firstpage){
+			if (PFhashDelete(fd,bpage->page)!= PFE_OK){
+				/* internal error */
+				printf("Internal error:PFbufDiscard()\n");
+				exit(1);
+			}
+			temppage = bpage;
+			bpage = bpage->nextpage;
+			PFbufUnlink(temppage);
+			PFbufInsertFree(temppage);
+		}
+		else	bpage = bpage->nextpage;
+	}
 	return(PFE_OK);
 }
 
@@ -507,14 +620,8 @@ PFbpage *bpage;
 	else {
 		printf("fd\tpage\tfixed\tdirty\tfpage\n");
 		for(bpage = PFfirstbpage; bpage != NULL; bpage= bpage->nextpage)
-<<<<<<< HEAD
 			printf("%d\t%d\t%d\t%d\t%p\n",
 				bpage->fd,bpage->page,(int)bpage->fixed,
 				(int)bpage->dirty,(void*)&bpage->fpage);
-=======
-			printf("%d\t%d\t%d\t%d\t%d\n",
-				bpage->fd,bpage->page,(int)bpage->fixed,
-				(int)bpage->dirty,(int)&bpage->fpage);
->>>>>>> upstream/main
 	}
 }
@@ -0,0 +1,157 @@
+/* churnbench.c
+ * Delete/insert churn on a heap file: file size and scan time.
+ *
+ * The table is bulk-loaded, then each cycle deletes a random fraction
+ * of the live records and inserts as many records again, taken from
+ * random lines of the table (so their lengths differ from the ones
+ * deleted). After every -e cycles it prints the file's pages, the
+ * live records, the time of a full scan and the PF reads of that
+ * scan. The scan must find exactly the live records.
+ *
+ * Usage: churnbench [-b poolSize] [-c cycles] [-f percent] [-e every]
+ *                   [-s seed] [table.txt]
+ *   -b  buffer pool size              (default 20)
+ *   -c  delete/insert cycles          (default 50)
+ *   -f  percent of the records deleted per cycle (default 10)
+ *   -e  print a line every this many cycles (default 5)
+ *   -s  random seed                   (default 1)
+ *   table defaults to ../../data/student.txt
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "hf.h"
+#include "pftypes.h"
+#include "benchutil.h"
+
+static const char *heapFile = "churnbench.hf";
+
+// full scan; returns the records found and adds up their lengths
+static long scan(int fd, long *bytes) {
+    HF_Scan sc;
+    RID rid;
+    char *rec;
+    int len;
+    long n = 0;
+
+    *bytes = 0;
+    HF_OpenFileScan(fd, &sc);
+    while (HF_GetNextRec(fd, &sc, &rid, &rec, &len) == HFE_OK) {
+        *bytes += len;
+        n++;
+    }
+    HF_CloseFileScan(&sc);
+    return n;
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = "../../data/student.txt";
+    int pool = 20, cycles = 50, percent = 10, every = 5;
+    unsigned seed = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "b:c:f:e:s:")) != -1) {
+        switch (opt) {
+        case 'b': pool = atoi(optarg); break;
+        case 'c': cycles = atoi(optarg); break;
+        case 'f': percent = atoi(optarg); break;
+        case 'e': every = atoi(optarg); break;
+        case 's': seed = (unsigned)atoi(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-b poolSize] [-c cycles] [-f percent] "
+                    "[-e every] [-s seed] [table.txt]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind < argc)
+        path = argv[optind];
+    if (pool <= 0 || pool > PF_MAX_BUFS_LIMIT) {
+        fprintf(stderr, "pool size out of range (1..%d)\n", PF_MAX_BUFS_LIMIT);
+        return 1;
+    }
+    if (percent <= 0 || percent > 100 || every <= 0) {
+        fprintf(stderr, "-f must be 1..100 and -e positive\n");
+        return 1;
+    }
+    if (read_table(path) <= 0) {
+        perror(path);
+        return 1;
+    }
+    srand(seed);
+
+    PF_Init();
+    PF_SetBufferSize(pool);
+    PF_SetReplacementPolicy(PF_REPL_LRU);
+
+    // 1. Load the table; rids[i] is where record i lives
+    RID *rids;
+    int *recLine = malloc(nlines * sizeof(int));   // line each record holds
+    int n, next = 0;
+    PF_DestroyFile((char *)heapFile);
+    if (HF_CreateFile((char *)heapFile) != HFE_OK) {
+        PF_PrintError("HF_CreateFile");
+        return 1;
+    }
+    int fd = HF_OpenFile((char *)heapFile);
+    if (fd < 0 || HF_BulkLoad(fd, next_line, &next, 100, &rids, &n) != HFE_OK) {
+        PF_PrintError("HF_BulkLoad");
+        return 1;
+    }
+    for (int i = 0; i < n; i++)
+        recLine[i] = i;
+
+    int perCycle = (int)((long)n * percent / 100);
+    int *victims = malloc(n * sizeof(int));
+    for (int i = 0; i < n; i++)
+        victims[i] = i;
+
+    printf("churnbench: %s, %d records, %d deleted + inserted per cycle, pool=%d\n",
+           path, n, perCycle, pool);
+    printf("%6s %8s %9s %10s %10s\n", "cycle", "pages", "records", "scan ms", "reads");
+
+    int status = 0;
+    for (int cycle = 0; cycle <= cycles; cycle++) {
+        // 2. Delete perCycle random records, then insert as many
+        if (cycle > 0) {
+            for (int i = 0; i < perCycle; i++) {
+                int j = i + rand() % (n - i);
+                int t = victims[i]; victims[i] = victims[j]; victims[j] = t;
+                if (HF_DeleteRec(fd, rids[victims[i]]) != HFE_OK) {
+                    PF_PrintError("HF_DeleteRec");
+                    return 1;
+                }
+            }
+            for (int i = 0; i < perCycle; i++) {
+                int r = victims[i];
+                recLine[r] = rand() % nlines;
+                if (HF_InsertRec(fd, lines[recLine[r]], lineLen[recLine[r]], &rids[r]) != HFE_OK) {
+                    PF_PrintError("HF_InsertRec");
+                    return 1;
+                }
+            }
+        }
+        if (cycle % every != 0)
+            continue;
+
+        // 3. Size of the file and one full scan of it
+        long expect = 0, bytes;
+        for (int i = 0; i < n; i++)
+            expect += lineLen[recLine[i]];
+        PF_ResetStats();
+        double t0 = now_ms();
+        long found = scan(fd, &bytes);
+        double ms = now_ms() - t0;
+        printf("%6d %8d %9ld %10.2f %10d", cycle, PF_NumPages(fd), found, ms,
+               PF_stats.physicalReads);
+        if (found != n || bytes != expect) {
+            printf("  WRONG (expected %d records, %ld bytes)", n, expect);
+            status = 1;
+        }
+        printf("\n");
+    }
+
+    HF_CloseFile(fd);
+    PF_DestroyFile((char *)heapFile);
+    return status;
+}
@@ -0,0 +1,309 @@
+/* clusterbench.c
+ * Clustered heap files: index range scans that read a few neighbouring
+ * pages instead of one page per record.
+ *
+ * 80% of the table, in random order, is inserted one record at a time
+ * (HF_InsertRec) into three files:
+ *   heap       - an unclustered file
+ *   full       - clustered on the key column, with clusterFill 100
+ *   clustered  - clustered on the key column, with clusterFill -f
+ * The clustered files are then reclustered (HF_Recluster), and the
+ * other 20% of the table is inserted, again in random order. Each file
+ * then answers -q index range scans over windows that hold 0.1% and 1%
+ * of the keys: the RIDs of the window are fetched with HF_GetRec in key
+ * order, the order a B+-tree on the key returns them in. For each
+ * window the bench prints the heap pages a query moves to (a page is
+ * counted again when the scan comes back to it), the PF physical reads
+ * per query and the time per query. The files are then vacuumed (a
+ * vacuum reclusters a clustered file with too many strays) and the
+ * queries are run again. Moved records are followed through the
+ * relocation callbacks, and every record fetched is checked.
+ *
+ * Usage: clusterbench [-b poolSize] [-c col] [-f fill] [-q queries]
+ *                     [-s seed] [table.txt]
+ *   -b  buffer pool size              (default 50)
+ *   -c  key column                    (default 0: roll number)
+ *   -f  clusterFill of "clustered"    (default HF_CLUSTER_FILL)
+ *   -q  queries per window            (default 200)
+ *   -s  random seed                   (default 1)
+ *   table defaults to ../../data/student.txt
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "hf.h"
+#include "pftypes.h"
+#include "benchutil.h"
+
+#define NWIN      2
+#define NFILES    3
+#define LOAD_PCT  80
+#define MAX_SLOTS (PF_PAGE_SIZE / (int)sizeof(HF_SlotEntry))
+
+static const char *heapFile = "clusterbench.hf";
+static const double winPct[NWIN] = { 0.1, 1 };
+
+// the "index": the records with a numeric key, in key order
+static double *keys;
+static int *byKey;
+static int nkeys;
+
+// RID of each record, and record at each (page, slot)
+static RID *rids;
+static int *owner;
+static int ownerPages;
+
+// records moved through a staged RID (HF_RID_STAGED), by its slotNum
+static int *staged;
+static int stagedCap;
+
+static int cmp_key(const void *a, const void *b) {
+    double x = keys[*(const int *)a], y = keys[*(const int *)b];
+    return x < y ? -1 : x > y;
+}
+
+// the key column's numbers, as a numeric HF_Pred reads them
+static int read_keys(int col) {
+    keys = malloc(nlines * sizeof(double));
+    byKey = malloc(nlines * sizeof(int));
+    for (int i = 0; i < nlines; i++) {
+        const char *p = lines[i];
+        for (int c = 0; c < col && p; c++) {
+            p = strchr(p, ';');
+            if (p)
+                p++;
+        }
+        char *end;
+        keys[i] = p ? strtod(p, &end) : 0;
+        if (!p || end == p || *p == ';')
+            continue;
+        byKey[nkeys++] = i;
+    }
+    qsort(byKey, nkeys, sizeof(int), cmp_key);
+    return nkeys;
+}
+
+// the owner slot of a RID, growing the table to reach it
+static int *owner_of(RID rid) {
+    if (rid.pageNum >= ownerPages) {
+        int n = ownerPages ? ownerPages : 1024;
+        while (n <= rid.pageNum)
+            n *= 2;
+        owner = realloc(owner, (size_t)n * MAX_SLOTS * sizeof(int));
+        for (size_t k = (size_t)ownerPages * MAX_SLOTS; k < (size_t)n * MAX_SLOTS; k++)
+            owner[k] = -1;
+        ownerPages = n;
+    }
+    return &owner[(size_t)rid.pageNum * MAX_SLOTS + rid.slotNum];
+}
+
+// the owner slot of a RID, staged or not
+static int *holder_of(RID rid) {
+    if (rid.pageNum != HF_RID_STAGED)
+        return owner_of(rid);
+    if (rid.slotNum >= stagedCap) {
+        int n = stagedCap ? stagedCap : 1024;
+        while (n <= rid.slotNum)
+            n *= 2;
+        staged = realloc(staged, n * sizeof(int));
+        stagedCap = n;
+    }
+    return &staged[rid.slotNum];
+}
+
+// HF_RelocFn: the record at oldRid now lives at newRid
+static void relocate(void *ctx, RID oldRid, RID newRid) {
+    (void)ctx;
+    int *o = holder_of(oldRid);
+    int r = *o;
+    *o = -1;
+    *holder_of(newRid) = r;
+    if (newRid.pageNum != HF_RID_STAGED)
+        rids[r] = newRid;
+}
+
+// runs the index range scans of one window; returns the records that
+// came back wrong
+static int queries(int fd, int width, const int *at, int q, double *pages, double *reads,
+                   double *ms) {
+    long moves = 0;
+    int wrong = 0;
+
+    PF_ResetStats();
+    double t0 = now_ms();
+    for (int k = 0; k < q; k++) {
+        int last = -1;
+        for (int j = at[k]; j < at[k] + width; j++) {
+            int i = byKey[j];
+            char *rec;
+            int len;
+            if (HF_GetRec(fd, rids[i], &rec, &len) != HFE_OK || len != lineLen[i] ||
+                memcmp(rec, lines[i], len) != 0)
+                wrong++;
+            if (rids[i].pageNum != last)
+                moves++;
+            last = rids[i].pageNum;
+        }
+    }
+    *ms = (now_ms() - t0) / q;
+    *pages = (double)moves / q;
+    *reads = (double)PF_stats.physicalReads / q;
+    return wrong;
+}
+
+// runs every window and prints a row per window
+static int report(const char *name, const char *when, int fd, int q, int *const at[]) {
+    HF_ClusterStats cs;
+    char strays[32] = "-";
+    int wrong = 0;
+
+    if (HF_GetClusterStats(fd, &cs) == HFE_OK)
+        snprintf(strays, sizeof(strays), "%d/%d", cs.strays, cs.placed);
+    for (int w = 0; w < NWIN; w++) {
+        int width = (int)(nkeys * winPct[w] / 100);
+        double pages, reads, ms;
+        char win[16];
+        wrong += queries(fd, width > 0 ? width : 1, at[w], q, &pages, &reads, &ms);
+        snprintf(win, sizeof(win), "%g%%", winPct[w]);
+        if (w == 0)
+            printf("%-10s %-9s %6d %11s", name, when, PF_NumPages(fd), strays);
+        else
+            printf("%-10s %-9s %6s %11s", "", "", "", "");
+        printf(" %7s %12.1f %12.1f %10.3f\n", win, pages, reads, ms);
+    }
+    if (wrong) {
+        printf("WRONG: %d records not found at their RID\n", wrong);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = "../../data/student.txt";
+    int pool = 50, col = 0, fill = HF_CLUSTER_FILL, q = 200;
+    unsigned seed = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "b:c:f:q:s:")) != -1) {
+        switch (opt) {
+        case 'b': pool = atoi(optarg); break;
+        case 'c': col = atoi(optarg); break;
+        case 'f': fill = atoi(optarg); break;
+        case 'q': q = atoi(optarg); break;
+        case 's': seed = (unsigned)atoi(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-b poolSize] [-c col] [-f fill] [-q queries] "
+                    "[-s seed] [table.txt]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind < argc)
+        path = argv[optind];
+    if (pool <= 0 || pool > PF_MAX_BUFS_LIMIT) {
+        fprintf(stderr, "pool size out of range (1..%d)\n", PF_MAX_BUFS_LIMIT);
+        return 1;
+    }
+    if (col < 0 || col >= HF_MAX_PROJ || fill < 1 || fill > 100 || q < 1) {
+        fprintf(stderr, "-c must be below %d, -f within 1..100, -q at least 1\n", HF_MAX_PROJ);
+        return 1;
+    }
+    if (read_table(path) <= 0) {
+        fprintf(stderr, "cannot read %s\n", path);
+        return 1;
+    }
+    if (read_keys(col) == 0) {
+        fprintf(stderr, "%s: column %d has no numbers\n", path, col);
+        return 1;
+    }
+    srand(seed);
+
+    PF_Init();
+    PF_SetBufferSize(pool);
+    PF_SetReplacementPolicy(PF_REPL_LRU);
+
+    // 1. The same insert order and query windows for every file
+    int *order = malloc(nlines * sizeof(int));
+    int *at[NWIN];
+    rids = malloc(nlines * sizeof(RID));
+    for (int i = 0; i < nlines; i++)
+        order[i] = i;
+    for (int i = nlines - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        int t = order[i];
+        order[i] = order[j];
+        order[j] = t;
+    }
+    for (int w = 0; w < NWIN; w++) {
+        int width = (int)(nkeys * winPct[w] / 100);
+        if (width < 1)
+            width = 1;
+        at[w] = malloc(q * sizeof(int));
+        for (int k = 0; k < q; k++)
+            at[w][k] = rand() % (nkeys - width + 1);
+    }
+
+    printf("clusterbench: %s, %d records, key column %d, %d%% inserted, reclustered, "
+           "%d%% inserted, %d queries per window, pool=%d\n",
+           path, nlines, col, LOAD_PCT, 100 - LOAD_PCT, q, pool);
+    printf("%-10s %-9s %6s %11s %7s %12s %12s %10s\n", "file", "after", "pages", "strays",
+           "window", "pages/query", "reads/query", "ms/query");
+
+    int status = 0;
+    for (int f = 0; f < NFILES; f++) {
+        static const char *names[NFILES] = { "heap", "full", "clustered" };
+        HF_FileOptions opts;
+        HF_VacuumStats vs;
+
+        // 2. Insert 80% of the records; a clustered file is then reclustered
+        memset(&opts, 0, sizeof(opts));
+        opts.layout = HF_LAYOUT_SLOTTED;
+        if (f > 0) {
+            opts.cluster = 1;
+            opts.clusterCol = col;
+            opts.clusterFill = f == 1 ? 100 : fill;
+        }
+        PF_DestroyFile((char *)heapFile);
+        if (HF_CreateFileEx((char *)heapFile, &opts) != HFE_OK) {
+            PF_PrintError("HF_CreateFileEx");
+            return 1;
+        }
+        int fd = HF_OpenFile((char *)heapFile);
+        if (fd < 0) {
+            PF_PrintError("HF_OpenFile");
+            return 1;
+        }
+        for (int k = 0; k < nlines; k++) {
+            if (k == nlines * LOAD_PCT / 100 && f > 0) {
+                memset(&vs, 0, sizeof(vs));
+                if (HF_Recluster(fd, relocate, NULL, &vs) != HFE_OK) {
+                    PF_PrintError("HF_Recluster");
+                    return 1;
+                }
+            }
+            int i = order[k];
+            int err = HF_InsertRec(fd, lines[i], lineLen[i], &rids[i]);
+            if (err != HFE_OK) {
+                printf("HF_InsertRec error %d on record %d\n", err, i);
+                return 1;
+            }
+            *owner_of(rids[i]) = i;
+        }
+        status |= report(names[f], "inserts", fd, q, at);
+
+        // 3. Vacuum, then the same queries again
+        memset(&vs, 0, sizeof(vs));
+        if (HF_Vacuum(fd, HF_VACUUM_SPARSE, relocate, NULL, &vs) != HFE_OK) {
+            PF_PrintError("HF_Vacuum");
+            return 1;
+        }
+        status |= report("", vs.reclusters ? "recluster" : "vacuum", fd, q, at);
+
+        HF_CloseFile(fd);
+        for (int p = 0; p < ownerPages * MAX_SLOTS; p++)
+            owner[p] = -1;
+    }
+
+    PF_DestroyFile((char *)heapFile);
+    return status;
+}
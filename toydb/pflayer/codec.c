@@ -0,0 +1,188 @@
+/* codec.c: a small LZ-style page codec used by the PF layer to keep
+page images compressed in memory (victim cache) and on disk. The
+interface routines are PFcodecCompress() and PFcodecDecompress().
+
+The encoding is byte oriented, in the spirit of LZF:
+	ctrl < 32	a run of (ctrl+1) literal bytes follows.
+	ctrl >= 32	a back reference. Bits 5..7 of ctrl hold (length-2),
+			where 7 means "add the next byte". The low 5 bits of
+			ctrl and the byte after that form (offset-1).
+Long runs of the same byte (e.g. "XXXXXXXXX" fillers) turn into
+overlapping back references, which is where most of the gain comes from. */
+#include <string.h>
+#include "pf.h"
+#include "pftypes.h"
+
+#define PF_CODEC_HLOG	12			/* log2 of hash table size */
+#define PF_CODEC_HSIZE	(1 << PF_CODEC_HLOG)
+#define PF_CODEC_MAXLIT	32			/* max literal run */
+#define PF_CODEC_MAXOFF	(1 << 13)		/* max back reference distance */
+#define PF_CODEC_MAXREF	((1 << 8) + (1 << 3))	/* max match length */
+
+/* hash of the three bytes starting at p */
+#define PFcodecHash(p) \
+	((((unsigned)(p)[0] << 16 | (unsigned)(p)[1] << 8 | (p)[2]) * 2654435761u) \
+		>> (32 - PF_CODEC_HLOG))
+
+
+int PFcodecCompress(in,inlen,out,outcap)
+char *in;	/* data to compress */
+int inlen;	/* # of bytes in "in" */
+char *out;	/* where to put the compressed data */
+int outcap;	/* size of "out" */
+/****************************************************************************
+SPECIFICATIONS:
+	Compress "inlen" bytes from "in" into "out". The output is only
+	useful if it is smaller than the input, so compression gives up
+	as soon as the output would not fit in "outcap" bytes.
+
+RETURN VALUE:
+	The # of bytes written to "out", or
+	0	if the data did not compress into "outcap" bytes.
+*****************************************************************************/
+{
+int htab[PF_CODEC_HSIZE];	/* last position+1 of each 3-byte hash */
+const unsigned char *ip = (const unsigned char *)in;
+unsigned char *op = (unsigned char *)out;
+int ipos;	/* current input position */
+int opos;	/* current output position */
+int lit;	/* # of literals in the current run */
+
+	if (inlen <= 0 || outcap < 2)
+		return(0);
+
+	memset(htab, 0, sizeof(htab));
+	ipos = 0;
+	opos = 1;	/* reserve the control byte of the first literal run */
+	lit = 0;
+
+	while (ipos < inlen - 2){
+		unsigned h = PFcodecHash(ip + ipos);
+		int ref = htab[h] - 1;
+		int off = ipos - ref - 1;
+
+		htab[h] = ipos + 1;
+		if (ref >= 0 && off < PF_CODEC_MAXOFF
+				&& ip[ref] == ip[ipos] && ip[ref+1] == ip[ipos+1]
+				&& ip[ref+2] == ip[ipos+2]){
+			/* found a match of at least 3 bytes; extend it */
+			int maxlen = inlen - ipos;
+			int len = 3;
+
+			if (maxlen > PF_CODEC_MAXREF)
+				maxlen = PF_CODEC_MAXREF;
+			while (len < maxlen && ip[ref+len] == ip[ipos+len])
+				len++;
+
+			/* close the pending literal run */
+			if (lit)
+				op[opos - lit - 1] = lit - 1;
+			else	opos--;
+
+			if (opos + 3 + 1 > outcap)
+				return(0);
+			len -= 2;
+			if (len < 7)
+				op[opos++] = (off >> 8) + (len << 5);
+			else {
+				op[opos++] = (off >> 8) + (7 << 5);
+				op[opos++] = len - 7;
+			}
+			op[opos++] = off & 0xff;
+
+			lit = 0;
+			opos++;		/* control byte of the next literal run */
+			ipos += len + 2;
+			continue;
+		}
+
+		/* no match, emit a literal */
+		if (opos + 1 > outcap)
+			return(0);
+		op[opos++] = ip[ipos++];
+		if (++lit == PF_CODEC_MAXLIT){
+			op[opos - lit - 1] = lit - 1;
+			lit = 0;
+			opos++;
+		}
+	}
+
+	/* the last (at most 2) bytes are always literals */
+	while (ipos < inlen){
+		if (opos + 1 > outcap)
+			return(0);
+		op[opos++] = ip[ipos++];
+		if (++lit == PF_CODEC_MAXLIT){
+			op[opos - lit - 1] = lit - 1;
+			lit = 0;
+			opos++;
+		}
+	}
+
+	if (lit)
+		op[opos - lit - 1] = lit - 1;
+	else	opos--;
+
+	if (opos >= outcap)
+		return(0);
+	return(opos);
+}
+
+
+int PFcodecDecompress(in,inlen,out,outcap)
+char *in;	/* compressed data */
+int inlen;	/* # of bytes in "in" */
+char *out;	/* where to put the data */
+int outcap;	/* size of "out" */
+/****************************************************************************
+SPECIFICATIONS:
+	Decompress "inlen" bytes produced by PFcodecCompress() from "in"
+	into "out". Never writes past "outcap" bytes of "out".
+
+RETURN VALUE:
+	The # of bytes written into "out", or
+	-1	if the compressed data is corrupt.
+*****************************************************************************/
+{
+const unsigned char *ip = (const unsigned char *)in;
+unsigned char *op = (unsigned char *)out;
+int ipos = 0;
+int opos = 0;
+
+	while (ipos < inlen){
+		unsigned ctrl = ip[ipos++];
+
+		if (ctrl < 32){
+			/* literal run */
+			int n = ctrl + 1;
+
+			if (opos + n > outcap || ipos + n > inlen)
+				return(-1);
+			memcpy(op + opos, ip + ipos, n);
+			opos += n;
+			ipos += n;
+		}
+		else {
+			/* back reference */
+			int len = ctrl >> 5;
+			int ref;
+
+			if (len == 7){
+				if (ipos >= inlen)
+					return(-1);
+				len += ip[ipos++];
+			}
+			if (ipos >= inlen)
+				return(-1);
+			ref = opos - (int)((ctrl & 0x1f) << 8) - 1 - ip[ipos++];
+			len += 2;
+			if (ref < 0 || opos + len > outcap)
+				return(-1);
+
+			/* copy byte by byte: source and target may overlap */
+			while (len--)
+				op[opos++] = op[ref++];
+		}
+	}
+	return(opos);
+}
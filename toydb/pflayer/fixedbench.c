@@ -0,0 +1,344 @@
+/* fixedbench.c
+ * Fixed-length record pages vs slotted pages.
+ *
+ * A table's rows are encoded as binary tuples (tuple.c), with a
+ * dictionary for string fields that have few values. If no string
+ * field is left with varying lengths, every tuple has the same
+ * length; shorter ones are padded with zeroes to the longest, which
+ * a tuple does not notice. The table is then inserted one record at
+ * a time (HF_InsertRec) into three files:
+ *   slotted text   - the text lines on slotted pages
+ *   slotted tuple  - the tuples on slotted pages
+ *   fixed tuple    - the padded tuples on HF_LAYOUT_FIXED pages
+ * The tuple files keep the dictionary (HF_SetDict) and are reopened
+ * after the inserts, and the tuples are decoded with the dictionary
+ * loaded back from the file.
+ * Each file is checked record by record with HF_GetRec, then timed
+ * for full scans that sum one field (for at least MIN_MS) and for -g
+ * HF_GetRec calls on random RIDs. All three must give the same sums.
+ *
+ * Usage: fixedbench [-b poolSize] [-c col] [-g gets] [-s seed] [table.txt]
+ *   -b  buffer pool size              (default 100)
+ *   -c  field the scans sum           (default 6: CGPA of gradsum)
+ *   -g  random point gets             (default 200000)
+ *   -s  random seed                   (default 1)
+ *   table defaults to ../../data/gradsum.txt
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "hf.h"
+#include "pftypes.h"
+#include "tuple.h"
+#include "benchutil.h"
+
+#define MIN_MS     200.0    // run each scan for at least this long
+#define DICT_RATIO 8        // dictionary: at most 1 value per 8 rows
+
+static const char *heapFile = "fixedbench.hf";
+
+static TT_Schema schema;
+static TT_Dict dict;
+
+// the rows that fit the schema: their text and their tuple
+static char **text;
+static int *textLen;
+static char **tuple;
+static int *tupleLen;
+static int nrows;
+static int fixedLen;    // longest tuple
+
+static int read_rows(const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return -1;
+    fseek(fp, 0, SEEK_END);
+    long len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char *data = malloc(len > 0 ? len : 1);
+    if (!data || (long)fread(data, 1, len, fp) != len) {
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+
+    // 1. Schema and dictionary from the whole table
+    int newlines = 0;
+    for (long i = 0; i < len; i++)
+        if (data[i] == '\n')
+            newlines++;
+    if (TT_InferSchema(&schema, data, len) != TT_OK ||
+        TT_DictBuild(&schema, &dict, data, len, newlines / DICT_RATIO) < 0)
+        return -1;
+
+    // 2. Encode each row; rows that do not fit (the header) are left out
+    text = malloc((newlines + 1) * sizeof(char *));
+    textLen = malloc((newlines + 1) * sizeof(int));
+    tuple = malloc((newlines + 1) * sizeof(char *));
+    tupleLen = malloc((newlines + 1) * sizeof(int));
+    for (long off = 0; off < len; ) {
+        char *nl = memchr(data + off, '\n', len - off);
+        int rowLen = (int)((nl ? nl - data : len) - off);
+        char *row = data + off;
+        off += rowLen + 1;
+        while (rowLen > 0 && row[rowLen - 1] == '\r')
+            rowLen--;
+        int cap = schema.bitmapSize + schema.fixedSize + 2 * schema.nvar + rowLen;
+        char *tup = malloc(cap);
+        int n = TT_EncodeText(&schema, row, rowLen, tup, cap);
+        if (n < 0) {
+            free(tup);
+            continue;
+        }
+        text[nrows] = row;
+        textLen[nrows] = rowLen;
+        tuple[nrows] = tup;
+        tupleLen[nrows] = n;
+        if (n > fixedLen)
+            fixedLen = n;
+        nrows++;
+    }
+
+    // 3. Pad the tuples to one length
+    for (int i = 0; i < nrows; i++) {
+        if (tupleLen[i] < fixedLen) {
+            tuple[i] = realloc(tuple[i], fixedLen);
+            memset(tuple[i] + tupleLen[i], 0, fixedLen - tupleLen[i]);
+        }
+    }
+    return nrows;
+}
+
+// value of field col of a text row, as the scans sum it
+static double text_value(const char *row, int len, int col) {
+    char buf[64];
+    int start = 0, skip = col;
+    for (int i = 0; i < len && skip > 0; i++)
+        if (row[i] == ';') {
+            start = i + 1;
+            skip--;
+        }
+    const char *end = memchr(row + start, ';', len - start);
+    int flen = end ? (int)(end - row - start) : len - start;
+    if (skip > 0 || flen == 0)
+        return 0;
+    if (schema.type[col] == TT_STRING || schema.type[col] == TT_CODE)
+        return flen;
+    if (flen >= (int)sizeof(buf))
+        return 0;
+    memcpy(buf, row + start, flen);
+    buf[flen] = '\0';
+    return strtod(buf, NULL);
+}
+
+static double tuple_value(const char *tup, int col) {
+    int iv, len;
+    double fv;
+    const char *sv;
+    switch (schema.type[col]) {
+    case TT_INT:
+        return TT_GetInt(&schema, tup, col, &iv) == TT_OK ? iv : 0;
+    case TT_FLOAT:
+        return TT_GetFloat(&schema, tup, col, &fv) == TT_OK ? fv : 0;
+    default:
+        return TT_GetString(&schema, tup, col, &sv, &len) == TT_OK ? len : 0;
+    }
+}
+
+static double value(int isText, const char *rec, int len, int col) {
+    return isText ? text_value(rec, len, col) : tuple_value(rec, col);
+}
+
+// one full scan, summing field col
+static double scan(int fd, int isText, int col, long *rows) {
+    HF_Scan sc;
+    RID rid;
+    char *rec;
+    int len;
+    double sum = 0;
+
+    *rows = 0;
+    HF_OpenFileScan(fd, &sc);
+    while (HF_GetNextRec(fd, &sc, &rid, &rec, &len) == HFE_OK) {
+        sum += value(isText, rec, len, col);
+        (*rows)++;
+    }
+    HF_CloseFileScan(&sc);
+    return sum;
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = "../../data/gradsum.txt";
+    int pool = 100, col = 6, gets = 200000;
+    unsigned seed = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "b:c:g:s:")) != -1) {
+        switch (opt) {
+        case 'b': pool = atoi(optarg); break;
+        case 'c': col = atoi(optarg); break;
+        case 'g': gets = atoi(optarg); break;
+        case 's': seed = (unsigned)atoi(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-b poolSize] [-c col] [-g gets] [-s seed] "
+                    "[table.txt]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind < argc)
+        path = argv[optind];
+    if (pool <= 0 || pool > PF_MAX_BUFS_LIMIT) {
+        fprintf(stderr, "pool size out of range (1..%d)\n", PF_MAX_BUFS_LIMIT);
+        return 1;
+    }
+    if (read_rows(path) <= 0) {
+        fprintf(stderr, "%s: no rows with a schema\n", path);
+        return 1;
+    }
+    if (col < 0 || col >= schema.nfields || gets < 1) {
+        fprintf(stderr, "-c must be a field (0..%d), -g at least 1\n", schema.nfields - 1);
+        return 1;
+    }
+    if (fixedLen > HF_FIXED_MAX_LEN) {
+        fprintf(stderr, "tuples of %d bytes do not fit a page\n", fixedLen);
+        return 1;
+    }
+    srand(seed);
+
+    PF_Init();
+    PF_SetBufferSize(pool);
+    PF_SetReplacementPolicy(PF_REPL_LRU);
+
+    char spec[TT_MAX_FIELDS * 4];
+    TT_SchemaSpec(&schema, spec, sizeof(spec));
+    printf("fixedbench: %s, %d rows, schema %s, %d-byte tuples (%d per page), pool=%d\n",
+           path, nrows, spec, fixedLen, HF_FixedPage_Capacity(fixedLen), pool);
+    printf("%-14s %9s %7s %10s %12s %10s\n", "format", "bytes/row", "pages",
+           "kins/s", "scan Mrow/s", "kget/s");
+
+    RID *rids = malloc(nrows * sizeof(RID));
+    int *order = malloc(gets * sizeof(int));
+    for (int k = 0; k < gets; k++)
+        order[k] = rand() % nrows;
+
+    double ref[2] = { 0, 0 };
+    int status = 0;
+    for (int format = 0; format < 3; format++) {
+        static const char *names[] = { "slotted text", "slotted tuple", "fixed tuple" };
+        HF_FileOptions opts = { .layout = HF_LAYOUT_SLOTTED, .sep = ';' };
+        int isText = format == 0;
+        char **recs = isText ? text : tuple;
+        struct stat sb;
+        int bad = 0;
+
+        if (format == 2) {
+            opts.layout = HF_LAYOUT_FIXED;
+            opts.recLen = fixedLen;
+        }
+
+        // 1. Insert the records one at a time
+        PF_DestroyFile((char *)heapFile);
+        if (HF_CreateFileEx((char *)heapFile, &opts) != HFE_OK) {
+            PF_PrintError("HF_CreateFileEx");
+            return 1;
+        }
+        int fd = HF_OpenFile((char *)heapFile);
+        if (fd < 0) {
+            PF_PrintError("HF_OpenFile");
+            return 1;
+        }
+        double t0 = now_ms();
+        for (int i = 0; i < nrows; i++) {
+            int len = isText ? textLen[i] : format == 1 ? tupleLen[i] : fixedLen;
+            int err = HF_InsertRec(fd, recs[i], len, &rids[i]);
+            if (err != HFE_OK) {
+                printf("HF_InsertRec error %d on row %d\n", err, i);
+                return 1;
+            }
+        }
+        double insMs = now_ms() - t0;
+
+        // 2. Keep the dictionary in the file, and decode the tuples with
+        //    the one read back from it
+        if (!isText) {
+            TT_Schema fileSchema;
+            TT_Dict fileDict;
+            const char *saved;
+            char *data;
+            int len;
+            if (TT_DictSave(&schema, &data, &len) != TT_OK ||
+                HF_SetDict(fd, data, len) != HFE_OK) {
+                PF_PrintError("HF_SetDict");
+                return 1;
+            }
+            free(data);
+            HF_CloseFile(fd);
+            if ((fd = HF_OpenFile((char *)heapFile)) < 0 ||
+                HF_GetDict(fd, &saved, &len) != HFE_OK ||
+                TT_DictLoad(&fileSchema, &fileDict, saved, len) != TT_OK) {
+                printf("cannot load the dictionary of %s\n", heapFile);
+                return 1;
+            }
+            TT_DictFree(&dict);
+            dict = fileDict;
+            schema = fileSchema;
+            schema.dict = &dict;
+        }
+
+        // 3. Every record at its RID
+        for (int i = 0; i < nrows; i++) {
+            int want = isText ? textLen[i] : format == 1 ? tupleLen[i] : fixedLen;
+            char *rec;
+            int len;
+            if (HF_GetRec(fd, rids[i], &rec, &len) != HFE_OK || len != want ||
+                memcmp(rec, recs[i], len) != 0)
+                bad++;
+        }
+
+        // 4. Full scans
+        double sum = 0, ms;
+        long rows = 0;
+        int reps;
+        for (reps = 0, t0 = now_ms(); (ms = now_ms() - t0) < MIN_MS; reps++)
+            sum = scan(fd, isText, col, &rows);
+        double scanRate = rows * (double)reps / ms / 1e3;
+        if (rows != nrows)
+            bad++;
+
+        // 5. Point gets at random RIDs
+        double getSum = 0;
+        t0 = now_ms();
+        for (int k = 0; k < gets; k++) {
+            char *rec;
+            int len;
+            if (HF_GetRec(fd, rids[order[k]], &rec, &len) == HFE_OK)
+                getSum += value(isText, rec, len, col);
+        }
+        double getMs = now_ms() - t0;
+        HF_CloseFile(fd);
+
+        int pages = stat(heapFile, &sb) == 0 ? (int)(sb.st_size / sizeof(PFfpage)) : 0;
+        printf("%-14s %9.1f %7d %10.1f %12.2f %10.1f", names[format],
+               (double)pages * PF_PAGE_SIZE / nrows, pages, nrows / insMs,
+               scanRate, gets / getMs);
+        if (format == 0) {
+            ref[0] = sum;
+            ref[1] = getSum;
+        } else if (fabs(sum - ref[0]) > 1e-6 * fabs(ref[0]) ||
+                   fabs(getSum - ref[1]) > 1e-6 * fabs(ref[1])) {
+            printf("  SUM MISMATCH");
+            status = 1;
+        }
+        if (bad) {
+            printf("  WRONG (%d records)", bad);
+            status = 1;
+        }
+        printf("\n");
+    }
+
+    PF_DestroyFile((char *)heapFile);
+    return status;
+}
@@ -173,7 +173,7 @@ SPECIFICATIONS:
 
 AUTHOR: clc
 
-RETURN VALUE: None
+RETURN VALUE: PFE_OK
 *****************************************************************************/
 {
 int i;
@@ -186,12 +186,9 @@ PFhash_entry *entry;
 		else{
 			for (entry = PFhashtbl[i]; entry != NULL;
 					entry = entry->nextentry)
-<<<<<<< HEAD
 				printf("\tfd: %d, page: %d %p\n",
-=======
-				printf("\tfd: %d, page: %d %d\n",
->>>>>>> upstream/main
 					entry->fd, entry->page,entry->bpage);
 		}
 	}
+	return(PFE_OK);
 }
@@ -1,6 +1,74 @@
 #include "hf.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h> // for memcpy
+#include <stddef.h> // for offsetof
+#include <math.h>   // for HUGE_VAL, NAN
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+/*
+ * Per-file state of the HF layer, indexed by PF file descriptor.
+ *
+ * The free-space map (FSM) keeps one byte per page: the room left on
+ * the page for one more record, in HF_FSM_UNIT units. It is read from
+ * the FSM pages at open, kept up to date in memory by every insert and
+ * delete, and written back at close. The zone map (HF_ZoneEntry) of
+ * a file with zone columns is kept the same way.
+ */
+typedef struct {
+    int inUse;
+    int legacy;             /* No header page: map is not persisted */
+    HF_FileHeader header;   /* Copy of page 0 */
+    int headerDirty;
+    unsigned char *fsm;     /* Free-space category of every page */
+    int fsmSize;            /* Pages described by fsm[] */
+    int fsmAlloc;           /* Entries allocated in fsm[] */
+    int dirtyLo, dirtyHi;   /* Range of fsm[] changed since open */
+    int fsmFrom[256];       /* No page below fsmFrom[c] has category c or more */
+    HF_ZoneEntry *zone;     /* opts.nzone entries for every page */
+    int zoneSize;           /* Pages described by zone[] */
+    int zoneAlloc;          /* Pages allocated in zone[] */
+    int zoneLo, zoneHi;     /* Range of pages whose entries changed */
+    int zoneMaxCol;         /* Highest zone column */
+    int clusterZone;        /* Clustered: the key column's zone entry */
+    int *keyPages;          /* Clustered: the pages with keys, by smallest key */
+    int nkeyPages;          /* Entries in use in keyPages[] */
+    double *keyMin;         /* Smallest key each page is listed under, or NAN */
+    int lastPage;           /* Page of the last insert, tried first */
+    HF_FileOptions opts;    /* Page layout, from the header */
+    char *rowBuf;           /* PAX: records are rebuilt here */
+    char *ovfBuf;           /* HF_GetRec puts long records together here */
+    int ovfCap;             /* Bytes allocated at ovfBuf */
+    int activeScans;        /* Open scans; vacuum waits for none */
+    int vacPhase;           /* HF_VAC_... */
+    int vacNext;            /* Next page of the vacuum pass */
+    long vacUsed;           /* Bytes used by the data pages compacted */
+    int vacKeep;            /* Pages the merge fills; later ones are emptied */
+    struct HF_VacuumThread *vac;   /* Background vacuum, or NULL */
+    char *appendBuf;        /* Append-only: HF_APPEND_PAGES pages not yet written */
+    int appendFirst;        /* Page number of the first of them */
+    int appendPages;        /* Pages in use; the last one is the tail */
+    RID *tomb;              /* Append-only: deletes not carried out, hashed */
+    int tombCap;            /* Entries allocated in tomb[] */
+    int ntomb;              /* Entries in use */
+    char *dict;             /* The file dictionary (HF_SetDict), or NULL */
+} HF_FileState;
+
+/* Where a file's vacuum pass is */
+#define HF_VAC_IDLE     0   /* Between passes */
+#define HF_VAC_COMPACT  1   /* Compacting pages, going up */
+#define HF_VAC_MERGE    2   /* Emptying sparse pages, going down */
+
+static HF_FileState *HFftab = NULL;
+static int HFftabSize = 0;
+
+/*
+ * Held by the HF calls that change a file or its state, so that a
+ * background vacuum (HF_StartVacuum) can run beside them.
+ */
+static pthread_mutex_t HFlatch = PTHREAD_MUTEX_INITIALIZER;
 
 /*
  * Helper function to get a pointer to the header of a page.
@@ -17,6 +85,50 @@ static HF_SlotEntry* HF_GetSlotArray(char *pageBuf) {
     return (HF_SlotEntry*)(pageBuf + sizeof(HF_PageHeader));
 }
 
+/*
+ * Bytes a slot takes up in the data heap.
+ */
+static int HF_SlotBytes(const HF_SlotEntry *slot) {
+    if (slot->length == -1) {
+        return 0;
+    }
+    if (slot->length == HF_SLOT_FORWARD || (slot->length & HF_SLOT_PADDED)) {
+        return sizeof(RID);
+    }
+    return slot->length & ~(HF_SLOT_MOVED | HF_SLOT_OVERFLOW);
+}
+
+/*
+ * Length of the bytes a live slot holds, without the padding of a
+ * short record.
+ */
+static int HF_SlotLen(const HF_SlotEntry *slot) {
+    return slot->length & ~(HF_SLOT_MOVED | HF_SLOT_OVERFLOW | HF_SLOT_PADDED);
+}
+
+/*
+ * Bytes the heap needs for len bytes of a slot, and the flag its
+ * length gets: a slot is never shorter than a forward.
+ */
+static int HF_PadBytes(int len, int *flag) {
+    *flag = len < (int)sizeof(RID) ? HF_SLOT_PADDED : 0;
+    return len < (int)sizeof(RID) ? (int)sizeof(RID) : len;
+}
+
+/*
+ * True if the slot holds the moved copy of a record.
+ */
+static int HF_SlotMoved(const HF_SlotEntry *slot) {
+    return slot->length >= 0 && (slot->length & HF_SLOT_MOVED) != 0;
+}
+
+/*
+ * HF_SLOT_OVERFLOW if the slot holds the head of a long record, else 0.
+ */
+static int HF_SlotOverflow(const HF_SlotEntry *slot) {
+    return slot->length >= 0 ? slot->length & HF_SLOT_OVERFLOW : 0;
+}
+
 /*
  * Initializes a new, empty slotted page.
  * This is called by the PF layer right after allocating a new page.
@@ -32,63 +144,157 @@ void HF_InitPage(char *pageBuf) {
     header->dataStartPtr = PF_PAGE_SIZE;
 }
 
+/*
+ * Free space of a slotted page, which records deleted since the page
+ * was last compacted leave in the data heap.
+ *
+ * Outputs:
+ * freeSlot: The lowest deleted slot, or -1 if there is none
+ *
+ * Returns the bytes between the slot array and the data heap plus the
+ * bytes of deleted records.
+ */
+static int HF_Page_Space(char *pageBuf, int *freeSlot) {
+    HF_PageHeader *header = HF_GetPageHeader(pageBuf);
+    HF_SlotEntry *slotArray = HF_GetSlotArray(pageBuf);
+    int live = 0;
+
+    *freeSlot = -1;
+    for (int i = 0; i < header->numSlots; i++) {
+        if (slotArray[i].length != -1) {
+            live += HF_SlotBytes(&slotArray[i]);
+        } else if (*freeSlot < 0) {
+            *freeSlot = i;
+        }
+    }
+    int slotArrayEnd = sizeof(HF_PageHeader) + (header->numSlots * sizeof(HF_SlotEntry));
+    return PF_PAGE_SIZE - slotArrayEnd - live;
+}
+
+/*
+ * Compacts a slotted page: the live records are moved to the end of
+ * the page, back to back, so all free space is in one piece. Slot
+ * numbers (and so RIDs) do not change.
+ */
+void HF_Page_Compact(char *pageBuf) {
+    HF_PageHeader *header = HF_GetPageHeader(pageBuf);
+    HF_SlotEntry *slotArray = HF_GetSlotArray(pageBuf);
+    char heap[PF_PAGE_SIZE];
+    int end = PF_PAGE_SIZE;
+
+    // 1. Copy the live records to the end of a scratch page
+    for (int i = 0; i < header->numSlots; i++) {
+        if (slotArray[i].length != -1) {
+            int bytes = HF_SlotBytes(&slotArray[i]);
+            end -= bytes;
+            memcpy(heap + end, pageBuf + slotArray[i].offset, bytes);
+            slotArray[i].offset = end;
+        }
+    }
+
+    // 2. Copy them back in one piece
+    memcpy(pageBuf + end, heap + end, PF_PAGE_SIZE - end);
+    header->dataStartPtr = end;
+}
+
 /*
  * Inserts a new record onto the page.
  * Returns the new slot number if successful.
  * Returns an error code if it fails.
+ *
+ * A deleted slot is reused before a new one is added to the slot
+ * array. If the record only fits in the space of deleted records,
+ * the page is compacted first.
  */
 int HF_Page_InsertRec(char *pageBuf, char *record, int recLen) {
     HF_PageHeader *header = HF_GetPageHeader(pageBuf);
     HF_SlotEntry *slotArray = HF_GetSlotArray(pageBuf);
+    int freeSlot, padded;
+    int bytes = HF_PadBytes(recLen, &padded);
+
+    // Header and free-space map pages never take records
+    if (header->numSlots < 0) {
+        return HFE_PAGENOFREE;
+    }
+    
+    // 1. Find a deleted slot, and all the space deleted records left
+    int totalFree = HF_Page_Space(pageBuf, &freeSlot);
     
-    // 1. Calculate the end of the slot array
+    // 2. Calculate the end of the slot array
     int slotArrayEnd = sizeof(HF_PageHeader) + (header->numSlots * sizeof(HF_SlotEntry));
     
-    // 2. Calculate the available free space
+    // 3. Calculate the available free space
     //    (Space between the data heap and the slot array)
     int freeSpace = header->dataStartPtr - slotArrayEnd;
     
-    // 3. Calculate space needed for this new record
-    //    (The record's data + one new slot entry)
-    int spaceNeeded = recLen + sizeof(HF_SlotEntry);
+    // 4. Calculate space needed for this new record
+    //    (The record's data, padded to sizeof(RID), plus one new slot
+    //    entry unless one is reused)
+    int spaceNeeded = bytes + (freeSlot < 0 ? (int)sizeof(HF_SlotEntry) : 0);
 
-    // 4. Check if there is enough space
+    // 5. Check if there is enough space, compacting the page if that
+    //    makes enough
     if (freeSpace < spaceNeeded) {
-        // Not enough free space on this page
-        return HFE_PAGENOFREE;
+        if (totalFree < spaceNeeded) {
+            // Not enough free space on this page
+            return HFE_PAGENOFREE;
+        }
+        HF_Page_Compact(pageBuf);
     }
     
     // --- We have enough space, so let's insert ---
 
-    // 5. Find the new record's destination
-    //    (Move the data pointer "back" by recLen)
-    header->dataStartPtr -= recLen;
+    // 6. Find the new record's destination
+    //    (Move the data pointer "back" by its bytes)
+    header->dataStartPtr -= bytes;
     
-    // 6. Copy the record data into the data heap
+    // 7. Copy the record data into the data heap
     memcpy(pageBuf + header->dataStartPtr, record, recLen);
+    memset(pageBuf + header->dataStartPtr + recLen, 0, bytes - recLen);
     
-    // 7. Get the new slot for this record
-    //    (It's the next available slot in the array)
-    HF_SlotEntry *newSlot = &slotArray[header->numSlots];
+    // 8. Get the slot for this record: the deleted one, or the next
+    //    one in the array
+    int newSlotNum = freeSlot >= 0 ? freeSlot : header->numSlots++;
+    HF_SlotEntry *newSlot = &slotArray[newSlotNum];
     
-    // 8. Update the new slot's info
+    // 9. Update the slot's info
     newSlot->offset = header->dataStartPtr;
-    newSlot->length = recLen;
-    
-    // 9. Update the header
-    int newSlotNum = header->numSlots;
-    header->numSlots++;
+    newSlot->length = recLen | padded;
     
     // Return the slot number where we inserted the record
     return newSlotNum;
 }
 
+/*
+ * Returns the length of the largest record that can still be
+ * inserted on the page, counting the space of deleted records (an
+ * insert compacts the page to use it). Pages that are not slotted
+ * pages have none.
+ */
+int HF_Page_FreeSpace(char *pageBuf) {
+    HF_PageHeader *header = HF_GetPageHeader(pageBuf);
+    int freeSlot;
+
+    if (header->numSlots < 0) {
+        return 0;
+    }
+    int freeSpace = HF_Page_Space(pageBuf, &freeSlot);
+    if (freeSlot < 0) {
+        freeSpace -= (int)sizeof(HF_SlotEntry);
+    }
+    // Even the shortest record takes up sizeof(RID) bytes
+    return freeSpace >= (int)sizeof(RID) ? freeSpace : 0;
+}
+
 /*
  * Deletes a record from the page, given its slot number.
  *
- * This is a "lazy" delete: it just marks the slot as free
- * by setting its length to -1. It does not reclaim the space
- * or compact the page.
+ * The slot is marked free by setting its length to -1, so a later
+ * insert can reuse it; the other records keep their slots. The
+ * record's bytes are reclaimed at once only if it is the first record
+ * of the data heap, and otherwise when an insert needs them (see
+ * HF_Page_Compact). Deleted slots at the end of the slot array are
+ * dropped.
  */
 int HF_Page_DeleteRec(char *pageBuf, int slotNum) {
     HF_PageHeader *header = HF_GetPageHeader(pageBuf);
@@ -106,9 +312,19 @@ int HF_Page_DeleteRec(char *pageBuf, int slotNum) {
         return HFE_INVALIDSLOT;
     }
 
-    // 3. "Delete" the record by invalidating its slot
+    // 3. A record at the start of the data heap gives its bytes back now
+    if (slot->offset == header->dataStartPtr) {
+        header->dataStartPtr += HF_SlotBytes(slot);
+    }
+
+    // 4. "Delete" the record by invalidating its slot
     slot->length = -1;
 
+    // 5. Trailing free slots are not needed to keep any RID stable
+    while (header->numSlots > 0 && slotArray[header->numSlots - 1].length == -1) {
+        header->numSlots--;
+    }
+
     return HFE_OK;
 }
 
@@ -125,6 +341,7 @@ int HF_Page_DeleteRec(char *pageBuf, int slotNum) {
  *
  * Returns:
  * HFE_OK if successful
+ * HFE_OVERFLOW if the record is long: *record is its HF_OverflowHead
  * HFE_INVALIDSLOT if the slot is invalid or deleted
  */
 int HF_Page_GetRec(char *pageBuf, int slotNum, char **record, int *recLen) {
@@ -138,16 +355,20 @@ int HF_Page_GetRec(char *pageBuf, int slotNum, char **record, int *recLen) {
 
     HF_SlotEntry *slot = &slotArray[slotNum];
 
-    // 2. Check if the slot is deleted
-    if (slot->length == -1) {
+    // 2. Check if the slot is deleted, or only forwards the record
+    if (slot->length == -1 || slot->length == HF_SLOT_FORWARD) {
         return HFE_INVALIDSLOT;
     }
 
-    // 3. Set the output pointers
+    // 3. Set the output pointers, past the home RID of a moved copy
     *record = pageBuf + slot->offset;
-    *recLen = slot->length;
+    *recLen = HF_SlotLen(slot);
+    if (HF_SlotMoved(slot)) {
+        *record += sizeof(RID);
+        *recLen -= (int)sizeof(RID);
+    }
 
-    return HFE_OK;
+    return HF_SlotOverflow(slot) ? HFE_OVERFLOW : HFE_OK;
 }
 
 
@@ -174,12 +395,11 @@ int HF_Page_GetNextRec(char *pageBuf, int currentSlotNum, char **record, int *re
     // 1. Start scanning from the *next* slot
     for (int i = currentSlotNum + 1; i < header->numSlots; i++) {
         
-        // 2. Check if this slot is valid (not deleted)
-        if (slotArray[i].length != -1) {
+        // 2. Check if this slot is valid (not deleted or forwarding)
+        if (slotArray[i].length != -1 && slotArray[i].length != HF_SLOT_FORWARD) {
             
             // 3. Found a valid record. Set output pointers.
-            *record = pageBuf + slotArray[i].offset;
-            *recLen = slotArray[i].length;
+            HF_Page_GetRec(pageBuf, i, record, recLen);
             
             // 4. Return the slot number we found it in
             return i;
@@ -191,293 +411,4719 @@ int HF_Page_GetNextRec(char *pageBuf, int currentSlotNum, char **record, int *re
 }
 
 /*
- * ======================================================
- * File-level HF Layer Function Implementations
- * ======================================================
+ * Writes new bytes for a live slot: prefix (if not NULL) followed by
+ * record, and sets the slot's length to length (padded, see
+ * HF_PadBytes). The slot's old bytes are overwritten if the new ones
+ * fit in them; otherwise they are freed and the new ones go to the
+ * data heap, compacting the page if need be.
+ *
+ * Returns HFE_OK, or HFE_PAGENOFREE (page unchanged).
  */
+static int HF_Page_Rewrite(char *pageBuf, int slotNum, const RID *prefix,
+                           const char *record, int recLen, int length) {
+    HF_PageHeader *header = HF_GetPageHeader(pageBuf);
+    HF_SlotEntry *slot = &HF_GetSlotArray(pageBuf)[slotNum];
+    int len = (prefix != NULL ? (int)sizeof(RID) : 0) + recLen;
+    int padded;
+    int need = HF_PadBytes(len, &padded);
+    char copy[PF_PAGE_SIZE];
+    int freeSlot;
 
-/*
- * Creates a new, empty heap file.
- * This is just a wrapper for the PF layer.
- */
-int HF_CreateFile(char *fileName) {
-    // Call the PF layer to create the file
-    if (PF_CreateFile(fileName) != PFE_OK) {
-        return PFerrno; // Return PF layer's error code
+    if (length != HF_SLOT_FORWARD) {
+        length |= padded;
+    }
+    if (prefix != NULL) {
+        memcpy(copy, prefix, sizeof(RID));
+    }
+    if (recLen > 0) {
+        memcpy(copy + len - recLen, record, recLen);    // record may be on the page
+    }
+    memset(copy + len, 0, need - len);
+
+    // 1. The new bytes fit where the old ones are
+    if (need <= HF_SlotBytes(slot)) {
+        memcpy(pageBuf + slot->offset, copy, need);
+        slot->length = length;
+        return HFE_OK;
     }
+
+    // 2. Otherwise the old bytes and the free space must hold them
+    if (HF_Page_Space(pageBuf, &freeSlot) + HF_SlotBytes(slot) < need) {
+        return HFE_PAGENOFREE;
+    }
+    slot->length = -1;
+    int slotArrayEnd = sizeof(HF_PageHeader) + header->numSlots * sizeof(HF_SlotEntry);
+    if (header->dataStartPtr - slotArrayEnd < need) {
+        HF_Page_Compact(pageBuf);
+    }
+    header->dataStartPtr -= need;
+    memcpy(pageBuf + header->dataStartPtr, copy, need);
+    slot->offset = header->dataStartPtr;
+    slot->length = length;
     return HFE_OK;
 }
 
 /*
- * Opens an existing heap file.
- * This is just a wrapper for the PF layer.
- * Returns a file descriptor (fd) from the PF layer.
+ * HF_Page_UpdateRec for the bytes of a slot: flags is
+ * HF_SLOT_OVERFLOW if record is the HF_OverflowHead of a long record.
  */
-int HF_OpenFile(char *fileName) {
-    // Call the PF layer to open the file
-    int fd = PF_OpenFile(fileName);
-    if (fd < 0) {
-        return PFerrno; // Return PF layer's error code
+static int HF_Page_UpdateSlot(char *pageBuf, int slotNum, char *record, int recLen,
+                              int flags) {
+    HF_PageHeader *header = HF_GetPageHeader(pageBuf);
+    HF_SlotEntry *slot;
+
+    if (slotNum < 0 || slotNum >= header->numSlots ||
+        (slot = &HF_GetSlotArray(pageBuf)[slotNum])->length == -1) {
+        return HFE_INVALIDSLOT;
     }
-    return fd; // Return the file descriptor
+    if (HF_SlotMoved(slot)) {
+        RID home;
+        memcpy(&home, pageBuf + slot->offset, sizeof(RID));
+        return HF_Page_Rewrite(pageBuf, slotNum, &home, record, recLen,
+                               ((int)sizeof(RID) + recLen) | HF_SLOT_MOVED | flags);
+    }
+    return HF_Page_Rewrite(pageBuf, slotNum, NULL, record, recLen, recLen | flags);
 }
 
 /*
- * Closes a heap file.
- * This is just a wrapper for the PF layer.
+ * Replaces the record in a slot, keeping the slot number. A forwarding
+ * slot gets the record back; a moved copy keeps its home RID.
  */
-int HF_CloseFile(int fd) {
-    // Call the PF layer to close the file
-    if (PF_CloseFile(fd) != PFE_OK) {
-        return PFerrno; // Return PF layer's error code
-    }
-    return HFE_OK;
+int HF_Page_UpdateRec(char *pageBuf, int slotNum, char *record, int recLen) {
+    return HF_Page_UpdateSlot(pageBuf, slotNum, record, recLen, 0);
 }
 
 /*
- * Inserts a record into the file.
- *
- * This function scans the file page by page to find one
- * with enough free space. If no page has space, it
- * allocates a new page and inserts the record there.
+ * Inserts the moved copy of a record: its home RID, then the record.
  */
-int HF_InsertRec(int fd, char *record, int recLen, RID *rid) {
-    int pagenum = -1; // Start scan from the beginning
-    char *pageBuf;
-    int error;
-    int slotNum;
+int HF_Page_InsertMoved(char *pageBuf, RID home, char *record, int recLen) {
+    char copy[PF_PAGE_SIZE];
 
-    // 1. Scan the file for a page with free space
-    while ((error = PF_GetNextPage(fd, &pagenum, &pageBuf)) == PFE_OK) {
-        
-        // Try to insert the record on this page
-        // (We call our old page-level insert function)
-        slotNum = HF_Page_InsertRec(pageBuf, record, recLen);
-        
-        if (slotNum == HFE_PAGENOFREE) {
-            // This page is full, unfix it and try the next one
-            if ((error = PF_UnfixPage(fd, pagenum, FALSE)) != PFE_OK) {
-                return error; // Propagate PF error
-            }
-            continue; // Go to the next page
-        }
-        
-        // --- Success! We found space and inserted the record ---
-        
-        // Set the output RID
-        rid->pageNum = pagenum;
-        rid->slotNum = slotNum;
-        
-        // Mark the page as dirty (it was modified) and unfix it
-        if ((error = PF_UnfixPage(fd, pagenum, TRUE)) != PFE_OK) {
-            return error;
-        }
-        
-        // Return success
-        return HFE_OK;
-    }
-    
-    // 2. We reached here, so PF_GetNextPage failed.
-    // Check if it was because we reached the End Of File (EOF).
-    if (error != PFE_EOF) {
-        return error; // It was a real error
-    }
-    
-    // 3. --- No page had free space, so we must allocate a new one ---
-    
-    // Allocate a new page
-    if ((error = PF_AllocPage(fd, &pagenum, &pageBuf)) != PFE_OK) {
-        return error; // Propagate PF error
+    if (recLen > PF_PAGE_SIZE - (int)sizeof(RID)) {
+        return HFE_PAGENOFREE;
     }
-    
-    // Initialize the new page
-    HF_InitPage(pageBuf);
-    
-    // Insert the record (this *must* succeed on a new page)
-    slotNum = HF_Page_InsertRec(pageBuf, record, recLen);
-    
-    // Set the output RID
-    rid->pageNum = pagenum;
-    rid->slotNum = slotNum;
-    
-    // Mark the new page as dirty and unfix it
-    if ((error = PF_UnfixPage(fd, pagenum, TRUE)) != PFE_OK) {
-        return error;
+    memcpy(copy, &home, sizeof(RID));
+    memcpy(copy + sizeof(RID), record, recLen);
+    int slotNum = HF_Page_InsertRec(pageBuf, copy, (int)sizeof(RID) + recLen);
+    if (slotNum >= 0) {
+        HF_GetSlotArray(pageBuf)[slotNum].length |= HF_SLOT_MOVED;
     }
+    return slotNum;
+}
+
+/*
+ * Gets the HF_OverflowHead of a long record (or of its moved copy).
+ */
+int HF_Page_GetOverflow(char *pageBuf, int slotNum, HF_OverflowHead *head) {
+    char *record;
+    int recLen;
 
+    if (HF_Page_GetRec(pageBuf, slotNum, &record, &recLen) != HFE_OVERFLOW) {
+        return HFE_INVALIDSLOT;
+    }
+    memcpy(head, record, sizeof(HF_OverflowHead));
     return HFE_OK;
 }
 
 /*
- * Deletes a record from the file, given its RID.
+ * Makes a slot that holds a record (not a moved copy) forward to RID
+ * to, or re-points a forwarding slot.
  */
-int HF_DeleteRec(int fd, RID rid) {
-    char *pageBuf;
-    int error;
-    
-    // 1. Get the specific page the record is on
-    if ((error = PF_GetThisPage(fd, rid.pageNum, &pageBuf)) != PFE_OK) {
-        return error;
-    }
-    
-    // 2. Call our page-level delete function
-    error = HF_Page_DeleteRec(pageBuf, rid.slotNum);
-    
-    // 3. Mark the page as dirty and unfix it
-    if (PF_UnfixPage(fd, rid.pageNum, TRUE) != PFE_OK) {
-        return PFE_UNIX; // Return a generic error if unfix fails
+int HF_Page_SetForward(char *pageBuf, int slotNum, RID to) {
+    HF_PageHeader *header = HF_GetPageHeader(pageBuf);
+    HF_SlotEntry *slot;
+
+    if (slotNum < 0 || slotNum >= header->numSlots ||
+        (slot = &HF_GetSlotArray(pageBuf)[slotNum])->length == -1 || HF_SlotMoved(slot)) {
+        return HFE_INVALIDSLOT;
     }
-    
-    return error; // Return result of HF_DeleteRec
+    return HF_Page_Rewrite(pageBuf, slotNum, &to, NULL, 0, HF_SLOT_FORWARD);
 }
 
 /*
- * Retrieves a record from the file, given its RID.
- *
- * Outputs:
- * record: Pointer to the record data *within the buffer page*
- * recLen: Length of the record
- *
- * WARNING: The 'record' pointer is only valid until the page
- * is unfixed. The caller must copy the data if needed.
+ * Gets the RID a forwarding slot points at.
  */
-int HF_GetRec(int fd, RID rid, char **record, int *recLen) {
-    char *pageBuf;
-    int error;
+int HF_Page_GetForward(char *pageBuf, int slotNum, RID *to) {
+    HF_PageHeader *header = HF_GetPageHeader(pageBuf);
+    HF_SlotEntry *slot;
 
-    // 1. Get the specific page the record is on
-    if ((error = PF_GetThisPage(fd, rid.pageNum, &pageBuf)) != PFE_OK) {
-        return error;
+    if (slotNum < 0 || slotNum >= header->numSlots ||
+        (slot = &HF_GetSlotArray(pageBuf)[slotNum])->length != HF_SLOT_FORWARD) {
+        return HFE_INVALIDSLOT;
     }
+    memcpy(to, pageBuf + slot->offset, sizeof(RID));
+    return HFE_OK;
+}
 
-    // 2. Call our page-level get function
-    error = HF_Page_GetRec(pageBuf, rid.slotNum, record, recLen);
+/*
+ * Gets the home RID of a moved copy.
+ */
+int HF_Page_GetHome(char *pageBuf, int slotNum, RID *home) {
+    HF_PageHeader *header = HF_GetPageHeader(pageBuf);
+    HF_SlotEntry *slot;
 
-    // 3. Unfix the page (it wasn't modified)
-    if (PF_UnfixPage(fd, rid.pageNum, FALSE) != PFE_OK) {
-        return PFE_UNIX;
+    if (slotNum < 0 || slotNum >= header->numSlots ||
+        !HF_SlotMoved(slot = &HF_GetSlotArray(pageBuf)[slotNum])) {
+        return HFE_INVALIDSLOT;
     }
-
-    return error; // Return result of HF_Page_GetRec
+    memcpy(home, pageBuf + slot->offset, sizeof(RID));
+    return HFE_OK;
 }
 
 /*
  * ======================================================
- * File Scan Function Implementations
+ * PAX Pages
  * ======================================================
  */
 
 /*
- * Opens a new file scan.
- *
- * Initializes the scan struct to start from the beginning
- * of the file.
+ * Minipage offsets and end offsets are 2-byte values at any byte
+ * position, so they are read and written with memcpy.
  */
-int HF_OpenFileScan(int fd, HF_Scan *scan) {
-    // Store the file descriptor
-    scan->fd = fd;
-    
-    // Start the scan *before* the first page
-    scan->currentPageNum = -1; 
-    
-    // No record has been found yet
-    scan->currentSlotNum = -1;
-    
-    // No page is pinned in the buffer yet
-    scan->currentPageBuf = NULL;
-    
-    return HFE_OK;
+static int HF_Get16(const char *p) {
+    unsigned short v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static void HF_Put16(char *p, int v) {
+    unsigned short s = (unsigned short)v;
+    memcpy(p, &s, sizeof(s));
+}
+
+static int HF_PaxHeaderSize(int ncols) {
+    return (int)offsetof(HF_PaxPage, mini) + (ncols + 2) * (int)sizeof(unsigned short);
 }
 
 /*
- * Closes a file scan.
- *
- * This function must be called to unfix the last page
- * that the scanner was looking at.
+ * Initializes a new, empty PAX page: every minipage is empty and
+ * starts right after the header.
  */
-int HF_CloseFileScan(HF_Scan *scan) {
-    int error;
-    
-    // Check if a page is still pinned in the buffer
-    if (scan->currentPageBuf != NULL) {
-        // Unfix it (it wasn't modified)
-        error = PF_UnfixPage(scan->fd, scan->currentPageNum, FALSE);
-        if (error != PFE_OK) {
-            return error;
-        }
+void HF_PaxPage_Init(char *pageBuf, int ncols) {
+    HF_PaxPage *pp = (HF_PaxPage *)pageBuf;
+
+    pp->numSlots = 0;
+    pp->ncols = ncols;
+    for (int k = 0; k < ncols + 2; k++) {
+        pp->mini[k] = (unsigned short)HF_PaxHeaderSize(ncols);
     }
-    
-    // Reset the scan struct
-    scan->fd = -1;
-    scan->currentPageBuf = NULL;
-    
-    return HFE_OK;
 }
 
 /*
- * Retrieves the next valid record in the file scan.
+ * Returns the length of the largest record that can still be
+ * inserted on the page. This assumes no separators in the record, so
+ * a record of this length always fits.
  */
-/*
+int HF_PaxPage_FreeSpace(char *pageBuf) {
+    HF_PaxPage *pp = (HF_PaxPage *)pageBuf;
+
+    if (pp->numSlots < 0) {
+        return 0;
+    }
+    // One status byte and one end offset per column for the new row
+    int freeSpace = PF_PAGE_SIZE - pp->mini[pp->ncols + 1] - 1 - 2 * pp->ncols;
+    return freeSpace > 0 ? freeSpace : 0;
+}
+
+/*
+ * Inserts a record onto a PAX page.
+ * Returns the new slot number, or HFE_PAGENOFREE.
+ */
+int HF_PaxPage_InsertRec(char *pageBuf, char sep, char *record, int recLen) {
+    HF_PaxPage *pp = (HF_PaxPage *)pageBuf;
+    int ncols = pp->ncols;
+    int n = pp->numSlots;
+    int start[HF_PAX_MAX_COLS];
+    int len[HF_PAX_MAX_COLS];
+    int nfields = 1;
+    int grow = 1;       // Bytes the row adds: status byte ...
+
+    if (n < 0) {
+        return HFE_PAGENOFREE;
+    }
+
+    // 1. Split the record into its columns
+    start[0] = 0;
+    for (int i = 0; i < recLen && nfields < ncols; i++) {
+        if (record[i] == sep) {
+            len[nfields - 1] = i - start[nfields - 1];
+            start[nfields++] = i + 1;
+        }
+    }
+    len[nfields - 1] = recLen - start[nfields - 1];
+    for (int c = nfields; c < ncols; c++) {
+        start[c] = recLen;
+        len[c] = 0;
+    }
+    for (int c = 0; c < ncols; c++) {
+        grow += 2 + len[c];     // ... plus an end offset and the bytes
+    }
+    if (pp->mini[ncols + 1] + grow > PF_PAGE_SIZE) {
+        return HFE_PAGENOFREE;
+    }
+
+    // 2. Move the column minipages up, the last one first. Minipage
+    //    c + 1 moves by what the minipages before it grow.
+    int shift = grow - (2 + len[ncols - 1]);
+    for (int c = ncols - 1; c >= 0; c--) {
+        int from = pp->mini[c + 1];
+        int dataLen = pp->mini[c + 2] - from - 2 * n;
+        char *to = pageBuf + from + shift;
+
+        memmove(to + 2 * (n + 1), pageBuf + from + 2 * n, dataLen);
+        memmove(to, pageBuf + from, 2 * n);
+        HF_Put16(to + 2 * n, dataLen + len[c]);
+        memcpy(to + 2 * (n + 1) + dataLen, record + start[c], len[c]);
+        if (c > 0) {
+            shift -= 2 + len[c - 1];
+        }
+    }
+    shift = 1;
+    for (int c = 0; c <= ncols; c++) {
+        pp->mini[c + 1] += shift;
+        if (c < ncols) {
+            shift += 2 + len[c];
+        }
+    }
+
+    // 3. The status minipage stays put and gains the row's byte
+    pageBuf[pp->mini[0] + n] = (char)nfields;
+    pp->numSlots++;
+    return n;
+}
+
+/*
+ * Deletes a row of a PAX page. This only marks it deleted: unlike a
+ * slotted page, a PAX page does not reuse the row or its bytes, since
+ * that would mean shifting every minipage.
+ */
+int HF_PaxPage_DeleteRec(char *pageBuf, int slotNum) {
+    HF_PaxPage *pp = (HF_PaxPage *)pageBuf;
+
+    if (slotNum < 0 || slotNum >= pp->numSlots || pageBuf[pp->mini[0] + slotNum] == 0) {
+        return HFE_INVALIDSLOT;
+    }
+    pageBuf[pp->mini[0] + slotNum] = 0;
+    return HFE_OK;
+}
+
+/*
+ * Points *field at column col of row slotNum.
+ */
+int HF_PaxPage_GetField(char *pageBuf, int slotNum, int col, char **field, int *len) {
+    HF_PaxPage *pp = (HF_PaxPage *)pageBuf;
+
+    if (slotNum < 0 || slotNum >= pp->numSlots ||
+        col < 0 || col >= (unsigned char)pageBuf[pp->mini[0] + slotNum]) {
+        return HFE_INVALIDSLOT;
+    }
+    char *ends = pageBuf + pp->mini[col + 1];
+    int begin = slotNum > 0 ? HF_Get16(ends + 2 * (slotNum - 1)) : 0;
+    *field = ends + 2 * pp->numSlots + begin;
+    *len = HF_Get16(ends + 2 * slotNum) - begin;
+    return HFE_OK;
+}
+
+/*
+ * Rebuilds row slotNum in out, with sep between the columns.
+ */
+int HF_PaxPage_GetRec(char *pageBuf, char sep, int slotNum, char *out, int *recLen) {
+    HF_PaxPage *pp = (HF_PaxPage *)pageBuf;
+    int n = 0;
+
+    if (slotNum < 0 || slotNum >= pp->numSlots) {
+        return HFE_INVALIDSLOT;
+    }
+    int nfields = (unsigned char)pageBuf[pp->mini[0] + slotNum];
+    if (nfields == 0) {
+        return HFE_INVALIDSLOT;
+    }
+    for (int c = 0; c < nfields; c++) {
+        char *field;
+        int len;
+        int err = HF_PaxPage_GetField(pageBuf, slotNum, c, &field, &len);
+        if (err != HFE_OK) {
+            return err;
+        }
+        if (c > 0) {
+            out[n++] = sep;
+        }
+        memcpy(out + n, field, len);
+        n += len;
+    }
+    *recLen = n;
+    return HFE_OK;
+}
+
+/*
+ * Returns the next live row after currentSlotNum, or HFE_EOF.
+ */
+int HF_PaxPage_NextSlot(char *pageBuf, int currentSlotNum) {
+    HF_PaxPage *pp = (HF_PaxPage *)pageBuf;
+    const char *status = pageBuf + pp->mini[0];
+
+    for (int i = currentSlotNum + 1; i < pp->numSlots; i++) {
+        if (status[i] != 0) {
+            return i;
+        }
+    }
+    return HFE_EOF;
+}
+
+/*
+ * ======================================================
+ * Fixed-Length Pages
+ * ======================================================
+ */
+
+/*
+ * Records a page of recLen-byte records holds: each takes recLen bytes
+ * and one bit of the bitmap.
+ */
+int HF_FixedPage_Capacity(int recLen) {
+    int room = PF_PAGE_SIZE - (int)offsetof(HF_FixedPage, used);
+    int n = room * 8 / (recLen * 8 + 1);
+
+    while (n > 0 && (n + 7) / 8 + n * recLen > room) {
+        n--;
+    }
+    return n;
+}
+
+/*
+ * Offset of record 0: right after the bitmap.
+ */
+int HF_FixedPage_DataStart(int recLen) {
+    return (int)offsetof(HF_FixedPage, used) + (HF_FixedPage_Capacity(recLen) + 7) / 8;
+}
+
+/*
+ * Initializes a new, empty fixed-length page.
+ */
+void HF_FixedPage_Init(char *pageBuf, int recLen) {
+    HF_FixedPage *fp = (HF_FixedPage *)pageBuf;
+
+    fp->numSlots = 0;
+    fp->recLen = recLen;
+    fp->live = 0;
+    memset(fp->used, 0, (HF_FixedPage_Capacity(recLen) + 7) / 8);
+}
+
+/*
+ * Returns the bytes of the free slots, rounded up to whole
+ * HF_FSM_UNITs (see hf.h).
+ */
+int HF_FixedPage_FreeSpace(char *pageBuf) {
+    HF_FixedPage *fp = (HF_FixedPage *)pageBuf;
+
+    if (fp->numSlots < 0) {
+        return 0;
+    }
+    int bytes = (HF_FixedPage_Capacity(fp->recLen) - fp->live) * fp->recLen;
+    return (bytes + HF_FSM_UNIT - 1) / HF_FSM_UNIT * HF_FSM_UNIT;
+}
+
+/*
+ * Inserts a record into the lowest free slot.
+ * Returns the slot number, HFE_PAGENOFREE if the page is full, or
+ * HFE_BADOPTIONS if the record is not recLen bytes long.
+ */
+int HF_FixedPage_InsertRec(char *pageBuf, char *record, int recLen) {
+    HF_FixedPage *fp = (HF_FixedPage *)pageBuf;
+    int cap;
+    int slot;
+
+    if (fp->numSlots < 0) {
+        return HFE_PAGENOFREE;
+    }
+    if (recLen != fp->recLen) {
+        return HFE_BADOPTIONS;
+    }
+    if (fp->live == (cap = HF_FixedPage_Capacity(recLen))) {
+        return HFE_PAGENOFREE;
+    }
+
+    // 1. A hole below numSlots if there is one, else the next slot;
+    //    whole bytes of the bitmap are passed over at a time
+    if (fp->live < fp->numSlots) {
+        int k = 0;
+        while (fp->used[k] == 0xff) {
+            k++;
+        }
+        slot = 8 * k;
+        while (fp->used[k] & (1 << (slot & 7))) {
+            slot++;
+        }
+    } else {
+        slot = fp->numSlots;
+    }
+
+    // 2. The record goes where its slot number says
+    memcpy(pageBuf + HF_FixedPage_DataStart(recLen) + slot * recLen, record, recLen);
+    fp->used[slot >> 3] |= (unsigned char)(1 << (slot & 7));
+    fp->live++;
+    if (slot >= fp->numSlots) {
+        fp->numSlots = slot + 1;
+    }
+    return slot;
+}
+
+static int HF_FixedPage_Used(const HF_FixedPage *fp, int slotNum) {
+    return slotNum >= 0 && slotNum < fp->numSlots &&
+           (fp->used[slotNum >> 3] & (1 << (slotNum & 7)));
+}
+
+/*
+ * Deletes a record by clearing its bit. Free slots at the end are
+ * dropped from numSlots, so an empty page has none.
+ */
+int HF_FixedPage_DeleteRec(char *pageBuf, int slotNum) {
+    HF_FixedPage *fp = (HF_FixedPage *)pageBuf;
+
+    if (!HF_FixedPage_Used(fp, slotNum)) {
+        return HFE_INVALIDSLOT;
+    }
+    fp->used[slotNum >> 3] &= (unsigned char)~(1 << (slotNum & 7));
+    fp->live--;
+    while (fp->numSlots > 0 && !HF_FixedPage_Used(fp, fp->numSlots - 1)) {
+        fp->numSlots--;
+    }
+    return HFE_OK;
+}
+
+/*
+ * Points *record at a record in the page.
+ */
+int HF_FixedPage_GetRec(char *pageBuf, int slotNum, char **record, int *recLen) {
+    HF_FixedPage *fp = (HF_FixedPage *)pageBuf;
+
+    if (!HF_FixedPage_Used(fp, slotNum)) {
+        return HFE_INVALIDSLOT;
+    }
+    *record = pageBuf + HF_FixedPage_DataStart(fp->recLen) + slotNum * fp->recLen;
+    *recLen = fp->recLen;
+    return HFE_OK;
+}
+
+/*
+ * Overwrites a record; it always fits where it is.
+ */
+int HF_FixedPage_UpdateRec(char *pageBuf, int slotNum, char *record, int recLen) {
+    HF_FixedPage *fp = (HF_FixedPage *)pageBuf;
+
+    if (!HF_FixedPage_Used(fp, slotNum)) {
+        return HFE_INVALIDSLOT;
+    }
+    if (recLen != fp->recLen) {
+        return HFE_BADOPTIONS;
+    }
+    memcpy(pageBuf + HF_FixedPage_DataStart(recLen) + slotNum * recLen, record, recLen);
+    return HFE_OK;
+}
+
+/*
+ * Returns the next used slot after currentSlotNum, or HFE_EOF.
+ */
+int HF_FixedPage_NextSlot(char *pageBuf, int currentSlotNum) {
+    HF_FixedPage *fp = (HF_FixedPage *)pageBuf;
+    int i = currentSlotNum + 1;
+
+    while (i < fp->numSlots) {
+        if ((i & 7) == 0 && fp->used[i >> 3] == 0) {
+            i += 8;     // An empty byte of the bitmap
+        } else if (fp->used[i >> 3] & (1 << (i & 7))) {
+            return i;
+        } else {
+            i++;
+        }
+    }
+    return HFE_EOF;
+}
+
+/*
+ * ======================================================
+ * Predicates
+ * ======================================================
+ */
+
+/*
+ * Reads a column value as a number, the way numeric predicates (and
+ * zone maps) see it. Returns FALSE if it is not one.
+ */
+static int HF_FieldNum(const char *field, int len, double *v) {
+    char buf[64];
+    char *end;
+
+    if (len >= (int)sizeof(buf)) {
+        return FALSE;
+    }
+    memcpy(buf, field, len);
+    buf[len] = '\0';
+    *v = strtod(buf, &end);
+    return end != buf;
+}
+
+/*
+ * Checks one predicate against a column value.
+ */
+static int HF_PredMatch(const HF_Pred *p, const char *field, int len) {
+    int cmp;
+
+    if (len == 0) {
+        return FALSE;   // An empty column matches nothing
+    }
+    if (p->numeric) {
+        double v;
+        if (!HF_FieldNum(field, len, &v)) {
+            return FALSE;
+        }
+        cmp = v < p->num ? -1 : v > p->num;
+    } else {
+        cmp = memcmp(field, p->str, len < p->strLen ? len : p->strLen);
+        if (cmp == 0) {
+            cmp = len - p->strLen;
+        }
+    }
+    switch (p->op) {
+    case HF_EQ: return cmp == 0;
+    case HF_NE: return cmp != 0;
+    case HF_LT: return cmp < 0;
+    case HF_LE: return cmp <= 0;
+    case HF_GT: return cmp > 0;
+    default:    return cmp >= 0;
+    }
+}
+
+/*
+ * Splits a record at sep into its first maxFields columns.
+ * Returns the number of columns found.
+ */
+static int HF_SplitRecord(const char *record, int recLen, char sep, int maxFields,
+                          int *start, int *flen) {
+    int n = 0;
+    int from = 0;
+
+    for (int i = 0; i < recLen && n < maxFields; i++) {
+        if (record[i] == sep) {
+            start[n] = from;
+            flen[n++] = i - from;
+            from = i + 1;
+        }
+    }
+    if (n < maxFields) {
+        start[n] = from;
+        flen[n++] = recLen - from;
+    }
+    return n;
+}
+
+/*
+ * Checks every predicate of spec against a whole record.
+ */
+static int HF_RecMatch(const HF_ScanSpec *spec, int maxCol, char sep,
+                       const char *record, int recLen) {
+    int start[HF_MAX_PROJ];
+    int flen[HF_MAX_PROJ];
+    int nf = HF_SplitRecord(record, recLen, sep, maxCol + 1, start, flen);
+
+    for (int k = 0; k < spec->npreds; k++) {
+        const HF_Pred *p = &spec->preds[k];
+        if (p->col >= nf || !HF_PredMatch(p, record + start[p->col], flen[p->col])) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/*
+ * Finds the next slotted-page record that satisfies every predicate.
+ * Long records are left to the caller to check.
+ */
+int HF_Page_GetNextMatch(char *pageBuf, int currentSlotNum, const HF_ScanSpec *spec,
+                         int maxCol, char sep) {
+    HF_PageHeader *header = HF_GetPageHeader(pageBuf);
+    HF_SlotEntry *slotArray = HF_GetSlotArray(pageBuf);
+
+    for (int i = currentSlotNum + 1; i < header->numSlots; i++) {
+        char *record;
+        int recLen;
+        if (slotArray[i].length == -1 || slotArray[i].length == HF_SLOT_FORWARD) {
+            continue;
+        }
+        if (HF_Page_GetRec(pageBuf, i, &record, &recLen) != HFE_OK ||
+            HF_RecMatch(spec, maxCol, sep, record, recLen)) {
+            return i;
+        }
+    }
+    return HFE_EOF;
+}
+
+/*
+ * Finds the next PAX-page row that satisfies every predicate. Each
+ * predicate only looks at its own column's minipage.
+ */
+int HF_PaxPage_GetNextMatch(char *pageBuf, int currentSlotNum, const HF_ScanSpec *spec) {
+    int i = currentSlotNum;
+
+    while ((i = HF_PaxPage_NextSlot(pageBuf, i)) >= 0) {
+        int k;
+        for (k = 0; k < spec->npreds; k++) {
+            const HF_Pred *p = &spec->preds[k];
+            char *field;
+            int len;
+            if (HF_PaxPage_GetField(pageBuf, i, p->col, &field, &len) != HFE_OK ||
+                !HF_PredMatch(p, field, len)) {
+                break;
+            }
+        }
+        if (k == spec->npreds) {
+            return i;
+        }
+    }
+    return HFE_EOF;
+}
+
+/*
+ * Page functions for either layout.
+ */
+void HF_InitPageEx(const HF_FileOptions *opts, char *pageBuf) {
+    if (opts->layout == HF_LAYOUT_PAX) {
+        HF_PaxPage_Init(pageBuf, opts->ncols);
+    } else if (opts->layout == HF_LAYOUT_FIXED) {
+        HF_FixedPage_Init(pageBuf, opts->recLen);
+    } else {
+        HF_InitPage(pageBuf);
+    }
+}
+
+int HF_Page_InsertRecEx(const HF_FileOptions *opts, char *pageBuf, char *record, int recLen) {
+    if (opts->layout == HF_LAYOUT_PAX) {
+        return HF_PaxPage_InsertRec(pageBuf, opts->sep, record, recLen);
+    }
+    if (opts->layout == HF_LAYOUT_FIXED) {
+        return HF_FixedPage_InsertRec(pageBuf, record, recLen);
+    }
+    return HF_Page_InsertRec(pageBuf, record, recLen);
+}
+
+int HF_Page_FreeSpaceEx(const HF_FileOptions *opts, char *pageBuf) {
+    if (opts->layout == HF_LAYOUT_PAX) {
+        return HF_PaxPage_FreeSpace(pageBuf);
+    }
+    if (opts->layout == HF_LAYOUT_FIXED) {
+        return HF_FixedPage_FreeSpace(pageBuf);
+    }
+    return HF_Page_FreeSpace(pageBuf);
+}
+
+/*
+ * The record in a slot of a slotted or fixed-length page, in the page;
+ * HFE_OVERFLOW for a long record, as HF_Page_GetRec.
+ */
+static int HF_SlotRec(HF_FileState *st, char *pageBuf, int slot, char **record, int *recLen) {
+    if (st != NULL && st->opts.layout == HF_LAYOUT_FIXED) {
+        return HF_FixedPage_GetRec(pageBuf, slot, record, recLen);
+    }
+    return HF_Page_GetRec(pageBuf, slot, record, recLen);
+}
+
+/*
+ * The live slot after slot on a data page of either layout, or -1.
+ */
+static int HF_NextLiveSlot(HF_FileState *st, char *pageBuf, int slot) {
+    char *record;
+    int recLen;
+
+    if (st->opts.layout == HF_LAYOUT_PAX) {
+        return HF_PaxPage_NextSlot(pageBuf, slot);
+    }
+    if (st->opts.layout == HF_LAYOUT_FIXED) {
+        return HF_FixedPage_NextSlot(pageBuf, slot);
+    }
+    return HF_Page_GetNextRec(pageBuf, slot, &record, &recLen);
+}
+
+/*
+ * ======================================================
+ * File-level HF Layer Function Implementations
+ * ======================================================
+ */
+
+/*
+ * ======================================================
+ * Free-Space Map
+ * ======================================================
+ */
+
+/*
+ * Returns the HF state of an open file, or NULL.
+ */
+static HF_FileState *HF_GetFileState(int fd) {
+    if (fd < 0 || fd >= HFftabSize || !HFftab[fd].inUse) {
+        return NULL;
+    }
+    return &HFftab[fd];
+}
+
+/*
+ * Returns a fresh HF state slot for file fd, growing the table
+ * if needed. Returns NULL if out of memory.
+ */
+static HF_FileState *HF_NewFileState(int fd) {
+    if (fd >= HFftabSize) {
+        int newSize = HFftabSize ? HFftabSize : 20;
+        while (newSize <= fd) {
+            newSize *= 2;
+        }
+        HF_FileState *tab = realloc(HFftab, newSize * sizeof(HF_FileState));
+        if (tab == NULL) {
+            return NULL;
+        }
+        memset(tab + HFftabSize, 0, (newSize - HFftabSize) * sizeof(HF_FileState));
+        HFftab = tab;
+        HFftabSize = newSize;
+    }
+    HF_FileState *st = &HFftab[fd];
+    memset(st, 0, sizeof(HF_FileState));
+    st->inUse = TRUE;
+    st->dirtyLo = 0x7fffffff;
+    st->dirtyHi = -1;
+    st->zoneLo = 0x7fffffff;
+    st->zoneHi = -1;
+    st->lastPage = -1;
+    return st;
+}
+
+static void HF_FreeFileState(HF_FileState *st) {
+    free(st->fsm);
+    free(st->zone);
+    free(st->keyPages);
+    free(st->keyMin);
+    free(st->rowBuf);
+    free(st->ovfBuf);
+    free(st->appendBuf);
+    free(st->tomb);
+    free(st->dict);
+    memset(st, 0, sizeof(HF_FileState));
+}
+
+/*
+ * The FSM category of a page: its free space in HF_FSM_UNIT units.
+ */
+static int HF_FsmCategory(HF_FileState *st, char *pageBuf) {
+    int cat = HF_Page_FreeSpaceEx(&st->opts, pageBuf) / HF_FSM_UNIT;
+    return cat > 255 ? 255 : cat;
+}
+
+/*
+ * Records the category of page pagenum in the map.
+ * Returns HFE_OK, or PFE_NOMEM.
+ */
+static int HF_FsmSet(HF_FileState *st, int pagenum, int cat) {
+    // 1. Make room for the page
+    if (pagenum >= st->fsmAlloc) {
+        int newAlloc = st->fsmAlloc ? st->fsmAlloc : HF_FSM_ENTRIES;
+        while (newAlloc <= pagenum) {
+            newAlloc *= 2;
+        }
+        unsigned char *fsm = realloc(st->fsm, newAlloc);
+        if (fsm == NULL) {
+            return PFE_NOMEM;
+        }
+        memset(fsm + st->fsmAlloc, 0, newAlloc - st->fsmAlloc);
+        st->fsm = fsm;
+        st->fsmAlloc = newAlloc;
+    }
+    if (pagenum >= st->fsmSize) {
+        st->fsmSize = pagenum + 1;
+    }
+
+    // 2. Update the entry and remember that it must be written back.
+    //    A page that gains room may now be the first with it.
+    if (st->fsm[pagenum] != cat) {
+        for (int c = st->fsm[pagenum] + 1; c <= cat; c++) {
+            if (st->fsmFrom[c] > pagenum) {
+                st->fsmFrom[c] = pagenum;
+            }
+        }
+        st->fsm[pagenum] = (unsigned char)cat;
+        if (pagenum < st->dirtyLo) st->dirtyLo = pagenum;
+        if (pagenum > st->dirtyHi) st->dirtyHi = pagenum;
+    }
+    return HFE_OK;
+}
+
+/*
+ * Finds a page whose category is at least need.
+ * The page of the last insert is tried first, since loads
+ * mostly fill one page after the other. Otherwise the search starts
+ * at fsmFrom[need] and leaves it at the page found, so filling a file
+ * does not look at the full pages again and again.
+ * Returns the page number, or -1 if there is none.
+ */
+static int HF_FsmFind(HF_FileState *st, int need) {
+    if (st->lastPage >= 0 && st->lastPage < st->fsmSize &&
+        st->fsm[st->lastPage] >= need) {
+        return st->lastPage;
+    }
+    if (need > 255) {
+        return -1;
+    }
+    for (int i = st->fsmFrom[need]; i < st->fsmSize; i++) {
+        if (st->fsm[i] >= need) {
+            st->fsmFrom[need] = i;
+            return i;
+        }
+    }
+    st->fsmFrom[need] = st->fsmSize;
+    return -1;
+}
+
+/*
+ * Reads the FSM pages listed in the header into memory.
+ */
+static int HF_FsmLoad(int fd, HF_FileState *st) {
+    char *pageBuf;
+    int error;
+
+    for (int k = 0; k < st->header.numFsmPages; k++) {
+        int pagenum = st->header.fsmPages[k];
+        if ((error = PF_GetThisPage(fd, pagenum, &pageBuf)) != PFE_OK) {
+            return error;
+        }
+        HF_FsmPage *fp = (HF_FsmPage *)pageBuf;
+        if (fp->pageType != HF_PAGE_FSM) {
+            PF_UnfixPage(fd, pagenum, FALSE);
+            return PFE_HDRREAD;
+        }
+        // Make room for the whole page worth of entries, then copy them
+        if ((error = HF_FsmSet(st, (k + 1) * HF_FSM_ENTRIES - 1, 0)) != HFE_OK) {
+            PF_UnfixPage(fd, pagenum, FALSE);
+            return error;
+        }
+        memcpy(st->fsm + k * HF_FSM_ENTRIES, fp->cat, HF_FSM_ENTRIES);
+        if ((error = PF_UnfixPage(fd, pagenum, FALSE)) != PFE_OK) {
+            return error;
+        }
+    }
+
+    // Trailing pages with no room are not worth looking at
+    while (st->fsmSize > 0 && st->fsm[st->fsmSize - 1] == 0) {
+        st->fsmSize--;
+    }
+    st->dirtyLo = 0x7fffffff;
+    st->dirtyHi = -1;
+    return HFE_OK;
+}
+
+/*
+ * Builds the map of a file without a header page by visiting
+ * every page once.
+ */
+static int HF_FsmBuild(int fd, HF_FileState *st) {
+    int pagenum = -1;
+    char *pageBuf;
+    int error;
+
+    while ((error = PF_GetNextPage(fd, &pagenum, &pageBuf)) == PFE_OK) {
+        error = HF_FsmSet(st, pagenum, HF_FsmCategory(st, pageBuf));
+        int unfixErr = PF_UnfixPage(fd, pagenum, FALSE);
+        if (unfixErr != PFE_OK) {
+            return unfixErr;
+        }
+        if (error != HFE_OK) {
+            return error;
+        }
+    }
+    return error == PFE_EOF ? HFE_OK : error;
+}
+
+/*
+ * Writes the changed part of the map back to the FSM pages,
+ * allocating new FSM pages as the file grows. Pages beyond what
+ * HF_MAX_FSM_PAGES can describe are left out; they read back as
+ * full, so inserts just don't reuse them.
+ */
+static int HF_FsmFlush(int fd, HF_FileState *st) {
+    char *pageBuf;
+    int pagenum;
+    int error;
+
+    if (st->legacy || st->dirtyHi < 0) {
+        return HFE_OK;
+    }
+
+    // 1. Allocate the FSM pages the file does not have yet. Each new
+    //    FSM page is itself a page to describe, so re-check the size.
+    while (st->header.numFsmPages < HF_MAX_FSM_PAGES &&
+           st->header.numFsmPages * HF_FSM_ENTRIES < st->fsmSize) {
+        if ((error = PF_AllocPage(fd, &pagenum, &pageBuf)) != PFE_OK) {
+            return error;
+        }
+        memset(pageBuf, 0, PF_PAGE_SIZE);
+        ((HF_FsmPage *)pageBuf)->pageType = HF_PAGE_FSM;
+        ((HF_FsmPage *)pageBuf)->firstPage = st->header.numFsmPages * HF_FSM_ENTRIES;
+        if ((error = PF_UnfixPage(fd, pagenum, TRUE)) != PFE_OK) {
+            return error;
+        }
+        st->header.fsmPages[st->header.numFsmPages++] = pagenum;
+        st->headerDirty = TRUE;
+        if ((error = HF_FsmSet(st, pagenum, 0)) != HFE_OK) {
+            return error;
+        }
+    }
+
+    // 2. Copy the changed entries into their FSM pages
+    for (int k = st->dirtyLo / HF_FSM_ENTRIES;
+         k < st->header.numFsmPages && k * HF_FSM_ENTRIES <= st->dirtyHi; k++) {
+        pagenum = st->header.fsmPages[k];
+        if ((error = PF_GetThisPage(fd, pagenum, &pageBuf)) != PFE_OK) {
+            return error;
+        }
+        HF_FsmPage *fp = (HF_FsmPage *)pageBuf;
+        int first = k * HF_FSM_ENTRIES;
+        int n = st->fsmSize - first;
+        if (n > HF_FSM_ENTRIES) n = HF_FSM_ENTRIES;
+        if (n < 0) n = 0;
+        memcpy(fp->cat, st->fsm + first, n);
+        memset(fp->cat + n, 0, HF_FSM_ENTRIES - n);
+        if ((error = PF_UnfixPage(fd, pagenum, TRUE)) != PFE_OK) {
+            return error;
+        }
+    }
+    st->dirtyLo = 0x7fffffff;
+    st->dirtyHi = -1;
+    return HFE_OK;
+}
+
+/*
+ * Writes the in-memory copy of the header back to page 0.
+ */
+static int HF_WriteHeader(int fd, HF_FileState *st) {
+    char *pageBuf;
+    int error;
+
+    if (st->legacy || !st->headerDirty) {
+        return HFE_OK;
+    }
+    if ((error = PF_GetThisPage(fd, 0, &pageBuf)) != PFE_OK) {
+        return error;
+    }
+    memcpy(pageBuf, &st->header, sizeof(HF_FileHeader));
+    if ((error = PF_UnfixPage(fd, 0, TRUE)) != PFE_OK) {
+        return error;
+    }
+    st->headerDirty = FALSE;
+    return HFE_OK;
+}
+
+/*
+ * Gives an empty PF file its header page.
+ */
+static int HF_InitHeader(int fd, HF_FileState *st) {
+    char *pageBuf;
+    int pagenum;
+    int error;
+
+    if ((error = PF_AllocPage(fd, &pagenum, &pageBuf)) != PFE_OK) {
+        return error;
+    }
+    memset(&st->header, 0, sizeof(HF_FileHeader));
+    st->header.pageType = HF_PAGE_HEADER;
+    st->header.magic = HF_FILE_MAGIC;
+    memset(pageBuf, 0, PF_PAGE_SIZE);
+    memcpy(pageBuf, &st->header, sizeof(HF_FileHeader));
+    if ((error = PF_UnfixPage(fd, pagenum, TRUE)) != PFE_OK) {
+        return error;
+    }
+    return HF_FsmSet(st, pagenum, 0);
+}
+
+/*
+ * Takes the page layout from the header. Header pages from before
+ * layouts existed have zeroes there, which means slotted pages.
+ */
+static void HF_SetOptions(HF_FileState *st) {
+    st->opts.layout = st->header.layout;
+    st->opts.ncols = st->header.ncols;
+    st->opts.sep = st->header.sep ? (char)st->header.sep : HF_DEFAULT_SEP;
+    st->opts.recLen = st->header.recLen;
+    st->opts.nzone = st->header.nzone;
+    st->opts.cluster = st->header.cluster;
+    st->opts.clusterCol = st->header.clusterCol;
+    st->opts.clusterFill = st->header.clusterFill;
+    st->opts.append = st->header.append;
+    st->zoneMaxCol = 0;
+    for (int k = 0; k < st->opts.nzone; k++) {
+        st->opts.zoneCols[k] = st->header.zoneCols[k];
+        if (st->opts.zoneCols[k] > st->zoneMaxCol) {
+            st->zoneMaxCol = st->opts.zoneCols[k];
+        }
+        if (st->opts.zoneCols[k] == st->opts.clusterCol) {
+            st->clusterZone = k;
+        }
+    }
+}
+
+/*
+ * Returns the record buffer of a PAX file, allocating it on first
+ * use, or NULL if out of memory.
+ */
+static char *HF_RowBuf(HF_FileState *st) {
+    if (st->rowBuf == NULL) {
+        st->rowBuf = malloc(PF_PAGE_SIZE + HF_PAX_MAX_COLS);
+    }
+    return st->rowBuf;
+}
+
+/*
+ * Returns the record buffer of a scan of a PAX file, allocating it on
+ * first use, or NULL if out of memory.
+ */
+static char *HF_ScanRowBuf(HF_Scan *scan) {
+    if (scan->rowBuf == NULL) {
+        scan->rowBuf = malloc(PF_PAGE_SIZE + HF_PAX_MAX_COLS);
+    }
+    return scan->rowBuf;
+}
+
+/*
+ * ======================================================
+ * Zone Maps
+ * ======================================================
+ */
+
+/*
+ * The zone-map entries of page pagenum (opts.nzone of them), or NULL
+ * if the map does not reach that far.
+ */
+static HF_ZoneEntry *HF_ZoneOf(HF_FileState *st, int pagenum) {
+    if (pagenum < 0 || pagenum >= st->zoneSize) {
+        return NULL;
+    }
+    return st->zone + pagenum * st->opts.nzone;
+}
+
+/*
+ * The first entry of keyPages[] that does not sort before page
+ * pagenum listed under key (by key, then page number).
+ */
+static int HF_KeyPos(HF_FileState *st, double key, int pagenum) {
+    int lo = 0, hi = st->nkeyPages;
+
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        int q = st->keyPages[mid];
+        if (st->keyMin[q] < key || (st->keyMin[q] == key && q < pagenum)) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/*
+ * Moves page pagenum of a clustered file to where its smallest key
+ * now puts it in keyPages[], if that changed.
+ */
+static void HF_KeyNote(HF_FileState *st, int pagenum) {
+    HF_ZoneEntry *z = HF_ZoneOf(st, pagenum);
+    int k = st->clusterZone;
+    double key = NAN;
+
+    if (z == NULL) {
+        return;     // Beyond the map, so never listed
+    }
+    double old = st->keyMin[pagenum];
+    if (z[k].other >= 0 && z[k].min <= z[k].max) {
+        key = z[k].min;
+    }
+    if (key == old || (isnan(key) && isnan(old))) {
+        return;
+    }
+    if (!isnan(old)) {
+        int i = HF_KeyPos(st, old, pagenum);
+        memmove(st->keyPages + i, st->keyPages + i + 1,
+                (st->nkeyPages - i - 1) * sizeof(int));
+        st->nkeyPages--;
+    }
+    if (!isnan(key)) {
+        int i = HF_KeyPos(st, key, pagenum);
+        memmove(st->keyPages + i + 1, st->keyPages + i, (st->nkeyPages - i) * sizeof(int));
+        st->keyPages[i] = pagenum;
+        st->nkeyPages++;
+    }
+    st->keyMin[pagenum] = key;
+}
+
+static void HF_ZoneDirty(HF_FileState *st, int pagenum) {
+    if (pagenum < st->zoneLo) st->zoneLo = pagenum;
+    if (pagenum > st->zoneHi) st->zoneHi = pagenum;
+    if (st->opts.cluster) {
+        HF_KeyNote(st, pagenum);
+    }
+}
+
+/*
+ * Makes the map reach page pagenum. Pages new to it are not
+ * summarized. Returns HFE_OK, or PFE_NOMEM.
+ */
+static int HF_ZoneGrow(HF_FileState *st, int pagenum) {
+    int nz = st->opts.nzone;
+
+    if (pagenum >= st->zoneAlloc) {
+        int newAlloc = st->zoneAlloc ? st->zoneAlloc : HF_ZONE_ENTRIES;
+        while (newAlloc <= pagenum) {
+            newAlloc *= 2;
+        }
+        HF_ZoneEntry *zone = realloc(st->zone, (size_t)newAlloc * nz * sizeof(HF_ZoneEntry));
+        if (zone == NULL) {
+            return PFE_NOMEM;
+        }
+        st->zone = zone;
+        if (st->opts.cluster) {
+            int *pages = realloc(st->keyPages, newAlloc * sizeof(int));
+            if (pages != NULL) {
+                st->keyPages = pages;
+            }
+            double *keyMin = realloc(st->keyMin, newAlloc * sizeof(double));
+            if (keyMin != NULL) {
+                st->keyMin = keyMin;
+            }
+            if (pages == NULL || keyMin == NULL) {
+                return PFE_NOMEM;
+            }
+        }
+        st->zoneAlloc = newAlloc;
+    }
+    for (int i = st->zoneSize * nz; i < (pagenum + 1) * nz; i++) {
+        memset(&st->zone[i], 0, sizeof(HF_ZoneEntry));
+        st->zone[i].other = -1;
+    }
+    for (int p = st->zoneSize; st->opts.cluster && p <= pagenum; p++) {
+        st->keyMin[p] = NAN;    // Not summarized, so not listed
+    }
+    if (pagenum >= st->zoneSize) {
+        st->zoneSize = pagenum + 1;
+    }
+    return HFE_OK;
+}
+
+/*
+ * Sets the entries of page pagenum to those of a page with no rows.
+ */
+static int HF_ZoneReset(HF_FileState *st, int pagenum) {
+    int error;
+
+    if (st->opts.nzone == 0) {
+        return HFE_OK;
+    }
+    if ((error = HF_ZoneGrow(st, pagenum)) != HFE_OK) {
+        return error;
+    }
+    HF_ZoneEntry *z = HF_ZoneOf(st, pagenum);
+    for (int k = 0; k < st->opts.nzone; k++) {
+        z[k].min = HUGE_VAL;
+        z[k].max = -HUGE_VAL;
+        z[k].nulls = 0;
+        z[k].other = 0;
+    }
+    HF_ZoneDirty(st, pagenum);
+    return HFE_OK;
+}
+
+/*
+ * Marks the entries of page pagenum as not summarized, e.g. when the
+ * page is given back to the PF free list.
+ */
+static void HF_ZoneForget(HF_FileState *st, int pagenum) {
+    HF_ZoneEntry *z = HF_ZoneOf(st, pagenum);
+
+    for (int k = 0; z != NULL && k < st->opts.nzone; k++) {
+        z[k].other = -1;
+    }
+    HF_ZoneDirty(st, pagenum);
+}
+
+/*
+ * What a row adds to the zone-map entries of its page, column by
+ * column (HF_ZONE_...).
+ */
+#define HF_ZONE_SKIP    0   /* Not a number: matches no numeric predicate */
+#define HF_ZONE_NULL    1   /* Empty */
+#define HF_ZONE_NUM     2   /* A number, in v[] */
+#define HF_ZONE_OTHER   3   /* Not summarized */
+
+typedef struct {
+    int kind[HF_ZONE_MAX_COLS];
+    double v[HF_ZONE_MAX_COLS];
+} HF_ZoneRow;
+
+/*
+ * Reads the zone columns of the row in slot. They are found as the
+ * scans find them: in their minipages on a PAX page, else by splitting
+ * the record at sep. A long record is not read.
+ * Returns HFE_OK, or an error code if the slot holds no row.
+ */
+static int HF_ZoneRowOf(HF_FileState *st, char *pageBuf, int slot, HF_ZoneRow *row) {
+    int pax = st->opts.layout == HF_LAYOUT_PAX;
+    int start[HF_MAX_PROJ];
+    int flen[HF_MAX_PROJ];
+    int nf = 0;
+    char *record = NULL;
+    int recLen;
+
+    if (!pax) {
+        int error = HF_SlotRec(st, pageBuf, slot, &record, &recLen);
+        if (error == HFE_OVERFLOW) {
+            for (int k = 0; k < st->opts.nzone; k++) {
+                row->kind[k] = HF_ZONE_OTHER;
+            }
+            return HFE_OK;
+        }
+        if (error != HFE_OK) {
+            return error;
+        }
+        nf = HF_SplitRecord(record, recLen, st->opts.sep, st->zoneMaxCol + 1, start, flen);
+    }
+    for (int k = 0; k < st->opts.nzone; k++) {
+        int col = st->opts.zoneCols[k];
+        char *field;
+        int len = 0;
+        if (pax) {
+            if (HF_PaxPage_GetField(pageBuf, slot, col, &field, &len) != HFE_OK) {
+                len = 0;
+            }
+        } else if (col < nf) {
+            field = record + start[col];
+            len = flen[col];
+        }
+        if (len == 0) {
+            row->kind[k] = HF_ZONE_NULL;
+        } else if (!HF_FieldNum(field, len, &row->v[k])) {
+            row->kind[k] = HF_ZONE_SKIP;
+        } else {
+            // NaN is equal to every number, so it cannot be summarized
+            row->kind[k] = row->v[k] != row->v[k] ? HF_ZONE_OTHER : HF_ZONE_NUM;
+        }
+    }
+    return HFE_OK;
+}
+
+/*
+ * Widens the entries of page pagenum by the row in slot, which is on
+ * the page.
+ */
+static void HF_ZoneAdd(HF_FileState *st, int pagenum, char *pageBuf, int slot) {
+    HF_ZoneEntry *z = HF_ZoneOf(st, pagenum);
+    HF_ZoneRow row;
+
+    if (z == NULL || z[0].other < 0) {
+        return;     // Not summarized; an insert does not change that
+    }
+    if (HF_ZoneRowOf(st, pageBuf, slot, &row) != HFE_OK) {
+        for (int k = 0; k < st->opts.nzone; k++) {
+            row.kind[k] = HF_ZONE_OTHER;
+        }
+    }
+    for (int k = 0; k < st->opts.nzone; k++) {
+        switch (row.kind[k]) {
+        case HF_ZONE_NULL:
+            z[k].nulls++;
+            break;
+        case HF_ZONE_OTHER:
+            z[k].other++;
+            break;
+        case HF_ZONE_NUM:
+            if (row.v[k] < z[k].min) z[k].min = row.v[k];
+            if (row.v[k] > z[k].max) z[k].max = row.v[k];
+            break;
+        }
+    }
+    HF_ZoneDirty(st, pagenum);
+}
+
+/*
+ * Works out the entries of page pagenum from its rows.
+ */
+static int HF_ZoneBuild(HF_FileState *st, int pagenum, char *pageBuf) {
+    int error;
+
+    if ((error = HF_ZoneReset(st, pagenum)) != HFE_OK) {
+        return error;
+    }
+    for (int slot = -1; (slot = HF_NextLiveSlot(st, pageBuf, slot)) >= 0; ) {
+        HF_ZoneAdd(st, pagenum, pageBuf, slot);
+    }
+    return HFE_OK;
+}
+
+/*
+ * Takes a deleted row out of the entries of page pagenum; row has the
+ * row's values from before the delete, or is NULL if they could not be
+ * read. Only a number at either end of a range makes the entries be
+ * worked out again from the page.
+ */
+static void HF_ZoneDrop(HF_FileState *st, int pagenum, char *pageBuf, const HF_ZoneRow *row) {
+    HF_ZoneEntry *z = HF_ZoneOf(st, pagenum);
+    int rebuild = row == NULL || z == NULL || z[0].other < 0;
+
+    for (int k = 0; k < st->opts.nzone && !rebuild; k++) {
+        switch (row->kind[k]) {
+        case HF_ZONE_NULL:
+            z[k].nulls--;
+            break;
+        case HF_ZONE_OTHER:
+            z[k].other--;
+            break;
+        case HF_ZONE_NUM:
+            rebuild = row->v[k] <= z[k].min || row->v[k] >= z[k].max;
+            break;
+        }
+    }
+    if (rebuild) {
+        HF_ZoneBuild(st, pagenum, pageBuf);
+    } else {
+        HF_ZoneDirty(st, pagenum);
+    }
+}
+
+/*
+ * Brings the maps up to date with a data page that changed other than
+ * by an insert or a delete: its free space, and its zone-map entries,
+ * which are worked out again from the page.
+ */
+static int HF_NotePage(HF_FileState *st, int pagenum, char *pageBuf) {
+    if (st->opts.nzone > 0) {
+        HF_ZoneBuild(st, pagenum, pageBuf);
+    }
+    return HF_FsmSet(st, pagenum, HF_FsmCategory(st, pageBuf));
+}
+
+/*
+ * Returns TRUE if the zone map shows that no row of page pagenum can
+ * satisfy every predicate of spec.
+ */
+static int HF_ZoneRulesOut(HF_FileState *st, const HF_ScanSpec *spec, int pagenum) {
+    HF_ZoneEntry *z = HF_ZoneOf(st, pagenum);
+
+    if (z == NULL) {
+        return FALSE;
+    }
+    for (int i = 0; i < spec->npreds; i++) {
+        const HF_Pred *p = &spec->preds[i];
+        if (!p->numeric) {
+            continue;
+        }
+        for (int k = 0; k < st->opts.nzone; k++) {
+            if (st->opts.zoneCols[k] != p->col || z[k].other != 0) {
+                continue;
+            }
+            double lo = z[k].min, hi = z[k].max, x = p->num;
+            if (lo > hi) {
+                return TRUE;    // No number in the column at all
+            }
+            switch (p->op) {
+            case HF_EQ: if (x < lo || x > hi) return TRUE; break;
+            case HF_NE: if (lo == x && hi == x) return TRUE; break;
+            case HF_LT: if (lo >= x) return TRUE; break;
+            case HF_LE: if (lo > x) return TRUE; break;
+            case HF_GT: if (hi <= x) return TRUE; break;
+            default:    if (hi < x) return TRUE; break;
+            }
+        }
+    }
+    return FALSE;
+}
+
+/*
+ * HF_ZoneRulesOut for a scan, which holds no latch.
+ */
+static int HF_ScanRulesOut(HF_FileState *st, HF_Scan *scan, int pagenum) {
+    if (st == NULL || !scan->useZones) {
+        return FALSE;
+    }
+    pthread_mutex_lock(&HFlatch);
+    int out = HF_ZoneRulesOut(st, &scan->spec, pagenum);
+    pthread_mutex_unlock(&HFlatch);
+    return out;
+}
+
+/*
+ * Moves a scan past the pages after its current one that the zone map
+ * rules out. The map may describe pages past the end of the file
+ * (trimmed ones, or the rest of its last zone-map page); the scan
+ * stops at the last page.
+ */
+static void HF_ScanSkip(HF_FileState *st, HF_Scan *scan) {
+    if (st == NULL || !scan->useZones) {
+        return;
+    }
+    int numPages = PF_NumPages(scan->fd);
+    pthread_mutex_lock(&HFlatch);
+    while (scan->currentPageNum + 1 < numPages &&
+           HF_ZoneRulesOut(st, &scan->spec, scan->currentPageNum + 1)) {
+        scan->currentPageNum++;
+    }
+    pthread_mutex_unlock(&HFlatch);
+}
+
+/*
+ * Reads the zone-map pages listed in the header into memory.
+ */
+static int HF_ZoneLoad(int fd, HF_FileState *st) {
+    int nz = st->opts.nzone;
+    char *pageBuf;
+    int error;
+
+    if (nz == 0) {
+        return HFE_OK;
+    }
+    int per = HF_ZONE_ENTRIES / nz;
+    for (int k = 0; k < st->header.numZonePages; k++) {
+        int pagenum = st->header.zonePages[k];
+        if ((error = PF_GetThisPage(fd, pagenum, &pageBuf)) != PFE_OK) {
+            return error;
+        }
+        HF_ZonePage *zp = (HF_ZonePage *)pageBuf;
+        if (zp->pageType != HF_PAGE_ZONE) {
+            PF_UnfixPage(fd, pagenum, FALSE);
+            return PFE_HDRREAD;
+        }
+        if ((error = HF_ZoneGrow(st, (k + 1) * per - 1)) != HFE_OK) {
+            PF_UnfixPage(fd, pagenum, FALSE);
+            return error;
+        }
+        memcpy(st->zone + k * per * nz, zp->e, per * nz * sizeof(HF_ZoneEntry));
+        if ((error = PF_UnfixPage(fd, pagenum, FALSE)) != PFE_OK) {
+            return error;
+        }
+    }
+    for (int p = 0; st->opts.cluster && p < st->zoneSize; p++) {
+        HF_KeyNote(st, p);
+    }
+    st->zoneLo = 0x7fffffff;
+    st->zoneHi = -1;
+    return HFE_OK;
+}
+
+/*
+ * Writes the changed part of the zone map back to its pages, as
+ * HF_FsmFlush does. Pages beyond what HF_MAX_ZONE_PAGES can describe
+ * read back as not summarized, so scans always read them.
+ */
+static int HF_ZoneFlush(int fd, HF_FileState *st) {
+    int nz = st->opts.nzone;
+    char *pageBuf;
+    int pagenum;
+    int error;
+
+    if (st->legacy || nz == 0 || st->zoneHi < 0) {
+        return HFE_OK;
+    }
+    int per = HF_ZONE_ENTRIES / nz;
+
+    // 1. Allocate the zone-map pages the file does not have yet
+    while (st->header.numZonePages < HF_MAX_ZONE_PAGES &&
+           st->header.numZonePages * per < st->zoneSize) {
+        if ((error = PF_AllocPage(fd, &pagenum, &pageBuf)) != PFE_OK) {
+            return error;
+        }
+        memset(pageBuf, 0, PF_PAGE_SIZE);
+        ((HF_ZonePage *)pageBuf)->pageType = HF_PAGE_ZONE;
+        ((HF_ZonePage *)pageBuf)->firstPage = st->header.numZonePages * per;
+        if ((error = PF_UnfixPage(fd, pagenum, TRUE)) != PFE_OK) {
+            return error;
+        }
+        st->header.zonePages[st->header.numZonePages++] = pagenum;
+        st->headerDirty = TRUE;
+        if ((error = HF_FsmSet(st, pagenum, 0)) != HFE_OK) {
+            return error;
+        }
+    }
+
+    // 2. Copy the changed entries into their pages
+    for (int k = st->zoneLo / per;
+         k < st->header.numZonePages && k * per <= st->zoneHi; k++) {
+        pagenum = st->header.zonePages[k];
+        if ((error = PF_GetThisPage(fd, pagenum, &pageBuf)) != PFE_OK) {
+            return error;
+        }
+        HF_ZonePage *zp = (HF_ZonePage *)pageBuf;
+        int first = k * per;
+        int n = st->zoneSize - first;
+        if (n > per) n = per;
+        if (n < 0) n = 0;
+        memcpy(zp->e, st->zone + first * nz, n * nz * sizeof(HF_ZoneEntry));
+        for (int i = n * nz; i < per * nz; i++) {
+            memset(&zp->e[i], 0, sizeof(HF_ZoneEntry));
+            zp->e[i].other = -1;
+        }
+        if ((error = PF_UnfixPage(fd, pagenum, TRUE)) != PFE_OK) {
+            return error;
+        }
+    }
+    st->zoneLo = 0x7fffffff;
+    st->zoneHi = -1;
+    return HFE_OK;
+}
+
+/*
+ * ======================================================
+ * Key Pages of Clustered Files
+ * ======================================================
+ */
+
+/*
+ * Reads the key of a record of a clustered file, as a numeric HF_Pred
+ * reads column clusterCol. Returns FALSE if it has none.
+ */
+static int HF_ClusterKey(HF_FileState *st, const char *record, int recLen, double *v) {
+    int start[HF_MAX_PROJ];
+    int flen[HF_MAX_PROJ];
+    int col = st->opts.clusterCol;
+
+    if (HF_SplitRecord(record, recLen, st->opts.sep, col + 1, start, flen) <= col ||
+        !HF_FieldNum(record + start[col], flen[col], v)) {
+        return FALSE;
+    }
+    return *v == *v;    // NaN sorts nowhere
+}
+
+/*
+ * The page a record of a clustered file goes on (see HF_Recluster in
+ * hf.h): the page with the highest smallest key not above the
+ * record's key, or the page with the lowest one if there is none; or
+ * failing that, the page after it or before it. need is as for
+ * HF_FsmFind, and flags as for HF_PutRec.
+ *
+ * Returns the first of these pages the map says has room, -1 if none
+ * has, or -2 if the file is not clustered, the record has no key or
+ * no page has keys yet.
+ */
+static int HF_ClusterPage(HF_FileState *st, const char *record, int recLen, int flags,
+                          int need) {
+    int best;
+    double v;
+
+    if (!st->opts.cluster || flags != 0 || !HF_ClusterKey(st, record, recLen, &v) ||
+        st->nkeyPages == 0) {
+        return -2;
+    }
+
+    // 1. Find the page among the summarized pages that have keys: the
+    //    last one in keyPages[] that is not listed above v
+    int i = HF_KeyPos(st, v, 0x7fffffff);
+    best = st->keyPages[i > 0 ? i - 1 : 0];
+
+    // 2. It or a neighbour, if the map says it has room
+    for (int d = 0; d < 3; d++) {
+        int p = best + (d == 2 ? -1 : d);
+        if (p >= 0 && p < st->fsmSize && st->fsm[p] >= need) {
+            return p;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Counts a record placed in a clustered file, stray if it did not go
+ * on or next to its key's page.
+ */
+static void HF_ClusterNote(HF_FileState *st, int stray) {
+    if (st->opts.cluster) {
+        st->header.clusterPlaced++;
+        st->header.clusterStrays += stray != 0;
+        st->headerDirty = TRUE;
+    }
+}
+
+/*
+ * TRUE if a clustered file has enough strays to be reclustered.
+ */
+static int HF_ClusterDue(HF_FileState *st) {
+    HF_FileHeader *h = &st->header;
+
+    return st->opts.cluster && (long)h->clusterStrays * 100 >
+           (long)HF_CLUSTER_STRAYS * (h->clusterRecs + h->clusterPlaced);
+}
+
+/*
+ * ======================================================
+ * Overflow Pages
+ * ======================================================
+ */
+
+/*
+ * Gives the overflow pages from page on back to the PF free list.
+ */
+static int HF_OverflowFree(int fd, int page) {
+    char *pageBuf;
+    int error;
+
+    while (page >= 0) {
+        if ((error = PF_GetThisPage(fd, page, &pageBuf)) != PFE_OK) {
+            return error;
+        }
+        int next = ((HF_OverflowPage *)pageBuf)->next;
+        if ((error = PF_UnfixPage(fd, page, FALSE)) != PFE_OK ||
+            (error = PF_DisposePage(fd, page)) != PFE_OK) {
+            return error;
+        }
+        page = next;
+    }
+    return HFE_OK;
+}
+
+/*
+ * Writes a long record to new overflow pages, in order. Each page is
+ * kept pinned until the next one is allocated, which it points to.
+ */
+static int HF_OverflowWrite(int fd, char *record, int recLen, HF_OverflowHead *head) {
+    HF_OverflowPage *prev = NULL;
+    int prevPage = -1;
+    char *pageBuf;
+    int pagenum;
+    int error;
+
+    head->length = recLen;
+    head->firstPage = -1;
+    for (int off = 0; off < recLen; off += HF_OVERFLOW_BYTES) {
+        if ((error = PF_AllocPage(fd, &pagenum, &pageBuf)) != PFE_OK) {
+            // Give back what was written so far
+            if (prev != NULL) {
+                PF_UnfixPage(fd, prevPage, TRUE);
+            }
+            HF_OverflowFree(fd, head->firstPage);
+            return error;
+        }
+        HF_OverflowPage *op = (HF_OverflowPage *)pageBuf;
+        op->pageType = HF_PAGE_OVERFLOW;
+        op->next = -1;
+        op->length = recLen - off < HF_OVERFLOW_BYTES ? recLen - off : HF_OVERFLOW_BYTES;
+        memcpy(op->data, record + off, op->length);
+
+        if (prev == NULL) {
+            head->firstPage = pagenum;
+        } else {
+            prev->next = pagenum;
+            if ((error = PF_UnfixPage(fd, prevPage, TRUE)) != PFE_OK) {
+                PF_UnfixPage(fd, pagenum, TRUE);
+                return error;
+            }
+        }
+        prev = op;
+        prevPage = pagenum;
+    }
+    return PF_UnfixPage(fd, prevPage, TRUE);
+}
+
+/*
+ * Copies len bytes of a long record to buf, from byte *pageOff of the
+ * data of overflow page *page on, and moves (*page, *pageOff) past
+ * them. A parallel scan may have an overflow page pinned for the
+ * moment it takes to see that it has no records; that is waited out.
+ */
+static int HF_OverflowCopy(int fd, int *page, int *pageOff, char *buf, int len) {
+    char *pageBuf;
+    int error;
+
+    while (len > 0) {
+        if (*page < 0) {
+            return HFE_INVALIDSLOT;     // The chain is shorter than the record
+        }
+        while ((error = PF_GetThisPage(fd, *page, &pageBuf)) == PFE_PAGEFIXED) {
+            sched_yield();
+        }
+        if (error != PFE_OK) {
+            return error;
+        }
+        HF_OverflowPage *op = (HF_OverflowPage *)pageBuf;
+        if (op->pageType != HF_PAGE_OVERFLOW || *pageOff > op->length) {
+            PF_UnfixPage(fd, *page, FALSE);
+            return HFE_INVALIDSLOT;
+        }
+        int n = op->length - *pageOff < len ? op->length - *pageOff : len;
+        memcpy(buf, op->data + *pageOff, n);
+        buf += n;
+        len -= n;
+        *pageOff += n;
+
+        int pinned = *page;
+        if (*pageOff == op->length) {
+            *page = op->next;
+            *pageOff = 0;
+        }
+        if ((error = PF_UnfixPage(fd, pinned, FALSE)) != PFE_OK) {
+            return error;
+        }
+    }
+    return HFE_OK;
+}
+
+/*
+ * Puts a whole long record together in *buf, which has *cap bytes
+ * allocated and is grown if need be.
+ */
+static int HF_OverflowGet(int fd, const HF_OverflowHead *head, char **buf, int *cap) {
+    int page = head->firstPage;
+    int pageOff = 0;
+
+    if (head->length > *cap) {
+        char *b = realloc(*buf, head->length);
+        if (b == NULL) {
+            return PFE_NOMEM;
+        }
+        *buf = b;
+        *cap = head->length;
+    }
+    return HF_OverflowCopy(fd, &page, &pageOff, *buf, head->length);
+}
+
+/*
+ * ======================================================
+ * File-level HF Layer Function Implementations
+ * ======================================================
+ */
+
+/*
+ * Creates a new, empty heap file: a PF file whose
+ * first page is the file header page.
+ */
+int HF_CreateFile(char *fileName) {
+    return HF_CreateFileEx(fileName, NULL);
+}
+
+/*
+ * Creates a new, empty heap file with the given page layout.
+ */
+int HF_CreateFileEx(char *fileName, HF_FileOptions *opts) {
+    HF_FileOptions o;
+    int fd;
+    int error;
+
+    if (opts != NULL && (opts->layout < HF_LAYOUT_SLOTTED || opts->layout > HF_LAYOUT_FIXED ||
+        (opts->layout == HF_LAYOUT_PAX && (opts->ncols < 1 || opts->ncols > HF_PAX_MAX_COLS)) ||
+        (opts->layout == HF_LAYOUT_FIXED && (opts->recLen < 1 || opts->recLen > HF_FIXED_MAX_LEN)) ||
+        opts->nzone < 0 || opts->nzone > HF_ZONE_MAX_COLS ||
+        (opts->cluster && (opts->clusterFill < 0 || opts->clusterFill > 100 ||
+                           opts->append)))) {
+        return HFE_BADOPTIONS;
+    }
+    if (opts != NULL) {
+        // The key column of a clustered file needs a zone map
+        o = *opts;
+        opts = &o;
+        int k = 0;
+        while (o.cluster && k < o.nzone && o.zoneCols[k] != o.clusterCol) {
+            k++;
+        }
+        if (o.cluster && k == o.nzone) {
+            if (o.nzone == HF_ZONE_MAX_COLS) {
+                return HFE_BADOPTIONS;
+            }
+            o.zoneCols[o.nzone++] = o.clusterCol;
+        }
+    }
+    for (int k = 0; opts != NULL && k < opts->nzone; k++) {
+        int col = opts->zoneCols[k];
+        if (col < 0 || col >= HF_MAX_PROJ ||
+            (opts->layout == HF_LAYOUT_PAX && col >= opts->ncols)) {
+            return HFE_BADOPTIONS;
+        }
+    }
+
+    // 1. Call the PF layer to create the file
+    if (PF_CreateFile(fileName) != PFE_OK) {
+        return PFerrno; // Return PF layer's error code
+    }
+
+    // 2. Opening an empty file writes its header page
+    if ((fd = HF_OpenFile(fileName)) < 0) {
+        return fd;
+    }
+
+    // 3. Record the layout in the header
+    if (opts != NULL) {
+        HF_FileState *st = HF_GetFileState(fd);
+        st->header.layout = opts->layout;
+        st->header.ncols = opts->layout == HF_LAYOUT_PAX ? opts->ncols : 0;
+        st->header.sep = (unsigned char)opts->sep;
+        st->header.recLen = opts->layout == HF_LAYOUT_FIXED ? opts->recLen : 0;
+        st->header.nzone = opts->nzone;
+        for (int k = 0; k < opts->nzone; k++) {
+            st->header.zoneCols[k] = opts->zoneCols[k];
+        }
+        if (opts->cluster) {
+            st->header.cluster = TRUE;
+            st->header.clusterCol = opts->clusterCol;
+            st->header.clusterFill = opts->clusterFill ? opts->clusterFill : HF_CLUSTER_FILL;
+        }
+        st->header.append = opts->append ? TRUE : FALSE;
+        st->headerDirty = TRUE;
+        HF_SetOptions(st);
+    }
+    if ((error = HF_CloseFile(fd)) != HFE_OK) {
+        return error;
+    }
+    return HFE_OK;
+}
+
+/*
+ * Gets the page layout of an open file.
+ */
+int HF_GetFileOptions(int fd, HF_FileOptions *opts) {
+    HF_FileState *st = HF_GetFileState(fd);
+
+    if (st == NULL) {
+        return PFE_FD;
+    }
+    *opts = st->opts;
+    return HFE_OK;
+}
+
+/*
+ * Gets a page's zone-map entry for one zone column.
+ */
+int HF_GetZone(int fd, int pagenum, int k, HF_ZoneEntry *zone) {
+    int error = HFE_OK;
+
+    pthread_mutex_lock(&HFlatch);
+    HF_FileState *st = HF_GetFileState(fd);
+    if (st == NULL) {
+        error = PFE_FD;
+    } else if (k < 0 || k >= st->opts.nzone) {
+        error = HFE_BADOPTIONS;
+    } else {
+        HF_ZoneEntry *z = HF_ZoneOf(st, pagenum);
+        if (z == NULL || z[k].other < 0) {
+            error = HFE_EOF;
+        } else {
+            *zone = z[k];
+        }
+    }
+    pthread_mutex_unlock(&HFlatch);
+    return error;
+}
+
+/*
+ * Reads the file dictionary from the overflow pages the header lists.
+ */
+static int HF_DictLoad(int fd, HF_FileState *st) {
+    int page = st->header.dictPage;
+    int pageOff = 0;
+
+    if (st->header.dictLen <= 0) {
+        return HFE_OK;
+    }
+    if ((st->dict = malloc(st->header.dictLen)) == NULL) {
+        return PFE_NOMEM;
+    }
+    return HF_OverflowCopy(fd, &page, &pageOff, st->dict, st->header.dictLen);
+}
+
+/*
+ * Opens an existing heap file.
+ * Returns a file descriptor (fd) from the PF layer.
+ */
+static int HF_DoOpenFile(char *fileName) {
+    char *pageBuf;
+    int error;
+
+    // 1. Call the PF layer to open the file
+    int fd = PF_OpenFile(fileName);
+    if (fd < 0) {
+        return PFerrno; // Return PF layer's error code
+    }
+
+    HF_FileState *st = HF_NewFileState(fd);
+    if (st == NULL) {
+        PF_CloseFile(fd);
+        return PFE_NOMEM;
+    }
+
+    // 2. Look at page 0 to see what kind of file this is
+    error = PF_GetThisPage(fd, 0, &pageBuf);
+    if (error == PFE_INVALIDPAGE) {
+        // An empty file (e.g. from PF_CreateCompressedFile)
+        error = HF_InitHeader(fd, st);
+    } else if (error == PFE_OK) {
+        HF_FileHeader *hdr = (HF_FileHeader *)pageBuf;
+        if (hdr->pageType == HF_PAGE_HEADER && hdr->magic == HF_FILE_MAGIC) {
+            memcpy(&st->header, hdr, sizeof(HF_FileHeader));
+            error = PF_UnfixPage(fd, 0, FALSE);
+            if (error == PFE_OK) {
+                error = HF_FsmLoad(fd, st);
+            }
+            if (error == HFE_OK) {
+                HF_SetOptions(st);
+                error = HF_ZoneLoad(fd, st);
+            }
+            if (error == HFE_OK) {
+                error = HF_DictLoad(fd, st);
+            }
+        } else {
+            // Written before heap files had a header page
+            st->legacy = TRUE;
+            error = PF_UnfixPage(fd, 0, FALSE);
+            if (error == PFE_OK) {
+                error = HF_FsmBuild(fd, st);
+            }
+        }
+    }
+
+    if (error != HFE_OK) {
+        HF_FreeFileState(st);
+        PF_CloseFile(fd);
+        return error;
+    }
+    HF_SetOptions(st);
+    return fd; // Return the file descriptor
+}
+
+/*
+ * Closes a heap file, writing back its free-space map and zone map.
+ */
+static int HF_DoCloseFile(int fd) {
+    HF_FileState *st = HF_GetFileState(fd);
+    int error = HFE_OK;
+
+    // 1. Write back the maps, then the header that lists their pages.
+    //    New zone-map pages go in the free-space map, so it goes last.
+    if (st != NULL) {
+        error = HF_ZoneFlush(fd, st);
+        if (error == HFE_OK) {
+            error = HF_FsmFlush(fd, st);
+        }
+        if (error == HFE_OK) {
+            error = HF_WriteHeader(fd, st);
+        }
+        HF_FreeFileState(st);
+    }
+
+    // 2. Call the PF layer to close the file
+    if (PF_CloseFile(fd) != PFE_OK) {
+        return PFerrno; // Return PF layer's error code
+    }
+    return error;
+}
+
+/*
+ * Inserts a record, or with home set the moved copy of the record
+ * whose home that is, on a page that has room for it. flags is
+ * HF_SLOT_OVERFLOW if record is the HF_OverflowHead of a long record.
+ */
+static int HF_PutRec(HF_FileState *st, char *pageBuf, const RID *home, char *record,
+                     int recLen, int flags) {
+    int slotNum;
+
+    if (home != NULL) {
+        slotNum = HF_Page_InsertMoved(pageBuf, *home, record, recLen);
+    } else {
+        slotNum = HF_Page_InsertRecEx(&st->opts, pageBuf, record, recLen);
+    }
+    if (slotNum >= 0 && flags != 0) {
+        HF_GetSlotArray(pageBuf)[slotNum].length |= flags;
+    }
+    return slotNum;
+}
+
+/*
+ * Inserts a record into the file, or with home set the moved copy of
+ * a record (see HF_UpdateRec).
+ *
+ * The free-space map gives a page with enough room, so only
+ * that page is read. If the map says no page has room, a new
+ * page is allocated and the record is inserted there. A clustered
+ * file tries the page of the record's key first (HF_ClusterPage).
+ */
+static int HF_PlaceRec(int fd, HF_FileState *st, const RID *home, char *record, int recLen,
+                       int flags, RID *rid) {
+    int bytes = recLen + (home != NULL ? (int)sizeof(RID) : 0);
+    // Category 0 also means "not a data page", so ask for at least 1
+    int need = bytes > 0 ? (bytes + HF_FSM_UNIT - 1) / HF_FSM_UNIT : 1;
+    int want = HF_ClusterPage(st, record, recLen, flags, need);
+    int next = want;
+    int pagenum;
+    char *pageBuf;
+    int error;
+    int slotNum;
+
+    // 1. Try the key's page, then the pages the map says have room
+    while ((pagenum = next >= 0 ? next : HF_FsmFind(st, need)) >= 0) {
+        next = -1;
+        if ((error = PF_GetThisPage(fd, pagenum, &pageBuf)) != PFE_OK) {
+            if (error != PFE_INVALIDPAGE) {
+                return error;
+            }
+            // The page is gone; forget about it
+            HF_FsmSet(st, pagenum, 0);
+            continue;
+        }
+
+        // Try to insert the record on this page
+        slotNum = HF_PutRec(st, pageBuf, home, record, recLen, flags);
+
+        // Whatever happened, the map now learns the page's real state
+        HF_FsmSet(st, pagenum, HF_FsmCategory(st, pageBuf));
+
+        if (slotNum == HFE_PAGENOFREE) {
+            // The map was out of date; unfix and look again
+            if ((error = PF_UnfixPage(fd, pagenum, FALSE)) != PFE_OK) {
+                return error;
+            }
+            continue;
+        }
+
+        // --- Success! We found space and inserted the record ---
+        HF_ZoneAdd(st, pagenum, pageBuf, slotNum);
+        HF_ClusterNote(st, want != -2 && pagenum != want);
+        rid->pageNum = pagenum;
+        rid->slotNum = slotNum;
+        st->lastPage = pagenum;
+
+        // Mark the page as dirty (it was modified) and unfix it
+        if ((error = PF_UnfixPage(fd, pagenum, TRUE)) != PFE_OK) {
+            return error;
+        }
+        return HFE_OK;
+    }
+
+    // 2. --- No page has free space, so we must allocate a new one ---
+
+    // Allocate a new page
+    if ((error = PF_AllocPage(fd, &pagenum, &pageBuf)) != PFE_OK) {
+        return error; // Propagate PF error
+    }
+
+    // Initialize the new page; its zone-map entries start out empty
+    HF_InitPageEx(&st->opts, pageBuf);
+    HF_ZoneReset(st, pagenum);
+
+    // Insert the record (this *must* succeed on a new page, unless it
+    // is longer than a page)
+    slotNum = HF_PutRec(st, pageBuf, home, record, recLen, flags);
+    if (slotNum < 0) {
+        HF_FsmSet(st, pagenum, HF_FsmCategory(st, pageBuf));
+        PF_UnfixPage(fd, pagenum, TRUE);
+        return slotNum;
+    }
+
+    // Set the output RID
+    rid->pageNum = pagenum;
+    rid->slotNum = slotNum;
+    st->lastPage = pagenum;
+    HF_ZoneAdd(st, pagenum, pageBuf, slotNum);
+    HF_ClusterNote(st, want != -2);
+    error = HF_FsmSet(st, pagenum, HF_FsmCategory(st, pageBuf));
+
+    // Mark the new page as dirty and unfix it
+    int unfixErr = PF_UnfixPage(fd, pagenum, TRUE);
+    if (unfixErr != PFE_OK) {
+        return unfixErr;
+    }
+    return error;
+}
+
+/*
+ * ======================================================
+ * Append-Only Files
+ * ======================================================
+ */
+
+/*
+ * True if page pagenum is a page of an append-only file that is still
+ * in memory.
+ */
+static int HF_AppendHas(HF_FileState *st, int pagenum) {
+    return st != NULL && pagenum >= st->appendFirst &&
+           pagenum < st->appendFirst + st->appendPages;
+}
+
+/*
+ * Fixes a page in the buffer pool, or finds it in memory if it is one
+ * of an append-only file's pages not yet written.
+ */
+static int HF_FixPage(int fd, HF_FileState *st, int pagenum, char **pageBuf) {
+    if (HF_AppendHas(st, pagenum)) {
+        *pageBuf = st->appendBuf + (long)(pagenum - st->appendFirst) * PF_PAGE_SIZE;
+        return PFE_OK;
+    }
+    return PF_GetThisPage(fd, pagenum, pageBuf);
+}
+
+static int HF_UnfixPage(int fd, HF_FileState *st, int pagenum, int dirty) {
+    if (HF_AppendHas(st, pagenum)) {
+        return PFE_OK;
+    }
+    return PF_UnfixPage(fd, pagenum, dirty);
+}
+
+/*
+ * The entry of an append-only file's tombstone table that holds rid,
+ * or the empty entry (pageNum -1) where it would go. The table is
+ * open-addressed and never more than half full.
+ */
+static RID *HF_TombSlot(HF_FileState *st, RID rid) {
+    unsigned h = (unsigned)rid.pageNum * 2654435761u ^ (unsigned)rid.slotNum;
+    int mask = st->tombCap - 1;
+
+    for (int i = (int)((h ^ h >> 16) & mask);; i = (i + 1) & mask) {
+        RID *t = &st->tomb[i];
+        if (t->pageNum == -1 || (t->pageNum == rid.pageNum && t->slotNum == rid.slotNum)) {
+            return t;
+        }
+    }
+}
+
+/*
+ * True if the record at rid is deleted but for its tombstone.
+ */
+static int HF_TombHas(HF_FileState *st, RID rid) {
+    return st->ntomb > 0 && HF_TombSlot(st, rid)->pageNum != -1;
+}
+
+/*
+ * Writes the pages of an append-only file that are still in memory to
+ * the end of the file, in one sequential write, and records them in
+ * the free-space map and the zone map. Their page numbers went out
+ * with their RIDs, so nothing else may add pages to the file while
+ * there are any.
+ */
+static int HF_AppendFlush(int fd, HF_FileState *st) {
+    int firstPage;
+    int error;
+
+    if (st->appendPages == 0) {
+        return HFE_OK;
+    }
+    if ((error = PF_AppendPages(fd, st->appendPages, st->appendBuf, &firstPage)) != PFE_OK) {
+        return error;
+    }
+    for (int i = 0; i < st->appendPages; i++) {
+        error = HF_NotePage(st, firstPage + i, st->appendBuf + (long)i * PF_PAGE_SIZE);
+        if (error != HFE_OK) {
+            return error;
+        }
+    }
+    st->lastPage = firstPage + st->appendPages - 1;
+    st->appendPages = 0;
+    return HFE_OK;
+}
+
+/*
+ * Inserts a record into an append-only file, on the tail page or on a
+ * new one. flags is as for HF_PutRec.
+ */
+static int HF_AppendRec(int fd, HF_FileState *st, char *record, int recLen, int flags,
+                        RID *rid) {
+    char *tail;
+    int slotNum = HFE_PAGENOFREE;
+    int error;
+
+    // 1. Try the tail page
+    if (st->appendPages > 0) {
+        tail = st->appendBuf + (long)(st->appendPages - 1) * PF_PAGE_SIZE;
+        slotNum = HF_PutRec(st, tail, NULL, record, recLen, flags);
+        if (slotNum == HFE_PAGENOFREE && HF_GetPageHeader(tail)->numSlots == 0) {
+            return slotNum;     // Larger than a page
+        }
+    }
+
+    // 2. Seal it and start a new one, first writing out the sealed
+    //    pages if there is no room for another
+    if (slotNum == HFE_PAGENOFREE) {
+        if (st->appendBuf == NULL &&
+            (st->appendBuf = malloc((long)HF_APPEND_PAGES * PF_PAGE_SIZE)) == NULL) {
+            return PFE_NOMEM;
+        }
+        if (st->appendPages == HF_APPEND_PAGES && (error = HF_AppendFlush(fd, st)) != HFE_OK) {
+            return error;
+        }
+        if (st->appendPages == 0) {
+            st->appendFirst = PF_NumPages(fd);
+        }
+        tail = st->appendBuf + (long)st->appendPages++ * PF_PAGE_SIZE;
+        HF_InitPageEx(&st->opts, tail);
+        if ((slotNum = HF_PutRec(st, tail, NULL, record, recLen, flags)) < 0) {
+            return slotNum;
+        }
+    }
+    rid->pageNum = st->appendFirst + st->appendPages - 1;
+    rid->slotNum = slotNum;
+    return HFE_OK;
+}
+
+/*
+ * Inserts a record into the file.
+ */
+static int HF_DoInsertRec(int fd, char *record, int recLen, RID *rid) {
+    HF_FileState *st = HF_GetFileState(fd);
+    HF_OverflowHead head;
+    int error;
+
+    if (st == NULL) {
+        return PFE_FD;
+    }
+    if (st->opts.layout == HF_LAYOUT_FIXED && recLen != st->opts.recLen) {
+        return HFE_BADOPTIONS;
+    }
+    if (recLen <= HF_MAX_INLINE || st->opts.layout != HF_LAYOUT_SLOTTED) {
+        if (st->opts.append) {
+            return HF_AppendRec(fd, st, record, recLen, 0, rid);
+        }
+        return HF_PlaceRec(fd, st, NULL, record, recLen, 0, rid);
+    }
+
+    // A long record goes to overflow pages; its slot gets their head.
+    // They may go at the end of the file, so an append-only file's
+    // pages in memory are written out first.
+    if (st->opts.append && (error = HF_AppendFlush(fd, st)) != HFE_OK) {
+        return error;
+    }
+    if ((error = HF_OverflowWrite(fd, record, recLen, &head)) != HFE_OK) {
+        return error;
+    }
+    if (st->opts.append) {
+        error = HF_AppendRec(fd, st, (char *)&head, sizeof(head), HF_SLOT_OVERFLOW, rid);
+    } else {
+        error = HF_PlaceRec(fd, st, NULL, (char *)&head, sizeof(head), HF_SLOT_OVERFLOW, rid);
+    }
+    if (error != HFE_OK) {
+        HF_OverflowFree(fd, head.firstPage);
+    }
+    return error;
+}
+
+/*
+ * Replaces the file dictionary. The new pages are written before the
+ * old ones are given back, so an error leaves the old dictionary.
+ */
+static int HF_DoSetDict(int fd, const char *data, int len) {
+    HF_FileState *st = HF_GetFileState(fd);
+    HF_OverflowHead head = { 0, -1 };
+    char *copy = NULL;
+    int error;
+
+    if (st == NULL) {
+        return PFE_FD;
+    }
+    if (st->legacy || len < 0) {
+        return HFE_BADOPTIONS;
+    }
+
+    // 1. Write the new pages. They may go at the end of the file, so
+    //    an append-only file's pages in memory are written out first.
+    if (len > 0) {
+        if ((copy = malloc(len)) == NULL) {
+            return PFE_NOMEM;
+        }
+        memcpy(copy, data, len);
+        if ((st->opts.append && (error = HF_AppendFlush(fd, st)) != HFE_OK) ||
+            (error = HF_OverflowWrite(fd, copy, len, &head)) != HFE_OK) {
+            free(copy);
+            return error;
+        }
+    }
+
+    // 2. Point the header at them and free the old ones
+    int oldPage = st->header.dictLen > 0 ? st->header.dictPage : -1;
+    st->header.dictLen = len;
+    st->header.dictPage = head.firstPage;
+    st->headerDirty = TRUE;
+    free(st->dict);
+    st->dict = copy;
+    return HF_OverflowFree(fd, oldPage);
+}
+
+/*
+ * Pages built by HF_BulkLoad before they are handed to
+ * PF_AppendPages in one go.
+ */
+#define HF_BULK_PAGES 64
+
+/*
+ * Appends finished data pages to the end of the file and
+ * records them in the free-space map and the zone map. If
+ * PF_AppendPages fails, none of the pages is in the file.
+ */
+static int HF_DoAppendPages(int fd, char *pages, int npages, int *firstPage) {
+    HF_FileState *st = HF_GetFileState(fd);
+    int error;
+
+    if (st == NULL) {
+        return PFE_FD;
+    }
+    *firstPage = -1;
+    if (npages == 0) {
+        return HFE_OK;
+    }
+    if ((error = PF_AppendPages(fd, npages, pages, firstPage)) != PFE_OK) {
+        return error;
+    }
+    for (int i = 0; i < npages; i++) {
+        if ((error = HF_NotePage(st, *firstPage + i, pages + i * PF_PAGE_SIZE)) != HFE_OK) {
+            return error;
+        }
+    }
+    st->lastPage = *firstPage + npages - 1;
+    return HFE_OK;
+}
+
+/*
+ * Appends the npages pages in pages[] to the file, then fixes up
+ * the RIDs of their records, which so far hold the page's index
+ * in pages[].
+ */
+static int HF_BulkFlush(int fd, char *pages, int npages,
+                        RID *rids, int firstRid, int numRids) {
+    int firstPage;
+    int error;
+
+    if ((error = HF_AppendPages(fd, pages, npages, &firstPage)) != HFE_OK) {
+        return error;
+    }
+    if (rids != NULL) {
+        for (int i = firstRid; i < numRids; i++) {
+            rids[i].pageNum += firstPage;
+        }
+    }
+    return HFE_OK;
+}
+
+/*
+ * Bulk-loads records into the file, packing them into new pages.
+ */
+int HF_BulkLoad(int fd, HF_RecordIter next, void *ctx, int fillFactor,
+                RID **rids, int *numRids) {
+    HF_FileState *st = HF_GetFileState(fd);
+    char *pages;        // HF_BULK_PAGES pages under construction
+    int npages = 0;     // Pages finished or in progress in pages[]
+    RID *ridArray = NULL;
+    int ridAlloc = 0;
+    int count = 0;
+    int flushed = 0;    // RIDs before this one have real page numbers
+    char *record;
+    int recLen;
+    int error = HFE_OK;
+    int more;
+
+    *numRids = 0;
+    if (rids != NULL) {
+        *rids = NULL;
+    }
+    if (st == NULL) {
+        return PFE_FD;
+    }
+    if (fillFactor < 1 || fillFactor > 100) {
+        fillFactor = 100;
+    }
+
+    // 1. Room a page must keep free to honour the fill factor
+    int reserve = PF_PAGE_SIZE * (100 - fillFactor) / 100;
+
+    if ((pages = malloc(HF_BULK_PAGES * PF_PAGE_SIZE)) == NULL) {
+        return PFE_NOMEM;
+    }
+
+    while ((more = next(ctx, &record, &recLen)) > 0) {
+        char *pageBuf = npages > 0 ? pages + (npages - 1) * PF_PAGE_SIZE : NULL;
+        HF_OverflowHead head;
+        int flags = 0;
+
+        // 2. A long record goes to overflow pages now; the page being
+        //    built gets their head
+        if (recLen > HF_MAX_INLINE && st->opts.layout == HF_LAYOUT_SLOTTED) {
+            if ((error = HF_OverflowWrite(fd, record, recLen, &head)) != HFE_OK) {
+                break;
+            }
+            record = (char *)&head;
+            recLen = sizeof(head);
+            flags = HF_SLOT_OVERFLOW;
+        }
+
+        // 3. Start a new page if there is none, or the record would
+        //    push the current one past the fill factor (a short record
+        //    on a slotted page is padded to sizeof(RID))
+        int bytes = st->opts.layout == HF_LAYOUT_SLOTTED && recLen < (int)sizeof(RID) ?
+                    (int)sizeof(RID) : recLen;
+        if (npages == 0 || HF_Page_FreeSpaceEx(&st->opts, pageBuf) - bytes < reserve) {
+            if (npages == HF_BULK_PAGES) {
+                error = HF_BulkFlush(fd, pages, npages, ridArray, flushed, count);
+                if (error != HFE_OK) {
+                    npages = 0;     // Not worth retrying below
+                    break;
+                }
+                flushed = count;
+                npages = 0;
+            }
+            pageBuf = pages + npages * PF_PAGE_SIZE;
+            memset(pageBuf, 0, PF_PAGE_SIZE);
+            HF_InitPageEx(&st->opts, pageBuf);
+            npages++;
+        }
+
+        // 4. Make room for its RID
+        if (rids != NULL && count == ridAlloc) {
+            int newAlloc = ridAlloc ? 2 * ridAlloc : 1024;
+            RID *a = realloc(ridArray, newAlloc * sizeof(RID));
+            if (a == NULL) {
+                error = PFE_NOMEM;
+                if (flags != 0) {
+                    HF_OverflowFree(fd, head.firstPage);
+                }
+                break;
+            }
+            ridArray = a;
+            ridAlloc = newAlloc;
+        }
+
+        // 5. Put the record on the page. This only fails if the
+        //    record is larger than an empty PAX page.
+        int slotNum = HF_Page_InsertRecEx(&st->opts, pageBuf, record, recLen);
+        if (slotNum < 0) {
+            error = slotNum;
+            break;
+        }
+        if (flags != 0) {
+            HF_GetSlotArray(pageBuf)[slotNum].length |= flags;
+        }
+
+        // The page number is fixed up at flush time
+        if (rids != NULL) {
+            ridArray[count].pageNum = npages - 1;
+            ridArray[count].slotNum = slotNum;
+        }
+        count++;
+    }
+    if (more < 0 && error == HFE_OK) {
+        error = more;
+    }
+
+    // 6. Write out the last batch. This is done after an error too,
+    //    so that the records before it end up in the file. A failed
+    //    append adds no pages, so its records are simply not counted.
+    if (npages > 0 && HF_GetPageHeader(pages + (npages - 1) * PF_PAGE_SIZE)->numSlots == 0) {
+        npages--;
+    }
+    if (npages > 0) {
+        int flushError = HF_BulkFlush(fd, pages, npages, ridArray, flushed, count);
+        if (flushError == HFE_OK) {
+            flushed = count;
+        } else if (error == HFE_OK) {
+            error = flushError;
+        }
+    }
+    free(pages);
+
+    *numRids = flushed;
+    if (rids != NULL) {
+        *rids = ridArray;
+    } else {
+        free(ridArray);
+    }
+    return error;
+}
+
+/*
+ * Deletes the moved copy of a record. If head is not NULL, it gets
+ * the copy's HF_OverflowHead if the record is long.
+ */
+static int HF_DeleteCopy(int fd, HF_FileState *st, RID copy, HF_OverflowHead *head) {
+    HF_ZoneRow row;
+    char *pageBuf;
+    int error;
+
+    if ((error = PF_GetThisPage(fd, copy.pageNum, &pageBuf)) != PFE_OK) {
+        return error;
+    }
+    if (head != NULL) {
+        HF_Page_GetOverflow(pageBuf, copy.slotNum, head);
+    }
+    int known = st->opts.nzone > 0 && HF_ZoneRowOf(st, pageBuf, copy.slotNum, &row) == HFE_OK;
+    error = HF_Page_DeleteRec(pageBuf, copy.slotNum);
+    if (error == HFE_OK && st->opts.nzone > 0) {
+        HF_ZoneDrop(st, copy.pageNum, pageBuf, known ? &row : NULL);
+    }
+    HF_FsmSet(st, copy.pageNum, HF_FsmCategory(st, pageBuf));
+    int unfixErr = PF_UnfixPage(fd, copy.pageNum, TRUE);
+    if (unfixErr != PFE_OK) {
+        return unfixErr;
+    }
+    return error;
+}
+
+/*
+ * Deletes a record from the file, given its RID. The page may be one
+ * of an append-only file's pages in memory; its maps are worked out
+ * when it is written.
+ */
+static int HF_DeleteAt(int fd, HF_FileState *st, RID rid) {
+    HF_OverflowHead head = { 0, -1 };
+    HF_ZoneRow row;
+    char *pageBuf;
+    int forward = FALSE;
+    RID copy;
+    int error;
+    
+    // 1. Get the specific page the record is on, and what the record
+    //    adds to the zone map
+    if ((error = HF_FixPage(fd, st, rid.pageNum, &pageBuf)) != PFE_OK) {
+        return error;
+    }
+    int inMemory = HF_AppendHas(st, rid.pageNum);
+    int zoned = st != NULL && st->opts.nzone > 0 && !inMemory;
+    int known = zoned && HF_ZoneRowOf(st, pageBuf, rid.slotNum, &row) == HFE_OK;
+    
+    // 2. Call our page-level delete function. A moved copy is only
+    //    deleted through its home slot.
+    if (st != NULL && st->opts.layout == HF_LAYOUT_PAX) {
+        error = HF_PaxPage_DeleteRec(pageBuf, rid.slotNum);
+    } else if (st != NULL && st->opts.layout == HF_LAYOUT_FIXED) {
+        error = HF_FixedPage_DeleteRec(pageBuf, rid.slotNum);
+    } else if (HF_Page_GetHome(pageBuf, rid.slotNum, &copy) == HFE_OK) {
+        error = HFE_INVALIDSLOT;
+    } else {
+        forward = HF_Page_GetForward(pageBuf, rid.slotNum, &copy) == HFE_OK;
+        HF_Page_GetOverflow(pageBuf, rid.slotNum, &head);
+        error = HF_Page_DeleteRec(pageBuf, rid.slotNum);
+    }
+
+    // Keep the free-space map and zone map in step with the page
+    if (st != NULL && error == HFE_OK && !inMemory) {
+        if (zoned) {
+            HF_ZoneDrop(st, rid.pageNum, pageBuf, known ? &row : NULL);
+        }
+        HF_FsmSet(st, rid.pageNum, HF_FsmCategory(st, pageBuf));
+    }
+    
+    // 3. Mark the page as dirty and unfix it
+    if (HF_UnfixPage(fd, st, rid.pageNum, TRUE) != PFE_OK) {
+        return PFE_UNIX; // Return a generic error if unfix fails
+    }
+
+    // 4. A forwarded record's moved copy goes too, and a long record's
+    //    overflow pages
+    if (error == HFE_OK && forward && st != NULL) {
+        error = HF_DeleteCopy(fd, st, copy, &head);
+    }
+    if (error == HFE_OK) {
+        error = HF_OverflowFree(fd, head.firstPage);
+    }
+    
+    return error; // Return result of HF_DeleteRec
+}
+
+/*
+ * Retrieves a record from the file, given its RID.
+ *
+ * Outputs:
+ * record: Pointer to the record data *within the buffer page*
+ * recLen: Length of the record
+ * head: Set instead for a long record, with HFE_OVERFLOW returned
+ *
+ * WARNING: The 'record' pointer is only valid until the page
+ * is unfixed. The caller must copy the data if needed.
+ */
+static int HF_LookupRec(int fd, RID rid, char **record, int *recLen, HF_OverflowHead *head) {
+    HF_FileState *st = HF_GetFileState(fd);
+    char *pageBuf;
+    int forward = FALSE;
+    RID copy;
+    int error;
+
+    // 1. Get the specific page the record is on, unless the record is
+    //    deleted but for its tombstone
+    if (st != NULL && HF_TombHas(st, rid)) {
+        return HFE_INVALIDSLOT;
+    }
+    if ((error = HF_FixPage(fd, st, rid.pageNum, &pageBuf)) != PFE_OK) {
+        return error;
+    }
+
+    // 2. Call our page-level get function. A PAX record is rebuilt
+    //    in the file's buffer, since it is not in one piece on the page.
+    if (st != NULL && st->opts.layout == HF_LAYOUT_PAX) {
+        if ((*record = HF_RowBuf(st)) == NULL) {
+            error = PFE_NOMEM;
+        } else {
+            error = HF_PaxPage_GetRec(pageBuf, st->opts.sep, rid.slotNum, *record, recLen);
+        }
+    } else if (st != NULL && st->opts.layout == HF_LAYOUT_FIXED) {
+        error = HF_FixedPage_GetRec(pageBuf, rid.slotNum, record, recLen);
+    } else if (HF_Page_GetForward(pageBuf, rid.slotNum, &copy) == HFE_OK) {
+        forward = TRUE;
+    } else if (HF_Page_GetHome(pageBuf, rid.slotNum, &copy) == HFE_OK) {
+        error = HFE_INVALIDSLOT;    // Only found through its home slot
+    } else {
+        error = HF_Page_GetRec(pageBuf, rid.slotNum, record, recLen);
+    }
+    if (error == HFE_OVERFLOW) {
+        memcpy(head, *record, sizeof(HF_OverflowHead));
+    }
+
+    // 3. Unfix the page (it wasn't modified)
+    if (HF_UnfixPage(fd, st, rid.pageNum, FALSE) != PFE_OK) {
+        return PFE_UNIX;
+    }
+
+    // 4. Follow a forwarding slot to the moved copy; there is only one hop
+    if (forward) {
+        if ((error = PF_GetThisPage(fd, copy.pageNum, &pageBuf)) != PFE_OK) {
+            return error;
+        }
+        error = HF_Page_GetRec(pageBuf, copy.slotNum, record, recLen);
+        if (error == HFE_OVERFLOW) {
+            memcpy(head, *record, sizeof(HF_OverflowHead));
+        }
+        if (PF_UnfixPage(fd, copy.pageNum, FALSE) != PFE_OK) {
+            return PFE_UNIX;
+        }
+    }
+
+    return error; // Return result of HF_Page_GetRec
+}
+
+/*
+ * Retrieves a record from the file; a long one is put together in
+ * the file's buffer.
+ */
+static int HF_DoGetRec(int fd, RID rid, char **record, int *recLen) {
+    HF_FileState *st = HF_GetFileState(fd);
+    HF_OverflowHead head;
+
+    int error = HF_LookupRec(fd, rid, record, recLen, &head);
+    if (error != HFE_OVERFLOW || st == NULL) {
+        return error;
+    }
+    if ((error = HF_OverflowGet(fd, &head, &st->ovfBuf, &st->ovfCap)) != HFE_OK) {
+        return error;
+    }
+    *record = st->ovfBuf;
+    *recLen = head.length;
+    return HFE_OK;
+}
+
+/*
+ * ======================================================
+ * Tombstones
+ * ======================================================
+ */
+
+static int HF_RidCmp(const void *a, const void *b) {
+    const RID *x = a, *y = b;
+    if (x->pageNum != y->pageNum) {
+        return x->pageNum < y->pageNum ? -1 : 1;
+    }
+    return x->slotNum < y->slotNum ? -1 : x->slotNum > y->slotNum;
+}
+
+/*
+ * Puts a RID in the tombstone table, which must have room for it.
+ */
+static void HF_TombPut(HF_FileState *st, RID rid) {
+    RID *t = HF_TombSlot(st, rid);
+    if (t->pageNum == -1) {
+        *t = rid;
+        st->ntomb++;
+    }
+}
+
+/*
+ * Carries out the deletes kept as tombstones, in page order, so that
+ * each page is fixed and written once. applied (may be NULL) is added
+ * the number of them. After an error, the deletes not carried out are
+ * kept.
+ */
+static int HF_TombApply(int fd, HF_FileState *st, int *applied) {
+    int n = 0;
+    int error = HFE_OK;
+
+    if (st->ntomb == 0) {
+        return HFE_OK;
+    }
+
+    // 1. Take the RIDs out of the table and sort them
+    RID *rids = malloc(st->ntomb * sizeof(RID));
+    if (rids == NULL) {
+        return PFE_NOMEM;
+    }
+    for (int i = 0; i < st->tombCap; i++) {
+        if (st->tomb[i].pageNum != -1) {
+            rids[n++] = st->tomb[i];
+        }
+    }
+    qsort(rids, n, sizeof(RID), HF_RidCmp);
+    memset(st->tomb, 0xff, st->tombCap * sizeof(RID));
+    st->ntomb = 0;
+
+    // 2. Delete the records
+    int k = 0;
+    while (k < n && (error = HF_DeleteAt(fd, st, rids[k])) == HFE_OK) {
+        k++;
+    }
+    if (applied != NULL) {
+        *applied += k;
+    }
+    for (int j = k; error != HFE_OK && j < n; j++) {
+        HF_TombPut(st, rids[j]);
+    }
+    free(rids);
+    return error;
+}
+
+/*
+ * Deletes a record of an append-only file by giving it a tombstone.
+ * The record's page is only read, to check that there is a record.
+ */
+static int HF_TombAdd(int fd, HF_FileState *st, RID rid) {
+    HF_OverflowHead head;
+    char *record;
+    int recLen;
+
+    // 1. Check the record, as a delete in place would
+    int error = HF_LookupRec(fd, rid, &record, &recLen, &head);
+    if (error != HFE_OK && error != HFE_OVERFLOW) {
+        return error;
+    }
+
+    // 2. Grow the table to keep it at most half full
+    if (2 * (st->ntomb + 1) > st->tombCap) {
+        int oldCap = st->tombCap;
+        RID *old = st->tomb;
+        int cap = oldCap ? 2 * oldCap : 1024;
+        if ((st->tomb = malloc(cap * sizeof(RID))) == NULL) {
+            st->tomb = old;
+            return PFE_NOMEM;
+        }
+        memset(st->tomb, 0xff, cap * sizeof(RID));
+        st->tombCap = cap;
+        st->ntomb = 0;
+        for (int i = 0; i < oldCap; i++) {
+            if (old[i].pageNum != -1) {
+                HF_TombPut(st, old[i]);
+            }
+        }
+        free(old);
+    }
+    HF_TombPut(st, rid);
+
+    // 3. Carry the deletes out before they take up too much memory
+    if (st->ntomb >= HF_APPEND_TOMBS) {
+        return HF_TombApply(fd, st, NULL);
+    }
+    return HFE_OK;
+}
+
+/*
+ * Brings the pages of an append-only file up to date: writes out the
+ * pages in memory and carries out the tombstones. applied is as for
+ * HF_TombApply. Does nothing for other files.
+ */
+static int HF_AppendSync(int fd, HF_FileState *st, int *applied) {
+    int error = HF_AppendFlush(fd, st);
+    if (error == HFE_OK) {
+        error = HF_TombApply(fd, st, applied);
+    }
+    return error;
+}
+
+/*
+ * Deletes a record from the file, given its RID. In an append-only
+ * file that no scan has open, a record on a page already written only
+ * gets a tombstone.
+ */
+static int HF_DoDeleteRec(int fd, RID rid) {
+    HF_FileState *st = HF_GetFileState(fd);
+
+    if (st != NULL && st->opts.append && st->activeScans == 0 &&
+        !HF_AppendHas(st, rid.pageNum)) {
+        return HF_TombAdd(fd, st, rid);
+    }
+    return HF_DeleteAt(fd, st, rid);
+}
+
+/*
+ * Starts reading a record a piece at a time.
+ */
+static int HF_DoOpenRecStream(int fd, RID rid, HF_RecStream *rs) {
+    HF_OverflowHead head;
+    char *record;
+    int recLen;
+
+    int error = HF_LookupRec(fd, rid, &record, &recLen, &head);
+    rs->fd = fd;
+    rs->rid = rid;
+    rs->pos = 0;
+    rs->pageOff = 0;
+    if (error == HFE_OVERFLOW) {
+        rs->length = head.length;
+        rs->page = head.firstPage;
+        return HFE_OK;
+    }
+    rs->length = recLen;
+    rs->page = -1;
+    return error;
+}
+
+/*
+ * Reads the next piece of a record: from its overflow pages, or for a
+ * record kept in its slot, from the slot (looked up again each time).
+ */
+static int HF_DoReadRecStream(HF_RecStream *rs, char *buf, int max) {
+    HF_OverflowHead head;
+    char *record;
+    int recLen;
+    int error;
+
+    int n = rs->length - rs->pos < max ? rs->length - rs->pos : max;
+    if (n <= 0) {
+        return 0;
+    }
+    if (rs->page >= 0) {
+        error = HF_OverflowCopy(rs->fd, &rs->page, &rs->pageOff, buf, n);
+    } else if ((error = HF_LookupRec(rs->fd, rs->rid, &record, &recLen, &head)) == HFE_OK) {
+        if (recLen != rs->length) {
+            return HFE_INVALIDSLOT;     // The record changed
+        }
+        memcpy(buf, record + rs->pos, n);
+    } else if (error == HFE_OVERFLOW) {
+        error = HFE_INVALIDSLOT;
+    }
+    if (error != HFE_OK) {
+        return error;
+    }
+    rs->pos += n;
+    return n;
+}
+
+/*
+ * Puts new bytes for a record in its slots, keeping its RID: record is
+ * the HF_OverflowHead of a long record if flags is HF_SLOT_OVERFLOW.
+ * old gets the HF_OverflowHead the record had before, if it was long.
+ */
+static int HF_UpdateSlots(int fd, HF_FileState *st, RID rid, char *record, int recLen,
+                          int flags, HF_OverflowHead *old) {
+    char *pageBuf;
+    int forward = FALSE;
+    RID copy, newCopy;
+    int error;
+
+    // 1. Rewrite the record in its home slot if it fits there; a
+    //    forwarded record that fits again comes home
+    if ((error = PF_GetThisPage(fd, rid.pageNum, &pageBuf)) != PFE_OK) {
+        return error;
+    }
+    if (HF_Page_GetHome(pageBuf, rid.slotNum, &copy) == HFE_OK) {
+        error = HFE_INVALIDSLOT;    // A moved copy is updated through its home
+    } else {
+        forward = HF_Page_GetForward(pageBuf, rid.slotNum, &copy) == HFE_OK;
+        HF_Page_GetOverflow(pageBuf, rid.slotNum, old);
+        error = HF_Page_UpdateSlot(pageBuf, rid.slotNum, record, recLen, flags);
+    }
+    HF_NotePage(st, rid.pageNum, pageBuf);
+    int unfixErr = PF_UnfixPage(fd, rid.pageNum, error == HFE_OK);
+    if (unfixErr != PFE_OK) {
+        return unfixErr;
+    }
+    if (error == HFE_OK) {
+        return forward ? HF_DeleteCopy(fd, st, copy, old) : HFE_OK;
+    }
+    if (error != HFE_PAGENOFREE) {
+        return error;
+    }
+
+    // 2. A forwarded record is rewritten in its copy if it fits there
+    if (forward) {
+        if ((error = PF_GetThisPage(fd, copy.pageNum, &pageBuf)) != PFE_OK) {
+            return error;
+        }
+        HF_Page_GetOverflow(pageBuf, copy.slotNum, old);
+        error = HF_Page_UpdateSlot(pageBuf, copy.slotNum, record, recLen, flags);
+        HF_NotePage(st, copy.pageNum, pageBuf);
+        int unfixErr = PF_UnfixPage(fd, copy.pageNum, error == HFE_OK);
+        if (unfixErr != PFE_OK) {
+            return unfixErr;
+        }
+        if (error != HFE_PAGENOFREE) {
+            return error;
+        }
+    }
+
+    // 3. Otherwise it gets a new copy, and the home slot forwards there
+    if ((error = HF_PlaceRec(fd, st, &rid, record, recLen, flags, &newCopy)) != HFE_OK) {
+        return error;
+    }
+    if ((error = PF_GetThisPage(fd, rid.pageNum, &pageBuf)) != PFE_OK) {
+        return error;
+    }
+    error = HF_Page_SetForward(pageBuf, rid.slotNum, newCopy);
+    HF_NotePage(st, rid.pageNum, pageBuf);
+    unfixErr = PF_UnfixPage(fd, rid.pageNum, error == HFE_OK);
+    if (unfixErr != PFE_OK) {
+        return unfixErr;
+    }
+    if (error != HFE_OK) {
+        // No room left even for the forward (a record under sizeof(RID)
+        // bytes, inserted before slots were padded, on a full page):
+        // keep the old record
+        HF_DeleteCopy(fd, st, newCopy, NULL);
+        return error;
+    }
+    return forward ? HF_DeleteCopy(fd, st, copy, NULL) : HFE_OK;
+}
+
+/*
+ * Overwrites a record of a fixed-length file; the new version always
+ * fits in the record's slot.
+ */
+static int HF_UpdateFixed(int fd, HF_FileState *st, RID rid, char *record, int recLen) {
+    char *pageBuf;
+    int error;
+
+    if ((error = PF_GetThisPage(fd, rid.pageNum, &pageBuf)) != PFE_OK) {
+        return error;
+    }
+    error = HF_FixedPage_UpdateRec(pageBuf, rid.slotNum, record, recLen);
+    if (error == HFE_OK) {
+        HF_NotePage(st, rid.pageNum, pageBuf);
+    }
+    int unfixErr = PF_UnfixPage(fd, rid.pageNum, error == HFE_OK);
+    if (unfixErr != PFE_OK) {
+        return unfixErr;
+    }
+    return error;
+}
+
+/*
+ * Replaces a record, keeping its RID.
+ */
+static int HF_DoUpdateRec(int fd, RID rid, char *record, int recLen) {
+    HF_FileState *st = HF_GetFileState(fd);
+    HF_OverflowHead fresh = { 0, -1 };
+    HF_OverflowHead old = { 0, -1 };
+    int flags = 0;
+    int error;
+
+    if (st == NULL) {
+        return PFE_FD;
+    }
+    if (st->opts.layout == HF_LAYOUT_PAX) {
+        return HFE_BADOPTIONS;
+    }
+
+    // An append-only file's pages in memory are written out first, as
+    // the record may move to another page
+    if (HF_TombHas(st, rid)) {
+        return HFE_INVALIDSLOT;
+    }
+    if ((error = HF_AppendFlush(fd, st)) != HFE_OK) {
+        return error;
+    }
+    if (st->opts.layout == HF_LAYOUT_FIXED) {
+        return HF_UpdateFixed(fd, st, rid, record, recLen);
+    }
+
+    // 1. A long record goes to new overflow pages; its slots get their head
+    if (recLen > HF_MAX_INLINE) {
+        if ((error = HF_OverflowWrite(fd, record, recLen, &fresh)) != HFE_OK) {
+            return error;
+        }
+        record = (char *)&fresh;
+        recLen = sizeof(fresh);
+        flags = HF_SLOT_OVERFLOW;
+    }
+
+    // 2. Replace the record; then the overflow pages of the old one, or
+    //    of the new one if it did not go in, are freed
+    error = HF_UpdateSlots(fd, st, rid, record, recLen, flags, &old);
+    if (error != HFE_OK) {
+        HF_OverflowFree(fd, fresh.firstPage);
+        return error;
+    }
+    return HF_OverflowFree(fd, old.firstPage);
+}
+
+/*
+ * ======================================================
+ * File Scan Function Implementations
+ * ======================================================
+ */
+
+/*
+ * Opens a new file scan.
+ *
+ * Initializes the scan struct to start from the beginning
+ * of the file.
+ */
+int HF_OpenFileScan(int fd, HF_Scan *scan) {
+    // Store the file descriptor
+    scan->fd = fd;
+
+    // Keep the vacuum away while the scan is open. An append-only
+    // file's pages are brought up to date for it first.
+    pthread_mutex_lock(&HFlatch);
+    HF_FileState *st = HF_GetFileState(fd);
+    int error = st != NULL ? HF_AppendSync(fd, st, NULL) : HFE_OK;
+    if (st != NULL && error == HFE_OK) {
+        st->activeScans++;
+    }
+    pthread_mutex_unlock(&HFlatch);
+    if (error != HFE_OK) {
+        return error;
+    }
+    
+    // Start the scan *before* the first page
+    scan->currentPageNum = -1; 
+    
+    // No record has been found yet
+    scan->currentSlotNum = -1;
+    
+    // No page is pinned in the buffer yet
+    scan->currentPageBuf = NULL;
+
+    // Every record matches, and is returned whole
+    scan->hasSpec = FALSE;
+    scan->spec.npreds = 0;
+    scan->spec.nproj = 0;
+    scan->batchPageDone = FALSE;
+    scan->maxCol = 0;
+
+    // No long record has been put together yet
+    scan->ovfBuf = NULL;
+    scan->ovfCap = 0;
+    scan->ovfPage = -1;
+    scan->rowBuf = NULL;
+
+    // No zone map is consulted
+    scan->useZones = FALSE;
+    
+    return HFE_OK;
+}
+
+/*
+ * Opens a file scan with predicates and a projection.
+ */
+int HF_OpenFileScanEx(int fd, HF_Scan *scan, const HF_ScanSpec *spec) {
+    int maxCol = 0;
+
+    // 1. Check the spec; columns must fit HF_SplitRecord's arrays
+    if (spec->npreds < 0 || spec->npreds > HF_MAX_PREDS ||
+        spec->nproj < 0 || spec->nproj > HF_MAX_PROJ) {
+        return HFE_BADOPTIONS;
+    }
+    for (int k = 0; k < spec->npreds + spec->nproj; k++) {
+        int col = k < spec->npreds ? spec->preds[k].col : spec->proj[k - spec->npreds];
+        if (col < 0 || col >= HF_MAX_PROJ) {
+            return HFE_BADOPTIONS;
+        }
+        if (col > maxCol) {
+            maxCol = col;
+        }
+    }
+
+    // 2. A plain scan that remembers the spec
+    int error = HF_OpenFileScan(fd, scan);
+    if (error != HFE_OK) {
+        return error;
+    }
+    scan->hasSpec = TRUE;
+    scan->maxCol = maxCol;
+    scan->spec = *spec;
+
+    // 3. Numeric predicates on zone columns let it skip pages
+    HF_FileState *st = HF_GetFileState(fd);
+    for (int k = 0; st != NULL && k < spec->npreds; k++) {
+        for (int z = 0; z < st->opts.nzone; z++) {
+            if (spec->preds[k].numeric && spec->preds[k].col == st->opts.zoneCols[z]) {
+                scan->useZones = TRUE;
+            }
+        }
+    }
+    return HFE_OK;
+}
+
+/*
+ * The RID a scan returns for a slot: the home RID of a moved copy,
+ * else the slot's own.
+ */
+static void HF_ScanRid(HF_FileState *st, char *pageBuf, int pagenum, int slot, RID *rid) {
+    if (st->opts.layout != HF_LAYOUT_SLOTTED || HF_Page_GetHome(pageBuf, slot, rid) != HFE_OK) {
+        rid->pageNum = pagenum;
+        rid->slotNum = slot;
+    }
+}
+
+/*
+ * The record in a slot of the scan's current slotted or fixed-length
+ * page. A long one is put together in the scan's buffer, which keeps
+ * it until the scan moves on.
+ */
+static int HF_ScanRecord(HF_Scan *scan, int slot, char **record, int *recLen) {
+    HF_OverflowHead head;
+
+    int error = HF_SlotRec(HF_GetFileState(scan->fd), scan->currentPageBuf, slot,
+                           record, recLen);
+    if (error != HFE_OVERFLOW) {
+        return error;
+    }
+    if (scan->ovfPage != scan->currentPageNum || scan->ovfSlot != slot) {
+        memcpy(&head, *record, sizeof(head));
+        scan->ovfPage = -1;
+        if ((error = HF_OverflowGet(scan->fd, &head, &scan->ovfBuf, &scan->ovfCap)) != HFE_OK) {
+            return error;
+        }
+        scan->ovfPage = scan->currentPageNum;
+        scan->ovfSlot = slot;
+        scan->ovfLen = head.length;
+    }
+    *record = scan->ovfBuf;
+    *recLen = scan->ovfLen;
+    return HFE_OK;
+}
+
+/*
+ * The next slot of the scan's current page that the scan returns:
+ * the next live one, or the next matching one for HF_OpenFileScanEx.
+ * Returns HFE_EOF at the end of the page, or an error code if a long
+ * record could not be read.
+ */
+static int HF_ScanNextSlot(HF_FileState *st, HF_Scan *scan) {
+    char *pageBuf = scan->currentPageBuf;
+    int cur = scan->currentSlotNum;
+    char *record;
+    int recLen;
+
+    scan->ovfPage = -1;
+    if (st != NULL && st->opts.layout == HF_LAYOUT_PAX) {
+        return scan->hasSpec ? HF_PaxPage_GetNextMatch(pageBuf, cur, &scan->spec)
+                             : HF_PaxPage_NextSlot(pageBuf, cur);
+    }
+    if (st != NULL && st->opts.layout == HF_LAYOUT_FIXED) {
+        while ((cur = HF_FixedPage_NextSlot(pageBuf, cur)) >= 0 && scan->hasSpec) {
+            HF_FixedPage_GetRec(pageBuf, cur, &record, &recLen);
+            if (HF_RecMatch(&scan->spec, scan->maxCol, st->opts.sep, record, recLen)) {
+                break;
+            }
+        }
+        return cur;
+    }
+    if (scan->hasSpec) {
+        char sep = st != NULL ? st->opts.sep : HF_DEFAULT_SEP;
+        // Long records come back unchecked; they are checked whole here
+        while ((cur = HF_Page_GetNextMatch(pageBuf, cur, &scan->spec, scan->maxCol, sep)) >= 0 &&
+               HF_Page_GetRec(pageBuf, cur, &record, &recLen) == HFE_OVERFLOW) {
+            int error = HF_ScanRecord(scan, cur, &record, &recLen);
+            if (error != HFE_OK) {
+                return error;
+            }
+            if (HF_RecMatch(&scan->spec, scan->maxCol, sep, record, recLen)) {
+                break;
+            }
+        }
+        return cur;
+    }
+    return HF_Page_GetNextRec(pageBuf, cur, &record, &recLen);
+}
+
+/*
+ * Copies the projected record at the scan's position to out, which
+ * has room for cap bytes. Returns its length, HFE_PAGENOFREE if it
+ * does not fit, or another error code if a long record could not be
+ * read.
+ */
+static int HF_ProjectRow(HF_FileState *st, HF_Scan *scan, char *out, int cap) {
+    char *pageBuf = scan->currentPageBuf;
+    int slot = scan->currentSlotNum;
+    int pax = st->opts.layout == HF_LAYOUT_PAX;
+    int start[HF_MAX_PROJ];
+    int flen[HF_MAX_PROJ];
+    char *record = NULL;
+    int recLen = 0;
+    int nf = 0;
+    int n = 0;
+    int error;
+
+    // 1. Whole records are copied as they are
+    if (scan->spec.nproj == 0) {
+        if (pax) {
+            if (cap < PF_PAGE_SIZE + HF_PAX_MAX_COLS) {
+                return HFE_PAGENOFREE;
+            }
+            HF_PaxPage_GetRec(pageBuf, st->opts.sep, slot, out, &recLen);
+            return recLen;
+        }
+        if ((error = HF_ScanRecord(scan, slot, &record, &recLen)) != HFE_OK) {
+            return error;
+        }
+        if (recLen > cap) {
+            return HFE_PAGENOFREE;
+        }
+        memcpy(out, record, recLen);
+        return recLen;
+    }
+
+    // 2. Otherwise the columns of proj[], in that order
+    if (!pax) {
+        if ((error = HF_ScanRecord(scan, slot, &record, &recLen)) != HFE_OK) {
+            return error;
+        }
+        nf = HF_SplitRecord(record, recLen, st->opts.sep, scan->maxCol + 1, start, flen);
+    }
+    for (int j = 0; j < scan->spec.nproj; j++) {
+        int col = scan->spec.proj[j];
+        char *field = NULL;
+        int len = 0;
+        if (pax) {
+            if (HF_PaxPage_GetField(pageBuf, slot, col, &field, &len) != HFE_OK) {
+                len = 0;
+            }
+        } else if (col < nf) {
+            field = record + start[col];
+            len = flen[col];
+        }
+        if (n + (j > 0) + len > cap) {
+            return HFE_PAGENOFREE;
+        }
+        if (j > 0) {
+            out[n++] = st->opts.sep;
+        }
+        memcpy(out + n, field, len);
+        n += len;
+    }
+    return n;
+}
+
+/*
+ * Fills a batch with the next matching, projected records.
+ */
+int HF_GetNextRows(HF_Scan *scan, HF_RowBatch *batch) {
+    HF_FileState *st = HF_GetFileState(scan->fd);
+    int used = 0;
+    int error;
+
+    batch->n = 0;
+    if (st == NULL) {
+        return PFE_FD;
+    }
+    while (batch->n < HF_BATCH_ROWS) {
+        // 1. Take the next record of the current page, if it fits
+        if (scan->currentPageBuf != NULL) {
+            int slot = HF_ScanNextSlot(st, scan);
+            if (slot >= 0) {
+                int saved = scan->currentSlotNum;
+                scan->currentSlotNum = slot;
+                int len = HF_ProjectRow(st, scan, batch->buf + used, HF_BATCH_BYTES - used);
+                if (len == HFE_PAGENOFREE) {
+                    // Full: this record starts the next batch
+                    scan->currentSlotNum = saved;
+                    return batch->n > 0 ? HFE_OK : HFE_PAGENOFREE;
+                }
+                if (len < 0) {
+                    return len;
+                }
+                HF_ScanRid(st, scan->currentPageBuf, scan->currentPageNum, slot,
+                           &batch->rid[batch->n]);
+                batch->off[batch->n] = used;
+                batch->len[batch->n] = len;
+                batch->n++;
+                used += len;
+                continue;
+            }
+            if (slot != HFE_EOF) {
+                return slot;
+            }
+            if ((error = PF_UnfixPage(scan->fd, scan->currentPageNum, FALSE)) != PFE_OK) {
+                return error;
+            }
+            scan->currentPageBuf = NULL;
+        }
+
+        // 2. Move on to the next page the zone map does not rule out
+        HF_ScanSkip(st, scan);
+        error = PF_GetNextPage(scan->fd, &scan->currentPageNum, &scan->currentPageBuf);
+        if (error == PFE_EOF) {
+            break;
+        }
+        if (error != PFE_OK) {
+            return error;
+        }
+        scan->currentSlotNum = -1;
+    }
+    return batch->n > 0 ? HFE_OK : HFE_EOF;
+}
+
+/*
+ * Closes a file scan.
+ *
+ * This function must be called to unfix the last page
+ * that the scanner was looking at.
+ */
+int HF_CloseFileScan(HF_Scan *scan) {
+    int error;
+    
+    // Check if a page is still pinned in the buffer
+    if (scan->currentPageBuf != NULL) {
+        // Unfix it (it wasn't modified)
+        error = PF_UnfixPage(scan->fd, scan->currentPageNum, FALSE);
+        if (error != PFE_OK) {
+            return error;
+        }
+    }
+    
+    // The vacuum may run again once no scan is open
+    pthread_mutex_lock(&HFlatch);
+    HF_FileState *st = HF_GetFileState(scan->fd);
+    if (st != NULL && st->activeScans > 0) {
+        st->activeScans--;
+    }
+    pthread_mutex_unlock(&HFlatch);
+
+    // Reset the scan struct
+    free(scan->ovfBuf);
+    scan->ovfBuf = NULL;
+    scan->ovfCap = 0;
+    free(scan->rowBuf);
+    scan->rowBuf = NULL;
+    scan->fd = -1;
+    scan->currentPageBuf = NULL;
+    
+    return HFE_OK;
+}
+
+/*
  * Retrieves the next valid record in the file scan.
  */
-int HF_GetNextRec(int fd, HF_Scan *scan, RID *rid, char **record, int *recLen) {
+int HF_GetNextRec(int fd, HF_Scan *scan, RID *rid, char **record, int *recLen) {
+    HF_FileState *st = HF_GetFileState(scan->fd);
+    (void)fd;   // The scan knows its file
+    int pax = st != NULL && st->opts.layout == HF_LAYOUT_PAX;
+    char *recPtr = NULL;
+    int len = 0;
+    int error;
+
+    // This is the main scanner loop
+    while (TRUE) {
+        
+        // --- 1. Try to find the next record on the current page ---
+        
+        // Check if we have a page loaded
+        if (scan->currentPageBuf != NULL) {
+            
+            // Call our page-level scanner. It returns the slot number.
+            int slot = HF_ScanNextSlot(st, scan);
+            
+            if (slot >= 0) { // HFE_OK is 0, but this is safer
+                // --- Success! Found a record on this page ---
+                
+                // Update the scanner's state
+                scan->currentSlotNum = slot;
+                
+                // Set the output RID
+                HF_ScanRid(st, scan->currentPageBuf, scan->currentPageNum, slot, rid);
+
+                // A PAX record is only rebuilt if the caller wants it
+                if (pax && record != NULL) {
+                    if ((recPtr = HF_ScanRowBuf(scan)) == NULL) {
+                        return PFE_NOMEM;
+                    }
+                    HF_PaxPage_GetRec(scan->currentPageBuf, st->opts.sep, slot, recPtr, &len);
+                } else if (!pax && (record != NULL || recLen != NULL)) {
+                    if ((error = HF_ScanRecord(scan, slot, &recPtr, &len)) != HFE_OK) {
+                        return error;
+                    }
+                }
+                if (record != NULL) *record = recPtr;
+                if (recLen != NULL) *recLen = len;
+                
+                return HFE_OK;
+            }
+            
+            // If we're here, the result was HFE_EOF (no more records on
+            // this page), or a long record could not be read
+            if (slot != HFE_EOF) {
+                return slot;
+            }
+            // Unfix the current page
+            if ((error = PF_UnfixPage(scan->fd, scan->currentPageNum, FALSE)) != PFE_OK) {
+                return error; // Propagate error
+            }
+            scan->currentPageBuf = NULL;
+        }
+
+        // --- 2. Get the next page in the file ---
+
+        // Pages the zone map rules out are not read at all
+        HF_ScanSkip(st, scan);
+        
+        // PF_GetNextPage gets the page *after* scan->currentPageNum
+        error = PF_GetNextPage(scan->fd, &scan->currentPageNum, &scan->currentPageBuf);
+        
+        if (error == PFE_EOF) {
+            // --- End of File ---
+            // No more pages left to scan
+            return HFE_EOF;
+        }
+        
+        if (error != PFE_OK) {
+            // A real PF error occurred
+            return error;
+        }
+
+        // --- 3. Got a new page, reset page scanner ---
+        
+        // Reset the slot number to start scanning this new page
+        // from the beginning in the next loop iteration.
+        scan->currentSlotNum = -1;
+    }
+}
+
+/*
+ * Gets one column of the record the scan is on.
+ */
+int HF_ScanGetField(HF_Scan *scan, int col, char **field, int *len) {
+    HF_FileState *st = HF_GetFileState(scan->fd);
+    char *record;
+    int recLen;
+    int error;
+
+    if (st == NULL) {
+        return PFE_FD;
+    }
+    if (scan->currentPageBuf == NULL) {
+        return HFE_INVALIDSLOT;
+    }
+
+    // 1. A PAX page has the column on its own
+    if (st->opts.layout == HF_LAYOUT_PAX) {
+        return HF_PaxPage_GetField(scan->currentPageBuf, scan->currentSlotNum,
+                                   col, field, len);
+    }
+
+    // 2. A slotted page has the whole record; skip col separators
+    error = HF_ScanRecord(scan, scan->currentSlotNum, &record, &recLen);
+    if (error != HFE_OK) {
+        return error;
+    }
+    int start = 0;
+    for (int i = 0; i < recLen && col > 0; i++) {
+        if (record[i] == st->opts.sep) {
+            start = i + 1;
+            col--;
+        }
+    }
+    if (col > 0) {
+        return HFE_INVALIDSLOT;
+    }
+    char *end = memchr(record + start, st->opts.sep, recLen - start);
+    *field = record + start;
+    *len = end ? (int)(end - *field) : recLen - start;
+    return HFE_OK;
+}
+
+/*
+ * Retrieves up to max records of one page without copying them.
+ */
+int HF_GetNextBatch(HF_Scan *scan, int max, RID *rids, char **records, int *lens,
+                    int *n) {
+    HF_FileState *st = HF_GetFileState(scan->fd);
+    int pax = st != NULL && st->opts.layout == HF_LAYOUT_PAX;
+    int used = 0;
+    int error;
+
+    *n = 0;
+    scan->batchPageDone = FALSE;
+    if (pax && HF_ScanRowBuf(scan) == NULL) {
+        return PFE_NOMEM;
+    }
+
+    while (TRUE) {
+        // 1. Take records from the current page while they last
+        if (scan->currentPageBuf != NULL) {
+            int slot = HFE_EOF;
+            int single = FALSE;
+            while (!single && *n < max && (slot = HF_ScanNextSlot(st, scan)) >= 0) {
+                char *rec;
+                int len;
+                if (pax) {
+                    // A rebuilt record is never longer than its share of the page
+                    rec = scan->rowBuf + used;
+                    HF_PaxPage_GetRec(scan->currentPageBuf, st->opts.sep, slot, rec, &len);
+                    used += len;
+                } else if (HF_SlotRec(st, scan->currentPageBuf, slot, &rec, &len) == HFE_OVERFLOW) {
+                    // A long record comes in a batch of its own
+                    if (*n > 0) {
+                        break;
+                    }
+                    if ((error = HF_ScanRecord(scan, slot, &rec, &len)) != HFE_OK) {
+                        return error;
+                    }
+                    single = TRUE;
+                }
+                scan->currentSlotNum = slot;
+                HF_ScanRid(st, scan->currentPageBuf, scan->currentPageNum, slot, &rids[*n]);
+                records[*n] = rec;
+                lens[*n] = len;
+                (*n)++;
+            }
+            if (slot < 0 && slot != HFE_EOF) {
+                return slot;
+            }
+            if (*n > 0) {
+                // The page stays pinned until HF_ReleaseBatch
+                scan->batchPageDone = slot < 0;
+                return HFE_OK;
+            }
+
+            // Nothing left on this page
+            if ((error = PF_UnfixPage(scan->fd, scan->currentPageNum, FALSE)) != PFE_OK) {
+                return error;
+            }
+            scan->currentPageBuf = NULL;
+        }
+
+        // 2. Move on to the next page the zone map does not rule out
+        HF_ScanSkip(st, scan);
+        error = PF_GetNextPage(scan->fd, &scan->currentPageNum, &scan->currentPageBuf);
+        if (error == PFE_EOF) {
+            return HFE_EOF;
+        }
+        if (error != PFE_OK) {
+            return error;
+        }
+        scan->currentSlotNum = -1;
+    }
+}
+
+/*
+ * Ends a batch, unpinning its page if the batch emptied it.
+ */
+int HF_ReleaseBatch(HF_Scan *scan) {
+    int error;
+
+    if (scan->batchPageDone && scan->currentPageBuf != NULL) {
+        if ((error = PF_UnfixPage(scan->fd, scan->currentPageNum, FALSE)) != PFE_OK) {
+            return error;
+        }
+        // The next call moves on from currentPageNum
+        scan->currentPageBuf = NULL;
+    }
+    scan->batchPageDone = FALSE;
+    return HFE_OK;
+}
+
+/*
+ * Scans one morsel of a parallel scan into a worker's batch.
+ */
+int HF_ScanMorsel(HF_ParScan *ps, int firstPage, int endPage, HF_RowBatch *batch,
+                  HF_BatchFn fn, void *ctx, int worker) {
+    HF_FileState *st = HF_GetFileState(ps->proto.fd);
+    HF_Scan scan = ps->proto;   // Its own buffer for long records
+    int error = HFE_OK;
+
+    if (st == NULL) {
+        return PFE_FD;
+    }
+    for (int pagenum = firstPage; pagenum < endPage && error == HFE_OK; pagenum++) {
+        // 1. Pin the page; free pages and pages the zone map rules out
+        //    are skipped
+        if (HF_ScanRulesOut(st, &scan, pagenum)) {
+            continue;
+        }
+        while ((error = PF_GetThisPage(scan.fd, pagenum, &scan.currentPageBuf)) == PFE_PAGEFIXED) {
+            sched_yield();      // An overflow page another worker is reading
+        }
+        if (error == PFE_INVALIDPAGE) {
+            error = HFE_OK;
+            continue;
+        }
+        if (error != PFE_OK) {
+            break;
+        }
+        scan.currentPageNum = pagenum;
+        scan.currentSlotNum = -1;
+
+        // 2. The page-local slot loop, with the predicates
+        int slot;
+        while ((slot = HF_ScanNextSlot(st, &scan)) >= 0) {
+            int used = batch->n > 0 ? batch->off[batch->n - 1] + batch->len[batch->n - 1] : 0;
+            int len = HFE_PAGENOFREE;
+            scan.currentSlotNum = slot;
+            if (batch->n < HF_BATCH_ROWS) {
+                len = HF_ProjectRow(st, &scan, batch->buf + used, HF_BATCH_BYTES - used);
+            }
+            if (len == HFE_PAGENOFREE && batch->n > 0) {
+                // 3. Full: hand the batch over; only a row longer than
+                //    HF_BATCH_BYTES does not fit an empty one
+                fn(ctx, worker, batch);
+                batch->n = 0;
+                used = 0;
+                len = HF_ProjectRow(st, &scan, batch->buf, HF_BATCH_BYTES);
+            }
+            if (len < 0) {
+                slot = len;
+                break;
+            }
+            HF_ScanRid(st, scan.currentPageBuf, pagenum, slot, &batch->rid[batch->n]);
+            batch->off[batch->n] = used;
+            batch->len[batch->n] = len;
+            batch->n++;
+        }
+        if (slot != HFE_EOF) {
+            error = slot;
+        }
+
+        int unfixErr = PF_UnfixPage(scan.fd, pagenum, FALSE);
+        if (unfixErr != PFE_OK && error == HFE_OK) {
+            error = unfixErr;
+        }
+    }
+    free(scan.ovfBuf);
+    return error;
+}
+
+/*
+ * ======================================================
+ * Reclustering
+ * ======================================================
+ */
+
+/* A record of a file being reclustered */
+typedef struct {
+    double key;
+    int hasKey;
+    RID oldRid;             /* The RID callers know it by */
+    RID newRid;
+    size_t off;             /* Its bytes in HF_ClusterBuf.arena */
+    int len;
+    int flags;              /* HF_SLOT_OVERFLOW for the head of a long record */
+} HF_ClusterRec;
+
+/* The records and data pages of a file being reclustered */
+typedef struct {
+    HF_ClusterRec *recs;
+    int nrecs, recAlloc;
+    char *arena;
+    size_t arenaUsed, arenaAlloc;
+    int *pages;             /* The data pages, in order */
+    int npages, pageAlloc;
+} HF_ClusterBuf;
+
+static void HF_ClusterFree(HF_ClusterBuf *cb) {
+    free(cb->recs);
+    free(cb->arena);
+    free(cb->pages);
+}
+
+static int HF_ClusterAddPage(HF_ClusterBuf *cb, int pagenum) {
+    if (cb->npages == cb->pageAlloc) {
+        int n = cb->pageAlloc ? cb->pageAlloc * 2 : 256;
+        int *pages = realloc(cb->pages, n * sizeof(int));
+        if (pages == NULL) {
+            return PFE_NOMEM;
+        }
+        cb->pages = pages;
+        cb->pageAlloc = n;
+    }
+    cb->pages[cb->npages++] = pagenum;
+    return HFE_OK;
+}
+
+/*
+ * Copies a record into the buffer, with its key; the key of a long
+ * record is read from its overflow pages.
+ */
+static int HF_ClusterAddRec(int fd, HF_FileState *st, HF_ClusterBuf *cb, RID oldRid,
+                            char *record, int recLen, int flags) {
+    if (cb->nrecs == cb->recAlloc) {
+        int n = cb->recAlloc ? cb->recAlloc * 2 : 1024;
+        HF_ClusterRec *recs = realloc(cb->recs, n * sizeof(HF_ClusterRec));
+        if (recs == NULL) {
+            return PFE_NOMEM;
+        }
+        cb->recs = recs;
+        cb->recAlloc = n;
+    }
+    if (cb->arenaUsed + recLen > cb->arenaAlloc) {
+        size_t n = cb->arenaAlloc ? cb->arenaAlloc : 64 * PF_PAGE_SIZE;
+        while (n < cb->arenaUsed + recLen) {
+            n *= 2;
+        }
+        char *arena = realloc(cb->arena, n);
+        if (arena == NULL) {
+            return PFE_NOMEM;
+        }
+        cb->arena = arena;
+        cb->arenaAlloc = n;
+    }
+
+    HF_ClusterRec *r = &cb->recs[cb->nrecs++];
+    r->oldRid = oldRid;
+    r->off = cb->arenaUsed;
+    r->len = recLen;
+    r->flags = flags;
+    memcpy(cb->arena + r->off, record, recLen);
+    cb->arenaUsed += recLen;
+    if (flags == 0) {
+        r->hasKey = HF_ClusterKey(st, record, recLen, &r->key);
+    } else {
+        HF_OverflowHead head;
+        int error;
+        memcpy(&head, record, sizeof(head));
+        if ((error = HF_OverflowGet(fd, &head, &st->ovfBuf, &st->ovfCap)) != HFE_OK) {
+            return error;
+        }
+        r->hasKey = HF_ClusterKey(st, st->ovfBuf, head.length, &r->key);
+    }
+    return HFE_OK;
+}
+
+/*
+ * Orders records by key, the ones without a key last, then by where
+ * they were.
+ */
+static int HF_ClusterCmp(const void *a, const void *b) {
+    const HF_ClusterRec *x = a, *y = b;
+
+    if (x->hasKey != y->hasKey) {
+        return x->hasKey ? -1 : 1;
+    }
+    if (x->hasKey && x->key != y->key) {
+        return x->key < y->key ? -1 : 1;
+    }
+    if (x->oldRid.pageNum != y->oldRid.pageNum) {
+        return x->oldRid.pageNum < y->oldRid.pageNum ? -1 : 1;
+    }
+    return (x->oldRid.slotNum > y->oldRid.slotNum) - (x->oldRid.slotNum < y->oldRid.slotNum);
+}
+
+static int HF_IntCmp(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Reads every live record of the file into the buffer, and lists the
+ * data pages. A moved copy is read under its home RID; forwarding
+ * slots are left behind.
+ */
+static int HF_ClusterRead(int fd, HF_FileState *st, HF_ClusterBuf *cb, HF_VacuumStats *stats) {
+    int numPages = PF_NumPages(fd);
+    char *pageBuf;
+    int error;
+
+    for (int pagenum = 1; pagenum < numPages; pagenum++) {
+        error = PF_GetThisPage(fd, pagenum, &pageBuf);
+        if (error == PFE_INVALIDPAGE) {
+            continue;
+        }
+        if (error != PFE_OK) {
+            return error;
+        }
+        if (HF_GetPageHeader(pageBuf)->numSlots < 0) {
+            if ((error = PF_UnfixPage(fd, pagenum, FALSE)) != PFE_OK) {
+                return error;
+            }
+            continue;
+        }
+
+        error = HF_ClusterAddPage(cb, pagenum);
+        for (int slot = -1; error == HFE_OK &&
+             (slot = HF_NextLiveSlot(st, pageBuf, slot)) >= 0; ) {
+            RID oldRid = { pagenum, slot };
+            char *record;
+            int recLen;
+            int flags = 0;
+            if (st->opts.layout == HF_LAYOUT_PAX) {
+                if ((record = HF_RowBuf(st)) == NULL) {
+                    error = PFE_NOMEM;
+                    break;
+                }
+                HF_PaxPage_GetRec(pageBuf, st->opts.sep, slot, record, &recLen);
+            } else if (HF_SlotRec(st, pageBuf, slot, &record, &recLen) == HFE_OVERFLOW) {
+                flags = HF_SLOT_OVERFLOW;   // Only the head moves
+            }
+            if (st->opts.layout == HF_LAYOUT_SLOTTED) {
+                HF_Page_GetHome(pageBuf, slot, &oldRid);
+            }
+            error = HF_ClusterAddRec(fd, st, cb, oldRid, record, recLen, flags);
+        }
+        int unfixErr = PF_UnfixPage(fd, pagenum, FALSE);
+        if (unfixErr != PFE_OK && error == HFE_OK) {
+            error = unfixErr;
+        }
+        if (error != HFE_OK) {
+            return error;
+        }
+        stats->pagesScanned++;
+    }
+    return HFE_OK;
+}
+
+/*
+ * Packs the sorted records into new pages in memory, filled to
+ * clusterFill percent. A record's newRid gets the index of its page.
+ */
+static int HF_ClusterPack(HF_FileState *st, HF_ClusterBuf *cb, char **out, int *nout) {
+    int fillBytes = PF_PAGE_SIZE / 100 * st->opts.clusterFill;
+    int alloc = 0;
+    char *page = NULL;
+
+    *out = NULL;
+    *nout = 0;
+    for (int i = 0; i < cb->nrecs; i++) {
+        HF_ClusterRec *r = &cb->recs[i];
+        char *record = cb->arena + r->off;
+        int slot = HFE_PAGENOFREE;
+        if (page != NULL && PF_PAGE_SIZE - HF_Page_FreeSpaceEx(&st->opts, page) < fillBytes) {
+            slot = HF_PutRec(st, page, NULL, record, r->len, r->flags);
+        }
+        if (slot == HFE_PAGENOFREE) {
+            // Start a new page
+            if (*nout == alloc) {
+                alloc = alloc ? alloc * 2 : 64;
+                char *pages = realloc(*out, (size_t)alloc * PF_PAGE_SIZE);
+                if (pages == NULL) {
+                    return PFE_NOMEM;
+                }
+                *out = pages;
+            }
+            page = *out + (size_t)(*nout)++ * PF_PAGE_SIZE;
+            HF_InitPageEx(&st->opts, page);
+            slot = HF_PutRec(st, page, NULL, record, r->len, r->flags);
+        }
+        if (slot < 0) {
+            return slot;
+        }
+        r->newRid.pageNum = *nout - 1;
+        r->newRid.slotNum = slot;
+    }
+    return HFE_OK;
+}
+
+/*
+ * Calls fn for every record whose RID the recluster changed, so that
+ * each call can be applied as it comes (see HF_RelocFn in hf.h): a
+ * record whose new RID is the old RID of another moved record is first
+ * staged through RID { HF_RID_STAGED, i }, and only moved to its new
+ * RID once every old RID has been reported. olds has room for every
+ * record.
+ */
+static void HF_ClusterReport(HF_ClusterBuf *cb, RID *olds, HF_RelocFn fn, void *ctx,
+                             HF_VacuumStats *stats) {
+    int nolds = 0;
+
+    // 1. The old RIDs of the records that move, sorted
+    for (int i = 0; i < cb->nrecs; i++) {
+        HF_ClusterRec *r = &cb->recs[i];
+        r->newRid.pageNum = cb->pages[r->newRid.pageNum];
+        if (HF_RidCmp(&r->oldRid, &r->newRid) != 0) {
+            stats->recordsMoved++;
+            nolds++;
+        }
+    }
+    if (fn == NULL || nolds == 0) {
+        return;
+    }
+    nolds = 0;
+    for (int i = 0; i < cb->nrecs; i++) {
+        HF_ClusterRec *r = &cb->recs[i];
+        if (HF_RidCmp(&r->oldRid, &r->newRid) != 0) {
+            olds[nolds++] = r->oldRid;
+        }
+    }
+    qsort(olds, nolds, sizeof(RID), HF_RidCmp);
+
+    // 2. Move the records to new RIDs no record had, and stage the
+    //    others
+    for (int i = 0; i < cb->nrecs; i++) {
+        HF_ClusterRec *r = &cb->recs[i];
+        RID staged = { HF_RID_STAGED, i };
+        if (HF_RidCmp(&r->oldRid, &r->newRid) == 0) {
+            continue;
+        }
+        if (bsearch(&r->newRid, olds, nolds, sizeof(RID), HF_RidCmp) != NULL) {
+            fn(ctx, r->oldRid, staged);
+        } else {
+            fn(ctx, r->oldRid, r->newRid);
+        }
+    }
+
+    // 3. Every old RID is gone now: move the staged records on
+    for (int i = 0; i < cb->nrecs; i++) {
+        HF_ClusterRec *r = &cb->recs[i];
+        RID staged = { HF_RID_STAGED, i };
+        if (HF_RidCmp(&r->oldRid, &r->newRid) != 0 &&
+            bsearch(&r->newRid, olds, nolds, sizeof(RID), HF_RidCmp) != NULL) {
+            fn(ctx, staged, r->newRid);
+        }
+    }
+}
+
+/*
+ * Rewrites a clustered file in key order (see HF_Recluster in hf.h),
+ * but leaves the free pages where they are.
+ */
+static int HF_DoRecluster(int fd, HF_FileState *st, HF_RelocFn fn, void *ctx,
+                          HF_VacuumStats *stats) {
+    HF_ClusterBuf cb;
+    char *out = NULL;
+    RID *olds;
+    int nout = 0;
+    char *pageBuf;
+    int pagenum;
+    int error;
+
+    // 1. Read the records in, and sort them by key. The room to report
+    //    their moves is taken now, before any page is written.
+    memset(&cb, 0, sizeof(cb));
+    if ((error = HF_ClusterRead(fd, st, &cb, stats)) != HFE_OK) {
+        HF_ClusterFree(&cb);
+        return error;
+    }
+    if ((olds = malloc((cb.nrecs + 1) * sizeof(RID))) == NULL) {
+        HF_ClusterFree(&cb);
+        return PFE_NOMEM;
+    }
+    qsort(cb.recs, cb.nrecs, sizeof(HF_ClusterRec), HF_ClusterCmp);
+
+    // 2. Lay them out on pages, and find enough data pages for those.
+    //    Keeping the page numbers in order keeps the keys in order.
+    error = HF_ClusterPack(st, &cb, &out, &nout);
+    while (error == HFE_OK && cb.npages < nout) {
+        if ((error = PF_AllocPage(fd, &pagenum, &pageBuf)) == PFE_OK) {
+            HF_InitPageEx(&st->opts, pageBuf);
+            error = PF_UnfixPage(fd, pagenum, TRUE);
+        }
+        if (error == PFE_OK) {
+            error = HF_ClusterAddPage(&cb, pagenum);
+        }
+    }
+    qsort(cb.pages, cb.npages, sizeof(int), HF_IntCmp);
+
+    // 3. Write the pages, and give the ones left over back
+    for (int i = 0; error == HFE_OK && i < cb.npages; i++) {
+        pagenum = cb.pages[i];
+        if (i >= nout) {
+            HF_FsmSet(st, pagenum, 0);
+            HF_ZoneForget(st, pagenum);
+            if ((error = PF_DisposePage(fd, pagenum)) == PFE_OK) {
+                stats->pagesFreed++;
+            }
+            continue;
+        }
+        if ((error = PF_GetThisPage(fd, pagenum, &pageBuf)) != PFE_OK) {
+            break;
+        }
+        memcpy(pageBuf, out + (size_t)i * PF_PAGE_SIZE, PF_PAGE_SIZE);
+        HF_NotePage(st, pagenum, pageBuf);
+        error = PF_UnfixPage(fd, pagenum, TRUE);
+    }
+
+    // 4. Tell the caller where the records went
+    if (error == HFE_OK) {
+        HF_ClusterReport(&cb, olds, fn, ctx, stats);
+    }
+    if (error == HFE_OK) {
+        st->header.clusterRecs = cb.nrecs;
+        st->header.clusterPlaced = 0;
+        st->header.clusterStrays = 0;
+        st->headerDirty = TRUE;
+    }
+    free(out);
+    free(olds);
+    HF_ClusterFree(&cb);
+    return error;
+}
+
+/*
+ * ======================================================
+ * Vacuum
+ * ======================================================
+ */
+
+typedef struct HF_VacuumThread {
+    pthread_t thread;
+    pthread_cond_t cond;    /* Signalled, under HFlatch, to stop it */
+    int stop;
+    int error;              /* Why it stopped early, or HFE_OK */
+    int fd;
+    int pagesPerStep;
+    int intervalMs;
+    int sparsePct;
+    HF_RelocFn fn;
+    void *ctx;
+    HF_VacuumStats stats;
+} HF_VacuumThread;
+
+/*
+ * The first page before page "below" whose category is at least
+ * need, or -1. Filling the file from the front lets a pass empty
+ * its end.
+ */
+static int HF_FsmFindBelow(HF_FileState *st, int need, int below) {
+    if (need > 255) {
+        return -1;
+    }
+    for (int i = st->fsmFrom[need]; i < below && i < st->fsmSize; i++) {
+        if (st->fsm[i] >= need) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Inserts a record moved out of page "below" into a page before it;
+ * with home set, as the moved copy of that record. flags is as for
+ * HF_PutRec.
+ *
+ * Returns HFE_OK with newRid set, HFE_PAGENOFREE if no such page has
+ * room, or a PF error code.
+ */
+static int HF_VacuumMove(int fd, HF_FileState *st, int below, const RID *home,
+                         char *record, int recLen, int flags, RID *newRid) {
+    int bytes = recLen + (home != NULL ? (int)sizeof(RID) : 0);
+    int need = bytes > 0 ? (bytes + HF_FSM_UNIT - 1) / HF_FSM_UNIT : 1;
+    int pagenum;
+    char *pageBuf;
     int error;
 
-    // This is the main scanner loop
-    while (TRUE) {
-        
-        // --- 1. Try to find the next record on the current page ---
-        
-        // Check if we have a page loaded
-        if (scan->currentPageBuf != NULL) {
-            
-            // Call our page-level scanner. It returns the slot number.
-            int slot = HF_Page_GetNextRec(scan->currentPageBuf, 
-                                        scan->currentSlotNum, 
-                                        record, 
-                                        recLen);
-            
-            if (slot >= 0) { // HFE_OK is 0, but this is safer
-                // --- Success! Found a record on this page ---
-                
-                // Update the scanner's state
-                scan->currentSlotNum = slot;
-                
-                // Set the output RID
-                rid->pageNum = scan->currentPageNum;
-                rid->slotNum = scan->currentSlotNum;
-                
-                return HFE_OK;
+    while ((pagenum = HF_FsmFindBelow(st, need, below)) >= 0) {
+        error = PF_GetThisPage(fd, pagenum, &pageBuf);
+        if (error == PFE_INVALIDPAGE) {
+            HF_FsmSet(st, pagenum, 0);
+            continue;
+        }
+        if (error == PFE_PAGEFIXED) {
+            return HFE_PAGENOFREE;      // In use; try again next pass
+        }
+        if (error != PFE_OK) {
+            return error;
+        }
+        int slot = HF_PutRec(st, pageBuf, home, record, recLen, flags);
+        HF_FsmSet(st, pagenum, HF_FsmCategory(st, pageBuf));
+        if (slot >= 0) {
+            HF_ZoneAdd(st, pagenum, pageBuf, slot);
+        }
+        if ((error = PF_UnfixPage(fd, pagenum, slot >= 0)) != PFE_OK) {
+            return error;
+        }
+        if (slot >= 0) {
+            newRid->pageNum = pagenum;
+            newRid->slotNum = slot;
+            HF_ClusterNote(st, TRUE);
+            return HFE_OK;
+        }
+        // The map was out of date and is now corrected; look again
+    }
+    return HFE_PAGENOFREE;
+}
+
+/*
+ * Moves a moved copy that the vacuum takes off its page: back into
+ * its home slot if the record fits there now, else into a page before
+ * page "below", re-pointing the home slot at it. The RID stays.
+ */
+static int HF_VacuumCopy(int fd, HF_FileState *st, int below, RID home, char *record,
+                         int recLen, int flags) {
+    char *pageBuf;
+    RID newCopy;
+    int error;
+
+    // 1. Back home, if the record fits there now
+    if ((error = PF_GetThisPage(fd, home.pageNum, &pageBuf)) != PFE_OK) {
+        return error == PFE_PAGEFIXED ? HFE_PAGENOFREE : error;
+    }
+    int back = HF_Page_UpdateSlot(pageBuf, home.slotNum, record, recLen, flags) == HFE_OK;
+    HF_NotePage(st, home.pageNum, pageBuf);
+    int unfixErr = PF_UnfixPage(fd, home.pageNum, back);
+    if (unfixErr != PFE_OK) {
+        return unfixErr;
+    }
+    if (back) {
+        return HFE_OK;
+    }
+
+    // 2. Else to an earlier page, and the home slot forwards there
+    if ((error = HF_VacuumMove(fd, st, below, &home, record, recLen, flags, &newCopy)) != HFE_OK) {
+        return error;
+    }
+    if ((error = PF_GetThisPage(fd, home.pageNum, &pageBuf)) != PFE_OK) {
+        return error;
+    }
+    error = HF_Page_SetForward(pageBuf, home.slotNum, newCopy);
+    unfixErr = PF_UnfixPage(fd, home.pageNum, TRUE);
+    if (unfixErr != PFE_OK) {
+        return unfixErr;
+    }
+    return error;
+}
+
+/*
+ * Rebuilds a PAX page that has deleted rows from its live rows, which
+ * renumbers them; fn is told of each row whose slot changes.
+ * Returns TRUE if the page was rebuilt, FALSE if it had no deleted
+ * rows, or PFE_NOMEM.
+ */
+static int HF_VacuumPaxPage(HF_FileState *st, int pagenum, char *pageBuf,
+                            HF_RelocFn fn, void *ctx) {
+    HF_PaxPage *pp = (HF_PaxPage *)pageBuf;
+    char copy[PF_PAGE_SIZE];
+    char *record;
+    int recLen;
+    int live = 0;
+
+    for (int slot = -1; (slot = HF_PaxPage_NextSlot(pageBuf, slot)) >= 0; ) {
+        live++;
+    }
+    if (live == pp->numSlots) {
+        return FALSE;
+    }
+    if ((record = HF_RowBuf(st)) == NULL) {
+        return PFE_NOMEM;
+    }
+
+    // Re-insert the live rows in order; they fitted before, so they fit now
+    memcpy(copy, pageBuf, PF_PAGE_SIZE);
+    HF_PaxPage_Init(pageBuf, st->opts.ncols);
+    for (int slot = -1; (slot = HF_PaxPage_NextSlot(copy, slot)) >= 0; ) {
+        HF_PaxPage_GetRec(copy, st->opts.sep, slot, record, &recLen);
+        int newSlot = HF_PaxPage_InsertRec(pageBuf, st->opts.sep, record, recLen);
+        if (newSlot != slot && fn != NULL) {
+            RID oldRid = { pagenum, slot };
+            RID newRid = { pagenum, newSlot };
+            fn(ctx, oldRid, newRid);
+        }
+    }
+    return TRUE;
+}
+
+/*
+ * Vacuums one page: compacts it, and with merge set, if it is sparse
+ * or past the pages the file's records need, moves its records into
+ * pages before it. A page left empty is given back to the PF layer.
+ */
+static int HF_VacuumPage(int fd, HF_FileState *st, int pagenum, int merge, int sparsePct,
+                         HF_RelocFn fn, void *ctx, HF_VacuumStats *stats) {
+    int pax = st->opts.layout == HF_LAYOUT_PAX;
+    int slotted = st->opts.layout == HF_LAYOUT_SLOTTED;
+    int dirty = FALSE;
+    char *pageBuf;
+    int error;
+
+    // 1. Pin the page; free pages, pages in use and non-data pages are skipped
+    error = PF_GetThisPage(fd, pagenum, &pageBuf);
+    if (error == PFE_INVALIDPAGE || error == PFE_PAGEFIXED) {
+        return HFE_OK;
+    }
+    if (error != PFE_OK) {
+        return error;
+    }
+    if (HF_GetPageHeader(pageBuf)->numSlots < 0) {
+        // Overflow pages stay where they are, and count as used
+        if (!merge && HF_GetPageHeader(pageBuf)->numSlots == HF_PAGE_OVERFLOW) {
+            st->vacUsed += PF_PAGE_SIZE;
+        }
+        return PF_UnfixPage(fd, pagenum, FALSE);
+    }
+
+    // 2. Put the free space of the page in one piece; on a fixed-length
+    //    page it always is
+    if (pax) {
+        if ((error = HF_VacuumPaxPage(st, pagenum, pageBuf, fn, ctx)) < 0) {
+            PF_UnfixPage(fd, pagenum, FALSE);
+            return error;
+        }
+        if (error) {
+            stats->pagesCompacted++;
+            dirty = TRUE;
+        }
+    } else if (slotted) {
+        HF_PageHeader *header = HF_GetPageHeader(pageBuf);
+        int slotArrayEnd = sizeof(HF_PageHeader) + header->numSlots * sizeof(HF_SlotEntry);
+        int freeSlot;
+        if (HF_Page_Space(pageBuf, &freeSlot) > header->dataStartPtr - slotArrayEnd) {
+            HF_Page_Compact(pageBuf);
+            stats->pagesCompacted++;
+            dirty = TRUE;
+        }
+    }
+
+    // 3. Empty a sparse or surplus page into the pages before it
+    int used = PF_PAGE_SIZE - HF_Page_FreeSpaceEx(&st->opts, pageBuf);
+    if (!merge) {
+        st->vacUsed += used;
+    } else if (used * 100 < sparsePct * PF_PAGE_SIZE || pagenum >= st->vacKeep) {
+        int slot = -1;
+        while ((slot = HF_NextLiveSlot(st, pageBuf, slot)) >= 0) {
+            char *record;
+            int recLen;
+            int flags = 0;
+            RID oldRid = { pagenum, slot };
+            RID newRid, home;
+            if (pax) {
+                if ((record = HF_RowBuf(st)) == NULL) {
+                    error = PFE_NOMEM;
+                    break;
+                }
+                HF_PaxPage_GetRec(pageBuf, st->opts.sep, slot, record, &recLen);
+            } else if (HF_SlotRec(st, pageBuf, slot, &record, &recLen) == HFE_OVERFLOW) {
+                flags = HF_SLOT_OVERFLOW;   // Only the head moves
             }
-            
-            // If we're here, the result was HFE_EOF (no more records on this page)
-            // Unfix the current page
-            if ((error = PF_UnfixPage(scan->fd, scan->currentPageNum, FALSE)) != PFE_OK) {
-                return error; // Propagate error
+            // A moved copy keeps its home RID, so nobody is told
+            int moved = slotted && HF_Page_GetHome(pageBuf, slot, &home) == HFE_OK;
+            if (moved) {
+                error = HF_VacuumCopy(fd, st, pagenum, home, record, recLen, flags);
+            } else {
+                error = HF_VacuumMove(fd, st, pagenum, NULL, record, recLen, flags, &newRid);
             }
-            scan->currentPageBuf = NULL;
+            if (error != HFE_OK) {
+                break;
+            }
+            if (pax) {
+                HF_PaxPage_DeleteRec(pageBuf, slot);
+            } else if (slotted) {
+                HF_Page_DeleteRec(pageBuf, slot);
+            } else {
+                HF_FixedPage_DeleteRec(pageBuf, slot);
+            }
+            dirty = TRUE;
+            stats->recordsMoved++;
+            if (fn != NULL && !moved) {
+                fn(ctx, oldRid, newRid);
+            }
+        }
+        if (error == HFE_PAGENOFREE) {
+            error = HFE_OK;         // The rest stays here
+        }
+        if (error != HFE_OK) {
+            PF_UnfixPage(fd, pagenum, dirty);
+            return error;
         }
+    }
 
-        // --- 2. Get the next page in the file ---
-        
-        // PF_GetNextPage gets the page *after* scan->currentPageNum
-        error = PF_GetNextPage(scan->fd, &scan->currentPageNum, &scan->currentPageBuf);
-        
-        if (error == PFE_EOF) {
-            // --- End of File ---
-            // No more pages left to scan
-            return HFE_EOF;
+    // 4. Give an empty page back to the PF free list; forwarding slots
+    //    keep a slotted page
+    int empty = pax ? HF_NextLiveSlot(st, pageBuf, -1) < 0
+                    : HF_GetPageHeader(pageBuf)->numSlots == 0;
+    if (empty) {
+        HF_FsmSet(st, pagenum, 0);
+        HF_ZoneForget(st, pagenum);
+    } else if (dirty) {
+        HF_NotePage(st, pagenum, pageBuf);
+    } else {
+        HF_FsmSet(st, pagenum, HF_FsmCategory(st, pageBuf));
+    }
+    if ((error = PF_UnfixPage(fd, pagenum, dirty)) != PFE_OK) {
+        return error;
+    }
+    if (empty) {
+        if ((error = PF_DisposePage(fd, pagenum)) != PFE_OK) {
+            return error;
         }
-        
-        if (error != PFE_OK) {
-            // A real PF error occurred
+        stats->pagesFreed++;
+    }
+    return HFE_OK;
+}
+
+/*
+ * Moves the FSM and zone-map pages into free pages before them, which
+ * vacuum passes leave at the start of the file, so that they do not
+ * keep the free pages after them from being cut off. Disposed pages
+ * are reused last-freed first, and a pass frees pages from the end of
+ * the file down, so the page PF_AllocPage hands out is the lowest.
+ */
+static int HF_VacuumMapPages(int fd, HF_FileState *st) {
+    int numFsm = st->header.numFsmPages;
+    char *oldBuf, *newBuf;
+    int pagenum;
+    int error;
+
+    for (int k = 0; k < numFsm + st->header.numZonePages; k++) {
+        int *list = k < numFsm ? &st->header.fsmPages[k]
+                               : &st->header.zonePages[k - numFsm];
+        int old = *list;
+        if ((error = PF_AllocPage(fd, &pagenum, &newBuf)) != PFE_OK) {
+            return error;
+        }
+        if (pagenum > old) {
+            // No free page before it; give this one back
+            if ((error = PF_UnfixPage(fd, pagenum, FALSE)) != PFE_OK) {
+                return error;
+            }
+            if ((error = PF_DisposePage(fd, pagenum)) != PFE_OK) {
+                return error;
+            }
+            continue;
+        }
+        if ((error = PF_GetThisPage(fd, old, &oldBuf)) != PFE_OK) {
+            PF_UnfixPage(fd, pagenum, FALSE);
             return error;
         }
+        memcpy(newBuf, oldBuf, PF_PAGE_SIZE);
+        if ((error = PF_UnfixPage(fd, old, FALSE)) != PFE_OK ||
+            (error = PF_UnfixPage(fd, pagenum, TRUE)) != PFE_OK ||
+            (error = PF_DisposePage(fd, old)) != PFE_OK) {
+            return error;
+        }
+        *list = pagenum;
+        st->headerDirty = TRUE;
+    }
+    return HFE_OK;
+}
 
-        // --- 3. Got a new page, reset page scanner ---
-        
-        // Reset the slot number to start scanning this new page
-        // from the beginning in the next loop iteration.
-        scan->currentSlotNum = -1;
+/*
+ * One vacuum step, with HFlatch held.
+ */
+static int HF_DoVacuumStep(int fd, HF_FileState *st, int maxPages, int sparsePct,
+                           HF_RelocFn fn, void *ctx, HF_VacuumStats *stats) {
+    int error;
+
+    // 1. An append-only file's pages in memory are written out, and its
+    //    tombstones carried out, before any page is looked at
+    if ((error = HF_AppendSync(fd, st, &stats->tombstones)) != HFE_OK) {
+        return error;
+    }
+
+    // 2. A pass first compacts the pages from page 1 up, so that the
+    //    map shows the room they have, then merges them from the end
+    //    of the file down into the first pages with room. The pages
+    //    past the ones the records would fill are emptied even if
+    //    they are not sparse, so that the end of the file comes free.
+    if (st->vacPhase == HF_VAC_IDLE) {
+        st->vacPhase = HF_VAC_COMPACT;
+        st->vacNext = 1;
+        st->vacUsed = 0;
+
+        // A clustered file with too many strays is reclustered instead,
+        // which packs its pages too; the pass then only trims the file
+        if (HF_ClusterDue(st)) {
+            if ((error = HF_DoRecluster(fd, st, fn, ctx, stats)) != HFE_OK) {
+                st->vacPhase = HF_VAC_IDLE;
+                return error;
+            }
+            stats->reclusters++;
+            st->vacPhase = HF_VAC_MERGE;
+            st->vacNext = 0;
+        }
+    }
+    for (int k = 0; k < maxPages; k++) {
+        if (st->vacPhase == HF_VAC_COMPACT && st->vacNext >= PF_NumPages(fd)) {
+            st->vacPhase = HF_VAC_MERGE;
+            st->vacNext = PF_NumPages(fd) - 1;
+            st->vacKeep = 1 + st->header.numFsmPages + st->header.numZonePages +
+                          (int)((st->vacUsed + PF_PAGE_SIZE - 1) / PF_PAGE_SIZE);
+        }
+        if (st->vacPhase == HF_VAC_MERGE && st->vacNext <= 0) {
+            break;
+        }
+        int merge = st->vacPhase == HF_VAC_MERGE;
+        int pagenum = merge ? st->vacNext-- : st->vacNext++;
+        if ((error = HF_VacuumPage(fd, st, pagenum, merge, sparsePct, fn, ctx, stats)) != HFE_OK) {
+            return error;
+        }
+        stats->pagesScanned++;
+    }
+    if (st->vacPhase != HF_VAC_MERGE || st->vacNext > 0) {
+        return HFE_OK;
+    }
+    st->vacPhase = HF_VAC_IDLE;
+
+    // 3. At the end of a pass, cut the free pages off the end of the file
+    if (!st->legacy && (error = HF_VacuumMapPages(fd, st)) != HFE_OK) {
+        return error;
+    }
+    int n = PF_TruncateFile(fd);
+    if (n < 0) {
+        return n;
+    }
+    stats->pagesTrimmed += n;
+    return HFE_EOF;
+}
+
+/*
+ * Vacuums up to maxPages pages.
+ */
+int HF_VacuumStep(int fd, int maxPages, int sparsePct, HF_RelocFn fn, void *ctx,
+                  HF_VacuumStats *stats) {
+    int error;
+
+    pthread_mutex_lock(&HFlatch);
+    HF_FileState *st = HF_GetFileState(fd);
+    if (st == NULL) {
+        error = PFE_FD;
+    } else if (st->activeScans > 0 || st->vac != NULL) {
+        error = HFE_BUSY;
+    } else {
+        error = HF_DoVacuumStep(fd, st, maxPages, sparsePct, fn, ctx, stats);
+    }
+    pthread_mutex_unlock(&HFlatch);
+    return error;
+}
+
+/*
+ * Vacuums the whole file.
+ */
+int HF_Vacuum(int fd, int sparsePct, HF_RelocFn fn, void *ctx, HF_VacuumStats *stats) {
+    int error;
+
+    while ((error = HF_VacuumStep(fd, 64, sparsePct, fn, ctx, stats)) == HFE_OK)
+        ;
+    return error == HFE_EOF ? HFE_OK : error;
+}
+
+/*
+ * Background vacuum thread: one step every intervalMs while no scan
+ * of the file is open.
+ */
+static void *HF_VacuumMain(void *arg) {
+    HF_VacuumThread *v = arg;
+
+    pthread_mutex_lock(&HFlatch);
+    while (!v->stop) {
+        HF_FileState *st = HF_GetFileState(v->fd);
+        if (st->activeScans == 0) {
+            int error = HF_DoVacuumStep(v->fd, st, v->pagesPerStep, v->sparsePct,
+                                        v->fn, v->ctx, &v->stats);
+            if (error != HFE_OK && error != HFE_EOF) {
+                v->error = error;
+                break;
+            }
+        }
+
+        // Wait, letting the other HF calls in
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_sec += v->intervalMs / 1000;
+        until.tv_nsec += (long)(v->intervalMs % 1000) * 1000000;
+        if (until.tv_nsec >= 1000000000) {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000;
+        }
+        if (!v->stop) {
+            pthread_cond_timedwait(&v->cond, &HFlatch, &until);
+        }
+    }
+    pthread_mutex_unlock(&HFlatch);
+    return NULL;
+}
+
+/*
+ * Starts a background vacuum of a file.
+ */
+int HF_StartVacuum(int fd, int pagesPerStep, int intervalMs, int sparsePct,
+                   HF_RelocFn fn, void *ctx) {
+    HF_VacuumThread *v;
+    int error = HFE_OK;
+
+    if (pagesPerStep <= 0 || intervalMs < 0) {
+        return HFE_BADOPTIONS;
+    }
+    pthread_mutex_lock(&HFlatch);
+    HF_FileState *st = HF_GetFileState(fd);
+    if (st == NULL) {
+        error = PFE_FD;
+    } else if (st->vac != NULL) {
+        error = HFE_BUSY;
+    } else if ((v = calloc(1, sizeof(HF_VacuumThread))) == NULL) {
+        error = PFE_NOMEM;
+    } else {
+        v->fd = fd;
+        v->pagesPerStep = pagesPerStep;
+        v->intervalMs = intervalMs;
+        v->sparsePct = sparsePct;
+        v->fn = fn;
+        v->ctx = ctx;
+        pthread_cond_init(&v->cond, NULL);
+        if (pthread_create(&v->thread, NULL, HF_VacuumMain, v) != 0) {
+            pthread_cond_destroy(&v->cond);
+            free(v);
+            error = PFE_NOMEM;
+        } else {
+            st->vac = v;
+        }
+    }
+    pthread_mutex_unlock(&HFlatch);
+    return error;
+}
+
+/*
+ * Stops the background vacuum of a file and waits for it.
+ */
+int HF_StopVacuum(int fd, HF_VacuumStats *stats) {
+    HF_VacuumThread *v = NULL;
+
+    pthread_mutex_lock(&HFlatch);
+    HF_FileState *st = HF_GetFileState(fd);
+    if (st != NULL && (v = st->vac) != NULL) {
+        v->stop = TRUE;
+        pthread_cond_signal(&v->cond);
+    }
+    pthread_mutex_unlock(&HFlatch);
+    if (v == NULL) {
+        return st == NULL ? PFE_FD : HFE_OK;
+    }
+
+    pthread_join(v->thread, NULL);
+    pthread_mutex_lock(&HFlatch);
+    st = HF_GetFileState(fd);
+    st->vac = NULL;
+    pthread_mutex_unlock(&HFlatch);
+
+    int error = v->error;
+    if (stats != NULL) {
+        *stats = v->stats;
+    }
+    pthread_cond_destroy(&v->cond);
+    free(v);
+    return error;
+}
+
+/*
+ * Rewrites a clustered file in key order, then moves the map pages
+ * forward and cuts the free pages off the end, as a vacuum pass does.
+ */
+int HF_Recluster(int fd, HF_RelocFn fn, void *ctx, HF_VacuumStats *stats) {
+    int error;
+
+    pthread_mutex_lock(&HFlatch);
+    HF_FileState *st = HF_GetFileState(fd);
+    if (st == NULL) {
+        error = PFE_FD;
+    } else if (!st->opts.cluster) {
+        error = HFE_BADOPTIONS;
+    } else if (st->activeScans > 0 || st->vac != NULL) {
+        error = HFE_BUSY;
+    } else if ((error = HF_DoRecluster(fd, st, fn, ctx, stats)) == HFE_OK &&
+               (error = HF_VacuumMapPages(fd, st)) == HFE_OK) {
+        int n = PF_TruncateFile(fd);
+        if (n < 0) {
+            error = n;
+        } else {
+            stats->pagesTrimmed += n;
+        }
+    }
+    pthread_mutex_unlock(&HFlatch);
+    return error;
+}
+
+/*
+ * Gets the cluster counters of a file.
+ */
+int HF_GetClusterStats(int fd, HF_ClusterStats *cs) {
+    int error = HFE_OK;
+
+    pthread_mutex_lock(&HFlatch);
+    HF_FileState *st = HF_GetFileState(fd);
+    if (st == NULL) {
+        error = PFE_FD;
+    } else if (!st->opts.cluster) {
+        error = HFE_BADOPTIONS;
+    } else {
+        cs->records = st->header.clusterRecs;
+        cs->placed = st->header.clusterPlaced;
+        cs->strays = st->header.clusterStrays;
+    }
+    pthread_mutex_unlock(&HFlatch);
+    return error;
+}
+
+/*
+ * ======================================================
+ * Latched entry points
+ * ======================================================
+ *
+ * These take HFlatch around the HF_DoXxx functions above, so a
+ * background vacuum never sees a file half way through a change.
+ */
+
+int HF_OpenFile(char *fileName) {
+    pthread_mutex_lock(&HFlatch);
+    int fd = HF_DoOpenFile(fileName);
+    pthread_mutex_unlock(&HFlatch);
+    return fd;
+}
+
+int HF_CloseFile(int fd) {
+    // The vacuum thread takes the latch itself, so stop it first
+    HF_StopVacuum(fd, NULL);
+    pthread_mutex_lock(&HFlatch);
+    HF_FileState *st = HF_GetFileState(fd);
+    int error = st != NULL ? HF_AppendSync(fd, st, NULL) : HFE_OK;
+    int closeError = HF_DoCloseFile(fd);
+    pthread_mutex_unlock(&HFlatch);
+    return error != HFE_OK ? error : closeError;
+}
+
+int HF_SetDict(int fd, const char *data, int len) {
+    pthread_mutex_lock(&HFlatch);
+    int error = HF_DoSetDict(fd, data, len);
+    pthread_mutex_unlock(&HFlatch);
+    return error;
+}
+
+int HF_GetDict(int fd, const char **data, int *len) {
+    pthread_mutex_lock(&HFlatch);
+    HF_FileState *st = HF_GetFileState(fd);
+    if (st != NULL) {
+        *data = st->dict;
+        *len = st->header.dictLen;
+    }
+    pthread_mutex_unlock(&HFlatch);
+    return st != NULL ? HFE_OK : PFE_FD;
+}
+
+int HF_InsertRec(int fd, char *record, int recLen, RID *rid) {
+    pthread_mutex_lock(&HFlatch);
+    int error = HF_DoInsertRec(fd, record, recLen, rid);
+    pthread_mutex_unlock(&HFlatch);
+    return error;
+}
+
+int HF_AppendPages(int fd, char *pages, int npages, int *firstPage) {
+    pthread_mutex_lock(&HFlatch);
+    HF_FileState *st = HF_GetFileState(fd);
+    int error = st != NULL ? HF_AppendFlush(fd, st) : HFE_OK;
+    if (error == HFE_OK) {
+        error = HF_DoAppendPages(fd, pages, npages, firstPage);
     }
-}
\ No newline at end of file
+    pthread_mutex_unlock(&HFlatch);
+    return error;
+}
+
+int HF_DeleteRec(int fd, RID rid) {
+    pthread_mutex_lock(&HFlatch);
+    int error = HF_DoDeleteRec(fd, rid);
+    pthread_mutex_unlock(&HFlatch);
+    return error;
+}
+
+int HF_GetRec(int fd, RID rid, char **record, int *recLen) {
+    pthread_mutex_lock(&HFlatch);
+    int error = HF_DoGetRec(fd, rid, record, recLen);
+    pthread_mutex_unlock(&HFlatch);
+    return error;
+}
+
+int HF_UpdateRec(int fd, RID rid, char *record, int recLen) {
+    pthread_mutex_lock(&HFlatch);
+    int error = HF_DoUpdateRec(fd, rid, record, recLen);
+    pthread_mutex_unlock(&HFlatch);
+    return error;
+}
+
+int HF_OpenRecStream(int fd, RID rid, HF_RecStream *rs) {
+    pthread_mutex_lock(&HFlatch);
+    int error = HF_DoOpenRecStream(fd, rid, rs);
+    pthread_mutex_unlock(&HFlatch);
+    return error;
+}
+
+int HF_ReadRecStream(HF_RecStream *rs, char *buf, int max) {
+    pthread_mutex_lock(&HFlatch);
+    int n = HF_DoReadRecStream(rs, buf, max);
+    pthread_mutex_unlock(&HFlatch);
+    return n;
+}
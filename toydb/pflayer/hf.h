@@ -1,6 +1,7 @@
 #ifndef HF_H
 #define HF_H
 
+#include <stdio.h> // FILE, for HF_LineSource
 #include "pf.h" // We need this for PF_PAGE_SIZE
 
 /*
@@ -23,6 +24,212 @@ typedef struct {
                         /* If length == -1, the slot is free (deleted) */
 } HF_SlotEntry;
 
+/*
+ * A record that outgrew its page on update (HF_UpdateRec) moves to
+ * another page, and its slot becomes a forwarding slot: its length is
+ * HF_SLOT_FORWARD and its offset points at the RID of the moved copy.
+ * The moved copy's length has HF_SLOT_MOVED set, and its data starts
+ * with the RID of the forwarding slot (its home), then the record.
+ */
+#define HF_SLOT_FORWARD   -2
+#define HF_SLOT_MOVED     0x10000
+
+/*
+ * A slot always takes up at least sizeof(RID) bytes, so that it can
+ * become a forwarding slot in place. A record shorter than that is
+ * padded: its slot's length has HF_SLOT_PADDED set, and its bytes are
+ * followed by unused ones up to sizeof(RID).
+ */
+#define HF_SLOT_PADDED    0x40000
+
+/*
+ * A record longer than HF_MAX_INLINE is kept on a chain of overflow
+ * pages. Its slot only holds an HF_OverflowHead (its length has
+ * HF_SLOT_OVERFLOW set), which can move and be forwarded like any
+ * record; the overflow pages stay where they are until the record is
+ * deleted or replaced.
+ */
+#define HF_SLOT_OVERFLOW  0x20000
+
+typedef struct {
+    int length;         /* Of the whole record */
+    int firstPage;      /* First overflow page */
+} HF_OverflowHead;
+
+
+/*
+ * Page 0 of a heap file is the file header page, and some other pages
+ * hold the free-space map (FSM). Both kinds of page start with a
+ * negative number where a data page keeps numSlots, so page-level
+ * scans find no records on them and inserts never pick them.
+ */
+#define HF_PAGE_HEADER    -1   /* "numSlots" of the file header page */
+#define HF_PAGE_FSM       -2   /* "numSlots" of a free-space map page */
+#define HF_PAGE_OVERFLOW  -3   /* "numSlots" of an overflow page */
+#define HF_PAGE_ZONE      -4   /* "numSlots" of a zone-map page */
+
+#define HF_FILE_MAGIC     0x48465331   /* "HFS1" */
+#define HF_MAX_FSM_PAGES  512          /* FSM pages listed in the header */
+#define HF_MAX_ZONE_PAGES 448          /* Zone-map pages listed in the header */
+#define HF_ZONE_MAX_COLS  4            /* Columns a zone map can summarize */
+
+/*
+ * Page layouts of the data pages of a file, chosen at HF_CreateFileEx
+ * time. Files written before layouts existed read back as slotted.
+ */
+#define HF_LAYOUT_SLOTTED 0   /* Whole records, see HF_PageHeader */
+#define HF_LAYOUT_PAX     1   /* One minipage per column, see HF_PaxPage */
+#define HF_LAYOUT_FIXED   2   /* Records of one length, see HF_FixedPage */
+
+#define HF_DEFAULT_SEP    ';'
+#define HF_PAX_MAX_COLS   255
+
+/*
+ * The file header page (page 0). Fields after fsmPages were added
+ * later; older header pages have them zeroed.
+ */
+typedef struct {
+    int pageType;                     /* HF_PAGE_HEADER */
+    int magic;                        /* HF_FILE_MAGIC */
+    int numFsmPages;                  /* Number of FSM pages in use */
+    int fsmPages[HF_MAX_FSM_PAGES];   /* Their page numbers, in order */
+    int layout;                       /* HF_LAYOUT_xxx */
+    int ncols;                        /* PAX: columns per record */
+    int sep;                          /* Column separator, 0 for the default */
+    int recLen;                       /* FIXED: bytes per record */
+    int nzone;                        /* Zone-map columns */
+    int zoneCols[HF_ZONE_MAX_COLS];   /* Their numbers */
+    int numZonePages;                 /* Number of zone-map pages in use */
+    int zonePages[HF_MAX_ZONE_PAGES]; /* Their page numbers, in order */
+    int cluster;                      /* Kept in key order (HF_Recluster) */
+    int clusterCol;                   /* The key column */
+    int clusterFill;                  /* % of a page HF_Recluster fills */
+    int clusterRecs;                  /* Records the last HF_Recluster wrote */
+    int clusterPlaced;                /* Records placed since */
+    int clusterStrays;                /* Of those, away from their key's page */
+    int append;                       /* Append-only (see HF_FileOptions) */
+    int dictLen;                      /* Bytes of the file dictionary */
+    int dictPage;                     /* Its first overflow page */
+} HF_FileHeader;
+
+/*
+ * Options for HF_CreateFileEx.
+ */
+typedef struct {
+    int layout;     /* HF_LAYOUT_xxx */
+    int ncols;      /* PAX: columns per record (1..HF_PAX_MAX_COLS) */
+    char sep;       /* Column separator (0 for HF_DEFAULT_SEP) */
+    int recLen;     /* FIXED: bytes per record (1..HF_FIXED_MAX_LEN) */
+    int nzone;      /* Columns with a zone map (0..HF_ZONE_MAX_COLS) */
+    int zoneCols[HF_ZONE_MAX_COLS];   /* Their numbers, from 0 */
+    int cluster;    /* TRUE: keep the records in clusterCol order */
+    int clusterCol; /* The key column; it gets a zone map */
+    int clusterFill;/* % of a page HF_Recluster fills (0 for HF_CLUSTER_FILL) */
+    int append;     /* TRUE: append-only, see "Append-only files" below */
+} HF_FileOptions;
+
+/*
+ * A PAX data page keeps the records column by column. A record is
+ * split at its first ncols - 1 separators (the last column keeps the
+ * rest); the separators themselves are not stored.
+ *
+ *   [HF_PaxPage header][status minipage][minipage of column 0]...
+ *
+ * mini[0] is the start of the status minipage: one byte per row with
+ * the row's number of columns, or 0 if the row is deleted. mini[c + 1]
+ * is the start of the minipage of column c: numSlots 2-byte end
+ * offsets, then the column's bytes for all rows back to back.
+ * mini[ncols + 1] is the end of the used space; the rest of the page
+ * is free. An insert shifts the later minipages to make room.
+ */
+typedef struct {
+    int numSlots;               /* Rows on the page, deleted ones included */
+    int ncols;                  /* Columns per row */
+    unsigned short mini[];      /* ncols + 2 minipage starts, see above */
+} HF_PaxPage;
+
+/*
+ * A fixed-length data page holds records of exactly recLen bytes and
+ * has no slot directory:
+ *
+ *   [HF_FixedPage header][used bitmap][record 0][record 1]...
+ *
+ * Bit i of the bitmap is set if slot i holds a record, and record i
+ * starts at HF_FixedPage_DataStart(recLen) + i * recLen. A page has
+ * room for HF_FixedPage_Capacity(recLen) records. As on a slotted
+ * page, numSlots is one past the highest slot in use, and an insert
+ * takes the lowest free slot.
+ */
+typedef struct {
+    int numSlots;               /* One past the highest slot in use */
+    int recLen;                 /* Bytes per record */
+    int live;                   /* Records on the page */
+    unsigned char used[4];      /* The bitmap, see above */
+} HF_FixedPage;
+
+#define HF_FIXED_MAX_LEN  (PF_PAGE_SIZE - (int)sizeof(HF_FixedPage))
+
+/*
+ * A free-space map page. Entry i of FSM page k describes page
+ * k * HF_FSM_ENTRIES + i of the file: how much room it has for one
+ * more record, in units of HF_FSM_UNIT bytes (rounded down, capped
+ * at 255). Pages that are not data pages have category 0.
+ */
+#define HF_FSM_UNIT       16
+#define HF_FSM_ENTRIES    (PF_PAGE_SIZE - 2 * (int)sizeof(int))
+
+typedef struct {
+    int pageType;                     /* HF_PAGE_FSM */
+    int firstPage;                    /* Page described by cat[0] */
+    unsigned char cat[HF_FSM_ENTRIES];
+} HF_FsmPage;
+
+/*
+ * A zone map keeps, for each data page and each of the file's zone
+ * columns (HF_FileOptions.zoneCols), the range of the column's numeric
+ * values on the page, as a numeric HF_Pred reads them. A scan with
+ * numeric predicates on zone columns does not read the pages whose
+ * ranges rule the predicates out. A value that is not a number matches
+ * no numeric predicate, so it is left out of the range; empty values
+ * are only counted.
+ *
+ * An insert widens the page's entries; a delete, an update or the
+ * vacuum works them out again from the page's rows, so they stay
+ * tight. A page whose entries are not known is always read.
+ */
+typedef struct {
+    double min;         /* Smallest value; min > max if there is none */
+    double max;         /* Largest value */
+    int nulls;          /* Rows where the column is empty */
+    int other;          /* Rows not summarized (long records, NaN), or -1
+                           if the page is not summarized at all */
+} HF_ZoneEntry;
+
+/*
+ * A zone-map page. With nzone zone columns, zone page k describes
+ * pages k * (HF_ZONE_ENTRIES / nzone) on, one after the other, with
+ * the entries of a page next to each other in zoneCols order.
+ */
+#define HF_ZONE_ENTRIES   ((PF_PAGE_SIZE - 2 * (int)sizeof(int)) / (int)sizeof(HF_ZoneEntry))
+
+typedef struct {
+    int pageType;                     /* HF_PAGE_ZONE */
+    int firstPage;                    /* Page described by e[0] */
+    HF_ZoneEntry e[HF_ZONE_ENTRIES];
+} HF_ZonePage;
+
+/*
+ * An overflow page: the next part of a long record, and the page with
+ * the part after it (-1 on the last page).
+ */
+#define HF_OVERFLOW_BYTES (PF_PAGE_SIZE - 3 * (int)sizeof(int))
+
+typedef struct {
+    int pageType;                     /* HF_PAGE_OVERFLOW */
+    int next;                         /* Next overflow page, or -1 */
+    int length;                       /* Bytes of data[] in use */
+    char data[HF_OVERFLOW_BYTES];
+} HF_OverflowPage;
 
 /* A Record ID (RID) uniquely identifies a record in the file.
  * It consists of the page number and the slot number.
@@ -38,6 +245,16 @@ typedef struct {
 #define HFE_PAGENOFREE    -20   /* Page has no free space */
 #define HFE_INVALIDSLOT   -21   /* Invalid slot number */
 #define HFE_EOF           -22   /* End of file */
+#define HFE_BADOPTIONS    -23   /* Bad HF_FileOptions */
+#define HFE_BUSY          -24   /* A scan or vacuum of the file is running */
+#define HFE_OVERFLOW      -25   /* The record is on overflow pages */
+
+/*
+ * Longest record kept in its slot: one that fits on an empty page even
+ * as a moved copy. Longer ones go to overflow pages.
+ */
+#define HF_MAX_INLINE     (PF_PAGE_SIZE - (int)sizeof(HF_PageHeader) - \
+                           (int)sizeof(HF_SlotEntry) - (int)sizeof(RID))
 
 /*
  * Function prototypes for the HF layer
@@ -46,26 +263,155 @@ typedef struct {
 // Initializes a new slotted page
 void HF_InitPage(char *pageBuf);
 
-// Inserts a new record
+// Inserts a new record, reusing a deleted slot if there is one; a
+// record shorter than sizeof(RID) is padded (HF_SLOT_PADDED)
 int HF_Page_InsertRec(char *pageBuf, char *record, int recLen);
 
-// Deletes a record
+// Deletes a record; its slot may be reused by a later insert
 int HF_Page_DeleteRec(char *pageBuf, int slotNum);
 
-// Gets a specific record
+// Moves the live records together, keeping their slots
+void HF_Page_Compact(char *pageBuf);
+
+// Gets a specific record (a moved copy's without its home RID). For
+// a long record it points *record at its HF_OverflowHead and returns
+// HFE_OVERFLOW.
 int HF_Page_GetRec(char *pageBuf, int slotNum, char **record, int *recLen);
 
-// Gets the next valid record
+// Gets the next valid record, passing over forwarding slots; a long
+// record's slot is returned too, with *record at its HF_OverflowHead
 int HF_Page_GetNextRec(char *pageBuf, int currentSlotNum, char **record, int *recLen);
 
+// HFE_OK with *head set if slotNum holds a long record (or its moved copy)
+int HF_Page_GetOverflow(char *pageBuf, int slotNum, HF_OverflowHead *head);
+
+// Replaces a record (or a forwarding slot) in its slot, if it fits;
+// a moved copy keeps its home RID. Returns HFE_PAGENOFREE if not.
+int HF_Page_UpdateRec(char *pageBuf, int slotNum, char *record, int recLen);
+
+// Inserts a moved copy of the record whose home is RID home
+int HF_Page_InsertMoved(char *pageBuf, RID home, char *record, int recLen);
+
+// Turns a slot into a forwarding slot to RID to, or re-points one
+int HF_Page_SetForward(char *pageBuf, int slotNum, RID to);
+
+// HFE_OK with *to set if slotNum is a forwarding slot
+int HF_Page_GetForward(char *pageBuf, int slotNum, RID *to);
+
+// HFE_OK with *home set if slotNum holds a moved copy
+int HF_Page_GetHome(char *pageBuf, int slotNum, RID *home);
+
+// Largest record that can still be inserted on the page (if need be
+// after compacting it)
+int HF_Page_FreeSpace(char *pageBuf);
+
+/*
+ * PAX page functions, the counterparts of the HF_Page_xxx ones.
+ * HF_PaxPage_GetRec copies the record, rebuilt with sep between the
+ * columns, to out (room for PF_PAGE_SIZE + HF_PAX_MAX_COLS bytes).
+ * HF_PaxPage_GetField points *field at one column of a row, in the
+ * page. HF_PaxPage_NextSlot returns the next live slot after
+ * currentSlotNum, or HFE_EOF.
+ */
+void HF_PaxPage_Init(char *pageBuf, int ncols);
+int HF_PaxPage_InsertRec(char *pageBuf, char sep, char *record, int recLen);
+int HF_PaxPage_DeleteRec(char *pageBuf, int slotNum);
+int HF_PaxPage_GetRec(char *pageBuf, char sep, int slotNum, char *out, int *recLen);
+int HF_PaxPage_GetField(char *pageBuf, int slotNum, int col, char **field, int *len);
+int HF_PaxPage_NextSlot(char *pageBuf, int currentSlotNum);
+int HF_PaxPage_FreeSpace(char *pageBuf);
+
+/*
+ * Fixed-length page functions. A record must be recLen bytes long
+ * (else HFE_BADOPTIONS). HF_FixedPage_GetRec points *record into the
+ * page, and HF_FixedPage_UpdateRec overwrites a record in place.
+ * HF_FixedPage_FreeSpace is the bytes of the free slots, rounded up
+ * to whole HF_FSM_UNITs, so that the free-space map finds a page with
+ * one free slot for a record of recLen bytes.
+ */
+int HF_FixedPage_Capacity(int recLen);
+int HF_FixedPage_DataStart(int recLen);
+void HF_FixedPage_Init(char *pageBuf, int recLen);
+int HF_FixedPage_InsertRec(char *pageBuf, char *record, int recLen);
+int HF_FixedPage_DeleteRec(char *pageBuf, int slotNum);
+int HF_FixedPage_GetRec(char *pageBuf, int slotNum, char **record, int *recLen);
+int HF_FixedPage_UpdateRec(char *pageBuf, int slotNum, char *record, int recLen);
+int HF_FixedPage_NextSlot(char *pageBuf, int currentSlotNum);
+int HF_FixedPage_FreeSpace(char *pageBuf);
+
+/*
+ * Page functions for the layout in opts, for code that builds
+ * pages itself (HF_BulkLoad, HF_LoadTextFile).
+ */
+void HF_InitPageEx(const HF_FileOptions *opts, char *pageBuf);
+int HF_Page_InsertRecEx(const HF_FileOptions *opts, char *pageBuf, char *record, int recLen);
+int HF_Page_FreeSpaceEx(const HF_FileOptions *opts, char *pageBuf);
+
 /*
  * Creates a new, empty heap file.
  */
 int HF_CreateFile(char *fileName);
 
+/*
+ * Creates a new, empty heap file with the page layout in opts
+ * (NULL for slotted pages). The layout is kept in the header page.
+ * A file of HF_LAYOUT_FIXED pages takes records of opts->recLen bytes
+ * only, e.g. the binary tuples of a schema without strings (tuple.h).
+ * The columns in opts->zoneCols get a zone map (see HF_ZoneEntry);
+ * on PAX pages they must be below opts->ncols. With opts->cluster set
+ * the file is clustered on opts->clusterCol (see HF_Recluster), which
+ * is added to the zone columns if it is not one. A file cannot be both
+ * clustered and append-only (opts->append).
+ *
+ * Returns:
+ * HFE_OK, HFE_BADOPTIONS if the options are not valid, or a PF
+ * error code
+ */
+int HF_CreateFileEx(char *fileName, HF_FileOptions *opts);
+
+/*
+ * Gets the page layout of an open file.
+ */
+int HF_GetFileOptions(int fd, HF_FileOptions *opts);
+
+/*
+ * Gets the zone-map entry of the k-th zone column (k < nzone) of a
+ * page.
+ *
+ * Returns:
+ * HFE_OK, HFE_EOF if the page is not summarized, or HFE_BADOPTIONS
+ * if the file has no k-th zone column
+ */
+int HF_GetZone(int fd, int pagenum, int k, HF_ZoneEntry *zone);
+
+/*
+ * A file can keep one dictionary for the layer above it, such as the
+ * schema and values of its binary tuples (TT_DictSave). The bytes mean
+ * nothing to the HF layer. They are kept on overflow pages listed in
+ * the header, read by HF_OpenFile, and replaced as a whole by
+ * HF_SetDict; len 0 drops them.
+ *
+ * Returns:
+ * HFE_OK, HFE_BADOPTIONS for a file without a header page, or a PF
+ * error code
+ */
+int HF_SetDict(int fd, const char *data, int len);
+
+/*
+ * Gets the file's dictionary. *data points to the HF layer's copy,
+ * which stays valid until the next HF_SetDict or HF_CloseFile; *len
+ * is 0 if the file has none.
+ */
+int HF_GetDict(int fd, const char **data, int *len);
+
 /*
  * Opens an existing heap file.
  * Returns a file descriptor (fd) from the PF layer.
+ *
+ * The free-space map and the zone map are loaded into memory here,
+ * and written back by HF_CloseFile. Files written before the header
+ * page existed have their map rebuilt by a scan and kept in memory
+ * only.
  */
 int HF_OpenFile(char *fileName);
 
@@ -75,7 +421,11 @@ int HF_OpenFile(char *fileName);
 int HF_CloseFile(int fd);
 
 /*
- * Inserts a record into the file.
+ * Inserts a record into the file, on a page that the free-space map
+ * says has enough room, or on a new page if there is none. A record
+ * longer than HF_MAX_INLINE is written to new overflow pages first,
+ * and its slot gets their HF_OverflowHead. An append-only file puts
+ * the record on its tail page instead (see "Append-only files").
  *
  * Inputs:
  * fd: The file descriptor
@@ -86,12 +436,92 @@ int HF_CloseFile(int fd);
  * rid: The RID of the newly inserted record
  *
  * Returns:
- * HFE_OK on success, or an error code
+ * HFE_OK on success, HFE_BADOPTIONS if the file has fixed-length
+ * records of another length, or an error code
  */
 int HF_InsertRec(int fd, char *record, int recLen, RID *rid);
 
 /*
- * Deletes a record from the file, given its RID.
+ * Record source for HF_BulkLoad. Called once per record with the
+ * ctx given to HF_BulkLoad; sets *record and *recLen and returns 1,
+ * or returns 0 when there are no more records (< 0 on error). The
+ * record only has to stay valid until the next call.
+ */
+typedef int (*HF_RecordIter)(void *ctx, char **record, int *recLen);
+
+/*
+ * Bulk-loads records into the file.
+ *
+ * Data pages are built in a private buffer, filled up to
+ * fillFactor percent (1..100) of the page, and appended to the end of
+ * the file in large sequential writes (PF_AppendPages) instead of
+ * going through the buffer pool one record at a time. Existing pages
+ * are not touched.
+ *
+ * Outputs:
+ * rids: If not NULL, set to a malloc'ed array with the RIDs of the
+ *       loaded records, in load order. The caller frees it.
+ * numRids: Number of records loaded
+ *
+ * A record longer than HF_MAX_INLINE is written to overflow pages
+ * right away, as for HF_InsertRec.
+ *
+ * Returns:
+ * HFE_OK on success, HFE_PAGENOFREE if a PAX record is larger than a
+ * page, HFE_BADOPTIONS if a record does not have a fixed-length
+ * file's length, the iterator's error, or a PF error code
+ */
+int HF_BulkLoad(int fd, HF_RecordIter next, void *ctx, int fillFactor,
+                RID **rids, int *numRids);
+
+/*
+ * Appends npages finished data pages (PF_PAGE_SIZE bytes each, built
+ * with HF_InitPageEx/HF_Page_InsertRecEx for the file's layout) to
+ * the end of the file and records them in the free-space map.
+ * *firstPage is set to the page number of the first one; the others
+ * follow in order. If the append fails, none of the pages is added.
+ */
+int HF_AppendPages(int fd, char *pages, int npages, int *firstPage);
+
+/*
+ * Loads a text file, one record per line, with nthreads threads.
+ *
+ * The file is mmapped and cut at newlines into chunks. The threads
+ * each take a chunk at a time and build its pages (filled to
+ * fillFactor percent). The calling thread appends the finished chunks
+ * to the file with HF_AppendPages, in file order, so the records end
+ * up in the same order as with HF_BulkLoad. Trailing "\r"s are
+ * stripped from each line, as HF_NextLine does.
+ *
+ * Outputs:
+ * numRecs: Number of records loaded
+ *
+ * Returns:
+ * HFE_OK on success, HFE_PAGENOFREE if a line is larger than a page,
+ * HFE_BADOPTIONS for a file of fixed-length records, or a PF error
+ * code
+ */
+int HF_LoadTextFile(int fd, char *fileName, int nthreads, int fillFactor,
+                    int *numRecs);
+
+/*
+ * HF_BulkLoad record source over a text file, one record per line.
+ * The line loses its "\n" and any "\r"s before it, as in
+ * HF_LoadTextFile. A line longer than HF_MAX_LINE - 1 bytes comes
+ * back in pieces. ctx is an HF_LineSource with fp open for reading.
+ */
+#define HF_MAX_LINE 4096
+
+typedef struct {
+    FILE *fp;
+    char line[HF_MAX_LINE];
+} HF_LineSource;
+
+int HF_NextLine(void *ctx, char **record, int *recLen);
+
+/*
+ * Deletes a record from the file, given its RID. The overflow pages
+ * of a long record go back to the PF free list.
  */
 int HF_DeleteRec(int fd, RID rid);
 
@@ -100,24 +530,130 @@ int HF_DeleteRec(int fd, RID rid);
  *
  * Outputs:
  * record: Pointer to the record data *within the buffer page*
+ *         (PAX files and long records: within a buffer of the file,
+ *         valid until the next call on the file)
  * recLen: Length of the record
  */
 int HF_GetRec(int fd, RID rid, char **record, int *recLen);
 
+/*
+ * Reads a record a piece at a time, so that a long one does not have
+ * to be put together in memory: HF_OpenRecStream, then
+ * HF_ReadRecStream until it returns 0. The record must not change
+ * meanwhile. There is nothing to close.
+ */
+typedef struct {
+    int fd;
+    RID rid;
+    int length;         /* Of the whole record */
+    int pos;            /* Bytes read so far */
+    int page;           /* Overflow page holding byte pos, or -1 */
+    int pageOff;        /* Where byte pos is in that page's data[] */
+} HF_RecStream;
+
+int HF_OpenRecStream(int fd, RID rid, HF_RecStream *rs);
+
+/*
+ * Copies the next (up to) max bytes of the record to buf.
+ *
+ * Returns:
+ * The number of bytes copied, 0 at the end of the record, or an
+ * error code
+ */
+int HF_ReadRecStream(HF_RecStream *rs, char *buf, int max);
+
+/*
+ * Replaces a record, keeping its RID.
+ *
+ * The record is rewritten in place if it still fits on its page.
+ * Otherwise it moves to another page and its slot forwards to it
+ * (HF_SLOT_FORWARD). HF_GetRec and HF_DeleteRec follow the forward;
+ * there is never more than one, since a moved record that grows again
+ * moves on from its copy and the forward is re-pointed, and one that
+ * fits its home page again goes back there. Scans return a moved
+ * record once, at its copy, with its home RID.
+ *
+ * A record longer than HF_MAX_INLINE gets new overflow pages, and
+ * the old record's overflow pages are freed. In a file of fixed-length
+ * records every update is in place.
+ *
+ * Returns:
+ * HFE_OK, HFE_INVALIDSLOT if rid is not a record, HFE_BADOPTIONS for
+ * a PAX file (its rows cannot grow in place) or a record of the wrong
+ * length for a fixed-length file, or a PF error code
+ */
+int HF_UpdateRec(int fd, RID rid, char *record, int recLen);
+
 /*
  * ======================================================
  * File Scan Function Prototypes
  * ======================================================
  */
 
+/*
+ * Scan conditions for HF_OpenFileScanEx: "column op constant". A
+ * numeric condition parses the column as a number; any other compares
+ * the column's bytes with the constant (memcmp order, shorter first).
+ * An empty column matches no condition.
+ */
+#define HF_MAX_PREDS  8
+#define HF_MAX_PROJ   64
+
+typedef enum { HF_EQ, HF_NE, HF_LT, HF_LE, HF_GT, HF_GE } HF_CompOp;
+
+typedef struct {
+    int col;                /* Column, from 0 */
+    HF_CompOp op;
+    int numeric;            /* Compare as numbers (num) or bytes (str) */
+    double num;
+    const char *str;        /* Must stay valid while the scan is open */
+    int strLen;
+} HF_Pred;
+
+/*
+ * What a scan returns: the records where every predicate holds (AND),
+ * cut down to the columns in proj[] (all of the record if nproj is 0).
+ */
+typedef struct {
+    int npreds;
+    HF_Pred preds[HF_MAX_PREDS];
+    int nproj;
+    int proj[HF_MAX_PROJ];
+} HF_ScanSpec;
+
 // This struct will keep track of the scanner's state
 typedef struct {
     int   fd;             // The file descriptor
     int   currentPageNum; // Page number of the current page
     int   currentSlotNum; // Slot number of the last record found
     char *currentPageBuf; // Pinned buffer for the current page
+    int   hasSpec;        // Set by HF_OpenFileScanEx
+    int   batchPageDone;  // The open batch took the page's last record
+    int   maxCol;         // Highest column spec refers to
+    HF_ScanSpec spec;
+    char *ovfBuf;         // Long records are put together here
+    int   ovfCap;         // Bytes allocated at ovfBuf
+    int   ovfPage, ovfSlot, ovfLen;   // The long record in ovfBuf
+    char *rowBuf;         // PAX records are rebuilt here
+    int   useZones;       // A predicate can rule out pages (zone maps)
 } HF_Scan;
 
+/*
+ * Rows returned by HF_GetNextRows. Row i is the projected record of
+ * rid[i]: len[i] bytes at buf + off[i], columns joined by the file's
+ * separator.
+ */
+#define HF_BATCH_ROWS   256
+#define HF_BATCH_BYTES  (64 * 1024)
+
+typedef struct {
+    int n;
+    RID rid[HF_BATCH_ROWS];
+    int off[HF_BATCH_ROWS];
+    int len[HF_BATCH_ROWS];
+    char buf[HF_BATCH_BYTES];
+} HF_RowBatch;
+
 
 /*
  * Opens a new file scan.
@@ -130,10 +666,47 @@ typedef struct {
  * initialized by this function.
  *
  * Returns:
- * HFE_OK on success
+ * HFE_OK on success, or the error that kept an append-only file's
+ * pages in memory from being written out
  */
 int HF_OpenFileScan(int fd, HF_Scan *scan);
 
+/*
+ * Opens a file scan that only returns records matching spec (see
+ * HF_ScanSpec), which is copied into the scan. The predicates are
+ * checked on the page, inside the slot loop, so records that do not
+ * match never leave the page layer. HF_GetNextRec on such a scan
+ * returns the matching records whole; HF_GetNextRows returns them
+ * projected, many at a time. Pages that the zone map rules out for a
+ * numeric predicate are not read at all.
+ *
+ * Returns:
+ * HFE_OK, or HFE_BADOPTIONS if spec has too many predicates or
+ * columns
+ */
+int HF_OpenFileScanEx(int fd, HF_Scan *scan, const HF_ScanSpec *spec);
+
+/*
+ * Fills batch with the next matching records of a scan, projected and
+ * copied out of the pages, so no page stays pinned for them.
+ *
+ * Returns:
+ * HFE_OK with batch->n > 0, HFE_EOF when the scan is over,
+ * HFE_PAGENOFREE if the next row is longer than HF_BATCH_BYTES (read
+ * it with HF_GetNextRec), or an error code
+ */
+int HF_GetNextRows(HF_Scan *scan, HF_RowBatch *batch);
+
+/*
+ * Page-level matching: the next live slot after currentSlotNum whose
+ * record satisfies the predicates of spec (columns split at sep), or
+ * HFE_EOF. maxCol is the highest column the predicates use. A long
+ * record is returned unchecked, since its bytes are not on the page.
+ */
+int HF_Page_GetNextMatch(char *pageBuf, int currentSlotNum, const HF_ScanSpec *spec,
+                         int maxCol, char sep);
+int HF_PaxPage_GetNextMatch(char *pageBuf, int currentSlotNum, const HF_ScanSpec *spec);
+
 /*
  * Retrieves the next valid record in the file scan.
  *
@@ -142,18 +715,501 @@ int HF_OpenFileScan(int fd, HF_Scan *scan);
  *
  * Outputs:
  * rid: The RID of the next record
- * record: Pointer to the record's data
+ * record: Pointer to the record's data (as for HF_GetRec)
  * recLen: Length of the record
  *
+ * record and recLen may be NULL to only move to the next record,
+ * e.g. to read some of its columns with HF_ScanGetField; PAX files
+ * then skip rebuilding the record. A long record, or a record of a PAX
+ * file, is put together in a buffer of the scan, valid until the next
+ * call on the scan.
+ *
  * Returns:
  * HFE_OK on success
  * HFE_EOF when no more records are found
  */
 int HF_GetNextRec(int fd, HF_Scan *scan, RID *rid, char **record, int *recLen);
 
+/*
+ * Gets column col of the record the scan is on. On a PAX page this
+ * points into the column's minipage; on a slotted page the record is
+ * split at the file's separator.
+ *
+ * Returns:
+ * HFE_OK, or HFE_INVALIDSLOT if the record has no such column
+ */
+int HF_ScanGetField(HF_Scan *scan, int col, char **field, int *len);
+
+/*
+ * Retrieves up to max records of the scan, all from one page, without
+ * copying them: records[i] points into the pinned page (for PAX files,
+ * into a buffer of the scan the page's records are rebuilt in). The
+ * pointers stay valid until HF_ReleaseBatch, which must be called
+ * before the next HF_GetNextBatch or HF_GetNextRec on the scan. A scan
+ * opened with HF_OpenFileScanEx only returns matching records (whole,
+ * not projected). A long record comes in a batch of its own, in a
+ * buffer of the scan.
+ *
+ * Outputs:
+ * rids, records, lens: Filled with n entries
+ * n: Number of records returned, at least 1 on HFE_OK
+ *
+ * Returns:
+ * HFE_OK, HFE_EOF when no more records are found, or an error code
+ */
+int HF_GetNextBatch(HF_Scan *scan, int max, RID *rids, char **records, int *lens,
+                    int *n);
+
+/*
+ * Ends the batch returned by HF_GetNextBatch. If it held the last
+ * records of its page, the page is unpinned.
+ */
+int HF_ReleaseBatch(HF_Scan *scan);
+
 /*
  * Closes a file scan.
  */
 int HF_CloseFileScan(HF_Scan *scan);
 
-#endif // HF_H
\ No newline at end of file
+/*
+ * ======================================================
+ * Parallel Scans (hfscan.c)
+ * ======================================================
+ */
+
+/*
+ * A parallel scan splits the file into morsels: runs of morselPages
+ * consecutive pages (never crossing a tablespace segment). Threads
+ * take the next morsel with HF_NextMorsel until none are left, so a
+ * fast thread simply takes more of them, and scan each one with
+ * HF_ScanMorsel. Each thread has its own HF_RowBatch; when it is full
+ * it is handed to an HF_BatchFn, which merges the rows into the
+ * result (e.g. into per-worker totals added up at the end).
+ *
+ * The file must not be changed while a parallel scan runs.
+ */
+#define HF_MORSEL_PAGES 16
+
+typedef struct {
+    HF_Scan proto;          // fd and spec, copied into every morsel's scan
+    int numPages;           // Pages of the file when the scan was opened
+    int morselPages;
+    int nextPage;           // First page of the next morsel
+} HF_ParScan;
+
+/*
+ * Called with a full (or, at the end, the last) batch of one worker.
+ * Calls for different workers may run at the same time.
+ */
+typedef void (*HF_BatchFn)(void *ctx, int worker, HF_RowBatch *batch);
+
+/*
+ * Opens a parallel scan. spec may be NULL to return whole records;
+ * otherwise it works as for HF_OpenFileScanEx. morselPages <= 0
+ * selects HF_MORSEL_PAGES.
+ *
+ * Returns:
+ * HFE_OK, HFE_BADOPTIONS for a bad spec, or PFE_FD
+ */
+int HF_OpenParScan(int fd, HF_ParScan *ps, const HF_ScanSpec *spec, int morselPages);
+
+/*
+ * Takes the next morsel, pages [*firstPage, *endPage). Thread-safe.
+ *
+ * Returns:
+ * HFE_OK, or HFE_EOF when every morsel has been taken
+ */
+int HF_NextMorsel(HF_ParScan *ps, int *firstPage, int *endPage);
+
+/*
+ * Adds the matching rows of pages [firstPage, endPage) to batch,
+ * projected as for HF_GetNextRows, calling fn(ctx, worker, batch)
+ * and emptying it whenever it is full. Rows still in the batch at the
+ * end are left for the caller. Each page is pinned only while its
+ * slots are looked at.
+ *
+ * Returns:
+ * HFE_OK, HFE_PAGENOFREE if a row is longer than HF_BATCH_BYTES, or a
+ * PF error code
+ */
+int HF_ScanMorsel(HF_ParScan *ps, int firstPage, int endPage, HF_RowBatch *batch,
+                  HF_BatchFn fn, void *ctx, int worker);
+
+/*
+ * Runs a whole parallel scan with nthreads threads, each with its own
+ * batch, and waits for them.
+ *
+ * Outputs:
+ * numRows: Number of rows handed to fn
+ *
+ * Returns:
+ * HFE_OK, or the first error of any thread
+ */
+int HF_RunParScan(HF_ParScan *ps, int nthreads, HF_BatchFn fn, void *ctx,
+                  long *numRows);
+
+/* Closes a parallel scan; every worker must be done with it */
+int HF_CloseParScan(HF_ParScan *ps);
+
+/*
+ * ======================================================
+ * Statistics (hfstats.c)
+ * ======================================================
+ */
+
+/*
+ * HF_Analyze gathers what a planner needs to guess how many rows a
+ * scan returns: the row count, the average record length and, for
+ * each of the first ncols columns, how many values are empty or
+ * numeric, the most common numbers, an equi-depth histogram of the
+ * other numbers (every bucket holds about as many values) and a
+ * HyperLogLog sketch of the distinct values. A number is one of the
+ * most common if it alone would fill a histogram bucket. Columns are
+ * split at the file's separator and numbers are read as a numeric
+ * HF_Pred reads them.
+ *
+ * With samplePct < 100 only about that share of the pages is read
+ * (the same pages each time), and the counts are scaled up. The
+ * distinct count is then estimated from how often each value turned
+ * up in the sample (the GEE estimator); the sketch holds the sampled
+ * values only.
+ */
+#define HF_STATS_COLS    32
+#define HF_HIST_BUCKETS  32
+#define HF_STATS_MCV     8
+#define HF_HLL_BITS      10
+#define HF_HLL_REGS      (1 << HF_HLL_BITS)
+#define HF_STATS_MAGIC   0x48465354      /* "HFST" */
+
+typedef struct {
+    long nulls;                 /* Rows where the column is empty or missing */
+    long numeric;               /* Rows where it is a number */
+    double min, max;            /* Of the numbers */
+    double distinct;            /* Distinct non-empty values (estimate) */
+    int nmcv;                   /* Most common numbers, most common first */
+    double mcv[HF_STATS_MCV];
+    double mcvShare[HF_STATS_MCV];        /* Their shares of the numbers */
+    int nbuckets;               /* Histogram buckets, 0 if no other numbers */
+    double bounds[HF_HIST_BUCKETS + 1];   /* Bucket b is bounds[b] .. bounds[b + 1] */
+    unsigned char hll[HF_HLL_REGS];       /* HyperLogLog registers */
+} HF_ColStats;
+
+typedef struct {
+    int magic;                  /* HF_STATS_MAGIC */
+    int samplePct;              /* 100 if every page was read */
+    int pages;                  /* Pages of the file */
+    int pagesRead;
+    long rows;                  /* Records (scaled up if sampled) */
+    double avgLen;              /* Average record length in bytes */
+    int ncols;                  /* Columns 0 .. ncols - 1 were analyzed */
+    HF_ColStats col[HF_STATS_COLS];
+} HF_Stats;
+
+/*
+ * Analyzes the first ncols columns (at most HF_STATS_COLS) of a file,
+ * reading samplePct percent of its pages (1..100). A sampled file with
+ * a record longer than HF_BATCH_BYTES is read in full instead.
+ *
+ * Returns:
+ * HFE_OK, HFE_BADOPTIONS for a bad ncols or samplePct, or a PF error
+ * code
+ */
+int HF_Analyze(int fd, int ncols, int samplePct, HF_Stats *stats);
+
+/*
+ * Saves stats next to the heap file fileName, as fileName.stats, or
+ * loads them from there. The stats are not kept up to date as the file
+ * changes; compare pages with PF_NumPages to see how far they are off.
+ *
+ * Returns:
+ * HFE_OK, HFE_EOF if there are no (valid) stats to load, or PFE_UNIX
+ */
+int HF_SaveStats(char *fileName, const HF_Stats *stats);
+int HF_LoadStats(char *fileName, HF_Stats *stats);
+
+/*
+ * Estimates how many rows a scan with spec returns. Numeric ranges
+ * are looked up in the most common numbers and the histogram (all
+ * those on one column together), equality in the most common numbers
+ * or else as 1/distinct; a column that was not analyzed, or a range
+ * on text, gets a fixed guess. Predicates on different columns are
+ * taken to be independent.
+ */
+double HF_EstimateRows(const HF_Stats *stats, const HF_ScanSpec *spec);
+
+/*
+ * ======================================================
+ * Snapshots (hfsnap.c)
+ * ======================================================
+ */
+
+/*
+ * A snapshot is a sealed, read-only copy of a heap file for tables
+ * that no longer change. The records are packed back to back in RID
+ * order from offset 0. The index starts on the next page boundary:
+ * for every page of the heap file an HF_SnapPage, then for every
+ * record its slot number (2 bytes) and where it ends (4 bytes, from
+ * the start of its page's records). An HF_SnapTrailer at the very end
+ * of the file, which is padded to whole pages, says where they are.
+ *
+ * HF_OpenSnapshot maps the file, checks the trailer and walks the
+ * page list and the record ends once, so that no page or record of the
+ * index points outside the records. Records are returned as pointers into the
+ * mapping: no copy, no buffer pool, no PF calls. The RIDs are those of
+ * the heap file, so an index built on it works on the snapshot too.
+ */
+#define HF_SNAP_MAGIC    0x48465350      /* "HFSP" */
+
+typedef struct {
+    long off;               /* Of the page's first record, from the start of the file */
+    int first;              /* Its first record, in RID order */
+    int unused;
+} HF_SnapPage;
+
+typedef struct {
+    int magic;              /* HF_SNAP_MAGIC */
+    int numRecs;
+    int numPages;           /* Pages of the heap file */
+    int sep;                /* Its column separator */
+    long dataLen;           /* Bytes of records, from offset 0 */
+    long pageOff;           /* HF_SnapPage pages[numPages + 1] */
+    long endOff;            /* unsigned int ends[numRecs] */
+    long slotOff;           /* unsigned short slots[numRecs] */
+} HF_SnapTrailer;
+
+typedef struct {
+    char *base;             /* The mapped file */
+    long size;
+    int numRecs;
+    int numPages;
+    char sep;
+    const HF_SnapPage *pages;   /* Page p: records pages[p].first .. pages[p + 1].first - 1 */
+    const unsigned int *ends;
+    const unsigned short *slots;
+} HF_Snapshot;
+
+typedef struct {
+    int pageNum;            /* Page of the next record */
+    int next;               /* Next record */
+} HF_SnapScan;
+
+/*
+ * Writes a snapshot of an open heap file to snapName. It is written
+ * to snapName.tmp first and renamed when complete, so snapName is
+ * always a whole snapshot. The file must not change meanwhile.
+ *
+ * Returns:
+ * HFE_OK, HFE_BADOPTIONS if a page's records add up to 4 GB or more
+ * (or a slot number does not fit 2 bytes), or a PF error code (PFE_UNIX
+ * if the file cannot be written)
+ */
+int HF_WriteSnapshot(int fd, char *snapName);
+
+/*
+ * Opens a snapshot.
+ *
+ * Returns:
+ * HFE_OK, HFE_BADOPTIONS if the file is not a snapshot or its index
+ * points outside its records, or PFE_UNIX
+ */
+int HF_OpenSnapshot(char *snapName, HF_Snapshot *snap);
+
+/*
+ * Gets the record with the given RID (of the heap file). *record points
+ * into the mapping and must not be written to.
+ *
+ * Returns:
+ * HFE_OK, or HFE_INVALIDSLOT if there is no such record
+ */
+int HF_SnapGetRec(const HF_Snapshot *snap, RID rid, char **record, int *recLen);
+
+/*
+ * Scans a snapshot in RID order: HF_SnapOpenScan starts a scan, and
+ * HF_SnapGetNext returns the next record as HF_SnapGetRec does, or
+ * HFE_EOF. A scan holds nothing, so it needs no closing.
+ */
+void HF_SnapOpenScan(HF_SnapScan *scan);
+int HF_SnapGetNext(const HF_Snapshot *snap, HF_SnapScan *scan, RID *rid, char **record,
+                   int *recLen);
+
+/* Unmaps a snapshot; the records it returned are gone with it */
+int HF_CloseSnapshot(HF_Snapshot *snap);
+
+/*
+ * ======================================================
+ * Vacuum
+ * ======================================================
+ */
+
+/*
+ * A vacuum pass first compacts each data page that has deleted
+ * records. It then goes through the pages from the end of the file
+ * to the start, emptying each sparse page (less than sparsePct
+ * percent used), and each page past the ones the file's records
+ * would fill, by moving its records into the first earlier pages
+ * that have room.
+ * Pages left empty go back to the PF free list (PF_DisposePage), and
+ * at the end of the pass the free pages at the end of the file are
+ * cut off (PF_TruncateFile), so scans no longer read them.
+ *
+ * A moved record gets a new RID, and so do the rows of a compacted
+ * PAX page, which is rebuilt. For each one, fn(ctx, oldRid, newRid)
+ * is called, e.g. to fix up index entries. fn may be NULL; it must
+ * not call the HF layer for the same file. A pass that reclusters a
+ * clustered file (see HF_Recluster) calls fn as HF_Recluster does.
+ *
+ * Each call can be applied as it comes: when it is made, no other
+ * record has newRid, and no later call has newRid as its oldRid
+ * unless it moves the same record on. A record may be moved through
+ * a staged RID, whose pageNum is HF_RID_STAGED: no page has that
+ * number, and a later call moves the record from it to its new RID.
+ *
+ * Only the head of a long record moves; its overflow pages stay put,
+ * and they count as full pages when the pass sizes the file.
+ *
+ * On an append-only file, each step first writes out the pages still
+ * in memory and carries out the deletes kept as tombstones, so the
+ * vacuum is also that file's compaction pass.
+ *
+ * The vacuum never runs while a scan of the file is open.
+ */
+#define HF_VACUUM_SPARSE  50    /* A good default for sparsePct */
+#define HF_RID_STAGED     -1    /* pageNum of a staged RID */
+
+typedef void (*HF_RelocFn)(void *ctx, RID oldRid, RID newRid);
+
+/* Added to by each call; zero it before the first */
+typedef struct {
+    int pagesScanned;
+    int pagesCompacted;
+    int recordsMoved;
+    int pagesFreed;         /* Given back to the PF free list */
+    int pagesTrimmed;       /* Cut off the end of the file */
+    int reclusters;         /* Passes that reclustered the file instead */
+    int tombstones;         /* Deletes of an append-only file carried out */
+} HF_VacuumStats;
+
+/*
+ * Vacuums the next maxPages pages of the current pass, so a vacuum
+ * can be spread out between other work.
+ *
+ * Returns:
+ * HFE_OK if the pass goes on, HFE_EOF when it has ended (the next
+ * call starts a new one), HFE_BUSY if a scan or background vacuum of
+ * the file is running, or an error code
+ */
+int HF_VacuumStep(int fd, int maxPages, int sparsePct, HF_RelocFn fn, void *ctx,
+                  HF_VacuumStats *stats);
+
+/* Runs (the rest of) a pass to its end */
+int HF_Vacuum(int fd, int sparsePct, HF_RelocFn fn, void *ctx, HF_VacuumStats *stats);
+
+/*
+ * Starts a thread that does a vacuum step of pagesPerStep pages every
+ * intervalMs milliseconds, passes after passes, until HF_StopVacuum or
+ * HF_CloseFile. fn is called on that thread. Record calls of the HF
+ * layer on the file may go on meanwhile; a step waits for the one
+ * running, and the other way round. HF_BulkLoad and HF_LoadTextFile
+ * are not covered: stop the vacuum around them.
+ */
+int HF_StartVacuum(int fd, int pagesPerStep, int intervalMs, int sparsePct,
+                   HF_RelocFn fn, void *ctx);
+
+/*
+ * Stops the background vacuum and waits for it to finish its step.
+ * stats (may be NULL) gets what it did.
+ *
+ * Returns:
+ * HFE_OK, or the error that stopped the thread early
+ */
+int HF_StopVacuum(int fd, HF_VacuumStats *stats);
+
+/*
+ * ======================================================
+ * Clustering
+ * ======================================================
+ */
+
+/*
+ * A clustered file (HF_FileOptions.cluster) keeps its records roughly
+ * in the order of a numeric key column, so that the records of a key
+ * range, e.g. the RIDs an index range scan returns, sit on a few pages
+ * next to each other instead of all over the file.
+ *
+ * HF_Recluster sorts the file by key, filling each page to clusterFill
+ * percent. An insert then goes to the page whose keys (from the zone
+ * map) the new key falls among: the page with the highest smallest key
+ * not above it, else the page before or after that one. Only if those
+ * are full does it go where an unclustered file would put it, and it
+ * counts as a stray; so do the records a vacuum merge moves. When more
+ * than HF_CLUSTER_STRAYS percent of the records placed since the last
+ * HF_Recluster are strays, the next vacuum pass reclusters the file
+ * instead of compacting and merging its pages.
+ *
+ * Records with no number in the key column, long records and the
+ * pages of HF_BulkLoad and HF_LoadTextFile are placed as in any file;
+ * HF_Recluster puts the first two after all the keys.
+ */
+#define HF_CLUSTER_FILL    80   /* Default clusterFill */
+#define HF_CLUSTER_STRAYS  10   /* % of strays that makes a vacuum recluster */
+
+typedef struct {
+    int records;    /* Records the last HF_Recluster wrote */
+    int placed;     /* Records inserted or moved since */
+    int strays;     /* Of those, not on or next to their key's page */
+} HF_ClusterStats;
+
+/*
+ * Rewrites a clustered file in key order. Every record is read into
+ * memory and sorted; the data pages are then filled again in page
+ * order, and new pages are added if they do not hold the records.
+ * Pages left over go back to the PF free list, and the free pages at
+ * the end of the file are cut off. fn is called for every record whose
+ * RID changes, as for HF_Vacuum, once the file is rewritten. A record
+ * whose new RID was the old RID of another moved record is staged, and
+ * moved on to its new RID after every record has left its old one.
+ * Forwarded records lose their forwarding slot and get a new RID too.
+ *
+ * Returns:
+ * HFE_OK, HFE_BADOPTIONS if the file is not clustered, HFE_BUSY if a
+ * scan or background vacuum of the file is running, or an error code
+ */
+int HF_Recluster(int fd, HF_RelocFn fn, void *ctx, HF_VacuumStats *stats);
+
+/*
+ * Gets how clustered a file still is.
+ */
+int HF_GetClusterStats(int fd, HF_ClusterStats *cs);
+
+/*
+ * ======================================================
+ * Append-only files
+ * ======================================================
+ */
+
+/*
+ * A file created with opts.append set is written like a log.
+ * HF_InsertRec never looks for room in earlier pages: it adds the
+ * record to a tail page kept in memory. A full tail page is sealed,
+ * and the sealed pages are appended to the file HF_APPEND_PAGES at a
+ * time, in one sequential write (PF_AppendPages), without going
+ * through the buffer pool. The RIDs are known at insert time, since
+ * the pages go to the end of the file in order. HF_GetRec and
+ * HF_DeleteRec work on the pages in memory too.
+ *
+ * HF_DeleteRec only reads the record's page. The delete is kept as a
+ * tombstone in memory, and HF_GetRec no longer finds the record. The
+ * tombstones are carried out in page order, each page written once,
+ * by the next vacuum step, scan or HF_CloseFile, or when
+ * HF_APPEND_TOMBS have piled up. While a scan is open, deletes are
+ * done in place as in any file.
+ *
+ * Opening a scan, HF_UpdateRec, HF_AppendPages and the calls above
+ * first write out the pages in memory, the tail page too. So a file
+ * read while it is loaded gets a partly filled page each time. The
+ * vacuum merges these pages.
+ */
+#define HF_APPEND_PAGES   64      /* Sealed pages written at a time */
+#define HF_APPEND_TOMBS   65536   /* Tombstones kept before they are carried out */
+
+#endif // HF_H
@@ -0,0 +1,280 @@
+#include "hf.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * Parallel loader for text files (one record per line).
+ *
+ * The input is mmapped and cut into chunks of about HF_LOAD_CHUNK
+ * bytes, each ending at a newline. Worker threads take the next chunk
+ * and turn it into data pages in memory; they never call the PF
+ * layer. The calling thread is the single appender, which keeps the
+ * pages in file order: it waits for chunk 0, appends its pages, then
+ * chunk 1, and so on. Workers may run at most HF_LOAD_AHEAD chunks per thread
+ * ahead of the appender, which bounds the memory held by built pages.
+ *
+ * Each chunk ends with a partly filled page, so the file gets about
+ * one extra page per chunk compared with HF_BulkLoad.
+ */
+#define HF_LOAD_CHUNK   (1 << 20)   /* Bytes of input per chunk */
+#define HF_LOAD_AHEAD   2           /* Chunks per thread beyond the appender */
+
+typedef struct {
+    const char *start;      /* First byte of the chunk */
+    const char *end;        /* One past its last byte */
+    char *pages;            /* Built pages */
+    int npages;
+    int nrecs;
+    int error;              /* HFE_OK, or why the chunk failed */
+    int done;               /* Pages are ready for the appender */
+} HF_LoadChunk;
+
+typedef struct {
+    HF_LoadChunk *chunks;
+    int nchunks;
+    int nextChunk;          /* Next chunk for a worker to take */
+    int nextAppend;         /* Next chunk for the appender */
+    int window;             /* Max chunks taken beyond nextAppend */
+    int reserve;            /* Bytes each page keeps free */
+    HF_FileOptions opts;    /* Page layout of the file */
+    int abort;              /* Set by the appender on error */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} HF_Loader;
+
+/*
+ * Builds the pages of one chunk.
+ */
+static void HF_BuildChunk(HF_LoadChunk *c, int reserve, const HF_FileOptions *opts) {
+    int alloc = 0;
+    char *pageBuf = NULL;
+    const char *p = c->start;
+
+    while (p < c->end) {
+        // 1. Find the end of the line, and drop trailing "\r"s
+        const char *nl = memchr(p, '\n', c->end - p);
+        const char *eol = nl ? nl : c->end;
+        int recLen = (int)(eol - p);
+        while (recLen > 0 && p[recLen - 1] == '\r') {
+            recLen--;
+        }
+
+        // 2. Start a new page if the record would push the current
+        //    one past the fill factor
+        if (pageBuf == NULL || HF_Page_FreeSpaceEx(opts, pageBuf) - recLen < reserve) {
+            if (c->npages == alloc) {
+                int newAlloc = alloc ? 2 * alloc : 64;
+                char *pages = realloc(c->pages, (size_t)newAlloc * PF_PAGE_SIZE);
+                if (pages == NULL) {
+                    c->error = PFE_NOMEM;
+                    return;
+                }
+                c->pages = pages;
+                alloc = newAlloc;
+            }
+            pageBuf = c->pages + (size_t)c->npages * PF_PAGE_SIZE;
+            memset(pageBuf, 0, PF_PAGE_SIZE);
+            HF_InitPageEx(opts, pageBuf);
+            c->npages++;
+        }
+
+        // 3. Put the record on the page (fails only if it is too big)
+        int slotNum = HF_Page_InsertRecEx(opts, pageBuf, (char *)p, recLen);
+        if (slotNum < 0) {
+            c->error = slotNum;
+            return;
+        }
+        c->nrecs++;
+        p = nl ? nl + 1 : c->end;
+    }
+}
+
+/*
+ * Worker thread: builds chunks until there are none left.
+ */
+static void *HF_LoadWorker(void *arg) {
+    HF_Loader *ld = arg;
+
+    pthread_mutex_lock(&ld->lock);
+    while (TRUE) {
+        // 1. Wait until there is a chunk we may take
+        while (!ld->abort && ld->nextChunk < ld->nchunks &&
+               ld->nextChunk >= ld->nextAppend + ld->window) {
+            pthread_cond_wait(&ld->cond, &ld->lock);
+        }
+        if (ld->abort || ld->nextChunk >= ld->nchunks) {
+            break;
+        }
+        HF_LoadChunk *c = &ld->chunks[ld->nextChunk++];
+        pthread_mutex_unlock(&ld->lock);
+
+        // 2. Build it without holding the lock
+        HF_BuildChunk(c, ld->reserve, &ld->opts);
+
+        pthread_mutex_lock(&ld->lock);
+        c->done = TRUE;
+        pthread_cond_broadcast(&ld->cond);
+    }
+    pthread_mutex_unlock(&ld->lock);
+    return NULL;
+}
+
+/*
+ * Loads a text file, one record per line, with nthreads threads.
+ */
+int HF_LoadTextFile(int fd, char *fileName, int nthreads, int fillFactor,
+                    int *numRecs) {
+    HF_Loader ld;
+    HF_FileOptions opts;
+    pthread_t *threads;
+    struct stat sb;
+    char *data;
+    int error = HFE_OK;
+    int started = 0;
+
+    *numRecs = 0;
+    if (nthreads < 1) {
+        nthreads = 1;
+    }
+    if (fillFactor < 1 || fillFactor > 100) {
+        fillFactor = 100;
+    }
+    if ((error = HF_GetFileOptions(fd, &opts)) != HFE_OK) {
+        return error;
+    }
+    if (opts.layout == HF_LAYOUT_FIXED) {
+        return HFE_BADOPTIONS;      // Text lines are not of one length
+    }
+
+    // 1. Map the input
+    int ufd = open(fileName, O_RDONLY);
+    if (ufd < 0) {
+        return PFE_UNIX;
+    }
+    if (fstat(ufd, &sb) < 0) {
+        close(ufd);
+        return PFE_UNIX;
+    }
+    if (sb.st_size == 0) {
+        close(ufd);
+        return HFE_OK;
+    }
+    data = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, ufd, 0);
+    close(ufd);
+    if (data == MAP_FAILED) {
+        return PFE_UNIX;
+    }
+    madvise(data, sb.st_size, MADV_SEQUENTIAL);
+
+    // 2. Cut it into chunks that end at a newline
+    memset(&ld, 0, sizeof(ld));
+    int maxChunks = (int)(sb.st_size / HF_LOAD_CHUNK) + 1;
+    ld.chunks = calloc(maxChunks, sizeof(HF_LoadChunk));
+    threads = malloc(nthreads * sizeof(pthread_t));
+    if (ld.chunks == NULL || threads == NULL) {
+        free(ld.chunks);
+        free(threads);
+        munmap(data, sb.st_size);
+        return PFE_NOMEM;
+    }
+    const char *p = data;
+    const char *end = data + sb.st_size;
+    while (p < end) {
+        const char *cut = p + HF_LOAD_CHUNK < end ? p + HF_LOAD_CHUNK : end;
+        if (cut < end) {
+            const char *nl = memchr(cut, '\n', end - cut);
+            cut = nl ? nl + 1 : end;
+        }
+        ld.chunks[ld.nchunks].start = p;
+        ld.chunks[ld.nchunks].end = cut;
+        ld.nchunks++;
+        p = cut;
+    }
+    ld.window = HF_LOAD_AHEAD * nthreads;
+    ld.reserve = PF_PAGE_SIZE * (100 - fillFactor) / 100;
+    ld.opts = opts;
+    pthread_mutex_init(&ld.lock, NULL);
+    pthread_cond_init(&ld.cond, NULL);
+
+    // 3. Start the workers
+    for (started = 0; started < nthreads; started++) {
+        if (pthread_create(&threads[started], NULL, HF_LoadWorker, &ld) != 0) {
+            break;
+        }
+    }
+    if (started == 0) {
+        error = PFE_UNIX;
+    }
+
+    // 4. Append the chunks in file order as they become ready
+    for (int i = 0; i < ld.nchunks && error == HFE_OK; i++) {
+        HF_LoadChunk *c = &ld.chunks[i];
+        int firstPage;
+
+        pthread_mutex_lock(&ld.lock);
+        while (!c->done) {
+            pthread_cond_wait(&ld.cond, &ld.lock);
+        }
+        pthread_mutex_unlock(&ld.lock);
+
+        error = c->error;
+        if (error == HFE_OK) {
+            error = HF_AppendPages(fd, c->pages, c->npages, &firstPage);
+        }
+        if (error == HFE_OK) {
+            *numRecs += c->nrecs;
+        }
+        free(c->pages);
+        c->pages = NULL;
+
+        pthread_mutex_lock(&ld.lock);
+        ld.nextAppend = i + 1;
+        if (error != HFE_OK) {
+            ld.abort = TRUE;
+        }
+        pthread_cond_broadcast(&ld.cond);
+        pthread_mutex_unlock(&ld.lock);
+    }
+
+    // 5. Clean up; after an error, workers stop at their next chunk
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    for (int i = 0; i < ld.nchunks; i++) {
+        free(ld.chunks[i].pages);
+    }
+    pthread_cond_destroy(&ld.cond);
+    pthread_mutex_destroy(&ld.lock);
+    free(ld.chunks);
+    free(threads);
+    munmap(data, sb.st_size);
+    return error;
+}
+
+/*
+ * HF_BulkLoad record source: the next line of a text file.
+ */
+int HF_NextLine(void *ctx, char **record, int *recLen) {
+    HF_LineSource *src = ctx;
+    if (!fgets(src->line, sizeof(src->line), src->fp)) {
+        return ferror(src->fp) ? PFE_UNIX : 0;
+    }
+
+    size_t len = strlen(src->line);
+    if (len > 0 && src->line[len - 1] == '\n') {
+        len--;
+    }
+    while (len > 0 && src->line[len - 1] == '\r') {
+        len--;
+    }
+    src->line[len] = '\0';
+    *record = src->line;
+    *recLen = (int)len;
+    return 1;
+}
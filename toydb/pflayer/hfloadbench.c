@@ -0,0 +1,206 @@
+/* hfloadbench.c
+ * Load-time benchmark for the HF layer.
+ *
+ * Every table in the data directory (one record per line) is loaded
+ * into a fresh heap file with HF_InsertRec. For each table it prints
+ * rows, pages, elapsed time, rows/s and the PF read/write counts of
+ * the load, so the cost of finding a page with free space shows up
+ * directly in the "logical reads" column. With -B the tables are
+ * loaded with HF_BulkLoad from fgets (the hfstudent path), and with -P
+ * by HF_LoadTextFile's mmap + worker threads loader.
+ *
+ * Usage: hfloadbench [-d dataDir] [-b poolSize] [-B] [-P threads] [-f fill]
+ *                    [table.txt ...]
+ *   -d  directory holding the *.txt tables  (default ../../data)
+ *   -b  buffer pool size                    (default 20)
+ *   -B  use HF_BulkLoad
+ *   -P  use HF_LoadTextFile with this many threads
+ *   -f  bulk-load fill factor in percent    (default 100)
+ *   tables default to every *.txt file in the data directory
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "hf.h"
+#include "pftypes.h"
+#include "benchutil.h"
+
+#define MAX_TABLES 64
+
+static const char *heapFile = "hfloadbench.hf";
+static int bulk = 0;
+static int threads = 0;
+static int fillFactor = 100;
+
+static int cmp_str(const void *a, const void *b) {
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+// load one table; returns 0 on success
+static int load_table(const char *path, const char *name) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+
+    PF_DestroyFile((char *)heapFile);  // ignore error if not exists
+    if (HF_CreateFile((char *)heapFile) != HFE_OK) {
+        PF_PrintError("HF_CreateFile");
+        fclose(fp);
+        return -1;
+    }
+    int fd = HF_OpenFile((char *)heapFile);
+    if (fd < 0) {
+        PF_PrintError("HF_OpenFile");
+        fclose(fp);
+        return -1;
+    }
+
+    HF_LineSource src;
+    long rows = 0;
+    int maxPage = 0;
+    char *rec;
+    int len;
+
+    src.fp = fp;
+    PF_ResetStats();
+    double start = now_ms();
+    if (threads > 0) {
+        int n;
+        int err = HF_LoadTextFile(fd, (char *)path, threads, fillFactor, &n);
+        if (err != HFE_OK) {
+            printf("%s: HF_LoadTextFile error %d\n", name, err);
+            fclose(fp);
+            HF_CloseFile(fd);
+            return -1;
+        }
+        rows = n;
+    } else if (bulk) {
+        RID *rids;
+        int n;
+        int err = HF_BulkLoad(fd, HF_NextLine, &src, fillFactor, &rids, &n);
+        if (err != HFE_OK) {
+            printf("%s: HF_BulkLoad error %d after %d records\n", name, err, n);
+            free(rids);
+            fclose(fp);
+            HF_CloseFile(fd);
+            return -1;
+        }
+        rows = n;
+        if (n > 0)
+            maxPage = rids[n - 1].pageNum;
+        free(rids);
+    } else {
+        while (HF_NextLine(&src, &rec, &len) > 0) {
+            RID rid;
+            int err = HF_InsertRec(fd, rec, len, &rid);
+            if (err != HFE_OK) {
+                printf("%s: HF_InsertRec error %d at record %ld\n", name, err, rows);
+                fclose(fp);
+                HF_CloseFile(fd);
+                return -1;
+            }
+            if (rid.pageNum > maxPage)
+                maxPage = rid.pageNum;
+            rows++;
+        }
+    }
+    // closing writes back the pool and the free-space map
+    HF_CloseFile(fd);
+    double ms = now_ms() - start;
+    fclose(fp);
+
+    // the threaded loader does not hand out RIDs; look at the file
+    if (threads > 0) {
+        struct stat sb;
+        maxPage = stat(heapFile, &sb) == 0 ?
+                  (int)(sb.st_size / sizeof(PFfpage)) - 1 : 0;
+    }
+
+    struct stat in;
+    double mb = stat(path, &in) == 0 ? in.st_size / (1024.0 * 1024.0) : 0.0;
+    printf("%-16s %8ld %7d %10.1f %12.0f %8.1f %10d %10d %10d\n",
+           name, rows, maxPage + 1, ms, ms > 0 ? rows / (ms / 1e3) : 0.0,
+           ms > 0 ? mb / (ms / 1e3) : 0.0,
+           PF_stats.logicalReads, PF_stats.physicalReads,
+           PF_stats.physicalWrites);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    const char *dataDir = "../../data";
+    int pool = 20;
+    char *tables[MAX_TABLES];
+    int ntables = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "d:b:BP:f:")) != -1) {
+        switch (opt) {
+        case 'd': dataDir = optarg; break;
+        case 'b': pool = atoi(optarg); break;
+        case 'B': bulk = 1; break;
+        case 'P': threads = atoi(optarg); break;
+        case 'f': fillFactor = atoi(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-d dataDir] [-b poolSize] [-B] [-P threads] "
+                            "[-f fill] [table.txt ...]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (pool <= 0 || pool > PF_MAX_BUFS_LIMIT) {
+        fprintf(stderr, "pool size out of range (1..%d)\n", PF_MAX_BUFS_LIMIT);
+        return 1;
+    }
+
+    for (; optind < argc && ntables < MAX_TABLES; optind++)
+        tables[ntables++] = strdup(argv[optind]);
+
+    if (ntables == 0) {
+        DIR *dir = opendir(dataDir);
+        struct dirent *de;
+        if (!dir) {
+            perror(dataDir);
+            return 1;
+        }
+        while ((de = readdir(dir)) != NULL && ntables < MAX_TABLES) {
+            size_t n = strlen(de->d_name);
+            if (n > 4 && strcmp(de->d_name + n - 4, ".txt") == 0)
+                tables[ntables++] = strdup(de->d_name);
+        }
+        closedir(dir);
+        qsort(tables, ntables, sizeof(char *), cmp_str);
+    }
+
+    PF_Init();
+    PF_SetBufferSize(pool);
+    PF_SetReplacementPolicy(PF_REPL_LRU);
+
+    char mode[64];
+    if (threads > 0)
+        snprintf(mode, sizeof(mode), "HF_LoadTextFile, %d threads", threads);
+    else
+        snprintf(mode, sizeof(mode), "%s", bulk ? "HF_BulkLoad" : "HF_InsertRec");
+    printf("hfloadbench: %d tables from %s, pool=%d, %s\n", ntables, dataDir, pool, mode);
+    printf("%-16s %8s %7s %10s %12s %8s %10s %10s %10s\n",
+           "table", "rows", "pages", "ms", "rows/s", "MB/s",
+           "logReads", "physReads", "physWrites");
+
+    int status = 0;
+    for (int i = 0; i < ntables; i++) {
+        char path[1024];
+        if (strchr(tables[i], '/'))
+            snprintf(path, sizeof(path), "%s", tables[i]);
+        else
+            snprintf(path, sizeof(path), "%s/%s", dataDir, tables[i]);
+        if (load_table(path, tables[i]) != 0)
+            status = 1;
+        free(tables[i]);
+    }
+
+    PF_DestroyFile((char *)heapFile);
+    return status;
+}
@@ -0,0 +1,171 @@
+#include "hf.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+/*
+ * Parallel heap scans.
+ *
+ * The pages of the file are handed out in morsels from a shared
+ * counter, so threads that get cached pages or few matching rows just
+ * take more morsels. Each thread runs the same page-local slot loop as
+ * HF_GetNextRows (HF_ScanMorsel) into a batch of its own; the PF page
+ * calls it makes are serialized by the PF layer's latch, while the
+ * slot loops, predicates and copying run in parallel.
+ */
+
+typedef struct {
+    HF_ParScan *ps;
+    HF_BatchFn fn;
+    void *ctx;
+    int worker;
+    long rows;              /* Rows handed to fn */
+    int error;
+} HF_ScanWorker;
+
+/*
+ * Opens a parallel scan.
+ */
+int HF_OpenParScan(int fd, HF_ParScan *ps, const HF_ScanSpec *spec, int morselPages) {
+    int error;
+
+    // 1. The scan every morsel starts from
+    if (spec != NULL) {
+        if ((error = HF_OpenFileScanEx(fd, &ps->proto, spec)) != HFE_OK) {
+            return error;
+        }
+    } else if ((error = HF_OpenFileScan(fd, &ps->proto)) != HFE_OK) {
+        return error;
+    }
+    if ((ps->numPages = PF_NumPages(fd)) < 0) {
+        HF_CloseFileScan(&ps->proto);
+        return ps->numPages;
+    }
+
+    // 2. Morsels must not cross a segment, so their size divides it
+    int segPages = PF_SegmentPages(fd);
+    if (morselPages <= 0) {
+        morselPages = HF_MORSEL_PAGES;
+    }
+    if (segPages > 0) {
+        if (morselPages > segPages) {
+            morselPages = segPages;
+        }
+        while (segPages % morselPages != 0) {
+            morselPages--;
+        }
+    }
+    ps->morselPages = morselPages;
+    ps->nextPage = 0;
+    return HFE_OK;
+}
+
+/*
+ * Takes the next morsel.
+ */
+int HF_NextMorsel(HF_ParScan *ps, int *firstPage, int *endPage) {
+    int first = __atomic_fetch_add(&ps->nextPage, ps->morselPages, __ATOMIC_RELAXED);
+
+    if (first >= ps->numPages) {
+        return HFE_EOF;
+    }
+    *firstPage = first;
+    *endPage = first + ps->morselPages < ps->numPages ? first + ps->morselPages
+                                                      : ps->numPages;
+    return HFE_OK;
+}
+
+/*
+ * An HF_BatchFn that counts a worker's rows and passes the batch on
+ * to the caller's function.
+ */
+static void HF_WorkerFlush(void *ctx, int worker, HF_RowBatch *batch) {
+    HF_ScanWorker *w = ctx;
+    w->rows += batch->n;
+    w->fn(w->ctx, worker, batch);
+}
+
+/*
+ * Thread body: scans morsels until none are left or one fails.
+ */
+static void *HF_ScanWorkerMain(void *arg) {
+    HF_ScanWorker *w = arg;
+    HF_RowBatch *batch = malloc(sizeof(HF_RowBatch));
+    int first, end;
+
+    if (batch == NULL) {
+        w->error = PFE_NOMEM;
+        return NULL;
+    }
+    batch->n = 0;
+    while (w->error == HFE_OK && HF_NextMorsel(w->ps, &first, &end) == HFE_OK) {
+        w->error = HF_ScanMorsel(w->ps, first, end, batch, HF_WorkerFlush, w, w->worker);
+    }
+    if (w->error == HFE_OK && batch->n > 0) {
+        HF_WorkerFlush(w, w->worker, batch);
+    }
+    free(batch);
+    return NULL;
+}
+
+/*
+ * Runs a parallel scan to the end.
+ */
+int HF_RunParScan(HF_ParScan *ps, int nthreads, HF_BatchFn fn, void *ctx,
+                  long *numRows) {
+    HF_ScanWorker *workers;
+    pthread_t *threads;
+    int error = HFE_OK;
+    int started = 0;
+
+    *numRows = 0;
+    if (nthreads < 1) {
+        nthreads = 1;
+    }
+    workers = calloc(nthreads, sizeof(HF_ScanWorker));
+    threads = malloc(nthreads * sizeof(pthread_t));
+    if (workers == NULL || threads == NULL) {
+        free(workers);
+        free(threads);
+        return PFE_NOMEM;
+    }
+
+    // 1. Start the workers; if a thread cannot be made, run with fewer
+    for (int i = 0; i < nthreads; i++) {
+        workers[i].ps = ps;
+        workers[i].fn = fn;
+        workers[i].ctx = ctx;
+        workers[i].worker = i;
+        workers[i].error = HFE_OK;
+        if (pthread_create(&threads[i], NULL, HF_ScanWorkerMain, &workers[i]) != 0) {
+            break;
+        }
+        started++;
+    }
+    if (started == 0) {
+        HF_ScanWorkerMain(&workers[0]);
+    }
+
+    // 2. Wait for them and merge their counts
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    for (int i = 0; i < (started > 0 ? started : 1); i++) {
+        *numRows += workers[i].rows;
+        if (error == HFE_OK) {
+            error = workers[i].error;
+        }
+    }
+    free(workers);
+    free(threads);
+    return error;
+}
+
+/*
+ * Closes a parallel scan.
+ */
+int HF_CloseParScan(HF_ParScan *ps) {
+    // The morsels pin pages only while scanning them
+    return HF_CloseFileScan(&ps->proto);
+}
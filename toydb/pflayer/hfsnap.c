@@ -0,0 +1,435 @@
+#include "hf.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * Read-only snapshots of heap files.
+ *
+ * HF_WriteSnapshot scans the heap file once, writing each record to
+ * the data area as it comes and keeping its RID, length and offset.
+ * The scan returns records in page and slot order, which is RID order,
+ * except that a moved record comes with its home RID. If there are
+ * any, the data area is copied once more in RID order. Since the
+ * records of a page are then back to back, the index needs no more
+ * than each record's slot and end. Everything after that is pointer
+ * arithmetic on the mapping: a point read is a binary search among
+ * the slots of one page, and a scan walks the records in order.
+ */
+#define HF_SNAP_MAXSLOT  65535
+
+typedef struct {
+    RID rid;
+    int len;
+    long off;
+} HF_SnapRec;
+
+static int HF_SnapRecCmp(const void *x, const void *y) {
+    const HF_SnapRec *a = x, *b = y;
+
+    if (a->rid.pageNum != b->rid.pageNum) {
+        return a->rid.pageNum < b->rid.pageNum ? -1 : 1;
+    }
+    return a->rid.slotNum < b->rid.slotNum ? -1 : a->rid.slotNum > b->rid.slotNum;
+}
+
+/*
+ * Writes zeros up to the next multiple of align (less reserve bytes,
+ * kept for what follows).
+ */
+static int HF_SnapPad(FILE *fp, long *pos, long align, long reserve) {
+    static const char zeros[PF_PAGE_SIZE];
+    long pad = (align - (*pos + reserve) % align) % align;
+
+    if (pad > 0 && fwrite(zeros, 1, pad, fp) != (size_t)pad) {
+        return PFE_UNIX;
+    }
+    *pos += pad;
+    return HFE_OK;
+}
+
+static int HF_SnapWrite(FILE *fp, long *pos, const void *buf, long len) {
+    if (len > 0 && fwrite(buf, 1, len, fp) != (size_t)len) {
+        return PFE_UNIX;
+    }
+    *pos += len;
+    return HFE_OK;
+}
+
+/*
+ * Writes the records of the heap file in scan order, and sorts what is
+ * known about them by RID.
+ */
+static int HF_SnapWriteData(int fd, FILE *fp, HF_SnapRec **recs, int *nrecs, long *pos) {
+    HF_Scan scan;
+    RID rid;
+    char *record;
+    int recLen, cap = 0, error;
+
+    if ((error = HF_OpenFileScan(fd, &scan)) != HFE_OK) {
+        return error;
+    }
+    while ((error = HF_GetNextRec(fd, &scan, &rid, &record, &recLen)) == HFE_OK) {
+        if (rid.slotNum > HF_SNAP_MAXSLOT) {
+            error = HFE_BADOPTIONS;
+            break;
+        }
+        if (*nrecs == cap) {
+            HF_SnapRec *more;
+            cap = cap ? cap * 2 : 1024;
+            if ((more = realloc(*recs, cap * sizeof(HF_SnapRec))) == NULL) {
+                error = PFE_NOMEM;
+                break;
+            }
+            *recs = more;
+        }
+        (*recs)[*nrecs].rid = rid;
+        (*recs)[*nrecs].len = recLen;
+        (*recs)[*nrecs].off = *pos;
+        (*nrecs)++;
+        if ((error = HF_SnapWrite(fp, pos, record, recLen)) != HFE_OK) {
+            break;
+        }
+    }
+    HF_CloseFileScan(&scan);
+    if (error != HFE_EOF) {
+        return error;
+    }
+    qsort(*recs, *nrecs, sizeof(HF_SnapRec), HF_SnapRecCmp);
+    return HFE_OK;
+}
+
+/*
+ * Copies the data area of the file fromName to fp in RID order, for a
+ * heap file with moved records.
+ */
+static int HF_SnapReorder(char *fromName, FILE *fp, HF_SnapRec *recs, int nrecs, long len) {
+    char *data;
+    long pos = 0;
+    int error = HFE_OK;
+
+    int ufd = open(fromName, O_RDONLY);
+    if (ufd < 0) {
+        return PFE_UNIX;
+    }
+    data = mmap(NULL, len, PROT_READ, MAP_PRIVATE, ufd, 0);
+    close(ufd);
+    if (data == MAP_FAILED) {
+        return PFE_UNIX;
+    }
+    for (int i = 0; i < nrecs && error == HFE_OK; i++) {
+        long off = pos;
+        error = HF_SnapWrite(fp, &pos, data + recs[i].off, recs[i].len);
+        recs[i].off = off;
+    }
+    munmap(data, len);
+    return error;
+}
+
+/*
+ * Writes the index and the trailer.
+ */
+static int HF_SnapWriteIndex(FILE *fp, HF_SnapTrailer *tr, const HF_SnapRec *recs,
+                             long *pos) {
+    HF_SnapPage page;
+    int error, k = 0;
+
+    // 1. The pages, from the first page boundary after the data
+    if ((error = HF_SnapPad(fp, pos, PF_PAGE_SIZE, 0)) != HFE_OK) {
+        return error;
+    }
+    tr->pageOff = *pos;
+    memset(&page, 0, sizeof(page));
+    for (int p = 0; p <= tr->numPages && error == HFE_OK; p++) {
+        while (k < tr->numRecs && recs[k].rid.pageNum < p) {
+            k++;
+        }
+        page.off = k < tr->numRecs ? recs[k].off : tr->dataLen;
+        page.first = k;
+        error = HF_SnapWrite(fp, pos, &page, sizeof(page));
+    }
+
+    // 2. Where each record ends within its page's records
+    tr->endOff = *pos;
+    long pageStart = 0;
+    for (int i = 0; i < tr->numRecs && error == HFE_OK; i++) {
+        if (i == 0 || recs[i].rid.pageNum != recs[i - 1].rid.pageNum) {
+            pageStart = recs[i].off;
+        }
+        long end = recs[i].off + recs[i].len - pageStart;
+        unsigned int end32 = (unsigned int)end;
+        if (end != (long)end32) {
+            return HFE_BADOPTIONS;
+        }
+        error = HF_SnapWrite(fp, pos, &end32, sizeof(end32));
+    }
+
+    // 3. The slot numbers
+    tr->slotOff = *pos;
+    for (int i = 0; i < tr->numRecs && error == HFE_OK; i++) {
+        unsigned short slot = (unsigned short)recs[i].rid.slotNum;
+        error = HF_SnapWrite(fp, pos, &slot, sizeof(slot));
+    }
+
+    // 4. The trailer, ending the last page
+    if (error == HFE_OK) {
+        error = HF_SnapPad(fp, pos, PF_PAGE_SIZE, sizeof(HF_SnapTrailer));
+    }
+    if (error == HFE_OK) {
+        error = HF_SnapWrite(fp, pos, tr, sizeof(HF_SnapTrailer));
+    }
+    return error;
+}
+
+/*
+ * Writes a snapshot of a heap file.
+ */
+int HF_WriteSnapshot(int fd, char *snapName) {
+    HF_FileOptions opts;
+    HF_SnapTrailer tr;
+    HF_SnapRec *recs = NULL;
+    char *tmpName, *dataName = NULL;
+    FILE *fp;
+    long pos = 0;
+    int error;
+
+    if ((error = HF_GetFileOptions(fd, &opts)) != HFE_OK) {
+        return error;
+    }
+    if ((tmpName = malloc(strlen(snapName) + sizeof(".tmp"))) == NULL) {
+        return PFE_NOMEM;
+    }
+    strcpy(tmpName, snapName);
+    strcat(tmpName, ".tmp");
+    if ((fp = fopen(tmpName, "wb")) == NULL) {
+        free(tmpName);
+        return PFE_UNIX;
+    }
+
+    // 1. The records
+    memset(&tr, 0, sizeof(tr));
+    tr.magic = HF_SNAP_MAGIC;
+    tr.sep = opts.sep ? opts.sep : HF_DEFAULT_SEP;
+    error = HF_SnapWriteData(fd, fp, &recs, &tr.numRecs, &pos);
+    if (error == HFE_OK && (tr.numPages = PF_NumPages(fd)) < 0) {
+        error = tr.numPages;
+    }
+    tr.dataLen = pos;
+
+    // 2. Moved records break RID order: copy the records over to a new
+    //    file in RID order, which becomes the snapshot
+    for (int i = 1; i < tr.numRecs && error == HFE_OK; i++) {
+        if (recs[i].off != recs[i - 1].off + recs[i - 1].len) {
+            char *name = malloc(strlen(snapName) + sizeof(".tmp2"));
+            if (name == NULL) {
+                error = PFE_NOMEM;
+                break;
+            }
+            dataName = tmpName;
+            tmpName = name;
+            strcpy(tmpName, snapName);
+            strcat(tmpName, ".tmp2");
+            if (fclose(fp) != 0) {
+                fp = NULL;
+                error = PFE_UNIX;
+            } else if ((fp = fopen(tmpName, "wb")) == NULL) {
+                error = PFE_UNIX;
+            } else {
+                error = HF_SnapReorder(dataName, fp, recs, tr.numRecs, tr.dataLen);
+            }
+            break;
+        }
+    }
+
+    // 3. The index
+    if (error == HFE_OK) {
+        pos = tr.dataLen;
+        error = HF_SnapWriteIndex(fp, &tr, recs, &pos);
+    }
+    free(recs);
+
+    // 4. Seal it: only a complete snapshot gets the name
+    if (fp != NULL && fclose(fp) != 0 && error == HFE_OK) {
+        error = PFE_UNIX;
+    }
+    if (error == HFE_OK && rename(tmpName, snapName) != 0) {
+        error = PFE_UNIX;
+    }
+    if (error != HFE_OK) {
+        unlink(tmpName);
+    }
+    if (dataName != NULL) {
+        unlink(dataName);
+        free(dataName);
+    }
+    free(tmpName);
+    return error;
+}
+
+/*
+ * Whether the index of a snapshot whose trailer checked out stays
+ * within the records: the pages' records in order, each page's ends
+ * rising, and every page's records inside the first dataLen bytes.
+ */
+static int HF_SnapCheckIndex(const char *base, const HF_SnapTrailer *tr) {
+    const HF_SnapPage *pages = (const HF_SnapPage *)(base + tr->pageOff);
+    const unsigned int *ends = (const unsigned int *)(base + tr->endOff);
+
+    if (pages[0].first != 0) {
+        return FALSE;
+    }
+    for (int p = 0; p < tr->numPages; p++) {
+        int first = pages[p].first, next = pages[p + 1].first;
+        unsigned int end = 0;
+
+        if (next < first || next > tr->numRecs ||
+            pages[p].off < 0 || pages[p].off > tr->dataLen) {
+            return FALSE;
+        }
+        for (int k = first; k < next; k++) {
+            if (ends[k] < end) {
+                return FALSE;
+            }
+            end = ends[k];
+        }
+        if (end > tr->dataLen - pages[p].off) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/*
+ * Opens a snapshot.
+ */
+int HF_OpenSnapshot(char *snapName, HF_Snapshot *snap) {
+    const HF_SnapTrailer *tr;
+    struct stat sb;
+    char *base;
+
+    // 1. Map the whole file
+    int ufd = open(snapName, O_RDONLY);
+    if (ufd < 0) {
+        return PFE_UNIX;
+    }
+    if (fstat(ufd, &sb) < 0) {
+        close(ufd);
+        return PFE_UNIX;
+    }
+    if (sb.st_size < (long)sizeof(HF_SnapTrailer) || sb.st_size % PF_PAGE_SIZE != 0) {
+        close(ufd);
+        return HFE_BADOPTIONS;
+    }
+    base = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, ufd, 0);
+    close(ufd);
+    if (base == MAP_FAILED) {
+        return PFE_UNIX;
+    }
+
+    // 2. Check that the trailer's parts fit in the file, in order, and
+    //    that the index stays within the records
+    tr = (const HF_SnapTrailer *)(base + sb.st_size - sizeof(HF_SnapTrailer));
+    if (tr->magic != HF_SNAP_MAGIC || tr->numRecs < 0 || tr->numPages < 0 ||
+        tr->dataLen < 0 || tr->dataLen > tr->pageOff || tr->pageOff > sb.st_size ||
+        tr->pageOff % PF_PAGE_SIZE != 0 ||
+        tr->pageOff + (long)(tr->numPages + 1) * (long)sizeof(HF_SnapPage) != tr->endOff ||
+        tr->endOff + (long)tr->numRecs * (long)sizeof(unsigned int) != tr->slotOff ||
+        tr->slotOff + (long)tr->numRecs * (long)sizeof(unsigned short) >
+            sb.st_size - (long)sizeof(HF_SnapTrailer) ||
+        ((const HF_SnapPage *)(base + tr->pageOff))[tr->numPages].first != tr->numRecs ||
+        !HF_SnapCheckIndex(base, tr)) {
+        munmap(base, sb.st_size);
+        return HFE_BADOPTIONS;
+    }
+    snap->base = base;
+    snap->size = sb.st_size;
+    snap->numRecs = tr->numRecs;
+    snap->numPages = tr->numPages;
+    snap->sep = (char)tr->sep;
+    snap->pages = (const HF_SnapPage *)(base + tr->pageOff);
+    snap->ends = (const unsigned int *)(base + tr->endOff);
+    snap->slots = (const unsigned short *)(base + tr->slotOff);
+    return HFE_OK;
+}
+
+/*
+ * Points at record k, of page pageNum.
+ */
+static void HF_SnapRecord(const HF_Snapshot *snap, int pageNum, int k, char **record,
+                          int *recLen) {
+    const HF_SnapPage *page = &snap->pages[pageNum];
+    unsigned int start = k > page->first ? snap->ends[k - 1] : 0;
+
+    *record = snap->base + page->off + start;
+    *recLen = (int)(snap->ends[k] - start);
+}
+
+/*
+ * Gets a record by RID.
+ */
+int HF_SnapGetRec(const HF_Snapshot *snap, RID rid, char **record, int *recLen) {
+    int lo, hi;
+
+    if (rid.pageNum < 0 || rid.pageNum >= snap->numPages || rid.slotNum < 0) {
+        return HFE_INVALIDSLOT;
+    }
+
+    // Binary search among the slots of the page
+    lo = snap->pages[rid.pageNum].first;
+    hi = snap->pages[rid.pageNum + 1].first;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (snap->slots[mid] == rid.slotNum) {
+            HF_SnapRecord(snap, rid.pageNum, mid, record, recLen);
+            return HFE_OK;
+        }
+        if (snap->slots[mid] < rid.slotNum) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return HFE_INVALIDSLOT;
+}
+
+/*
+ * Starts a scan of a snapshot.
+ */
+void HF_SnapOpenScan(HF_SnapScan *scan) {
+    scan->pageNum = 0;
+    scan->next = 0;
+}
+
+/*
+ * Returns the next record of a snapshot scan.
+ */
+int HF_SnapGetNext(const HF_Snapshot *snap, HF_SnapScan *scan, RID *rid, char **record,
+                   int *recLen) {
+    if (scan->next >= snap->numRecs) {
+        return HFE_EOF;
+    }
+
+    // Move on to the page the record belongs to
+    while (snap->pages[scan->pageNum + 1].first <= scan->next) {
+        scan->pageNum++;
+    }
+    rid->pageNum = scan->pageNum;
+    rid->slotNum = snap->slots[scan->next];
+    HF_SnapRecord(snap, scan->pageNum, scan->next++, record, recLen);
+    return HFE_OK;
+}
+
+/*
+ * Closes a snapshot.
+ */
+int HF_CloseSnapshot(HF_Snapshot *snap) {
+    if (snap->base != NULL && munmap(snap->base, snap->size) != 0) {
+        return PFE_UNIX;
+    }
+    snap->base = NULL;
+    return HFE_OK;
+}
@@ -0,0 +1,41 @@
+/* hfsnaptool.c
+ * hfsnap: seals a heap file into a read-only snapshot (HF_WriteSnapshot),
+ * then opens the snapshot, which checks it, and prints its size.
+ *
+ * Usage: hfsnap in.hf out.snap
+ */
+#include <stdio.h>
+#include "hf.h"
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s in.hf out.snap\n", argv[0]);
+        return 2;
+    }
+
+    PF_Init();
+    int fd = HF_OpenFile(argv[1]);
+    if (fd < 0) {
+        PF_PrintError("HF_OpenFile");
+        return 1;
+    }
+
+    int err = HF_WriteSnapshot(fd, argv[2]);
+    HF_CloseFile(fd);
+    if (err != HFE_OK) {
+        printf("HF_WriteSnapshot error %d\n", err);
+        return 1;
+    }
+
+    // open it the way a reader will, which checks its index
+    HF_Snapshot snap;
+    if ((err = HF_OpenSnapshot(argv[2], &snap)) != HFE_OK) {
+        printf("HF_OpenSnapshot error %d\n", err);
+        return 1;
+    }
+
+    printf("%s: %d records of %d pages, %ld bytes\n",
+           argv[2], snap.numRecs, snap.numPages, snap.size);
+    HF_CloseSnapshot(&snap);
+    return 0;
+}
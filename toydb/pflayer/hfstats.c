@@ -0,0 +1,632 @@
+#include "hf.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+
+/*
+ * Heap file statistics (ANALYZE).
+ *
+ * One pass over the records, or over a sample of the pages, feeds every
+ * analyzed column into a HyperLogLog sketch and collects its numbers;
+ * at the end the numbers are sorted and cut into an equi-depth
+ * histogram. A full analyze reads the file with HF_GetNextRec; a
+ * sampled one hands runs of chosen pages to HF_ScanMorsel, so pages
+ * that are not chosen are never read.
+ *
+ * The sketch keeps, for each of HF_HLL_REGS registers, the longest run
+ * of leading zero bits seen in the hashes that fall into it; the
+ * registers of two sketches can be merged by taking the larger one.
+ *
+ * A sketch only counts what it was fed, so a sample's distinct count
+ * is not scaled up by the sketch but estimated from how often each
+ * value turned up in the sample, with the GEE estimator of Charikar et
+ * al.: sqrt(N / n) * f1 + (d - f1), for d distinct values among n
+ * sampled of N, f1 of them seen once. A value seen more than once
+ * counts once; each value seen once stands for sqrt(N / n) of them. A
+ * sample in which every value was seen once is taken to be unique. To
+ * count them, the sampled pass also keeps every value's hash.
+ */
+#define HF_GUESS_EQ      0.005          /* "col = x" on a column without stats */
+#define HF_GUESS_RANGE   (1.0 / 3)      /* A range without a histogram */
+
+typedef struct {
+    HF_Stats *stats;
+    char sep;
+    long rows;              /* Records read */
+    double bytes;
+    long nulls[HF_STATS_COLS];
+    double *num[HF_STATS_COLS];       /* The numbers of each column */
+    long nnum[HF_STATS_COLS];
+    long numCap[HF_STATS_COLS];
+    uint64_t *hash[HF_STATS_COLS];    /* Hashes of each column's values, if sampled */
+    long nhash[HF_STATS_COLS];
+    long hashCap[HF_STATS_COLS];
+    int sampled;
+    int error;
+} HF_Analyzer;
+
+/*
+ * 64-bit hash of a value: FNV-1a, then a final mix so that the top
+ * bits (the register) and the rest are well spread.
+ */
+static uint64_t HF_HashValue(const char *s, int len) {
+    uint64_t h = 1469598103934665603ULL;
+
+    for (int i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static void HF_HllAdd(unsigned char *hll, uint64_t h) {
+    int reg = (int)(h >> (64 - HF_HLL_BITS));
+    uint64_t rest = h << HF_HLL_BITS;
+    int rank = 1;
+
+    while (rank <= 64 - HF_HLL_BITS && !(rest & (1ULL << 63))) {
+        rank++;
+        rest <<= 1;
+    }
+    if (rank > hll[reg]) {
+        hll[reg] = (unsigned char)rank;
+    }
+}
+
+/*
+ * The HyperLogLog estimate, with the linear counting correction for
+ * small sets (the hash is 64 bits, so large sets need none).
+ */
+static double HF_HllCount(const unsigned char *hll) {
+    double m = HF_HLL_REGS;
+    double sum = 0;
+    int zeros = 0;
+
+    for (int i = 0; i < HF_HLL_REGS; i++) {
+        sum += ldexp(1.0, -hll[i]);
+        zeros += hll[i] == 0;
+    }
+    double e = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+    if (e <= 2.5 * m && zeros > 0) {
+        e = m * log(m / zeros);
+    }
+    return e;
+}
+
+/*
+ * Reads a column as a number the way a numeric HF_Pred does; NaN is
+ * left out since it cannot be placed in the histogram.
+ */
+static int HF_ValueNum(const char *field, int len, double *v) {
+    char buf[64];
+    char *end;
+
+    if (len >= (int)sizeof(buf)) {
+        return 0;
+    }
+    memcpy(buf, field, len);
+    buf[len] = '\0';
+    *v = strtod(buf, &end);
+    return end != buf && *v == *v;
+}
+
+/*
+ * Feeds one record into the analyzer.
+ */
+static void HF_AnalyzeRec(HF_Analyzer *a, const char *rec, int len) {
+    int start = 0;
+
+    a->rows++;
+    a->bytes += len;
+    for (int c = 0; c < a->stats->ncols; c++) {
+        HF_ColStats *cs = &a->stats->col[c];
+        int end = start;
+        double v;
+
+        // 1. Cut the column at the next separator
+        while (end < len && rec[end] != a->sep) {
+            end++;
+        }
+        if (start >= end) {
+            a->nulls[c]++;
+            start = end + 1;
+            continue;
+        }
+
+        // 2. Sketch it (and keep its hash if sampled), and keep it if
+        //    it is a number
+        uint64_t h = HF_HashValue(rec + start, end - start);
+        HF_HllAdd(cs->hll, h);
+        if (a->sampled) {
+            if (a->nhash[c] == a->hashCap[c]) {
+                long cap = a->hashCap[c] ? a->hashCap[c] * 2 : 1024;
+                uint64_t *hash = realloc(a->hash[c], cap * sizeof(uint64_t));
+                if (hash == NULL) {
+                    a->error = PFE_NOMEM;
+                    return;
+                }
+                a->hash[c] = hash;
+                a->hashCap[c] = cap;
+            }
+            a->hash[c][a->nhash[c]++] = h;
+        }
+        if (HF_ValueNum(rec + start, end - start, &v)) {
+            if (a->nnum[c] == a->numCap[c]) {
+                long cap = a->numCap[c] ? a->numCap[c] * 2 : 1024;
+                double *num = realloc(a->num[c], cap * sizeof(double));
+                if (num == NULL) {
+                    a->error = PFE_NOMEM;
+                    return;
+                }
+                a->num[c] = num;
+                a->numCap[c] = cap;
+            }
+            a->num[c][a->nnum[c]++] = v;
+        }
+        start = end + 1;
+    }
+}
+
+/*
+ * An HF_BatchFn for the sampled pass.
+ */
+static void HF_AnalyzeBatch(void *ctx, int worker, HF_RowBatch *batch) {
+    HF_Analyzer *a = ctx;
+    (void)worker;
+
+    for (int i = 0; i < batch->n && a->error == HFE_OK; i++) {
+        HF_AnalyzeRec(a, batch->buf + batch->off[i], batch->len[i]);
+    }
+}
+
+/*
+ * Whether page pagenum is in a samplePct sample; the same pages are
+ * chosen every time.
+ */
+static int HF_SamplePage(int pagenum, int samplePct) {
+    uint64_t h = (uint64_t)pagenum * 0x9e3779b97f4a7c15ULL;
+
+    h ^= h >> 31;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 29;
+    return (int)(h % 100) < samplePct;
+}
+
+/*
+ * Reads every record into the analyzer.
+ */
+static int HF_AnalyzeFull(int fd, HF_Analyzer *a) {
+    HF_Scan scan;
+    RID rid;
+    char *rec;
+    int len, error;
+
+    if ((error = HF_OpenFileScan(fd, &scan)) != HFE_OK) {
+        return error;
+    }
+    while (a->error == HFE_OK && (error = HF_GetNextRec(fd, &scan, &rid, &rec, &len)) == HFE_OK) {
+        HF_AnalyzeRec(a, rec, len);
+    }
+    HF_CloseFileScan(&scan);
+    if (a->error != HFE_OK) {
+        return a->error;
+    }
+    a->stats->pagesRead = a->stats->pages;
+    return error == HFE_EOF ? HFE_OK : error;
+}
+
+/*
+ * Reads the records of the sampled pages into the analyzer, one
+ * morsel per run of consecutive sampled pages.
+ */
+static int HF_AnalyzeSample(int fd, int samplePct, HF_Analyzer *a) {
+    HF_ParScan ps;
+    HF_RowBatch *batch;
+    int error;
+
+    if ((batch = malloc(sizeof(HF_RowBatch))) == NULL) {
+        return PFE_NOMEM;
+    }
+    if ((error = HF_OpenParScan(fd, &ps, NULL, 0)) != HFE_OK) {
+        free(batch);
+        return error;
+    }
+    batch->n = 0;
+    a->stats->pagesRead = 0;
+    for (int first = 1; first < ps.numPages && error == HFE_OK && a->error == HFE_OK; ) {
+        int end;
+
+        if (!HF_SamplePage(first, samplePct)) {
+            first++;
+            continue;
+        }
+        for (end = first + 1; end < ps.numPages && HF_SamplePage(end, samplePct); end++)
+            ;
+        error = HF_ScanMorsel(&ps, first, end, batch, HF_AnalyzeBatch, a, 0);
+        a->stats->pagesRead += end - first;
+        first = end;
+    }
+    if (error == HFE_OK && batch->n > 0) {
+        HF_AnalyzeBatch(a, 0, batch);
+    }
+    HF_CloseParScan(&ps);
+    free(batch);
+    return a->error != HFE_OK ? a->error : error;
+}
+
+/*
+ * Index of v among the most common numbers, or -1.
+ */
+static int HF_McvIndex(const HF_ColStats *cs, double v) {
+    for (int k = 0; k < cs->nmcv; k++) {
+        if (cs->mcv[k] == v) {
+            return k;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Adds a number seen count times to the most common ones, if it is
+ * among the HF_STATS_MCV most common so far. Until the end, mcvShare
+ * holds the counts.
+ */
+static void HF_AddMcv(HF_ColStats *cs, double v, long count) {
+    int k = cs->nmcv;
+
+    if (k == HF_STATS_MCV) {
+        if (count <= cs->mcvShare[k - 1]) {
+            return;
+        }
+        k--;
+    } else {
+        cs->nmcv++;
+    }
+    for (; k > 0 && cs->mcvShare[k - 1] < count; k--) {
+        cs->mcv[k] = cs->mcv[k - 1];
+        cs->mcvShare[k] = cs->mcvShare[k - 1];
+    }
+    cs->mcv[k] = v;
+    cs->mcvShare[k] = count;
+}
+
+static int HF_CmpDouble(const void *x, const void *y) {
+    double a = *(const double *)x, b = *(const double *)y;
+    return a < b ? -1 : a > b;
+}
+
+static int HF_CmpHash(const void *x, const void *y) {
+    uint64_t a = *(const uint64_t *)x, b = *(const uint64_t *)y;
+    return a < b ? -1 : a > b;
+}
+
+/*
+ * Distinct values of a column from the n hashes of its sampled values,
+ * out of total values in the file (GEE, see the top of the file).
+ */
+static double HF_SampleDistinct(uint64_t *hash, long n, double total) {
+    long d = 0, f1 = 0;
+
+    qsort(hash, n, sizeof(uint64_t), HF_CmpHash);
+    for (long i = 0, j; i < n; i = j) {
+        for (j = i + 1; j < n && hash[j] == hash[i]; j++)
+            ;
+        d++;
+        f1 += j - i == 1;
+    }
+    if (f1 == n) {
+        return total;       // every value seen once: taken to be unique
+    }
+    double e = sqrt(total / n) * f1 + (d - f1);
+    return e < d ? d : e > total ? total : e;
+}
+
+/*
+ * Turns what the analyzer collected into stats, scaled up by scale.
+ */
+static void HF_AnalyzeFinish(HF_Analyzer *a, double scale) {
+    HF_Stats *stats = a->stats;
+
+    stats->rows = (long)(a->rows * scale + 0.5);
+    stats->avgLen = a->rows > 0 ? a->bytes / a->rows : 0;
+    for (int c = 0; c < stats->ncols; c++) {
+        HF_ColStats *cs = &stats->col[c];
+        long n = a->nnum[c];
+        long values = a->rows - a->nulls[c];
+
+        // 1. Counts
+        cs->nulls = (long)(a->nulls[c] * scale + 0.5);
+        cs->numeric = (long)(n * scale + 0.5);
+
+        if (n > 0) {
+            double *num = a->num[c];
+            long m = 0;
+
+            // 2. The most common numbers
+            qsort(num, n, sizeof(double), HF_CmpDouble);
+            cs->min = num[0];
+            cs->max = num[n - 1];
+            for (long i = 0, j; i < n; i = j) {
+                for (j = i + 1; j < n && num[j] == num[i]; j++)
+                    ;
+                if ((j - i) * HF_HIST_BUCKETS > n) {
+                    HF_AddMcv(cs, num[i], j - i);
+                }
+            }
+
+            // 3. Equi-depth histogram of the others: bucket bounds at
+            //    every 1 / nbuckets of them, in order
+            for (long i = 0; i < n; i++) {
+                if (HF_McvIndex(cs, num[i]) < 0) {
+                    num[m++] = num[i];
+                }
+            }
+            for (int k = 0; k < cs->nmcv; k++) {
+                cs->mcvShare[k] /= n;
+            }
+            cs->nbuckets = m < HF_HIST_BUCKETS ? (int)m : HF_HIST_BUCKETS;
+            for (int b = 0; b <= cs->nbuckets && m > 0; b++) {
+                cs->bounds[b] = num[(m - 1) * b / cs->nbuckets];
+            }
+        }
+
+        // 4. Distinct values: from the sketch, never more than there
+        //    were values, or estimated from the sample
+        if (a->sampled && values > 0) {
+            cs->distinct = HF_SampleDistinct(a->hash[c], a->nhash[c], values * scale);
+        } else {
+            cs->distinct = values > 0 ? HF_HllCount(cs->hll) : 0;
+            if (cs->distinct > values) {
+                cs->distinct = values;
+            }
+        }
+    }
+}
+
+/*
+ * Analyzes a file.
+ */
+int HF_Analyze(int fd, int ncols, int samplePct, HF_Stats *stats) {
+    HF_FileOptions opts;
+    HF_Analyzer a;
+    int error;
+
+    if (ncols < 1 || ncols > HF_STATS_COLS || samplePct < 1 || samplePct > 100) {
+        return HFE_BADOPTIONS;
+    }
+    if ((error = HF_GetFileOptions(fd, &opts)) != HFE_OK) {
+        return error;
+    }
+
+    for (;;) {
+        // 1. Start from empty stats and sketches
+        memset(stats, 0, sizeof(HF_Stats));
+        memset(&a, 0, sizeof(a));
+        stats->magic = HF_STATS_MAGIC;
+        stats->samplePct = samplePct;
+        stats->ncols = ncols;
+        if ((stats->pages = PF_NumPages(fd)) < 0) {
+            return stats->pages;
+        }
+        a.stats = stats;
+        a.sep = opts.sep ? opts.sep : HF_DEFAULT_SEP;
+        a.sampled = samplePct < 100;
+
+        // 2. Read the records
+        error = samplePct < 100 ? HF_AnalyzeSample(fd, samplePct, &a)
+                                : HF_AnalyzeFull(fd, &a);
+
+        // 3. Scale up by the share of the pages that was read
+        if (error == HFE_OK) {
+            double scale = 1;
+            if (samplePct < 100 && stats->pagesRead > 0) {
+                scale = (double)(stats->pages - 1) / stats->pagesRead;
+            }
+            HF_AnalyzeFinish(&a, scale);
+        }
+        for (int c = 0; c < ncols; c++) {
+            free(a.num[c]);
+            free(a.hash[c]);
+        }
+
+        // 4. A sample that found no page, or a record too long for a
+        //    batch, is done again in full
+        if (samplePct < 100 && ((error == HFE_OK && stats->pagesRead == 0) ||
+                                error == HFE_PAGENOFREE)) {
+            samplePct = 100;
+            continue;
+        }
+        return error;
+    }
+}
+
+/*
+ * Builds the name of the stats file of a heap file.
+ */
+static char *HF_StatsName(char *fileName) {
+    char *name = malloc(strlen(fileName) + sizeof(".stats"));
+
+    if (name != NULL) {
+        strcpy(name, fileName);
+        strcat(name, ".stats");
+    }
+    return name;
+}
+
+/*
+ * Saves stats as fileName.stats.
+ */
+int HF_SaveStats(char *fileName, const HF_Stats *stats) {
+    char *name = HF_StatsName(fileName);
+    FILE *fp;
+    int ok;
+
+    if (name == NULL) {
+        return PFE_NOMEM;
+    }
+    if ((fp = fopen(name, "wb")) == NULL) {
+        free(name);
+        return PFE_UNIX;
+    }
+    ok = fwrite(stats, sizeof(HF_Stats), 1, fp) == 1;
+    ok = fclose(fp) == 0 && ok;
+    free(name);
+    return ok ? HFE_OK : PFE_UNIX;
+}
+
+/*
+ * Loads stats from fileName.stats.
+ */
+int HF_LoadStats(char *fileName, HF_Stats *stats) {
+    char *name = HF_StatsName(fileName);
+    FILE *fp;
+    int ok;
+
+    if (name == NULL) {
+        return PFE_NOMEM;
+    }
+    if ((fp = fopen(name, "rb")) == NULL) {
+        free(name);
+        return errno == ENOENT ? HFE_EOF : PFE_UNIX;
+    }
+    ok = fread(stats, sizeof(HF_Stats), 1, fp) == 1;
+    fclose(fp);
+    free(name);
+    if (!ok || stats->magic != HF_STATS_MAGIC || stats->ncols < 1 ||
+        stats->ncols > HF_STATS_COLS) {
+        return HFE_EOF;
+    }
+    return HFE_OK;
+}
+
+/*
+ * Share of the histogram's numbers below x, with the numbers taken to
+ * be spread evenly within a bucket.
+ */
+static double HF_HistBelow(const HF_ColStats *cs, double x) {
+    int nb = cs->nbuckets;
+
+    if (nb == 0 || x <= cs->bounds[0]) {
+        return 0;
+    }
+    for (int b = 0; b < nb; b++) {
+        double lo = cs->bounds[b], hi = cs->bounds[b + 1];
+        if (x <= hi) {
+            // x > lo here, since it was above the bucket before
+            return (b + (x - lo) / (hi - lo)) / nb;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Whether v is within every numeric range on column col, from
+ * predicate i on.
+ */
+static int HF_InRanges(const HF_ScanSpec *spec, int i, int col, double v) {
+    for (int j = i; j < spec->npreds; j++) {
+        const HF_Pred *q = &spec->preds[j];
+        if (q->col != col || !q->numeric) {
+            continue;
+        }
+        if ((q->op == HF_LT && !(v < q->num)) || (q->op == HF_LE && !(v <= q->num)) ||
+            (q->op == HF_GT && !(v > q->num)) || (q->op == HF_GE && !(v >= q->num))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Share of the rows a predicate keeps. The numeric ranges on one
+ * column (say "x <= col < y") are taken together, at the first of
+ * them; done[] marks the predicates already counted that way.
+ */
+static double HF_PredSel(const HF_Stats *stats, const HF_ScanSpec *spec, int i, int *done) {
+    const HF_Pred *p = &spec->preds[i];
+    const HF_ColStats *cs;
+    double eq, has;
+
+    // 1. Nothing known about the column
+    if (p->col < 0 || p->col >= stats->ncols || stats->rows == 0) {
+        return p->op == HF_EQ ? HF_GUESS_EQ
+             : p->op == HF_NE ? 1 - HF_GUESS_EQ : HF_GUESS_RANGE;
+    }
+    cs = &stats->col[p->col];
+
+    // 2. Text: only equality can use the distinct count
+    if (!p->numeric) {
+        eq = cs->distinct >= 1 ? 1 / cs->distinct : 1;
+        has = (double)(stats->rows - cs->nulls) / stats->rows;
+        return has * (p->op == HF_EQ ? eq : p->op == HF_NE ? 1 - eq : HF_GUESS_RANGE);
+    }
+
+    // 3. Numbers: the most common ones are known; the others share
+    //    what is left of the column and of its distinct values
+    double rest = 1, restDistinct = cs->distinct - cs->nmcv;
+    for (int k = 0; k < cs->nmcv; k++) {
+        rest -= cs->mcvShare[k];
+    }
+    has = (double)cs->numeric / stats->rows;
+    eq = restDistinct >= 1 ? 1 / restDistinct : 1;      // Within the histogram
+    if (p->op == HF_EQ || p->op == HF_NE) {
+        int k = HF_McvIndex(cs, p->num);
+        double in = k >= 0 ? cs->mcvShare[k]
+                  : cs->nbuckets == 0 || p->num < cs->bounds[0] ||
+                    p->num > cs->bounds[cs->nbuckets] ? 0 : rest * eq;
+        return has * (p->op == HF_EQ ? in : 1 - in);
+    }
+
+    // 4. A range: the most common numbers within it, and the share of
+    //    the histogram below its upper end less the share below its
+    //    lower end, over every range on the column
+    double lower = 0, upper = 1, mcvIn = 0;
+    for (int j = i; j < spec->npreds; j++) {
+        const HF_Pred *q = &spec->preds[j];
+        if (q->col != p->col || !q->numeric || q->op == HF_EQ || q->op == HF_NE) {
+            continue;
+        }
+        double below = HF_HistBelow(cs, q->num);
+        double at = cs->nbuckets == 0 || q->num < cs->bounds[0] ||
+                    q->num > cs->bounds[cs->nbuckets] ? 0 : eq;
+        switch (q->op) {
+        case HF_LT: upper = below < upper ? below : upper; break;
+        case HF_LE: upper = below + at < upper ? below + at : upper; break;
+        case HF_GT: lower = below + at > lower ? below + at : lower; break;
+        default:    lower = below > lower ? below : lower; break;
+        }
+        done[j] = 1;
+    }
+    for (int k = 0; k < cs->nmcv; k++) {
+        if (HF_InRanges(spec, i, p->col, cs->mcv[k])) {
+            mcvIn += cs->mcvShare[k];
+        }
+    }
+    if (upper > 1) {
+        upper = 1;
+    }
+    return has * (mcvIn + (cs->nbuckets > 0 && upper > lower ? rest * (upper - lower) : 0));
+}
+
+/*
+ * Estimates the rows a scan returns.
+ */
+double HF_EstimateRows(const HF_Stats *stats, const HF_ScanSpec *spec) {
+    int done[HF_MAX_PREDS] = { 0 };
+    double rows = stats->rows;
+
+    for (int i = 0; spec != NULL && i < spec->npreds; i++) {
+        if (!done[i]) {
+            rows *= HF_PredSel(stats, spec, i, done);
+        }
+    }
+    return rows;
+}
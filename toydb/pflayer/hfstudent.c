@@ -2,10 +2,40 @@
 #include <string.h>
 #include <stdlib.h>
 #include "hf.h"
+#include "benchutil.h"
 
-#define MAX_LINE 4096
+#define BATCH    64         // records per HF_GetNextBatch call
+#define SCAN_MS  200.0      // time each scan path for at least this long
 
-int main() {
+// one full scan, a record per call or a batch per call; returns the
+// record count and adds up the record bytes so the two can be compared
+static int timed_scan(int fd, int batched, long *bytes) {
+    HF_Scan scan;
+    RID rid, rids[BATCH];
+    char *rec, *recs[BATCH];
+    int recLen, lens[BATCH], n;
+    int count = 0;
+
+    *bytes = 0;
+    HF_OpenFileScan(fd, &scan);
+    if (batched) {
+        while (HF_GetNextBatch(&scan, BATCH, rids, recs, lens, &n) == HFE_OK) {
+            for (int i = 0; i < n; i++)
+                *bytes += lens[i] + (unsigned char)recs[i][0];
+            count += n;
+            HF_ReleaseBatch(&scan);
+        }
+    } else {
+        while (HF_GetNextRec(fd, &scan, &rid, &rec, &recLen) == HFE_OK) {
+            *bytes += recLen + (unsigned char)rec[0];
+            count++;
+        }
+    }
+    HF_CloseFileScan(&scan);
+    return count;
+}
+
+int main(int argc, char *argv[]) {
     PF_Init();  // PF must be initialised
     PF_SetBufferSize(20);        // or smaller if you want to stress paging
     PF_SetReplacementPolicy(PF_REPL_LRU);
@@ -13,9 +43,17 @@ int main() {
     const char *dataFile = "../../data/student.txt";
     const char *heapFile = "student.hf";
 
+    // -z: keep the heap file compressed on disk
+    int compressed = (argc > 1 && strcmp(argv[1], "-z") == 0);
+
     // (Re)create HF file
     PF_DestroyFile((char*)heapFile);  // ignore error if not exists
-    if (HF_CreateFile((char*)heapFile) != HFE_OK) {
+    if (compressed) {
+        if (PF_CreateCompressedFile((char*)heapFile) != PFE_OK) {
+            PF_PrintError("PF_CreateCompressedFile");
+            return 1;
+        }
+    } else if (HF_CreateFile((char*)heapFile) != HFE_OK) {
         PF_PrintError("HF_CreateFile");
         return 1;
     }
@@ -26,32 +64,35 @@ int main() {
         return 1;
     }
 
-    FILE *fp = fopen(dataFile, "r");
-    if (!fp) {
+    PF_ResetStats();
+    HF_LineSource src;
+    src.fp = fopen(dataFile, "r");
+    if (!src.fp) {
         perror("fopen student.txt");
         return 1;
     }
 
-    char line[MAX_LINE];
+    // pack whole pages and append them to the file
     int count = 0;
-    while (fgets(line, sizeof(line), fp)) {
-        // strip trailing newline
-        size_t len = strlen(line);
-        if (len > 0 && (line[len-1] == '\n' || line[len-1] == '\r'))
-            line[--len] = '\0';
-
-        RID rid;
-        int err = HF_InsertRec(fd, line, (int)len, &rid);
-        if (err != HFE_OK) {
-            printf("HF_InsertRec error %d at record %d\n", err, count);
-            return 1;
-        }
-        count++;
+    int err = HF_BulkLoad(fd, HF_NextLine, &src, 100, NULL, &count);
+    fclose(src.fp);
+    if (err != HFE_OK) {
+        printf("HF_BulkLoad error %d after %d records\n", err, count);
+        return 1;
     }
-    fclose(fp);
 
     printf("Inserted %d student records into heap file %s\n", count, heapFile);
 
+    // flush everything so the scan below starts from disk
+    HF_CloseFile(fd);
+    printf("Load ");
+    PF_PrintStats();
+    if ((fd = HF_OpenFile((char*)heapFile)) < 0) {
+        PF_PrintError("HF_OpenFile");
+        return 1;
+    }
+    PF_ResetStats();
+
     // sanity check: sequential scan
     HF_Scan scan;
     HF_OpenFileScan(fd, &scan);
@@ -79,6 +120,21 @@ int main() {
     HF_CloseFileScan(&scan);
 
     printf("Scanned %d records from heap file\n", scanned);
+    printf("Scan ");
+    PF_PrintStats();
+
+    // records/s of HF_GetNextRec vs HF_GetNextBatch (pages stay cached)
+    long bytes[2];
+    for (int batched = 0; batched <= 1; batched++) {
+        double t0, ms;
+        int reps, n = 0;
+        for (reps = 0, t0 = now_ms(); (ms = now_ms() - t0) < SCAN_MS; reps++)
+            n = timed_scan(fd, batched, &bytes[batched]);
+        printf("%-28s %8.2f Mrec/s\n", batched ? "HF_GetNextBatch (64/call):" :
+               "HF_GetNextRec:", n * (double)reps / ms / 1e3);
+    }
+    if (bytes[0] != bytes[1])
+        printf("batch scan returned different records!\n");
 
     HF_CloseFile(fd);
     return 0;
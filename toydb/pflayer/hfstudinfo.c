@@ -3,8 +3,6 @@
 #include <stdlib.h>
 #include "hf.h"
 
-#define MAX_LINE 4096
-
 int main() {
     PF_Init();  // PF must be initialised
     PF_SetBufferSize(20);        // or smaller if you want to stress paging
@@ -26,29 +24,21 @@ int main() {
         return 1;
     }
 
-    FILE *fp = fopen(dataFile, "r");
-    if (!fp) {
+    HF_LineSource src;
+    src.fp = fopen(dataFile, "r");
+    if (!src.fp) {
         perror("fopen studinfo.txt");
         return 1;
     }
 
-    char line[MAX_LINE];
+    // pack whole pages and append them to the file
     int count = 0;
-    while (fgets(line, sizeof(line), fp)) {
-        // strip trailing newline
-        size_t len = strlen(line);
-        if (len > 0 && (line[len-1] == '\n' || line[len-1] == '\r'))
-            line[--len] = '\0';
-
-        RID rid;
-        int err = HF_InsertRec(fd, line, (int)len, &rid);
-        if (err != HFE_OK) {
-            printf("HF_InsertRec error %d at record %d\n", err, count);
-            return 1;
-        }
-        count++;
+    int err = HF_BulkLoad(fd, HF_NextLine, &src, 100, NULL, &count);
+    fclose(src.fp);
+    if (err != HFE_OK) {
+        printf("HF_BulkLoad error %d after %d records\n", err, count);
+        return 1;
     }
-    fclose(fp);
 
     printf("Inserted %d student records into heap file %s\n", count, heapFile);
 
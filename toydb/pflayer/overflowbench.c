@@ -0,0 +1,346 @@
+/* overflowbench.c
+ * Long records on overflow pages: inserts, reads, scans and updates.
+ *
+ * Every k-th line of the table gets a long text column appended, of a
+ * random length between HF_MAX_INLINE + 1 and -m bytes, so it goes to
+ * overflow pages. The records are inserted one at a time, then some
+ * long ones are shortened and some short ones made long with
+ * HF_UpdateRec, then the long ones are deleted and inserted again.
+ * After each phase every record is checked with HF_GetRec, read back
+ * with HF_ReadRecStream in small pieces, and found exactly once by a
+ * full scan, a filtered scan, HF_GetNextBatch and HF_GetNextRows.
+ * The short lines alone are also inserted into a file of their own,
+ * to compare the insert rate of the small-record path.
+ *
+ * Usage: overflowbench [-b poolSize] [-k every] [-m maxLen] [-s seed]
+ *                      [table.txt]
+ *   -b  buffer pool size              (default 20)
+ *   -k  every k-th record is long     (default 10)
+ *   -m  longest long record, bytes    (default 20000)
+ *   -s  random seed                   (default 1)
+ *   table defaults to ../../data/student.txt
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "hf.h"
+#include "pftypes.h"
+#include "benchutil.h"
+
+#define MAX_LINE  4096
+#define PIECE     1000      // bytes per HF_ReadRecStream call
+
+static const char *heapFile = "overflowbench.hf";
+static const char *shortFile = "overflowbench_short.hf";
+
+// the current version of each record: its line, plus extra long bytes
+static int *extra;
+static RID *rids;
+
+// record i as it is now: the line, then ';' and extra[i] text bytes
+static int make_record(int i, char *out) {
+    static const char words[] = "Advanced Topics in Database Systems, Hostel 7, ";
+    int len = lineLen[i];
+    memcpy(out, lines[i], len);
+    if (extra[i] > 0) {
+        out[len++] = ';';
+        for (int k = 0; k < extra[i]; k++)
+            out[len++] = words[(i + k) % (sizeof(words) - 1)];
+    }
+    return len;
+}
+
+static int long_len(int maxLen) {
+    return HF_MAX_INLINE + 1 + rand() % (maxLen - HF_MAX_INLINE);
+}
+
+// index of the record at rid, or -1 (rids[] is not sorted)
+static int *ridIndex;
+static int ridPages;
+
+static int owner_of(RID rid) {
+    if (rid.pageNum < 0 || rid.pageNum >= ridPages || rid.slotNum < 0 ||
+        rid.slotNum >= PF_PAGE_SIZE / (int)sizeof(HF_SlotEntry))
+        return -1;
+    return ridIndex[rid.pageNum * (PF_PAGE_SIZE / (int)sizeof(HF_SlotEntry)) + rid.slotNum];
+}
+
+static void index_rids(int fd, int n) {
+    int per = PF_PAGE_SIZE / (int)sizeof(HF_SlotEntry);
+    free(ridIndex);
+    ridPages = PF_NumPages(fd);
+    ridIndex = malloc((size_t)ridPages * per * sizeof(int));
+    for (int i = 0; i < ridPages * per; i++)
+        ridIndex[i] = -1;
+    for (int i = 0; i < n; i++)
+        ridIndex[rids[i].pageNum * per + rids[i].slotNum] = i;
+}
+
+// one record found by a scan: must be record i's current version, once
+static int seen_once(char *seen, RID rid, const char *rec, int len, char *want) {
+    int i = owner_of(rid);
+    if (i < 0 || seen[i] || len != make_record(i, want) || memcmp(rec, want, len) != 0)
+        return 1;
+    seen[i] = 1;
+    return 0;
+}
+
+// every way of reading the file must give every record once, as it is now
+static int check(int fd, int n, double *scanMs) {
+    char *want = malloc(MAX_LINE + HF_MAX_INLINE + 1 + 1000000);
+    char *got = malloc(MAX_LINE + HF_MAX_INLINE + 1 + 1000000);
+    char *seen = malloc(n);
+    HF_Scan sc;
+    RID rid;
+    char *rec;
+    int len, bad = 0, found;
+
+    index_rids(fd, n);
+
+    // 1. By RID, whole and in pieces
+    for (int i = 0; i < n; i++) {
+        int wlen = make_record(i, want);
+        HF_RecStream rs;
+        int got_len = 0, k;
+        if (HF_GetRec(fd, rids[i], &rec, &len) != HFE_OK || len != wlen ||
+            memcmp(rec, want, len) != 0)
+            bad++;
+        if (HF_OpenRecStream(fd, rids[i], &rs) != HFE_OK || rs.length != wlen) {
+            bad++;
+            continue;
+        }
+        while ((k = HF_ReadRecStream(&rs, got + got_len, PIECE)) > 0)
+            got_len += k;
+        if (k < 0 || got_len != wlen || memcmp(got, want, wlen) != 0)
+            bad++;
+    }
+
+    // 2. A full scan, timed
+    double t0 = now_ms();
+    memset(seen, 0, n);
+    found = 0;
+    HF_OpenFileScan(fd, &sc);
+    while (HF_GetNextRec(fd, &sc, &rid, &rec, &len) == HFE_OK) {
+        bad += seen_once(seen, rid, rec, len, want);
+        found++;
+    }
+    HF_CloseFileScan(&sc);
+    *scanMs = now_ms() - t0;
+    bad += found != n;
+
+    // 3. A filtered scan: column 0 not empty
+    HF_ScanSpec spec;
+    int expect = 0;
+    memset(&spec, 0, sizeof(spec));
+    spec.npreds = 1;
+    spec.preds[0].col = 0;
+    spec.preds[0].op = HF_NE;
+    spec.preds[0].str = "";
+    for (int i = 0; i < n; i++)
+        expect += lineLen[i] > 0 && lines[i][0] != ';';
+    memset(seen, 0, n);
+    found = 0;
+    HF_OpenFileScanEx(fd, &sc, &spec);
+    while (HF_GetNextRec(fd, &sc, &rid, &rec, &len) == HFE_OK) {
+        bad += seen_once(seen, rid, rec, len, want);
+        found++;
+    }
+    HF_CloseFileScan(&sc);
+    bad += found != expect;
+
+    // 4. Zero-copy batches
+    RID brids[64];
+    char *brecs[64];
+    int blens[64], bn;
+    memset(seen, 0, n);
+    found = 0;
+    HF_OpenFileScan(fd, &sc);
+    while (HF_GetNextBatch(&sc, 64, brids, brecs, blens, &bn) == HFE_OK) {
+        for (int j = 0; j < bn; j++)
+            bad += seen_once(seen, brids[j], brecs[j], blens[j], want);
+        found += bn;
+        HF_ReleaseBatch(&sc);
+    }
+    HF_CloseFileScan(&sc);
+    bad += found != n;
+
+    // 5. Copied rows; one longer than a batch is read on its own
+    HF_RowBatch *batch = malloc(sizeof(HF_RowBatch));
+    int err;
+    memset(&spec, 0, sizeof(spec));
+    memset(seen, 0, n);
+    found = 0;
+    HF_OpenFileScanEx(fd, &sc, &spec);
+    while ((err = HF_GetNextRows(&sc, batch)) == HFE_OK || err == HFE_PAGENOFREE) {
+        if (err == HFE_PAGENOFREE) {
+            if (HF_GetNextRec(fd, &sc, &rid, &rec, &len) != HFE_OK)
+                break;
+            bad += seen_once(seen, rid, rec, len, want);
+            found++;
+            continue;
+        }
+        for (int j = 0; j < batch->n; j++)
+            bad += seen_once(seen, batch->rid[j], batch->buf + batch->off[j],
+                             batch->len[j], want);
+        found += batch->n;
+    }
+    HF_CloseFileScan(&sc);
+    bad += found != n;
+
+    free(batch);
+    free(seen);
+    free(got);
+    free(want);
+    return bad;
+}
+
+static int report(const char *phase, int fd, int n, double ms) {
+    double scanMs;
+    int nlong = 0;
+    int bad = check(fd, n, &scanMs);
+    for (int i = 0; i < n; i++)
+        nlong += extra[i] > 0;
+    printf("%-8s %8d %6d %8d %10.2f %10.2f", phase, n, nlong, PF_NumPages(fd), ms, scanMs);
+    if (bad) {
+        printf("  WRONG (%d)\n", bad);
+        return 1;
+    }
+    printf("\n");
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = "../../data/student.txt";
+    int pool = 20, every = 10, maxLen = 20000;
+    unsigned seed = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "b:k:m:s:")) != -1) {
+        switch (opt) {
+        case 'b': pool = atoi(optarg); break;
+        case 'k': every = atoi(optarg); break;
+        case 'm': maxLen = atoi(optarg); break;
+        case 's': seed = (unsigned)atoi(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-b poolSize] [-k every] [-m maxLen] [-s seed] "
+                    "[table.txt]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind < argc)
+        path = argv[optind];
+    if (pool <= 0 || pool > PF_MAX_BUFS_LIMIT) {
+        fprintf(stderr, "pool size out of range (1..%d)\n", PF_MAX_BUFS_LIMIT);
+        return 1;
+    }
+    if (every < 2 || maxLen <= HF_MAX_INLINE || maxLen > 1000000) {
+        fprintf(stderr, "-k must be at least 2 and -m %d..1000000\n", HF_MAX_INLINE + 1);
+        return 1;
+    }
+    if (read_table(path) <= 0) {
+        perror(path);
+        return 1;
+    }
+    srand(seed);
+
+    PF_Init();
+    PF_SetBufferSize(pool);
+    PF_SetReplacementPolicy(PF_REPL_LRU);
+
+    int n = nlines;
+    char *rec = malloc(MAX_LINE + 1 + maxLen);
+    extra = calloc(n, sizeof(int));
+    rids = malloc(n * sizeof(RID));
+    int status = 0;
+
+    // 1. The short lines alone, for the insert rate of the small path
+    RID rid;
+    PF_DestroyFile((char *)shortFile);
+    HF_CreateFile((char *)shortFile);
+    int sfd = HF_OpenFile((char *)shortFile);
+    double t0 = now_ms();
+    for (int i = 0; i < n; i++) {
+        if (i % every != 0 && HF_InsertRec(sfd, lines[i], lineLen[i], &rid) != HFE_OK) {
+            PF_PrintError("HF_InsertRec");
+            return 1;
+        }
+    }
+    double shortMs = now_ms() - t0;
+    HF_CloseFile(sfd);
+    PF_DestroyFile((char *)shortFile);
+
+    // 2. Every record, the long ones included
+    PF_DestroyFile((char *)heapFile);
+    if (HF_CreateFile((char *)heapFile) != HFE_OK) {
+        PF_PrintError("HF_CreateFile");
+        return 1;
+    }
+    int fd = HF_OpenFile((char *)heapFile);
+    if (fd < 0) {
+        PF_PrintError("HF_OpenFile");
+        return 1;
+    }
+    for (int i = 0; i < n; i += every)
+        extra[i] = long_len(maxLen);
+
+    printf("overflowbench: %s, %d records, 1 in %d long (up to %d bytes), pool=%d\n",
+           path, n, every, maxLen, pool);
+    printf("short records alone: %.2f ms, %.1f kins/s\n", shortMs,
+           (n - (n + every - 1) / every) / shortMs);
+    printf("%-8s %8s %6s %8s %10s %10s\n", "phase", "records", "long", "pages", "ms",
+           "scan ms");
+
+    t0 = now_ms();
+    for (int i = 0; i < n; i++) {
+        int err = HF_InsertRec(fd, rec, make_record(i, rec), &rids[i]);
+        if (err != HFE_OK) {
+            printf("HF_InsertRec error %d on record %d\n", err, i);
+            return 1;
+        }
+    }
+    status |= report("insert", fd, n, now_ms() - t0);
+
+    // 3. Long records become short, and short ones long
+    t0 = now_ms();
+    for (int i = 0; i < n; i++) {
+        if (i % every == 0)
+            extra[i] = 0;
+        else if (i % every == every / 2)
+            extra[i] = long_len(maxLen);
+        else
+            continue;
+        int err = HF_UpdateRec(fd, rids[i], rec, make_record(i, rec));
+        if (err != HFE_OK) {
+            printf("HF_UpdateRec error %d on record %d\n", err, i);
+            return 1;
+        }
+    }
+    status |= report("update", fd, n, now_ms() - t0);
+
+    // 4. The long records go, and come back; their pages are reused
+    t0 = now_ms();
+    for (int i = every / 2; i < n; i += every) {
+        if (HF_DeleteRec(fd, rids[i]) != HFE_OK) {
+            PF_PrintError("HF_DeleteRec");
+            return 1;
+        }
+    }
+    for (int i = every / 2; i < n; i += every) {
+        extra[i] = long_len(maxLen);
+        if (HF_InsertRec(fd, rec, make_record(i, rec), &rids[i]) != HFE_OK) {
+            PF_PrintError("HF_InsertRec");
+            return 1;
+        }
+    }
+    status |= report("reinsert", fd, n, now_ms() - t0);
+
+    // 5. And it all reads back the same from disk
+    HF_CloseFile(fd);
+    fd = HF_OpenFile((char *)heapFile);
+    status |= report("reopen", fd, n, 0.0);
+
+    HF_CloseFile(fd);
+    PF_DestroyFile((char *)heapFile);
+    return status;
+}
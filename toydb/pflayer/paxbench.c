@@ -0,0 +1,207 @@
+/* paxbench.c
+ * Column-subset scans on slotted vs PAX heap files.
+ *
+ * One table is bulk-loaded twice: into a file with slotted pages and
+ * into one with PAX pages (HF_CreateFileEx). Each file is then scanned
+ *   full  - HF_GetNextRec returning whole records
+ *   cols  - HF_GetNextRec(NULL) + HF_ScanGetField for a few columns
+ * repeatedly for at least MIN_MS, printing rows/s and the physical
+ * reads per scan. Both files must give the same checksums.
+ *
+ * Usage: paxbench [-b poolSize] [-c col,col,...] [table.txt]
+ *   -b  buffer pool size                    (default 100)
+ *   -c  columns for the subset scan         (default 1,6: year and
+ *       CGPA of gradsum)
+ *   table defaults to ../../data/gradsum.txt
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "hf.h"
+#include "pftypes.h"
+#include "benchutil.h"
+
+#define MAX_LINE  4096
+#define MAX_COLS  16
+#define MIN_MS    200.0     // run each scan for at least this long
+
+static const char *heapFile = "paxbench.hf";
+
+// most ';'-separated columns of any line
+static int count_columns(const char *path) {
+    FILE *fp = fopen(path, "r");
+    char line[MAX_LINE];
+    int most = 1;
+    if (!fp)
+        return -1;
+    while (fgets(line, sizeof(line), fp)) {
+        int n = 1;
+        for (char *p = line; *p; p++)
+            if (*p == ';')
+                n++;
+        if (n > most)
+            most = n;
+    }
+    fclose(fp);
+    return most;
+}
+
+// a field is not terminated, so copy it before parsing
+static double field_value(const char *field, int len) {
+    char buf[32];
+    if (len <= 0 || len >= (int)sizeof(buf))
+        return 0;
+    memcpy(buf, field, len);
+    buf[len] = '\0';
+    return strtod(buf, NULL);
+}
+
+static int load(const char *path, HF_FileOptions *opts) {
+    HF_LineSource src;
+    int n;
+
+    PF_DestroyFile((char *)heapFile);
+    if (HF_CreateFileEx((char *)heapFile, opts) != HFE_OK) {
+        PF_PrintError("HF_CreateFileEx");
+        return -1;
+    }
+    int fd = HF_OpenFile((char *)heapFile);
+    if (fd < 0) {
+        PF_PrintError("HF_OpenFile");
+        return -1;
+    }
+    if (!(src.fp = fopen(path, "r"))) {
+        perror(path);
+        HF_CloseFile(fd);
+        return -1;
+    }
+    int err = HF_BulkLoad(fd, HF_NextLine, &src, 100, NULL, &n);
+    fclose(src.fp);
+    HF_CloseFile(fd);
+    if (err != HFE_OK) {
+        printf("HF_BulkLoad error %d after %d records\n", err, n);
+        return -1;
+    }
+    return n;
+}
+
+// one full scan; cols == NULL reads whole records
+static double scan(int fd, const int *cols, int ncols, long *rows) {
+    HF_Scan sc;
+    RID rid;
+    char *rec;
+    int len;
+    double sum = 0;
+
+    *rows = 0;
+    HF_OpenFileScan(fd, &sc);
+    if (cols == NULL) {
+        while (HF_GetNextRec(fd, &sc, &rid, &rec, &len) == HFE_OK) {
+            unsigned h = 2166136261u;   // FNV-1a, so the bytes must match
+            for (int i = 0; i < len; i++)
+                h = (h ^ (unsigned char)rec[i]) * 16777619u;
+            sum += h;
+            (*rows)++;
+        }
+    } else {
+        while (HF_GetNextRec(fd, &sc, &rid, NULL, NULL) == HFE_OK) {
+            for (int c = 0; c < ncols; c++)
+                if (HF_ScanGetField(&sc, cols[c], &rec, &len) == HFE_OK)
+                    sum += field_value(rec, len);
+            (*rows)++;
+        }
+    }
+    HF_CloseFileScan(&sc);
+    return sum;
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = "../../data/gradsum.txt";
+    char defaultCols[] = "1,6";
+    char *colSpec = defaultCols;
+    int pool = 100;
+    int cols[MAX_COLS];
+    int ncols = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "b:c:")) != -1) {
+        switch (opt) {
+        case 'b': pool = atoi(optarg); break;
+        case 'c': colSpec = optarg; break;
+        default:
+            fprintf(stderr, "Usage: %s [-b poolSize] [-c col,col,...] [table.txt]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (optind < argc)
+        path = argv[optind];
+    if (pool <= 0 || pool > PF_MAX_BUFS_LIMIT) {
+        fprintf(stderr, "pool size out of range (1..%d)\n", PF_MAX_BUFS_LIMIT);
+        return 1;
+    }
+    for (char *p = strtok(colSpec, ","); p && ncols < MAX_COLS; p = strtok(NULL, ","))
+        cols[ncols++] = atoi(p);
+
+    int tableCols = count_columns(path);
+    if (tableCols < 0) {
+        perror(path);
+        return 1;
+    }
+    if (tableCols > HF_PAX_MAX_COLS)
+        tableCols = HF_PAX_MAX_COLS;
+
+    PF_Init();
+    PF_SetBufferSize(pool);
+    PF_SetReplacementPolicy(PF_REPL_LRU);
+
+    printf("paxbench: %s, %d columns, pool=%d, subset=", path, tableCols, pool);
+    for (int c = 0; c < ncols; c++)
+        printf("%s%d", c ? "," : "", cols[c]);
+    printf("\n%-8s %8s %7s %12s %12s %12s %12s\n", "layout", "rows", "pages",
+           "full Mrow/s", "reads/scan", "cols Mrow/s", "reads/scan");
+
+    double ref[2] = { 0, 0 };
+    int status = 0;
+    for (int layout = HF_LAYOUT_SLOTTED; layout <= HF_LAYOUT_PAX; layout++) {
+        HF_FileOptions opts = { .layout = layout, .ncols = tableCols, .sep = ';' };
+        struct stat sb;
+        double sum[2], rate[2], reads[2];
+        long rows = 0;
+
+        if (load(path, &opts) < 0)
+            return 1;
+        int fd = HF_OpenFile((char *)heapFile);
+        if (fd < 0) {
+            PF_PrintError("HF_OpenFile");
+            return 1;
+        }
+        for (int subset = 0; subset <= 1; subset++) {
+            double t0, ms;
+            int reps;
+            PF_ResetStats();
+            for (reps = 0, t0 = now_ms(); (ms = now_ms() - t0) < MIN_MS; reps++)
+                sum[subset] = scan(fd, subset ? cols : NULL, ncols, &rows);
+            rate[subset] = rows * (double)reps / ms / 1e3;
+            reads[subset] = (double)PF_stats.physicalReads / reps;
+        }
+        HF_CloseFile(fd);
+
+        int pages = stat(heapFile, &sb) == 0 ? (int)(sb.st_size / sizeof(PFfpage)) : 0;
+        printf("%-8s %8ld %7d %12.2f %12.0f %12.2f %12.0f", layout ? "pax" : "slotted",
+               rows, pages, rate[0], reads[0], rate[1], reads[1]);
+        if (layout == HF_LAYOUT_SLOTTED) {
+            ref[0] = sum[0];
+            ref[1] = sum[1];
+        } else if (sum[0] != ref[0] || sum[1] != ref[1]) {
+            printf("  CHECKSUM MISMATCH");
+            status = 1;
+        }
+        printf("\n");
+    }
+
+    PF_DestroyFile((char *)heapFile);
+    return status;
+}
@@ -9,7 +9,16 @@
 #include <string.h>     /* strlen, strcpy, strcmp */
 #include <unistd.h>     /* lseek, read, write, close, unlink */
 #include <sys/stat.h>
-int PF_GetNextPage();      /* old-style prototype, no arg types */
+#include <errno.h>
+#include <time.h>       /* clock_gettime */
+#include <pthread.h>
+static int PFgetNext();      /* old-style prototypes, no arg types */
+static int PFgetThis();
+static int PFalloc();
+static int PFappend();
+static int PFdispose();
+static int PFunfix();
+static int PFtruncate();
 /* remove the PFbufUsed prototype here */
 
 int PF_MAX_BUFS = 20;   /* default; can be changed at runtime */
@@ -20,19 +29,29 @@ int PF_MAX_BUFS = 20;   /* default; can be changed at runtime */
 #endif
 
 int PFerrno = PFE_OK;	/* last error message */
-PF_Stats PF_stats = {0, 0, 0, 0}; /* initialize stats */
+PF_Stats PF_stats = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0.0}; /* initialize stats */
 /* default replacement policy = LRU */
 int PF_replacementPolicy = PF_REPL_LRU;
-static PFftab_ele PFftab[PF_FTAB_SIZE]; /* table of opened files */
+static PFftab_ele *PFftab = NULL; /* table of opened files */
+static int PFftabsize = 0;	/* # of entries in PFftab */
+static int PFftabfree = -1;	/* first free entry of PFftab, or -1 */
+static int PFfnametbl[PF_FNAME_TBL_SIZE]; /* file name hash buckets */
+
+/* held by every page-level call (see "Thread-safe page calls" below) */
+static pthread_mutex_t PFlatch = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t PFiodone = PTHREAD_COND_INITIALIZER; /* signalled
+				when a page transfer or a file's growth ends */
+static int PFlatched = FALSE;	/* TRUE while the holder of PFlatch may let
+				it go for I/O */
 
 /* true if file descriptor fd is invaild */
-#define PFinvalidFd(fd) ((fd) < 0 || (fd) >= PF_FTAB_SIZE \
+#define PFinvalidFd(fd) ((unsigned)(fd) >= (unsigned)PFftabsize \
 				|| PFftab[fd].fname == NULL)
 
 /* true if page number "pagenum" of file "fd" is invalid in the
 sense that it's <0 or >= # of pages in the file */
-#define PFinvalidPagenum(fd,pagenum) ((pagenum)<0 || (pagenum) >= \
-				PFftab[fd].hdr.numpages)
+#define PFinvalidPagenum(fd,pagenum) ((unsigned)(pagenum) >= \
+				(unsigned)PFftab[fd].hdr.numpages)
 
 
 /****************** Internal Support Functions *****************************/
@@ -51,6 +70,20 @@ char *s;
 	return(s);
 }
 
+static unsigned PFfnameHash(fname)
+char *fname;	/* file name */
+/****************************************************************************
+SPECIFICATIONS:
+	Return the bucket of "fname" in the file name hash table.
+*****************************************************************************/
+{
+unsigned h = 5381;
+
+	while (*fname)
+		h = h*33 + (unsigned char)*fname++;
+	return(h % PF_FNAME_TBL_SIZE);
+}
+
 static int  PFtabFindFname(fname)
 char *fname;		/* file name to find */
 /****************************************************************************
@@ -64,12 +97,16 @@ RETURN VALUE:
 	The desired index, or 
 	-1	if not found
 
+IMPLEMENTATION NOTES:
+	Only the entries in the hash bucket of "fname" are compared.
 *****************************************************************************/
 {
 int i;
 
-	for (i=0; i < PF_FTAB_SIZE; i++){
-		if(PFftab[i].fname != NULL&& strcmp(PFftab[i].fname,fname) == 0)
+	if (PFftabsize == 0)
+		return(-1);
+	for (i=PFfnametbl[PFfnameHash(fname)]; i >= 0; i=PFftab[i].nextname){
+		if(strcmp(PFftab[i].fname,fname) == 0)
 			/* found it */
 			return(i);
 	}
@@ -80,22 +117,622 @@ static int PFftabFindFree()
 /****************************************************************************
 SPECIFICATIONS:
 	Find a free entry in the open file table "PFtab", and return its
-	index.
+	index. The table is grown if it is full. The entry stays on the
+	free list until PFftabTake() is called.
 
 AUTHOR: clc
 
 RETURN VALUE:
 	If >=0, the index of the free entry.
-	Otherwise, none can be found.
+	Otherwise, none can be found (no memory).
 
 *****************************************************************************/
 {
+PFftab_ele *ftab;
+int size;
 int i;
 
-	for (i=0; i < PF_FTAB_SIZE; i++)
-		if (PFftab[i].fname == NULL)
-			return(i);
-	return(-1);
+	if (PFftabfree >= 0)
+		return(PFftabfree);
+
+	/* table full: double it */
+	size = PFftabsize > 0 ? 2*PFftabsize : PF_FTAB_SIZE;
+	if ((ftab=(PFftab_ele *)realloc((char *)PFftab,
+				size*sizeof(PFftab_ele)))== NULL)
+		return(-1);
+	if (PFftabsize == 0)
+		for (i=0; i < PF_FNAME_TBL_SIZE; i++)
+			PFfnametbl[i] = -1;
+
+	/* chain the new entries into the free list, lowest first */
+	for (i=size-1; i >= PFftabsize; i--){
+		ftab[i].fname = NULL;
+		ftab[i].zmap = NULL;
+		ftab[i].tsp = NULL;
+		ftab[i].nextname = -1;
+		ftab[i].nextfree = PFftabfree;
+		PFftabfree = i;
+	}
+	PFftab = ftab;
+	PFftabsize = size;
+	return(PFftabfree);
+}
+
+static void PFftabTake(fd)
+int fd;		/* entry returned by PFftabFindFree(), with fname set */
+/****************************************************************************
+SPECIFICATIONS:
+	Take entry "fd" off the free list and chain it into the file
+	name hash table.
+*****************************************************************************/
+{
+unsigned bucket = PFfnameHash(PFftab[fd].fname);
+
+	PFftabfree = PFftab[fd].nextfree;
+	PFftab[fd].nextname = PFfnametbl[bucket];
+	PFfnametbl[bucket] = fd;
+}
+
+static void PFftabRelease(fd)
+int fd;		/* entry of a file being closed */
+/****************************************************************************
+SPECIFICATIONS:
+	Unchain entry "fd" from the file name hash table and put it back
+	on the free list. The caller frees the file name afterwards.
+*****************************************************************************/
+{
+int *link;
+
+	for (link = &PFfnametbl[PFfnameHash(PFftab[fd].fname)]; *link != fd;
+				link = &PFftab[*link].nextname)
+		;
+	*link = PFftab[fd].nextname;
+	PFftab[fd].nextname = -1;
+	PFftab[fd].nextfree = PFftabfree;
+	PFftabfree = fd;
+}
+
+int PFioBegin()
+/****************************************************************************
+SPECIFICATIONS:
+	Let PFlatch go for the transfer of a page, if the call in
+	progress holds it and allows that (see "Thread-safe page calls"
+	below). The caller has made sure, while holding it, that no
+	other thread touches what the transfer reads or writes.
+
+RETURN VALUE:
+	TRUE if PFlatch was let go; pass it to PFioEnd().
+*****************************************************************************/
+{
+	if (!PFlatched)
+		return(FALSE);
+	PFlatched = FALSE;
+	pthread_mutex_unlock(&PFlatch);
+	return(TRUE);
+}
+
+void PFioEnd(released)
+int released;	/* what PFioBegin() returned */
+/****************************************************************************
+SPECIFICATIONS:
+	Take PFlatch back after a transfer started with PFioBegin().
+*****************************************************************************/
+{
+	if (released){
+		pthread_mutex_lock(&PFlatch);
+		PFlatched = TRUE;
+	}
+}
+
+int PFioWait()
+/****************************************************************************
+SPECIFICATIONS:
+	Wait, with PFlatch let go, until a page transfer or a file's
+	growth ends (PFioDone()), if the call in progress allows that.
+	The caller looks again at what it waited for: anything may have
+	changed meanwhile.
+
+RETURN VALUE:
+	TRUE if it waited, FALSE if it may not.
+*****************************************************************************/
+{
+	if (!PFlatched)
+		return(FALSE);
+	PFlatched = FALSE;
+	pthread_cond_wait(&PFiodone,&PFlatch);
+	PFlatched = TRUE;
+	return(TRUE);
+}
+
+void PFioDone()
+/****************************************************************************
+SPECIFICATIONS:
+	Wake the threads waiting in PFioWait(). Called with PFlatch held,
+	once the page or the file is in a state they can look at.
+*****************************************************************************/
+{
+	pthread_cond_broadcast(&PFiodone);
+}
+
+static double PFnowMs()
+/****************************************************************************
+SPECIFICATIONS:
+	Return a monotonic wall-clock time in milliseconds, used to
+	charge codec time to the statistics.
+*****************************************************************************/
+{
+struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return(ts.tv_sec*1000.0 + ts.tv_nsec/1000000.0);
+}
+
+static char *PFsideName(fname,suffix)
+char *fname;	/* name of the paged file */
+char *suffix;	/* suffix of the companion file */
+/****************************************************************************
+SPECIFICATIONS:
+	Return the name of the companion file of "fname" with the given
+	suffix (page-offset map, tablespace descriptor) in newly
+	allocated memory, or NULL if no memory.
+*****************************************************************************/
+{
+char *s;
+
+	if ((s=malloc(strlen(fname)+strlen(suffix)+1))!= NULL){
+		strcpy(s,fname);
+		strcat(s,suffix);
+	}
+	return(s);
+}
+
+static int PFzmapGrow(fd,pagenum)
+int fd;		/* file descriptor */
+int pagenum;	/* page number that must have an entry */
+/****************************************************************************
+SPECIFICATIONS:
+	Make sure the page-offset map of compressed file "fd" has room
+	for page "pagenum". New entries are marked as never written.
+
+RETURN VALUE:
+	PFE_OK	if ok
+	PFE_NOMEM if no memory.
+*****************************************************************************/
+{
+PFftab_ele *ftab = &PFftab[fd];
+PFzslot *zmap;
+int size;
+
+	if (pagenum < ftab->zmapsize)
+		return(PFE_OK);
+
+	for (size = ftab->zmapsize > 0 ? ftab->zmapsize : 16; size <= pagenum;)
+		size *= 2;
+	if ((zmap=(PFzslot *)realloc((char *)ftab->zmap,
+				size*sizeof(PFzslot)))== NULL){
+		PFerrno = PFE_NOMEM;
+		return(PFerrno);
+	}
+	memset(&zmap[ftab->zmapsize],0,
+		(size - ftab->zmapsize)*sizeof(PFzslot));
+	ftab->zmap = zmap;
+	ftab->zmapsize = size;
+	return(PFE_OK);
+}
+
+static int PFzmapLoad(fd)
+int fd;		/* file descriptor of a newly opened file */
+/****************************************************************************
+SPECIFICATIONS:
+	If the file "fd" has a page-offset map file, it is a compressed
+	file: load the map into the file table. Otherwise, mark the
+	file as not compressed.
+
+RETURN VALUE:
+	PFE_OK	if ok
+	PF error code if not OK.
+*****************************************************************************/
+{
+PFftab_ele *ftab = &PFftab[fd];
+PFzmap_hdr zhdr;
+char *zname;
+int zfd;
+int count;
+int error;
+
+	ftab->zmap = NULL;
+	ftab->zmapsize = 0;
+	ftab->zend = 0;
+	ftab->zmapchanged = FALSE;
+
+	if ((zname=PFsideName(ftab->fname,PF_ZMAP_SUFFIX))== NULL){
+		PFerrno = PFE_NOMEM;
+		return(PFerrno);
+	}
+	zfd = open(zname,O_RDONLY);
+	free(zname);
+	if (zfd < 0){
+		if (errno == ENOENT)
+			/* a plain file */
+			return(PFE_OK);
+		PFerrno = PFE_UNIX;
+		return(PFerrno);
+	}
+
+	if ((count=read(zfd,(char *)&zhdr,sizeof(zhdr)))!= sizeof(zhdr)
+			|| zhdr.magic != PF_ZMAP_MAGIC || zhdr.numslots < 0){
+		PFerrno = count < 0 ? PFE_UNIX : PFE_HDRREAD;
+		close(zfd);
+		return(PFerrno);
+	}
+
+	/* always keep a map, even for an empty file */
+	if ((error=PFzmapGrow(fd,zhdr.numslots))!= PFE_OK){
+		close(zfd);
+		return(error);
+	}
+	count = read(zfd,(char *)ftab->zmap,zhdr.numslots*sizeof(PFzslot));
+	close(zfd);
+	if (count != zhdr.numslots*(int)sizeof(PFzslot)){
+		free((char *)ftab->zmap);
+		ftab->zmap = NULL;
+		PFerrno = count < 0 ? PFE_UNIX : PFE_HDRREAD;
+		return(PFerrno);
+	}
+	ftab->zend = zhdr.dataend;
+	return(PFE_OK);
+}
+
+static int PFzmapSave(fd)
+int fd;		/* file descriptor of a compressed file */
+/****************************************************************************
+SPECIFICATIONS:
+	Write the page-offset map of compressed file "fd" back to its
+	map file.
+
+RETURN VALUE:
+	PFE_OK	if ok
+	PF error code if not OK.
+*****************************************************************************/
+{
+PFftab_ele *ftab = &PFftab[fd];
+PFzmap_hdr zhdr;
+char *zname;
+int zfd;
+int size;
+
+	if ((zname=PFsideName(ftab->fname,PF_ZMAP_SUFFIX))== NULL){
+		PFerrno = PFE_NOMEM;
+		return(PFerrno);
+	}
+	zfd = open(zname,O_WRONLY|O_TRUNC);
+	free(zname);
+	if (zfd < 0){
+		PFerrno = PFE_UNIX;
+		return(PFerrno);
+	}
+
+	zhdr.magic = PF_ZMAP_MAGIC;
+	zhdr.numslots = ftab->hdr.numpages;
+	zhdr.dataend = ftab->zend;
+	size = zhdr.numslots*sizeof(PFzslot);
+	if (write(zfd,(char *)&zhdr,sizeof(zhdr)) != sizeof(zhdr) ||
+			(size > 0 && write(zfd,(char *)ftab->zmap,size) != size)){
+		close(zfd);
+		PFerrno = PFE_HDRWRITE;
+		return(PFerrno);
+	}
+	if (close(zfd) == -1){
+		PFerrno = PFE_UNIX;
+		return(PFerrno);
+	}
+	ftab->zmapchanged = FALSE;
+	return(PFE_OK);
+}
+
+static int PFzreadfcn(fd,pagenum,buf)
+int fd;		/* file descriptor of a compressed file */
+int pagenum;	/* page number */
+PFfpage *buf;	/* where to put the page */
+/****************************************************************************
+SPECIFICATIONS:
+	Read the slot of page "pagenum" of compressed file "fd" and
+	decompress it into "buf". See PFreadfcn().
+
+RETURN VALUE:
+	PFE_OK	if ok
+	PF error code if not OK.
+*****************************************************************************/
+{
+char zbuf[sizeof(PFfpage)];
+char *dst;
+double ms;
+long offset;
+int len;
+int count;
+int released;
+
+	if (pagenum >= PFftab[fd].zmapsize ||
+			PFftab[fd].zmap[pagenum].len == 0){
+		/* page never written */
+		PFerrno = PFE_INCOMPLETEREAD;
+		return(PFerrno);
+	}
+	offset = PFftab[fd].zmap[pagenum].offset;
+	len = PFftab[fd].zmap[pagenum].len;
+
+	/* a raw slot is read straight into the buffer */
+	dst = len == sizeof(PFfpage) ? (char *)buf : zbuf;
+	released = PFioBegin();
+	count = pread(PFftab[fd].unixfd,dst,len,(off_t)offset);
+	ms = PFnowMs();
+	if (count == len && dst == zbuf)
+		count = PFcodecDecompress(zbuf,len,(char *)buf,
+				sizeof(PFfpage)) == sizeof(PFfpage) ? len : 0;
+	ms = PFnowMs() - ms;
+	PFioEnd(released);
+
+	if (count != len){
+		if (count <0)
+			PFerrno = PFE_UNIX;
+		else	PFerrno = PFE_INCOMPLETEREAD;
+		return(PFerrno);
+	}
+	PF_stats.physicalReads++;
+	PF_stats.bytesRead += len;
+	if (dst == zbuf)
+		PF_stats.codecMs += ms;
+	return(PFE_OK);
+}
+
+static int PFzwritefcn(fd,pagenum,buf)
+int fd;		/* file descriptor of a compressed file */
+int pagenum;	/* page number */
+PFfpage *buf;	/* page to write */
+/****************************************************************************
+SPECIFICATIONS:
+	Compress page "pagenum" and write it to its slot in compressed
+	file "fd". If it no longer fits in its slot, a new slot is
+	taken from the end of the file; the old slot is not reused.
+	The slot is chosen with PFlatch held; the compression and the
+	write are done with it let go.
+
+RETURN VALUE:
+	PFE_OK	if ok
+	PF error code if not OK.
+*****************************************************************************/
+{
+char zbuf[sizeof(PFfpage)];
+PFftab_ele *ftab = &PFftab[fd];
+PFzslot *slot;
+char *src;
+double ms;
+long offset;
+int len;
+int count;
+int error;
+int released;
+
+	/* compress; keep the raw page if it does not get smaller */
+	released = PFioBegin();
+	ms = PFnowMs();
+	len = PFcodecCompress((char *)buf,sizeof(PFfpage),zbuf,sizeof(PFfpage));
+	ms = PFnowMs() - ms;
+	PFioEnd(released);
+	PF_stats.codecMs += ms;
+
+	if ((error=PFzmapGrow(fd,pagenum))!= PFE_OK)
+		return(error);
+	slot = &ftab->zmap[pagenum];
+	if (len == 0){
+		len = sizeof(PFfpage);
+		src = (char *)buf;
+	}
+	else	src = zbuf;
+	PF_stats.zRawBytes += sizeof(PFfpage);
+	PF_stats.zPackedBytes += len;
+
+	if (len > slot->cap){
+		/* move to a new slot at the end, leaving some room to grow */
+		if (ftab->zend < (long)PF_HDR_SIZE)
+			ftab->zend = PF_HDR_SIZE;
+		slot->offset = ftab->zend;
+		slot->cap = (len + len/8 + PF_ZSLOT_ALIGN - 1)
+				/ PF_ZSLOT_ALIGN * PF_ZSLOT_ALIGN;
+		if (slot->cap < len)
+			slot->cap = len;
+		ftab->zend += slot->cap;
+	}
+	if (slot->len != len)
+		ftab->zmapchanged = TRUE;
+	slot->len = len;
+	offset = slot->offset;
+
+	released = PFioBegin();
+	count = pwrite(ftab->unixfd,src,len,(off_t)offset);
+	PFioEnd(released);
+	if (count != len){
+		if (count <0)
+			PFerrno = PFE_UNIX;
+		else	PFerrno = PFE_INCOMPLETEWRITE;
+		return(PFerrno);
+	}
+	PF_stats.physicalWrites++;
+	PF_stats.bytesWritten += len;
+	return(PFE_OK);
+}
+
+static void PFtspFree(tsp)
+PFtsp *tsp;	/* tablespace to free */
+/****************************************************************************
+SPECIFICATIONS:
+	Close the open segment files of "tsp" and free it.
+*****************************************************************************/
+{
+int i;
+
+	for (i=1; i < tsp->nsegs; i++)
+		if (tsp->segfd[i] >= 0)
+			close(tsp->segfd[i]);
+	for (i=0; i < tsp->ndirs; i++)
+		free(tsp->dirs[i]);
+	free((char *)tsp->dirs);
+	free((char *)tsp->segfd);
+	free((char *)tsp);
+}
+
+static PFtsp *PFtspRead(fname,error)
+char *fname;	/* name of the paged file */
+int *error;	/* set to the error code */
+/****************************************************************************
+SPECIFICATIONS:
+	Read the tablespace descriptor of "fname", if there is one.
+
+RETURN VALUE:
+	The tablespace, with no segment open yet, or
+	NULL	if "fname" is not a tablespace (*error == PFE_OK) or
+		on error (*error is the PF error code).
+*****************************************************************************/
+{
+PFtsp *tsp;
+char *tname;
+FILE *fp;
+char path[1024];
+char **dirs;
+
+	*error = PFE_OK;
+	if ((tname=PFsideName(fname,PF_TSP_SUFFIX))== NULL){
+		*error = PFerrno = PFE_NOMEM;
+		return(NULL);
+	}
+	fp = fopen(tname,"r");
+	free(tname);
+	if (fp == NULL){
+		if (errno != ENOENT)
+			*error = PFerrno = PFE_UNIX;
+		return(NULL);
+	}
+
+	if ((tsp=(PFtsp *)calloc(1,sizeof(PFtsp)))== NULL){
+		fclose(fp);
+		*error = PFerrno = PFE_NOMEM;
+		return(NULL);
+	}
+	if (fscanf(fp," segpages %d",&tsp->segpages)!= 1 || tsp->segpages <= 0){
+		fclose(fp);
+		PFtspFree(tsp);
+		*error = PFerrno = PFE_HDRREAD;
+		return(NULL);
+	}
+	while (fscanf(fp," dir %1023s",path) == 1){
+		if ((dirs=(char **)realloc((char *)tsp->dirs,
+				(tsp->ndirs+1)*sizeof(char *)))== NULL ||
+				(dirs[tsp->ndirs]=savestr(path))== NULL){
+			if (dirs != NULL)
+				tsp->dirs = dirs;
+			fclose(fp);
+			PFtspFree(tsp);
+			*error = PFerrno = PFE_NOMEM;
+			return(NULL);
+		}
+		tsp->dirs = dirs;
+		tsp->ndirs++;
+	}
+	fclose(fp);
+	return(tsp);
+}
+
+static char *PFtspSegName(fname,tsp,seg)
+char *fname;	/* name of the paged file */
+PFtsp *tsp;	/* its tablespace */
+int seg;	/* segment number, > 0 */
+/****************************************************************************
+SPECIFICATIONS:
+	Return the unix file name of segment "seg" in newly allocated
+	memory, or NULL if no memory.
+*****************************************************************************/
+{
+char *base;
+char *s;
+
+	if (tsp->ndirs == 0){
+		if ((s=malloc(strlen(fname)+16))!= NULL)
+			sprintf(s,"%s.%d",fname,seg);
+		return(s);
+	}
+
+	base = strrchr(fname,'/') != NULL ? strrchr(fname,'/')+1 : fname;
+	if ((s=malloc(strlen(tsp->dirs[(seg-1) % tsp->ndirs])
+				+strlen(base)+17))!= NULL)
+		sprintf(s,"%s/%s.%d",tsp->dirs[(seg-1) % tsp->ndirs],base,seg);
+	return(s);
+}
+
+static int PFpageLocate(fd,pagenum,create,unixfd,offset)
+int fd;		/* file descriptor */
+int pagenum;	/* page number */
+int create;	/* TRUE to create a missing segment */
+int *unixfd;	/* set to the unix fd that holds the page */
+off_t *offset;	/* set to the offset of the page in it */
+/****************************************************************************
+SPECIFICATIONS:
+	Find the unix file and the offset of page "pagenum" of file "fd".
+	For a tablespace, this is where page numbers are translated into
+	segments; segment files are opened (and, if "create" is TRUE,
+	created) the first time they are needed. The page is then read
+	or written with pread()/pwrite(), which leave the file offset
+	alone, so that several threads can use the same unix file.
+
+RETURN VALUE:
+	PFE_OK	if ok
+	PF error code if not OK.
+*****************************************************************************/
+{
+PFftab_ele *ftab = &PFftab[fd];
+PFtsp *tsp = ftab->tsp;
+char *sname;
+int *segfd;
+int seg;
+int i;
+
+	if (tsp == NULL){
+		*unixfd = ftab->unixfd;
+		*offset = (off_t)pagenum*sizeof(PFfpage)+PF_HDR_SIZE;
+	}
+	else if ((seg = pagenum / tsp->segpages) == 0){
+		*unixfd = ftab->unixfd;
+		*offset = (off_t)pagenum*sizeof(PFfpage)+PF_HDR_SIZE;
+	}
+	else {
+		if (seg >= tsp->nsegs){
+			/* make room for this segment's unix fd */
+			if ((segfd=(int *)realloc((char *)tsp->segfd,
+					(seg+1)*sizeof(int)))== NULL){
+				PFerrno = PFE_NOMEM;
+				return(PFerrno);
+			}
+			for (i=tsp->nsegs; i <= seg; i++)
+				segfd[i] = -1;
+			tsp->segfd = segfd;
+			tsp->nsegs = seg+1;
+		}
+		if (tsp->segfd[seg] < 0){
+			if ((sname=PFtspSegName(ftab->fname,tsp,seg))== NULL){
+				PFerrno = PFE_NOMEM;
+				return(PFerrno);
+			}
+			tsp->segfd[seg] = open(sname,
+					create ? O_RDWR|O_CREAT : O_RDWR,0664);
+			free(sname);
+			if (tsp->segfd[seg] < 0){
+				PFerrno = PFE_UNIX;
+				return(PFerrno);
+			}
+		}
+		*unixfd = tsp->segfd[seg];
+		*offset = (off_t)(pagenum % tsp->segpages)*sizeof(PFfpage);
+	}
+	return(PFE_OK);
 }
 
 int PFreadfcn(fd,pagenum,buf)
@@ -105,7 +742,8 @@ PFfpage *buf;
 /****************************************************************************
 SPECIFICATIONS:
 	Read the paged numbered "pagenum" from the file indexed by "fd"
-	into the page buffer "buf".
+	into the page buffer "buf". The read itself is done with
+	PFlatch let go (see PFioBegin()).
 
 AUTHOR: clc
 
@@ -115,17 +753,23 @@ RETURN VALUE:
 *****************************************************************************/
 {
 int error;
+int unixfd;	/* unix file holding the page */
+off_t offset;	/* where in it */
+int released;
 
-	/* seek to the appropriate place */
-	if ((error=lseek(PFftab[fd].unixfd,pagenum*sizeof(PFfpage)+PF_HDR_SIZE,
-				L_SET)) == -1){
-		PFerrno = PFE_UNIX;
-		return(PFerrno);
-	}
+	if (PFftab[fd].zmap != NULL)
+		/* compressed file */
+		return(PFzreadfcn(fd,pagenum,buf));
+
+	/* find the appropriate place */
+	if ((error=PFpageLocate(fd,pagenum,FALSE,&unixfd,&offset))!= PFE_OK)
+		return(error);
 
 	/* read the data */
-	if((error=read(PFftab[fd].unixfd,(char *)buf,sizeof(PFfpage)))
-			!=sizeof(PFfpage)){
+	released = PFioBegin();
+	error = pread(unixfd,(char *)buf,sizeof(PFfpage),offset);
+	PFioEnd(released);
+	if (error != sizeof(PFfpage)){
 		if (error <0)
 			PFerrno = PFE_UNIX;
 		else	PFerrno = PFE_INCOMPLETEREAD;
@@ -133,6 +777,7 @@ int error;
 	}
      /* one physical page read from disk */
     PF_stats.physicalReads++;
+    PF_stats.bytesRead += sizeof(PFfpage);
 	return(PFE_OK);
 }
 
@@ -143,6 +788,13 @@ void PF_SetBufferSize(int n)
     }
 }
 
+/* Size the compressed victim cache that sits behind the buffer pool.
+   0 (the default) turns it off. */
+void PF_SetVictimCacheSize(long bytes)
+{
+    PFvcacheSetSize(bytes > 0 ? bytes : 0L);
+}
+
 int PFwritefcn(fd,pagenum,buf)
 int fd;		/* file descriptor */
 int pagenum;	/* page to read */
@@ -150,7 +802,8 @@ PFfpage *buf;	/* buffer where to read the page */
 /****************************************************************************
 SPECIFICATIONS:
 	Write the page numbered "pagenum" from the buffer indexed
-	by "buf" into the file indexed by "fd".
+	by "buf" into the file indexed by "fd". The write itself is
+	done with PFlatch let go (see PFioBegin()).
 
 AUTHOR: clc
 
@@ -161,17 +814,23 @@ RETURN VALUE:
 *****************************************************************************/
 {
 int error;
+int unixfd;	/* unix file holding the page */
+off_t offset;	/* where in it */
+int released;
 
-	/* seek to the right place */
-	if ((error=lseek(PFftab[fd].unixfd,pagenum*sizeof(PFfpage)+PF_HDR_SIZE,
-				L_SET)) == -1){
-		PFerrno = PFE_UNIX;
-		return(PFerrno);
-	}
+	if (PFftab[fd].zmap != NULL)
+		/* compressed file */
+		return(PFzwritefcn(fd,pagenum,buf));
+
+	/* find the right place */
+	if ((error=PFpageLocate(fd,pagenum,TRUE,&unixfd,&offset))!= PFE_OK)
+		return(error);
 
 	/* write out the page */
-	if((error=write(PFftab[fd].unixfd,(char *)buf,sizeof(PFfpage)))
-			!=sizeof(PFfpage)){
+	released = PFioBegin();
+	error = pwrite(unixfd,(char *)buf,sizeof(PFfpage),offset);
+	PFioEnd(released);
+	if (error != sizeof(PFfpage)){
 		if (error <0)
 			PFerrno = PFE_UNIX;
 		else	PFerrno = PFE_INCOMPLETEWRITE;
@@ -179,6 +838,7 @@ int error;
 	}
      /* one physical page written to disk */
     PF_stats.physicalWrites++;
+    PF_stats.bytesWritten += sizeof(PFfpage);
 	return(PFE_OK);
 
 }
@@ -189,6 +849,12 @@ void PF_ResetStats()
     PF_stats.logicalWrites = 0;
     PF_stats.physicalReads = 0;
     PF_stats.physicalWrites= 0;
+    PF_stats.tier2Hits     = 0;
+    PF_stats.bytesRead     = 0;
+    PF_stats.bytesWritten  = 0;
+    PF_stats.zRawBytes     = 0;
+    PF_stats.zPackedBytes  = 0;
+    PF_stats.codecMs       = 0.0;
 }
 
 void PF_PrintStats()
@@ -198,6 +864,17 @@ void PF_PrintStats()
     printf("  logicalWrites  = %d\n", PF_stats.logicalWrites);
     printf("  physicalReads  = %d\n", PF_stats.physicalReads);
     printf("  physicalWrites = %d\n", PF_stats.physicalWrites);
+    printf("  tier2Hits      = %d\n", PF_stats.tier2Hits);
+    printf("  bytesRead      = %ld\n", PF_stats.bytesRead);
+    printf("  bytesWritten   = %ld\n", PF_stats.bytesWritten);
+    if (PF_stats.zPackedBytes > 0) {
+        /* only meaningful when compressed files were written */
+        printf("  compression    = %.2fx\n",
+               (double)PF_stats.zRawBytes / (double)PF_stats.zPackedBytes);
+    }
+    if (PF_stats.codecMs > 0.0) {
+        printf("  codecTime      = %.3f ms\n", PF_stats.codecMs);
+    }
 }
 
 // global switch between lru or mru
@@ -225,14 +902,14 @@ GLOBAL VARIABLES MODIFIED:
 	PFftab
 *****************************************************************************/
 {
-int i;
 	/* init the hash table */
 	PFhashInit();
 
-	/* init the file table to be not used*/
-	for (i=0; i < PF_FTAB_SIZE; i++){
-		PFftab[i].fname = NULL;
-	}
+	/* init the file table to be not used; it is grown on first open */
+	free((char *)PFftab);
+	PFftab = NULL;
+	PFftabsize = 0;
+	PFftabfree = -1;
 }
 
 int PF_CreateFile(fname)
@@ -282,6 +959,121 @@ int error;
 }
 
 
+int PF_CreateCompressedFile(fname)
+char *fname;	/* name of file to create */
+/****************************************************************************
+SPECIFICATIONS:
+	Create a paged file called "fname" whose pages are compressed on
+	disk, together with its page-offset map file. The buffer pool
+	still holds uncompressed pages, so the file is used exactly like
+	one made by PF_CreateFile().
+
+RETURN VALUE:
+	PFE_OK	if OK
+	PF error code if error.
+*****************************************************************************/
+{
+PFzmap_hdr zhdr;
+char *zname;
+int zfd;
+int error;
+
+	if ((error=PF_CreateFile(fname))!= PFE_OK)
+		return(error);
+
+	if ((zname=PFsideName(fname,PF_ZMAP_SUFFIX))== NULL){
+		unlink(fname);
+		PFerrno = PFE_NOMEM;
+		return(PFerrno);
+	}
+	if ((zfd=open(zname,O_CREAT|O_EXCL|O_WRONLY,0664))<0){
+		free(zname);
+		unlink(fname);
+		PFerrno = PFE_UNIX;
+		return(PFerrno);
+	}
+
+	/* empty map: no pages, slots start right after the header */
+	zhdr.magic = PF_ZMAP_MAGIC;
+	zhdr.numslots = 0;
+	zhdr.dataend = PF_HDR_SIZE;
+	if ((error=write(zfd,(char *)&zhdr,sizeof(zhdr))) != sizeof(zhdr)){
+		if (error < 0)
+			PFerrno = PFE_UNIX;
+		else PFerrno = PFE_HDRWRITE;
+		close(zfd);
+		unlink(zname);
+		unlink(fname);
+		free(zname);
+		return(PFerrno);
+	}
+	free(zname);
+
+	if (close(zfd) == -1){
+		PFerrno = PFE_UNIX;
+		return(PFerrno);
+	}
+	return(PFE_OK);
+}
+
+
+int PF_CreateTablespace(fname,segpages,dirs,ndirs)
+char *fname;	/* name of file to create */
+int segpages;	/* # of pages per segment file */
+char **dirs;	/* directories to put segments 1, 2, ... in, round robin */
+int ndirs;	/* # of entries in dirs; 0 to keep segments next to fname */
+/****************************************************************************
+SPECIFICATIONS:
+	Create a paged file called "fname" whose pages are spread over
+	segment files of "segpages" pages each, and its tablespace
+	descriptor. The file is used exactly like one made by
+	PF_CreateFile(); page numbers are translated into segments
+	by the read and write functions. The directories must exist.
+
+RETURN VALUE:
+	PFE_OK	if OK
+	PF error code if error.
+*****************************************************************************/
+{
+char *tname;
+FILE *fp;
+int error;
+int i;
+
+	if (segpages <= 0){
+		PFerrno = PFE_INVALIDPAGE;
+		return(PFerrno);
+	}
+
+	if ((error=PF_CreateFile(fname))!= PFE_OK)
+		return(error);
+
+	if ((tname=PFsideName(fname,PF_TSP_SUFFIX))== NULL){
+		unlink(fname);
+		PFerrno = PFE_NOMEM;
+		return(PFerrno);
+	}
+	if ((fp=fopen(tname,"w"))== NULL){
+		free(tname);
+		unlink(fname);
+		PFerrno = PFE_UNIX;
+		return(PFerrno);
+	}
+	fprintf(fp,"segpages %d\n",segpages);
+	for (i=0; i < ndirs; i++)
+		fprintf(fp,"dir %s\n",dirs[i]);
+	if (fclose(fp) != 0){
+		unlink(tname);
+		free(tname);
+		unlink(fname);
+		PFerrno = PFE_HDRWRITE;
+		return(PFerrno);
+	}
+	free(tname);
+	return(PFE_OK);
+}
+
+
 int PF_DestroyFile(fname)
 char *fname;		/* file name to destroy */
 /****************************************************************************
@@ -298,6 +1090,11 @@ RETURN VALUE:
 *****************************************************************************/
 {
 int error;
+char *zname;
+PFtsp *tsp;
+PFhdr_str hdr;
+int seg;
+int fd;
 
 	if (PFtabFindFname(fname)!= -1){
 		/* file is open */
@@ -305,12 +1102,40 @@ int error;
 		return(PFerrno);
 	}
 
+	if ((tsp=PFtspRead(fname,&error))!= NULL){
+		/* a tablespace: get rid of the segments first */
+		hdr.numpages = 0;
+		if ((fd=open(fname,O_RDONLY)) >= 0){
+			if (read(fd,(char *)&hdr,PF_HDR_SIZE) != PF_HDR_SIZE)
+				hdr.numpages = 0;
+			close(fd);
+		}
+		for (seg=1; (long)seg*tsp->segpages < hdr.numpages; seg++)
+			if ((zname=PFtspSegName(fname,tsp,seg))!= NULL){
+				unlink(zname);
+				free(zname);
+			}
+		PFtspFree(tsp);
+		if ((zname=PFsideName(fname,PF_TSP_SUFFIX))!= NULL){
+			unlink(zname);
+			free(zname);
+		}
+	}
+	else if (error != PFE_OK)
+		return(error);
+
 	if ((error =unlink(fname))!= 0){
 		/* unix error */
 		PFerrno = PFE_UNIX;
 		return(PFerrno);
 	}
 
+	/* get rid of the page-offset map of a compressed file */
+	if ((zname=PFsideName(fname,PF_ZMAP_SUFFIX))!= NULL){
+		unlink(zname);
+		free(zname);
+	}
+
 	/* success */
 	return(PFE_OK);
 }
@@ -340,10 +1165,11 @@ IMPLEMENTATION NOTES:
 {
 int count;	/* # of bytes in read */
 int fd; /* file descriptor */
+int error;
 
 	/* find a free entry in the file table */
 	if ((fd=PFftabFindFree())< 0){
-		/* file table full */
+		/* file table full, and can't grow it */
 		PFerrno = PFE_FTABFULL;
 		return(PFerrno);
 	}
@@ -368,6 +1194,7 @@ int fd; /* file descriptor */
 	}
 	/* set file header to be not changed */
 	PFftab[fd].hdrchanged = FALSE;
+	PFftab[fd].growing = FALSE;
 
 	/* save the file name */
 	if ((PFftab[fd].fname = savestr(fname)) == NULL){
@@ -377,6 +1204,34 @@ int fd; /* file descriptor */
 		return(PFerrno);
 	}
 
+	/* pick up the page-offset map if this is a compressed file */
+	if ((error=PFzmapLoad(fd))!= PFE_OK){
+		close(PFftab[fd].unixfd);
+		free(PFftab[fd].fname);
+		PFftab[fd].fname = NULL;
+		return(error);
+	}
+
+	/* pick up the segments if this is a tablespace */
+	if (((PFftab[fd].tsp=PFtspRead(fname,&error))== NULL && error != PFE_OK)
+			|| (PFftab[fd].tsp != NULL && PFftab[fd].zmap != NULL)){
+		/* error, or a compressed tablespace, which we don't do */
+		if (PFftab[fd].tsp != NULL){
+			PFtspFree(PFftab[fd].tsp);
+			PFftab[fd].tsp = NULL;
+			PFerrno = error = PFE_HDRREAD;
+		}
+		free((char *)PFftab[fd].zmap);
+		PFftab[fd].zmap = NULL;
+		close(PFftab[fd].unixfd);
+		free(PFftab[fd].fname);
+		PFftab[fd].fname = NULL;
+		return(error);
+	}
+
+	/* the entry is now in use */
+	PFftabTake(fd);
+
 	return(fd);
 }
 
@@ -429,7 +1284,21 @@ int error;
 		PFftab[fd].hdrchanged = FALSE;
 	}
 
+	if (PFftab[fd].zmap != NULL){
+		/* write the page-offset map back, and let it go */
+		if (PFftab[fd].zmapchanged &&
+				(error=PFzmapSave(fd))!= PFE_OK)
+			return(error);
+		free((char *)PFftab[fd].zmap);
+		PFftab[fd].zmap = NULL;
+		PFftab[fd].zmapsize = 0;
+	}
 
+	if (PFftab[fd].tsp != NULL){
+		/* close the segment files */
+		PFtspFree(PFftab[fd].tsp);
+		PFftab[fd].tsp = NULL;
+	}
 		
 	/* close the file */
 	if ((error=close(PFftab[fd].unixfd))== -1){
@@ -437,7 +1306,8 @@ int error;
 		return(PFerrno);
 	}
 
-	/* free the file name space */
+	/* free the entry and the file name space */
+	PFftabRelease(fd);
 	free((char *)PFftab[fd].fname);
 	PFftab[fd].fname = NULL;
 
@@ -467,11 +1337,11 @@ RETURN VALUE:
 {
 
 	*pagenum = -1;
-	return(PF_GetNextPage(fd,pagenum,pagebuf));
+	return(PF_GetNextPage(fd,pagenum,pagebuf));	/* takes PFlatch */
 }
 
 
-int PF_GetNextPage(fd,pagenum,pagebuf)
+static int PFgetNext(fd,pagenum,pagebuf)
 int fd;	/* file descriptor of the file */
 int *pagenum;	/* old page number on input, new page number on output */
 char **pagebuf;	/* pointer to pointer to buffer of page data */
@@ -536,7 +1406,7 @@ PFfpage *fpage;	/* pointer to file page */
 
 }
 
-int PF_GetThisPage(fd,pagenum,pagebuf)
+static int PFgetThis(fd,pagenum,pagebuf)
 int fd;		/* file descriptor */
 int pagenum;	/* page number to read */
 char **pagebuf;	/* pointer to pointer to page data */
@@ -594,7 +1464,7 @@ PFfpage *fpage;
 	}
 }
 
-int PF_AllocPage(fd,pagenum,pagebuf)
+static int PFalloc(fd,pagenum,pagebuf)
 int fd;		/* file descriptor */
 int *pagenum;	/* page number */
 char **pagebuf;	/* pointer to pointer to page buffer*/
@@ -605,6 +1475,12 @@ SPECIFICATIONS:
 	Set *pagebuf to point to the buffer for that page.
 	The page allocated is fixed in the buffer.
 
+	Reading the first free page may let PFlatch go; if another
+	thread took that page or changed the free list meanwhile, the
+	page is let go and the free list looked at again. A page added
+	at the end is added with the file marked "growing", which keeps
+	other threads from adding pages to it too.
+
 AUTHOR: clc
 
 RETURN VALUE:
@@ -624,20 +1500,37 @@ int error;
 	/* allocating a new logical page -> logical write */
     PF_stats.logicalWrites++;
 
-	if (PFftab[fd].hdr.firstfree != PF_PAGE_LIST_END){
+	while ((*pagenum = PFftab[fd].hdr.firstfree) != PF_PAGE_LIST_END){
 		/* get a page from the free list */
-		*pagenum = PFftab[fd].hdr.firstfree;
-		if ((error=PFbufGet(fd,*pagenum,&fpage,PFreadfcn,
-					PFwritefcn))!= PFE_OK)
+		error = PFbufGet(fd,*pagenum,&fpage,PFreadfcn,PFwritefcn);
+		if (error == PFE_OK && PFftab[fd].hdr.firstfree == *pagenum)
+			break;
+		if (error == PFE_OK)
+			/* taken while it was read; let it go */
+			error = PFbufUnfix(fd,*pagenum,FALSE);
+		else if (error == PFE_PAGEFIXED &&
+				PFftab[fd].hdr.firstfree != *pagenum)
+			/* taken by a thread that still has it */
+			error = PFE_OK;
+		if (error != PFE_OK)
 			/* can't get the page */
 			return(error);
+	}
+
+	if (*pagenum != PF_PAGE_LIST_END){
 		PFftab[fd].hdr.firstfree = fpage->nextfree;
 		PFftab[fd].hdrchanged = TRUE;
 	}
 	else {
 		/* Free list empty, allocate one more page from the file */
+		while (PFftab[fd].growing && PFioWait())
+			;
+		PFftab[fd].growing = TRUE;
 		*pagenum = PFftab[fd].hdr.numpages;
-		if ((error=PFbufAlloc(fd,*pagenum,&fpage,PFwritefcn))!= PFE_OK)
+		error = PFbufAlloc(fd,*pagenum,&fpage,PFwritefcn);
+		PFftab[fd].growing = FALSE;
+		PFioDone();
+		if (error != PFE_OK)
 			/* can't allocate a page */
 			return(error);
 	
@@ -668,7 +1561,138 @@ int error;
 	return(PFE_OK);
 }
 
-int PF_DisposePage(fd,pagenum)
+static int PFappend(fd,npages,pages,firstpage)
+int fd;		/* file descriptor */
+int npages;	/* # of pages to append */
+char *pages;	/* "npages" page images, PF_PAGE_SIZE bytes each */
+int *firstpage;	/* set to the page number of the first page */
+/****************************************************************************
+SPECIFICATIONS:
+	Append "npages" new pages to the end of file "fd", with the
+	contents given in "pages", and set "*firstpage" to the number of
+	the first one; the others follow in order. The pages go straight
+	to the file, bypassing the buffer pool, in writes of up to
+	PF_APPEND_RUN pages. The free list is left alone.
+
+	Meant for bulk loading, where the caller builds whole pages
+	itself and per-page PF_AllocPage()/PF_UnfixPage() calls are pure
+	overhead.
+
+RETURN VALUE:
+	PFE_OK	if ok
+	PF error code if not OK. Then none of the pages is added: the
+	page count goes back to what it was, and a plain file is cut
+	back to its old size.
+
+IMPLEMENTATION NOTES:
+	A compressed file is written one page at a time, through
+	PFwritefcn(). For a tablespace, a run never crosses a segment
+	boundary.
+	The runs are written with PFlatch let go, and the file is marked
+	"growing" until the last one is, so that no other thread adds
+	pages to it meanwhile. The page count only goes up once a run is
+	on disk, so other threads never read a page not yet written.
+*****************************************************************************/
+{
+PFfpage *run;	/* staging area for one write */
+PFftab_ele *ftab;
+int pagenum;	/* first page of the current run */
+int n;		/* # of pages in the current run */
+int unixfd;	/* unix file holding the run */
+off_t offset;	/* where in it */
+int released;
+int error;
+int i, j;
+
+	if (PFinvalidFd(fd)){
+		PFerrno= PFE_FD;
+		return(PFerrno);
+	}
+	if (npages < 0){
+		PFerrno = PFE_INVALIDPAGE;
+		return(PFerrno);
+	}
+	if ((run=(PFfpage *)malloc((npages < PF_APPEND_RUN ? npages+1 :
+			PF_APPEND_RUN)*sizeof(PFfpage)))== NULL){
+		PFerrno = PFE_NOMEM;
+		return(PFerrno);
+	}
+
+	ftab = &PFftab[fd];
+	while (ftab->growing && PFioWait())
+		;
+	ftab->growing = TRUE;
+	*firstpage = ftab->hdr.numpages;
+	PF_stats.logicalWrites += npages;
+
+	for (i=0; i < npages; i += n){
+		pagenum = ftab->hdr.numpages;
+		n = npages - i;
+		if (n > PF_APPEND_RUN)
+			n = PF_APPEND_RUN;
+		if (ftab->tsp != NULL &&
+			n > ftab->tsp->segpages - pagenum % ftab->tsp->segpages)
+			n = ftab->tsp->segpages - pagenum % ftab->tsp->segpages;
+
+		for (j=0; j < n; j++){
+			run[j].nextfree = PF_PAGE_USED;
+			memcpy(run[j].pagebuf,
+				pages+(long)(i+j)*PF_PAGE_SIZE,PF_PAGE_SIZE);
+			/* no stale copy of the page may survive */
+			PFvcacheDelete(fd,pagenum+j);
+		}
+
+		error = PFE_OK;
+		if (ftab->zmap != NULL){
+			/* compressed file: page by page */
+			for (j=0; j < n && error == PFE_OK; j++)
+				error = PFwritefcn(fd,pagenum+j,&run[j]);
+		}
+		else if ((error=PFpageLocate(fd,pagenum,TRUE,&unixfd,&offset))
+				== PFE_OK){
+			released = PFioBegin();
+			error = pwrite(unixfd,(char *)run,n*sizeof(PFfpage),
+					offset);
+			PFioEnd(released);
+			if (error != n*(int)sizeof(PFfpage)){
+				if (error <0)
+					PFerrno = PFE_UNIX;
+				else	PFerrno = PFE_INCOMPLETEWRITE;
+				error = PFerrno;
+			}
+			else {
+				error = PFE_OK;
+				PF_stats.physicalWrites += n;
+				PF_stats.bytesWritten += (long)n*sizeof(PFfpage);
+			}
+		}
+		if (error != PFE_OK)
+			break;
+
+		/* the pages exist now */
+		ftab->hdr.numpages += n;
+		ftab->hdrchanged = TRUE;
+	}
+	free((char *)run);
+
+	if (i < npages){
+		/* take back the runs that made it, as PFtruncate() would */
+		if (ftab->hdr.numpages != *firstpage){
+			ftab->hdr.numpages = *firstpage;
+			ftab->hdrchanged = TRUE;
+		}
+		if (ftab->tsp == NULL && ftab->zmap == NULL)
+			(void)ftruncate(ftab->unixfd,
+				(off_t)*firstpage*sizeof(PFfpage)+PF_HDR_SIZE);
+		PFerrno = error;
+	}
+	else	error = PFE_OK;
+	ftab->growing = FALSE;
+	PFioDone();
+	return(error);
+}
+
+static int PFdispose(fd,pagenum)
 int fd;		/* file descriptor */
 int pagenum;	/* page number */
 /****************************************************************************
@@ -723,7 +1747,7 @@ int error;
 	return(PFbufUnfix(fd,pagenum,TRUE));
 }
 
-int PF_UnfixPage(fd,pagenum,dirty)
+static int PFunfix(fd,pagenum,dirty)
 int fd;	/* file descriptor */
 int pagenum;	/* page number */
 int dirty;	/* true if file is dirty */
@@ -751,16 +1775,272 @@ RETURN VALUE:
 		PFerrno = PFE_INVALIDPAGE;
 		return(PFerrno);
 	}
-<<<<<<< HEAD
-=======
-	if (dirty) {
-        PF_stats.logicalWrites++;   // count a logical write: page modified by a query
-    }
->>>>>>> upstream/main
 
 	return(PFbufUnfix(fd,pagenum,dirty));
 }
 
+int PF_SegmentPages(fd)
+int fd;		/* file descriptor */
+/****************************************************************************
+SPECIFICATIONS:
+	Tell how many pages each segment of file "fd" holds, so that
+	scans can hand out page ranges that don't straddle segments and
+	read different segments in parallel.
+
+RETURN VALUE:
+	The # of pages per segment, or
+	0	if the file is not a tablespace (it is one big segment).
+	PFE_FD	if "fd" is invalid.
+*****************************************************************************/
+{
+	if (PFinvalidFd(fd)){
+		PFerrno = PFE_FD;
+		return(PFerrno);
+	}
+	return(PFftab[fd].tsp != NULL ? PFftab[fd].tsp->segpages : 0);
+}
+
+int PF_NumPages(fd)
+int fd;		/* file descriptor */
+/****************************************************************************
+SPECIFICATIONS:
+	Tell how many pages file "fd" has, used or free. Pages are
+	numbered 0 .. PF_NumPages(fd)-1.
+
+RETURN VALUE:
+	The # of pages, or
+	PFE_FD	if "fd" is invalid.
+*****************************************************************************/
+{
+int n;
+
+	pthread_mutex_lock(&PFlatch);
+	if (PFinvalidFd(fd))
+		n = PFerrno = PFE_FD;
+	else	n = PFftab[fd].hdr.numpages;
+	pthread_mutex_unlock(&PFlatch);
+	return(n);
+}
+
+static int PFtruncate(fd)
+int fd;		/* file descriptor */
+/****************************************************************************
+SPECIFICATIONS:
+	Cut the free pages at the end of file "fd" off the file: take
+	them out of the free list, forget their buffers and lower the
+	page count. A plain file is also shortened on disk; the segment
+	files of a tablespace and a compressed file keep their size, and
+	the pages are written over when the file grows again.
+	None of the pages may be fixed.
+
+RETURN VALUE:
+	The # of pages cut off (>= 0), or
+	PF error code if error.
+*****************************************************************************/
+{
+PFftab_ele *ftab;
+PFfpage *fpage;	/* pointer to file page */
+int numpages;	/* new # of pages */
+int prev, cur, next;	/* walk of the free list */
+int used;
+int error;
+
+	if (PFinvalidFd(fd)){
+		PFerrno = PFE_FD;
+		return(PFerrno);
+	}
+	ftab = &PFftab[fd];
+
+	/* find the last used page */
+	for (numpages = ftab->hdr.numpages; numpages > 0; numpages--){
+		if ((error=PFbufGet(fd,numpages-1,&fpage,PFreadfcn,
+					PFwritefcn))!= PFE_OK)
+			return(error);
+		used = fpage->nextfree == PF_PAGE_USED;
+		if ((error=PFbufUnfix(fd,numpages-1,FALSE))!= PFE_OK)
+			return(error);
+		if (used)
+			break;
+	}
+	if (numpages == ftab->hdr.numpages)
+		return(0);
+
+	/* unlink the pages past it from the free list */
+	prev = PF_PAGE_LIST_END;
+	for (cur = ftab->hdr.firstfree; cur != PF_PAGE_LIST_END; cur = next){
+		if ((error=PFbufGet(fd,cur,&fpage,PFreadfcn,PFwritefcn))!= PFE_OK)
+			return(error);
+		next = fpage->nextfree;
+		if ((error=PFbufUnfix(fd,cur,FALSE))!= PFE_OK)
+			return(error);
+		if (cur < numpages){
+			prev = cur;
+			continue;
+		}
+		if (prev == PF_PAGE_LIST_END){
+			ftab->hdr.firstfree = next;
+			ftab->hdrchanged = TRUE;
+		}
+		else {
+			if ((error=PFbufGet(fd,prev,&fpage,PFreadfcn,
+						PFwritefcn))!= PFE_OK)
+				return(error);
+			fpage->nextfree = next;
+			if ((error=PFbufUnfix(fd,prev,TRUE))!= PFE_OK)
+				return(error);
+		}
+	}
+
+	/* forget them */
+	if ((error=PFbufDiscard(fd,numpages))!= PFE_OK)
+		return(error);
+	for (cur = numpages; cur < ftab->hdr.numpages; cur++)
+		PFvcacheDelete(fd,cur);
+
+	cur = ftab->hdr.numpages - numpages;
+	ftab->hdr.numpages = numpages;
+	ftab->hdrchanged = TRUE;
+	if (ftab->tsp == NULL && ftab->zmap == NULL &&
+			ftruncate(ftab->unixfd,
+				(off_t)numpages*sizeof(PFfpage)+PF_HDR_SIZE) == -1){
+		PFerrno = PFE_UNIX;
+		return(PFerrno);
+	}
+	return(cur);
+}
+
+/****************** Thread-safe page calls *********************************/
+/* The calls that fix, unfix, allocate or free pages (and
+PF_TruncateFile()) may be made from several threads at once, e.g. by
+parallel scans that each read their own pages, or by a background
+vacuum. They are serialized by one latch, held while the buffer
+pool and the file table are looked at or changed. It is let go while
+a page is read or written (PFioBegin()): the buffer of that page is
+marked "io", and a thread that wants it waits (PFioWait()) and looks
+again once the transfer is over. A file being extended is marked
+"growing", and other threads wait before they extend it too.
+PF_TruncateFile() keeps the latch throughout, since the pages and the
+free list it looks at must not change under it; it gets PFE_PAGEFIXED
+if another thread is reading one of its pages. Opening, closing,
+creating and destroying files and the PF_Set...() calls are not
+covered: make them while no other thread is using the PF layer. Two
+threads may not fix the same page at the same time (the second gets
+PFE_PAGEFIXED). */
+
+static void PFlatchTake()
+/****************************************************************************
+SPECIFICATIONS:
+	Take PFlatch for a call that may let it go for I/O.
+*****************************************************************************/
+{
+	pthread_mutex_lock(&PFlatch);
+	PFlatched = TRUE;
+}
+
+static void PFlatchLet()
+/****************************************************************************
+SPECIFICATIONS:
+	Let PFlatch go at the end of such a call.
+*****************************************************************************/
+{
+	PFlatched = FALSE;
+	pthread_mutex_unlock(&PFlatch);
+}
+
+int PF_GetNextPage(fd,pagenum,pagebuf)
+int fd;
+int *pagenum;
+char **pagebuf;
+{
+int error;
+
+	PFlatchTake();
+	error = PFgetNext(fd,pagenum,pagebuf);
+	PFlatchLet();
+	return(error);
+}
+
+int PF_GetThisPage(fd,pagenum,pagebuf)
+int fd;
+int pagenum;
+char **pagebuf;
+{
+int error;
+
+	PFlatchTake();
+	error = PFgetThis(fd,pagenum,pagebuf);
+	PFlatchLet();
+	return(error);
+}
+
+int PF_AllocPage(fd,pagenum,pagebuf)
+int fd;
+int *pagenum;
+char **pagebuf;
+{
+int error;
+
+	PFlatchTake();
+	error = PFalloc(fd,pagenum,pagebuf);
+	PFlatchLet();
+	return(error);
+}
+
+int PF_AppendPages(fd,npages,pages,firstpage)
+int fd;
+int npages;
+char *pages;
+int *firstpage;
+{
+int error;
+
+	PFlatchTake();
+	error = PFappend(fd,npages,pages,firstpage);
+	PFlatchLet();
+	return(error);
+}
+
+int PF_DisposePage(fd,pagenum)
+int fd;
+int pagenum;
+{
+int error;
+
+	PFlatchTake();
+	error = PFdispose(fd,pagenum);
+	PFlatchLet();
+	return(error);
+}
+
+int PF_TruncateFile(fd)
+int fd;
+{
+int error;
+
+	/* wait until no other thread extends the file, then keep the
+	latch */
+	PFlatchTake();
+	while (!PFinvalidFd(fd) && PFftab[fd].growing)
+		PFioWait();
+	PFlatched = FALSE;
+	error = PFtruncate(fd);
+	pthread_mutex_unlock(&PFlatch);
+	return(error);
+}
+
+int PF_UnfixPage(fd,pagenum,dirty)
+int fd;
+int pagenum;
+int dirty;
+{
+int error;
+
+	PFlatchTake();
+	error = PFunfix(fd,pagenum,dirty);
+	PFlatchLet();
+	return(error);
+}
+
 /* error messages */
 static char *PFerrormsg[]={
 "No error",
@@ -47,18 +47,25 @@ extern void PF_PrintError(char *s);
 
 /* Add these missing prototypes */
 int PF_CreateFile(char *fname);
+int PF_CreateCompressedFile(char *fname);
+int PF_CreateTablespace(char *fname, int segpages, char **dirs, int ndirs);
+int PF_SegmentPages(int fd);
 int PF_DestroyFile(char *fname);
 int PF_OpenFile(char *fname);
 int PF_CloseFile(int fd);
 int PF_AllocPage(int fd, int *pagenum, char **pagebuf);
 int PF_DisposePage(int fd, int pagenum);
+int PF_AppendPages(int fd, int npages, char *pages, int *firstpage);
 int PF_GetThisPage(int fd, int pagenum, char **pagebuf);
 int PF_UnfixPage(int fd, int pagenum, int dirty);
 int PF_GetNextPage(int fd, int *pagenum, char **pagebuf);
+int PF_NumPages(int fd);
+int PF_TruncateFile(int fd);
 void PF_ResetStats();
 void PF_PrintStats();
 void PF_SetReplacementPolicy(int policy);
 void PF_SetBufferSize(int size);
+void PF_SetVictimCacheSize(long bytes);
 
 /* Statistics for PF layer */
 
@@ -70,6 +77,12 @@ typedef struct {
     int logicalWrites;
     int physicalReads;
     int physicalWrites;
+    int tier2Hits;        /* page reads served by the victim cache */
+    long bytesRead;       /* bytes read from files (after compression) */
+    long bytesWritten;    /* bytes written to files (after compression) */
+    long zRawBytes;       /* page bytes handed to the codec on writes */
+    long zPackedBytes;    /* ... and what they compressed to */
+    double codecMs;       /* time spent compressing / decompressing */
 } PF_Stats;
 
 /* global stats object */
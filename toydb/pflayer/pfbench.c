@@ -28,6 +28,13 @@ int main() {
     run_experiment("MRU 75W/25R",   PF_REPL_MRU, 75);
     run_experiment("MRU 100W/0R",   PF_REPL_MRU, 100);
 
+    // LRU again, with a compressed victim cache behind the pool
+    PF_SetVictimCacheSize(64 * 1024);
+    run_experiment("LRU+VC 0W/100R",  PF_REPL_LRU, 0);
+    run_experiment("LRU+VC 50W/50R",  PF_REPL_LRU, 50);
+    run_experiment("LRU+VC 100W/0R",  PF_REPL_LRU, 100);
+    PF_SetVictimCacheSize(0);
+
     return 0;
 }
 
@@ -0,0 +1,277 @@
+/* pfhugebench.c
+ * Scaling benchmark for the PF layer on files of 1M+ pages.
+ *
+ * For every buffer pool size it creates a fresh paged file in a temp
+ * directory and measures, per operation:
+ *   alloc   - PF_AllocPage + PF_UnfixPage(dirty) for every page
+ *   scan    - PF_GetNextPage + PF_UnfixPage over the whole file
+ *   rread   - PF_GetThisPage + PF_UnfixPage on random pages
+ *   rupdate - PF_GetThisPage + modify + PF_UnfixPage(dirty) on random pages
+ * and prints pages/s plus p50/p99 latency.
+ *
+ * Usage: pfhugebench [-n pages] [-r randomOps] [-d dir] [-z] [poolSize ...]
+ *   -n  pages in the file          (default 1048576, i.e. ~4 GiB)
+ *   -r  ops per random phase       (default 100000)
+ *   -d  directory for the file     (default $TMPDIR or /tmp)
+ *   -z  use a compressed PF file
+ *   pool sizes default to 10 50 100 (at most PF_MAX_BUFS_LIMIT)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "pf.h"
+#include "pftypes.h"
+
+#define DEFAULT_PAGES   (1 << 20)
+#define DEFAULT_OPS     100000
+#define MAX_POOLS       16
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static int cmp_int(const void *a, const void *b) {
+    return *(const int *)a - *(const int *)b;
+}
+
+// print one result line; sorts lat[] in place
+static void report(const char *op, int pool, double *lat, long n, double totalNs) {
+    if (n == 0) return;
+    qsort(lat, n, sizeof(double), cmp_double);
+    printf("%-8s pool=%-4d ops=%-9ld %12.0f pages/s   p50=%9.2f us   p99=%9.2f us\n",
+           op, pool, n, n / (totalNs / 1e9),
+           lat[n / 2] / 1e3, lat[(long)(n * 0.99)] / 1e3);
+    fflush(stdout);
+}
+
+// cheap xorshift so the random phases don't depend on rand()'s quality
+static unsigned long long rng_state = 88172645463325252ULL;
+static long rnd(long n) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (long)(rng_state % (unsigned long long)n);
+}
+
+// runs every phase on a fresh file; on an error the file is unfixed
+// and closed, and the caller destroys it
+static int run_pool(const char *fname, int pool, long npages, long nops,
+                    int compressed, double *lat) {
+    int fd = -1, pagenum, err;
+    int fixed = -1;             // page left fixed by a failed step
+    char *pagebuf;
+    long i;
+    double t0, t1, start;
+
+    PF_SetBufferSize(pool);
+    PF_DestroyFile((char *)fname);   // ignore error if not exists
+    err = compressed ? PF_CreateCompressedFile((char *)fname)
+                     : PF_CreateFile((char *)fname);
+    if (err != PFE_OK) {
+        PF_PrintError("create");
+        return -1;
+    }
+    if ((fd = PF_OpenFile((char *)fname)) < 0) {
+        PF_PrintError("PF_OpenFile");
+        return -1;
+    }
+
+    // ---- allocation ----
+    PF_ResetStats();
+    start = now_ns();
+    for (i = 0; i < npages; i++) {
+        t0 = now_ns();
+        if (PF_AllocPage(fd, &pagenum, &pagebuf) != PFE_OK) {
+            PF_PrintError("PF_AllocPage");
+            goto fail;
+        }
+        memset(pagebuf, 0, PF_PAGE_SIZE);
+        memcpy(pagebuf, &i, sizeof(i));
+        if (PF_UnfixPage(fd, pagenum, TRUE) != PFE_OK) {
+            PF_PrintError("PF_UnfixPage");
+            fixed = pagenum;
+            goto fail;
+        }
+        t1 = now_ns();
+        lat[i] = t1 - t0;
+    }
+    // closing flushes the dirty tail of the pool; charge it to allocation
+    err = PF_CloseFile(fd);
+    fd = -1;
+    if (err != PFE_OK) {
+        PF_PrintError("PF_CloseFile");
+        return -1;
+    }
+    report("alloc", pool, lat, npages, now_ns() - start);
+
+    if ((fd = PF_OpenFile((char *)fname)) < 0) {
+        PF_PrintError("PF_OpenFile");
+        return -1;
+    }
+
+    // ---- sequential scan ----
+    pagenum = -1;
+    i = 0;
+    start = now_ns();
+    while (1) {
+        t0 = now_ns();
+        err = PF_GetNextPage(fd, &pagenum, &pagebuf);
+        if (err == PFE_EOF) break;
+        if (err != PFE_OK) {
+            PF_PrintError("PF_GetNextPage");
+            goto fail;
+        }
+        fixed = pagenum;
+        long tag;
+        memcpy(&tag, pagebuf, sizeof(tag));
+        if (tag != pagenum) {
+            fprintf(stderr, "scan: page %d holds tag %ld\n", pagenum, tag);
+            goto fail;
+        }
+        if (PF_UnfixPage(fd, pagenum, FALSE) != PFE_OK) {
+            PF_PrintError("PF_UnfixPage");
+            goto fail;
+        }
+        fixed = -1;
+        lat[i++] = now_ns() - t0;
+    }
+    if (i != npages) {
+        fprintf(stderr, "scan: saw %ld of %ld pages\n", i, npages);
+        goto fail;
+    }
+    report("scan", pool, lat, i, now_ns() - start);
+
+    // ---- random read ----
+    start = now_ns();
+    for (i = 0; i < nops; i++) {
+        int page = (int)rnd(npages);
+        t0 = now_ns();
+        if (PF_GetThisPage(fd, page, &pagebuf) != PFE_OK) {
+            PF_PrintError("PF_GetThisPage");
+            goto fail;
+        }
+        volatile char c = pagebuf[PF_PAGE_SIZE - 1];
+        (void)c;
+        if (PF_UnfixPage(fd, page, FALSE) != PFE_OK) {
+            PF_PrintError("PF_UnfixPage");
+            fixed = page;
+            goto fail;
+        }
+        lat[i] = now_ns() - t0;
+    }
+    report("rread", pool, lat, nops, now_ns() - start);
+
+    // ---- random update ----
+    start = now_ns();
+    for (i = 0; i < nops; i++) {
+        int page = (int)rnd(npages);
+        t0 = now_ns();
+        if (PF_GetThisPage(fd, page, &pagebuf) != PFE_OK) {
+            PF_PrintError("PF_GetThisPage");
+            goto fail;
+        }
+        pagebuf[PF_PAGE_SIZE - 1]++;
+        if (PF_UnfixPage(fd, page, TRUE) != PFE_OK) {
+            PF_PrintError("PF_UnfixPage");
+            fixed = page;
+            goto fail;
+        }
+        lat[i] = now_ns() - t0;
+    }
+    report("rupdate", pool, lat, nops, now_ns() - start);
+    PF_PrintStats();
+
+    if (PF_CloseFile(fd) != PFE_OK) {
+        PF_PrintError("PF_CloseFile");
+        return -1;
+    }
+    PF_DestroyFile((char *)fname);
+    return 0;
+
+fail:
+    if (fixed >= 0)
+        PF_UnfixPage(fd, fixed, FALSE);
+    PF_CloseFile(fd);
+    return -1;
+}
+
+int main(int argc, char *argv[]) {
+    long npages = DEFAULT_PAGES;
+    long nops = DEFAULT_OPS;
+    const char *dir = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+    int compressed = 0;
+    int pools[MAX_POOLS];
+    int npools = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:r:d:z")) != -1) {
+        switch (opt) {
+        case 'n': npages = atol(optarg); break;
+        case 'r': nops = atol(optarg); break;
+        case 'd': dir = optarg; break;
+        case 'z': compressed = 1; break;
+        default:
+            fprintf(stderr, "Usage: %s [-n pages] [-r randomOps] [-d dir] [-z] "
+                            "[poolSize ...]\n", argv[0]);
+            return 1;
+        }
+    }
+    for (; optind < argc && npools < MAX_POOLS; optind++) {
+        int p = atoi(argv[optind]);
+        if (p <= 0 || p > PF_MAX_BUFS_LIMIT) {
+            fprintf(stderr, "pool size %s out of range (1..%d)\n",
+                    argv[optind], PF_MAX_BUFS_LIMIT);
+            return 1;
+        }
+        pools[npools++] = p;
+    }
+    if (npools == 0) {
+        pools[npools++] = 10;
+        pools[npools++] = 50;
+        pools[npools++] = 100;
+    }
+    if (npages <= 0 || npages > 0x7fffffffL || nops <= 0) {
+        fprintf(stderr, "bad page or op count\n");
+        return 1;
+    }
+
+    // the pool never shrinks once frames are malloc'ed, so go upwards
+    qsort(pools, npools, sizeof(int), cmp_int);
+
+    char fname[1024];
+    snprintf(fname, sizeof(fname), "%s/pfhugebench.%d.pf", dir, (int)getpid());
+
+    long nlat = npages > nops ? npages : nops;
+    double *lat = malloc(nlat * sizeof(double));
+    if (!lat) {
+        perror("malloc");
+        return 1;
+    }
+
+    PF_Init();
+    PF_SetReplacementPolicy(PF_REPL_LRU);
+    printf("pfhugebench: %ld pages (%.1f MiB) in %s, %ld random ops%s\n",
+           npages, npages * (double)sizeof(PFfpage) / (1 << 20), fname, nops,
+           compressed ? ", compressed" : "");
+
+    for (int i = 0; i < npools; i++) {
+        if (run_pool(fname, pools[i], npages, nops, compressed, lat) != 0) {
+            // the file may still be open in PF if closing failed too
+            if (PF_DestroyFile(fname) != PFE_OK)
+                unlink(fname);
+            free(lat);
+            return 1;
+        }
+    }
+    free(lat);
+    return 0;
+}
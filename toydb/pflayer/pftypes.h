@@ -29,8 +29,58 @@ typedef struct PFfpage {
 	char pagebuf[PF_PAGE_SIZE];	/* actual page data */
 } PFfpage;
 
+/*************************** Compressed Files *********************/
+/* A file created with PF_CreateCompressedFile() keeps the usual header,
+but each page is compressed and stored in a variable-size slot somewhere
+after it. The page-offset map is kept in a companion file whose name is
+the file name followed by PF_ZMAP_SUFFIX: a PFzmap_hdr followed by one
+PFzslot per page. */
+#define PF_ZMAP_SUFFIX	".zmap"
+#define PF_ZMAP_MAGIC	0x5a4d4150	/* "ZMAP" */
+#define PF_ZSLOT_ALIGN	64	/* slot sizes are rounded up to this */
+
+typedef struct PFzslot {
+	long	offset;	/* offset of the slot in the unix file */
+	int	len;	/* # of bytes used; sizeof(PFfpage) if stored raw,
+			0 if the page has never been written */
+	int	cap;	/* # of bytes reserved for the slot */
+} PFzslot;
+
+typedef struct PFzmap_hdr {
+	int	magic;		/* PF_ZMAP_MAGIC */
+	int	numslots;	/* # of PFzslot entries that follow */
+	long	dataend;	/* end of the slot area in the unix file */
+} PFzmap_hdr;
+
+/*************************** Tablespaces **************************/
+/* A file created with PF_CreateTablespace() spreads its pages over
+segment files of "segpages" pages each. Segment 0 is the paged file
+itself (header included); segment k > 0 is a separate unix file named
+"<dir>/<base>.<k>", where <dir> cycles over the directories listed in
+the descriptor file (the file name followed by PF_TSP_SUFFIX), or is
+the directory of the paged file if none are listed. Segments are
+created the first time one of their pages is written.
+
+The descriptor is a text file:
+	segpages <n>
+	dir <path>	(zero or more lines) */
+#define PF_TSP_SUFFIX	".tsp"
+
+typedef struct PFtsp {
+	int	segpages;	/* # of pages per segment */
+	int	nsegs;		/* # of entries in segfd */
+	int	*segfd;		/* unix fd of each segment, -1 if not open */
+	int	ndirs;		/* # of segment directories */
+	char	**dirs;		/* segment directories */
+} PFtsp;
+
 /*************************** Opened File Table **********************/
-#define PF_FTAB_SIZE	20	/* size of open file table */
+/* The table grows on demand; it starts with PF_FTAB_SIZE entries and
+doubles each time it fills up. Entries of open files are also chained
+into a hash table on the file name, for PFtabFindFname(). */
+#define PF_FTAB_SIZE	20	/* initial size of open file table */
+#define PF_FNAME_TBL_SIZE 64	/* size of file name hash table */
+#define PF_APPEND_RUN	64	/* max # of pages per write in PF_AppendPages() */
 
 /* open file table entry */
 typedef struct PFftab_ele {
@@ -38,6 +88,14 @@ typedef struct PFftab_ele {
 	int unixfd;	/* unix file descriptor*/
 	PFhdr_str hdr;	/* file header */
 	short hdrchanged; /* TRUE if file header has changed */
+	PFzslot *zmap;	/* page-offset map of a compressed file, or NULL */
+	int zmapsize;	/* # of entries allocated in zmap */
+	long zend;	/* end of the slot area of a compressed file */
+	short zmapchanged; /* TRUE if zmap has changed */
+	short growing;	/* TRUE while a call adds pages at the end */
+	PFtsp *tsp;	/* segments of a tablespace, or NULL */
+	int nextfree;	/* next free entry, if this one is not used */
+	int nextname;	/* next entry in the same file name bucket, or -1 */
 } PFftab_ele;
 
 /************************** Buffer Page Decls *********************/
@@ -54,7 +112,10 @@ typedef struct PFbpage {
 	struct PFbpage *prevpage;	/* previous in the linked list
 					of buffer pages */
 	short	dirty:1,		/* TRUE if page is dirty */
-		fixed:1;		/* TRUE if page is fixed in buffer*/
+		fixed:1,		/* TRUE if page is fixed in buffer*/
+		io:1;			/* TRUE while the page is read or
+					written with PFlatch let go; it
+					is also fixed */
 	int	page;			/* page number of this page */
 	int	fd;			/* file desciptor of this page */
 	PFfpage fpage; /* page data from the file */
@@ -77,6 +138,26 @@ typedef struct PFhash_entry {
 /* Hash function for hash table */
 #define PFhash(fd,page) (((fd)+(page)) % PF_HASH_TBL_SIZE)
 
+/******************** Victim Cache Decls **************************/
+/* Second-tier cache for pages evicted from the buffer pool. Pages are
+kept compressed, within a byte budget set by PF_SetVictimCacheSize(). */
+#define PF_VC_TBL_SIZE	256	/* size of victim cache hash table */
+
+/* Hash function for victim cache hash table */
+#define PFvcHash(fd,page) ((unsigned)((fd)*31+(page)) % PF_VC_TBL_SIZE)
+
+/* victim cache entry */
+typedef struct PFvc_entry {
+	struct PFvc_entry *nextentry;	/* next in hash bucket, or NULL */
+	struct PFvc_entry *preventry;	/* previous in hash bucket, or NULL */
+	struct PFvc_entry *nextlru;	/* next (older) entry in LRU list */
+	struct PFvc_entry *prevlru;	/* previous (newer) entry in LRU list */
+	int fd;		/* file descriptor */
+	int page;	/* page number */
+	int len;	/* # of bytes in data; sizeof(PFfpage) if stored raw */
+	char *data;	/* compressed page image */
+} PFvc_entry;
+
 /******************* Interface functions from Hash Table ****************/
 extern void PFhashInit();
 extern PFbpage *PFhashFind();
@@ -89,6 +170,24 @@ extern int PFbufGet();
 extern int PFbufUnfix();
 extern int PFbufAlloc();
 extern int PFbufReleaseFile();
+extern int PFbufDiscard();
 extern int PFbufUsed();
 
+/****************** Interface functions from Paged File *****************/
+extern int PFioBegin();
+extern void PFioEnd();
+extern int PFioWait();
+extern void PFioDone();
+
+/****************** Interface functions from Victim Cache ***************/
+extern int PFvcacheInsert();
+extern int PFvcacheGet();
+extern void PFvcacheDelete();
+extern void PFvcacheReleaseFile();
+extern void PFvcacheSetSize();
+
+/****************** Interface functions from Page Codec *****************/
+extern int PFcodecCompress();
+extern int PFcodecDecompress();
+
 #endif
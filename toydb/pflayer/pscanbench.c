@@ -0,0 +1,276 @@
+/* pscanbench.c
+ * Parallel heap scans: rows/s against the number of threads.
+ *
+ * The table is bulk-loaded -r times into one heap file, to make it
+ * larger than the buffer pool. The file is then scanned with
+ * HF_RunParScan with 1, 2, 4, ... threads (up to -t), each for at
+ * least MIN_MS, optionally with conditions and a projection as in
+ * scanbench. Every thread count must return the same rows, and the
+ * same rows as a serial HF_GetNextRows scan.
+ *
+ * Usage: pscanbench [-b poolSize] [-r copies] [-t maxThreads] [-m morselPages]
+ *                   [-p] [-w cond,cond,...] [-c col,col,...] [table.txt]
+ *   -b  buffer pool size              (default 100)
+ *   -r  copies of the table to load   (default 8)
+ *   -t  most threads to try           (default 8)
+ *   -m  pages per morsel              (default HF_MORSEL_PAGES)
+ *   -p  use PAX pages
+ *   -w  conditions "col op value", as for scanbench (default none)
+ *   -c  projected columns             (default none = whole records)
+ *   table defaults to ../../data/gradsum.txt
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "hf.h"
+#include "pftypes.h"
+#include "benchutil.h"
+
+#define MAX_LINE    4096
+#define MAX_THREADS 64
+#define MIN_MS      300.0   // run each scan for at least this long
+
+static const char *heapFile = "pscanbench.hf";
+
+// HF_BulkLoad record source: the lines of the table, copies times over
+typedef struct {
+    HF_LineSource lines;
+    int copies;
+} CopySource;
+
+static int next_copy(void *ctx, char **record, int *recLen) {
+    CopySource *src = ctx;
+    int more;
+    while ((more = HF_NextLine(&src->lines, record, recLen)) == 0 && --src->copies > 0)
+        rewind(src->lines.fp);
+    return more;
+}
+
+// most ';'-separated columns of any line
+static int count_columns(const char *path) {
+    FILE *fp = fopen(path, "r");
+    char line[MAX_LINE];
+    int most = 1;
+    if (!fp)
+        return -1;
+    while (fgets(line, sizeof(line), fp)) {
+        int n = 1;
+        for (char *p = line; *p; p++)
+            if (*p == ';')
+                n++;
+        if (n > most)
+            most = n;
+    }
+    fclose(fp);
+    return most;
+}
+
+// "6>=8" -> col 6, HF_GE, numeric 8
+static int parse_pred(char *text, HF_Pred *p) {
+    static const char *ops[] = { "!=", "<=", ">=", "=", "<", ">" };
+    static const HF_CompOp codes[] = { HF_NE, HF_LE, HF_GE, HF_EQ, HF_LT, HF_GT };
+    char *end;
+
+    p->col = (int)strtol(text, &end, 10);
+    if (end == text)
+        return -1;
+    for (int i = 0; i < 6; i++) {
+        size_t n = strlen(ops[i]);
+        if (strncmp(end, ops[i], n) == 0) {
+            char *num;
+            p->op = codes[i];
+            p->str = end + n;
+            p->strLen = (int)strlen(p->str);
+            p->num = strtod(p->str, &num);
+            p->numeric = p->strLen > 0 && *num == '\0';
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// per-worker result, padded so workers do not share a cache line
+typedef struct {
+    unsigned sum;
+    char pad[60];
+} WorkerSum;
+
+static WorkerSum sums[MAX_THREADS];
+
+// FNV-1a of each row, added up: the same rows give the same total in any order
+static unsigned hash_rows(const HF_RowBatch *batch) {
+    unsigned total = 0;
+    for (int i = 0; i < batch->n; i++) {
+        unsigned h = 2166136261u;
+        const char *p = batch->buf + batch->off[i];
+        for (int j = 0; j < batch->len[i]; j++)
+            h = (h ^ (unsigned char)p[j]) * 16777619u;
+        total += h;
+    }
+    return total;
+}
+
+static void merge_batch(void *ctx, int worker, HF_RowBatch *batch) {
+    (void)ctx;
+    sums[worker].sum += hash_rows(batch);
+}
+
+static unsigned par_scan(int fd, const HF_ScanSpec *spec, int threads, int morsel,
+                         long *rows) {
+    HF_ParScan ps;
+    unsigned total = 0;
+
+    memset(sums, 0, sizeof(sums));
+    if (HF_OpenParScan(fd, &ps, spec, morsel) != HFE_OK) {
+        PF_PrintError("HF_OpenParScan");
+        exit(1);
+    }
+    if (HF_RunParScan(&ps, threads, merge_batch, NULL, rows) != HFE_OK) {
+        PF_PrintError("parallel scan");
+        exit(1);
+    }
+    HF_CloseParScan(&ps);
+    for (int i = 0; i < threads; i++)
+        total += sums[i].sum;
+    return total;
+}
+
+static unsigned serial_scan(int fd, const HF_ScanSpec *spec, long *rows) {
+    static HF_RowBatch batch;
+    unsigned total = 0;
+    HF_Scan sc;
+
+    *rows = 0;
+    HF_OpenFileScanEx(fd, &sc, spec);
+    while (HF_GetNextRows(&sc, &batch) == HFE_OK) {
+        total += hash_rows(&batch);
+        *rows += batch.n;
+    }
+    HF_CloseFileScan(&sc);
+    return total;
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = "../../data/gradsum.txt";
+    char *predSpec = NULL;
+    char *colSpec = NULL;
+    HF_ScanSpec spec;
+    int pool = 100, copies = 8, maxThreads = 8, morsel = 0, layout = HF_LAYOUT_SLOTTED;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "b:r:t:m:pw:c:")) != -1) {
+        switch (opt) {
+        case 'b': pool = atoi(optarg); break;
+        case 'r': copies = atoi(optarg); break;
+        case 't': maxThreads = atoi(optarg); break;
+        case 'm': morsel = atoi(optarg); break;
+        case 'p': layout = HF_LAYOUT_PAX; break;
+        case 'w': predSpec = optarg; break;
+        case 'c': colSpec = optarg; break;
+        default:
+            fprintf(stderr, "Usage: %s [-b poolSize] [-r copies] [-t maxThreads] "
+                    "[-m morselPages] [-p] [-w cond,...] [-c col,...] [table.txt]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (optind < argc)
+        path = argv[optind];
+    if (pool <= 0 || pool > PF_MAX_BUFS_LIMIT) {
+        fprintf(stderr, "pool size out of range (1..%d)\n", PF_MAX_BUFS_LIMIT);
+        return 1;
+    }
+    if (maxThreads < 1 || maxThreads > MAX_THREADS || maxThreads > pool) {
+        fprintf(stderr, "threads out of range (1..%d, at most the pool size)\n",
+                MAX_THREADS);
+        return 1;
+    }
+
+    memset(&spec, 0, sizeof(spec));
+    for (char *p = predSpec ? strtok(predSpec, ",") : NULL; p; p = strtok(NULL, ",")) {
+        if (spec.npreds == HF_MAX_PREDS || parse_pred(p, &spec.preds[spec.npreds]) < 0) {
+            fprintf(stderr, "bad condition: %s\n", p);
+            return 1;
+        }
+        spec.npreds++;
+    }
+    for (char *p = colSpec ? strtok(colSpec, ",") : NULL; p && spec.nproj < HF_MAX_PROJ;
+         p = strtok(NULL, ","))
+        spec.proj[spec.nproj++] = atoi(p);
+
+    int tableCols = count_columns(path);
+    if (tableCols < 0) {
+        perror(path);
+        return 1;
+    }
+    if (tableCols > HF_PAX_MAX_COLS)
+        tableCols = HF_PAX_MAX_COLS;
+
+    PF_Init();
+    PF_SetBufferSize(pool);
+    PF_SetReplacementPolicy(PF_REPL_LRU);
+
+    // 1. Load the copies
+    HF_FileOptions opts = { .layout = layout, .ncols = tableCols, .sep = ';' };
+    CopySource src = { .copies = copies };
+    int n;
+    PF_DestroyFile((char *)heapFile);
+    if (HF_CreateFileEx((char *)heapFile, &opts) != HFE_OK) {
+        PF_PrintError("HF_CreateFileEx");
+        return 1;
+    }
+    int fd = HF_OpenFile((char *)heapFile);
+    if (fd < 0 || !(src.lines.fp = fopen(path, "r"))) {
+        perror(path);
+        return 1;
+    }
+    if (HF_BulkLoad(fd, next_copy, &src, 100, NULL, &n) != HFE_OK) {
+        printf("HF_BulkLoad error after %d records\n", n);
+        return 1;
+    }
+    fclose(src.lines.fp);
+    HF_CloseFile(fd);
+    if ((fd = HF_OpenFile((char *)heapFile)) < 0) {
+        PF_PrintError("HF_OpenFile");
+        return 1;
+    }
+
+    printf("pscanbench: %s x%d (%s), %d rows, %d pages, pool=%d, "
+           "%d conditions, %d columns projected\n", path, copies,
+           layout ? "pax" : "slotted", n, PF_NumPages(fd), pool, spec.npreds, spec.nproj);
+    printf("%-10s %9s %10s %8s %12s\n", "threads", "matched", "Mrow/s", "speedup",
+           "reads/scan");
+
+    // 2. A serial scan gives the expected result
+    long refRows;
+    unsigned ref = serial_scan(fd, &spec, &refRows);
+
+    int status = 0;
+    double base = 0;
+    for (int t = 1; ; t = t * 2 < maxThreads ? t * 2 : maxThreads) {
+        double t0, ms;
+        long rows = 0;
+        unsigned sum = 0;
+        int reps;
+        PF_ResetStats();
+        for (reps = 0, t0 = now_ms(); (ms = now_ms() - t0) < MIN_MS; reps++)
+            sum = par_scan(fd, &spec, t, morsel, &rows);
+        double rate = n * (double)reps / ms / 1e3;
+        if (t == 1)
+            base = rate;
+        printf("%-10d %9ld %10.2f %7.2fx %12.0f", t, rows, rate, rate / base,
+               (double)PF_stats.physicalReads / reps);
+        if (rows != refRows || sum != ref) {
+            printf("  MISMATCH (serial scan: %ld rows)", refRows);
+            status = 1;
+        }
+        printf("\n");
+        if (t == maxThreads)
+            break;
+    }
+
+    HF_CloseFile(fd);
+    PF_DestroyFile((char *)heapFile);
+    return status;
+}
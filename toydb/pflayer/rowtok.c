@@ -0,0 +1,236 @@
+#include "rowtok.h"
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define RT_HAVE_X86 1
+#include <immintrin.h>
+#endif
+
+/*
+ * Every scanner works the same way: a "mask" function looks at 32
+ * bytes and returns a bit for each byte that is sep or "\n", and the
+ * generic loops below walk the set bits. The loops are forced inline
+ * into one wrapper per level, so each wrapper gets its own copy with
+ * the mask function inlined (and, for AVX2, compiled for AVX2).
+ */
+#define RT_BLOCK 32
+#define RT_INLINE static inline __attribute__((always_inline))
+
+typedef uint32_t (*RT_MaskFn)(const char *p, char sep);
+
+static int RT_level = -1;   /* Level in use; -1 until first needed */
+
+/*
+ * Plain C mask.
+ */
+RT_INLINE uint32_t RT_MaskScalar(const char *p, char sep) {
+    uint32_t m = 0;
+    for (int i = 0; i < RT_BLOCK; i++) {
+        if (p[i] == sep || p[i] == '\n') {
+            m |= 1u << i;
+        }
+    }
+    return m;
+}
+
+#ifdef RT_HAVE_X86
+/*
+ * SSE2 mask: two 16-byte compares per block.
+ */
+RT_INLINE uint32_t RT_MaskSse2(const char *p, char sep) {
+    __m128i s = _mm_set1_epi8(sep);
+    __m128i nl = _mm_set1_epi8('\n');
+    __m128i a = _mm_loadu_si128((const __m128i *)p);
+    __m128i b = _mm_loadu_si128((const __m128i *)(p + 16));
+    uint32_t lo = (uint32_t)_mm_movemask_epi8(
+        _mm_or_si128(_mm_cmpeq_epi8(a, s), _mm_cmpeq_epi8(a, nl)));
+    uint32_t hi = (uint32_t)_mm_movemask_epi8(
+        _mm_or_si128(_mm_cmpeq_epi8(b, s), _mm_cmpeq_epi8(b, nl)));
+    return lo | hi << 16;
+}
+
+/*
+ * AVX2 mask: one 32-byte compare per block.
+ */
+__attribute__((target("avx2")))
+RT_INLINE uint32_t RT_MaskAvx2(const char *p, char sep) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)p);
+    __m256i hit = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(sep)),
+                                  _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+    return (uint32_t)_mm256_movemask_epi8(hit);
+}
+#endif
+
+/*
+ * Mask of the block at buf + i, which may run past len. The short
+ * last block is copied into a padded buffer, and bits past len are
+ * cleared.
+ */
+RT_INLINE uint32_t RT_Block(const char *buf, size_t len, size_t i, char sep,
+                            RT_MaskFn mask) {
+    char tail[RT_BLOCK];
+
+    if (len - i >= RT_BLOCK) {
+        return mask(buf + i, sep);
+    }
+    memset(tail, 0, RT_BLOCK);
+    memcpy(tail, buf + i, len - i);
+    return mask(tail, sep) & ((1u << (len - i)) - 1);
+}
+
+RT_INLINE size_t RT_FindGeneric(const char *buf, size_t len, char sep,
+                                uint32_t *pos, size_t maxPos, size_t *scanned,
+                                RT_MaskFn mask) {
+    size_t n = 0;
+    size_t i = 0;
+
+    while (i < len && n + RT_BLOCK <= maxPos) {
+        uint32_t m = RT_Block(buf, len, i, sep, mask);
+        while (m) {
+            pos[n++] = (uint32_t)(i + __builtin_ctz(m));
+            m &= m - 1;
+        }
+        i += RT_BLOCK;
+    }
+    *scanned = i < len ? i : len;
+    return n;
+}
+
+/*
+ * Closes the field [from, to) of the row.
+ */
+RT_INLINE void RT_AddField(RT_Row *row, size_t from, size_t to) {
+    if (row->nfields < RT_MAX_FIELDS) {
+        row->start[row->nfields] = (int)from;
+        row->flen[row->nfields] = (int)(to - from);
+        row->nfields++;
+    }
+}
+
+RT_INLINE size_t RT_RowGeneric(const char *buf, size_t len, char sep,
+                               RT_Row *row, RT_MaskFn mask) {
+    size_t field = 0;   // Start of the current field
+    size_t end = len;   // End of the row's data
+    size_t used = len;  // Bytes consumed
+    size_t i;
+
+    row->nfields = 0;
+    for (i = 0; i < len; i += RT_BLOCK) {
+        uint32_t m = RT_Block(buf, len, i, sep, mask);
+        while (m) {
+            size_t at = i + __builtin_ctz(m);
+            m &= m - 1;
+            if (buf[at] == '\n') {
+                end = at;
+                used = at + 1;
+                goto done;
+            }
+            RT_AddField(row, field, at);
+            field = at + 1;
+        }
+    }
+done:
+    // Drop the "\r"s before the line end, as strip after fgets does
+    while (end > field && buf[end - 1] == '\r') {
+        end--;
+    }
+    if (len > 0) {
+        RT_AddField(row, field, end);
+    }
+    row->len = (int)end;
+    return used;
+}
+
+/*
+ * One wrapper per level.
+ */
+static size_t RT_FindScalar(const char *buf, size_t len, char sep,
+                            uint32_t *pos, size_t maxPos, size_t *scanned) {
+    return RT_FindGeneric(buf, len, sep, pos, maxPos, scanned, RT_MaskScalar);
+}
+
+static size_t RT_RowScalar(const char *buf, size_t len, char sep, RT_Row *row) {
+    return RT_RowGeneric(buf, len, sep, row, RT_MaskScalar);
+}
+
+#ifdef RT_HAVE_X86
+static size_t RT_FindSse2(const char *buf, size_t len, char sep,
+                          uint32_t *pos, size_t maxPos, size_t *scanned) {
+    return RT_FindGeneric(buf, len, sep, pos, maxPos, scanned, RT_MaskSse2);
+}
+
+static size_t RT_RowSse2(const char *buf, size_t len, char sep, RT_Row *row) {
+    return RT_RowGeneric(buf, len, sep, row, RT_MaskSse2);
+}
+
+__attribute__((target("avx2")))
+static size_t RT_FindAvx2(const char *buf, size_t len, char sep,
+                          uint32_t *pos, size_t maxPos, size_t *scanned) {
+    return RT_FindGeneric(buf, len, sep, pos, maxPos, scanned, RT_MaskAvx2);
+}
+
+__attribute__((target("avx2")))
+static size_t RT_RowAvx2(const char *buf, size_t len, char sep, RT_Row *row) {
+    return RT_RowGeneric(buf, len, sep, row, RT_MaskAvx2);
+}
+#endif
+
+/*
+ * ======================================================
+ * Public interface
+ * ======================================================
+ */
+
+int RT_BestLevel(void) {
+#ifdef RT_HAVE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return RT_AVX2;
+    }
+    return RT_SSE2;
+#else
+    return RT_SCALAR;
+#endif
+}
+
+int RT_SetLevel(int level) {
+    int best = RT_BestLevel();
+    RT_level = (level < RT_SCALAR || level > best) ? best : level;
+    return RT_level;
+}
+
+int RT_GetLevel(void) {
+    if (RT_level < 0) {
+        RT_level = RT_BestLevel();
+    }
+    return RT_level;
+}
+
+const char *RT_LevelName(int level) {
+    switch (level) {
+    case RT_SSE2: return "sse2";
+    case RT_AVX2: return "avx2";
+    default:      return "scalar";
+    }
+}
+
+size_t RT_NextRow(const char *buf, size_t len, char sep, RT_Row *row) {
+    switch (RT_GetLevel()) {
+#ifdef RT_HAVE_X86
+    case RT_AVX2: return RT_RowAvx2(buf, len, sep, row);
+    case RT_SSE2: return RT_RowSse2(buf, len, sep, row);
+#endif
+    default:      return RT_RowScalar(buf, len, sep, row);
+    }
+}
+
+size_t RT_FindDelims(const char *buf, size_t len, char sep,
+                     uint32_t *pos, size_t maxPos, size_t *scanned) {
+    switch (RT_GetLevel()) {
+#ifdef RT_HAVE_X86
+    case RT_AVX2: return RT_FindAvx2(buf, len, sep, pos, maxPos, scanned);
+    case RT_SSE2: return RT_FindSse2(buf, len, sep, pos, maxPos, scanned);
+#endif
+    default:      return RT_FindScalar(buf, len, sep, pos, maxPos, scanned);
+    }
+}
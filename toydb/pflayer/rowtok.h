@@ -0,0 +1,66 @@
+#ifndef ROWTOK_H
+#define ROWTOK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Row tokenizer for the data files: one row per line, fields
+ * separated by ';'. The scanners look at 32 bytes at a time with
+ * AVX2 or SSE2 when the CPU has them, and fall back to plain C.
+ */
+
+#define RT_MAX_FIELDS 64   /* Fields past this are not recorded */
+
+/* Scanner implementations, for RT_SetLevel */
+#define RT_SCALAR 0
+#define RT_SSE2   1
+#define RT_AVX2   2
+
+/*
+ * One tokenized row. Offsets are relative to the start of the row.
+ */
+typedef struct {
+    int len;                        /* Row length, without "\n" or trailing "\r"s */
+    int nfields;                    /* Number of fields recorded */
+    int start[RT_MAX_FIELDS];       /* Offset of each field */
+    int flen[RT_MAX_FIELDS];        /* Length of each field */
+} RT_Row;
+
+/*
+ * Tokenizes the row that starts at buf, which holds len bytes.
+ * The row ends at the first "\n" or at buf + len.
+ *
+ * Returns the number of bytes consumed, including the "\n"
+ * (0 only if len is 0).
+ */
+size_t RT_NextRow(const char *buf, size_t len, char sep, RT_Row *row);
+
+/*
+ * Finds every sep and "\n" byte in buf[0..len) and stores their
+ * offsets in pos[], in order. Stops early when pos[] is nearly full
+ * (fewer than 32 entries left).
+ *
+ * Outputs:
+ * scanned: How many bytes of buf were looked at; call again from
+ *          there to continue
+ *
+ * Returns the number of offsets stored.
+ */
+size_t RT_FindDelims(const char *buf, size_t len, char sep,
+                     uint32_t *pos, size_t maxPos, size_t *scanned);
+
+/*
+ * Picks the scanner implementation. Asking for one the CPU does not
+ * have selects the best one it does have. Returns the level in use.
+ */
+int RT_SetLevel(int level);
+
+/* The best level this CPU supports, and the level in use */
+int RT_BestLevel(void);
+int RT_GetLevel(void);
+
+/* "scalar", "sse2" or "avx2" */
+const char *RT_LevelName(int level);
+
+#endif // ROWTOK_H
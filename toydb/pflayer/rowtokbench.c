@@ -0,0 +1,159 @@
+/* rowtokbench.c
+ * Throughput of the row tokenizer (rowtok.c) on the data files.
+ *
+ * Each file is read into memory once, then tokenized repeatedly by:
+ *   strchr  - the per-line strchr loop the drivers used so far
+ *   delims  - RT_FindDelims: offsets of every ';' and '\n'
+ *   rows    - RT_NextRow: field offset arrays, row by row
+ * with every scanner level the CPU supports (scalar, sse2, avx2).
+ * Prints GB/s and checks that all of them see the same rows/fields.
+ *
+ * Usage: rowtokbench [file ...]
+ *   files default to ../../data/gradsum.txt and ../../data/crsfmdt.txt
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rowtok.h"
+#include "benchutil.h"
+
+#define MIN_MS   300.0      // run each case for at least this long
+#define MAX_POS  65536
+
+static char *read_file(const char *path, size_t *len) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        perror(path);
+        return NULL;
+    }
+    fseek(fp, 0, SEEK_END);
+    long n = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char *buf = malloc(n + 1);
+    if (!buf || fread(buf, 1, n, fp) != (size_t)n) {
+        perror(path);
+        free(buf);
+        fclose(fp);
+        return NULL;
+    }
+    buf[n] = '\0';
+    fclose(fp);
+    *len = n;
+    return buf;
+}
+
+// old style: find each line end, then each ';' with strchr
+static long run_strchr(const char *buf, size_t len, long *rows) {
+    long fields = 0;
+    const char *p = buf;
+    const char *end = buf + len;
+    *rows = 0;
+    while (p < end) {
+        const char *nl = strchr(p, '\n');
+        if (!nl)
+            nl = end;
+        const char *f = p;
+        const char *s;
+        fields++;
+        while ((s = strchr(f, ';')) != NULL && s < nl) {
+            fields++;
+            f = s + 1;
+        }
+        (*rows)++;
+        p = nl + 1;
+    }
+    return fields;
+}
+
+// delimiter offsets: a row has one field more than it has ';'
+static long run_delims(const char *buf, size_t len, uint32_t *pos, long *rows) {
+    long semis = 0;
+    size_t off = 0;
+    *rows = 0;
+    while (off < len) {
+        size_t scanned;
+        size_t n = RT_FindDelims(buf + off, len - off, ';', pos, MAX_POS, &scanned);
+        for (size_t i = 0; i < n; i++) {
+            if (buf[off + pos[i]] == '\n')
+                (*rows)++;
+            else
+                semis++;
+        }
+        off += scanned;
+    }
+    // a last row without "\n" still counts
+    if (len > 0 && buf[len - 1] != '\n')
+        (*rows)++;
+    return semis + *rows;
+}
+
+static long run_rows(const char *buf, size_t len, long *rows) {
+    long fields = 0;
+    size_t off = 0;
+    RT_Row row;
+    *rows = 0;
+    while (off < len) {
+        off += RT_NextRow(buf + off, len - off, ';', &row);
+        fields += row.nfields;
+        (*rows)++;
+    }
+    return fields;
+}
+
+static void report(const char *method, const char *level, size_t len,
+                   double ms, int reps, long rows, long fields) {
+    printf("  %-7s %-7s %8.2f GB/s   rows=%ld fields=%ld\n", method, level,
+           (double)len * reps / (ms / 1e3) / 1e9, rows, fields);
+}
+
+int main(int argc, char *argv[]) {
+    const char *defaults[] = { "../../data/gradsum.txt", "../../data/crsfmdt.txt" };
+    const char **files = argc > 1 ? (const char **)argv + 1 : defaults;
+    int nfiles = argc > 1 ? argc - 1 : 2;
+    uint32_t *pos = malloc(MAX_POS * sizeof(uint32_t));
+    int status = 0;
+
+    printf("rowtokbench: best scanner on this CPU is %s\n",
+           RT_LevelName(RT_BestLevel()));
+
+    for (int f = 0; f < nfiles; f++) {
+        size_t len;
+        char *buf = read_file(files[f], &len);
+        if (!buf) {
+            status = 1;
+            continue;
+        }
+        printf("%s: %.2f MB\n", files[f], len / (1024.0 * 1024.0));
+
+        long rows = 0, fields = 0, refRows = 0, refFields = 0;
+        double t0, ms;
+        int reps;
+
+        for (reps = 0, t0 = now_ms(); (ms = now_ms() - t0) < MIN_MS; reps++)
+            refFields = run_strchr(buf, len, &refRows);
+        report("strchr", "libc", len, ms, reps, refRows, refFields);
+
+        for (int level = RT_SCALAR; level <= RT_BestLevel(); level++) {
+            RT_SetLevel(level);
+
+            for (reps = 0, t0 = now_ms(); (ms = now_ms() - t0) < MIN_MS; reps++)
+                fields = run_delims(buf, len, pos, &rows);
+            report("delims", RT_LevelName(level), len, ms, reps, rows, fields);
+            if (rows != refRows || fields != refFields) {
+                printf("  MISMATCH\n");
+                status = 1;
+            }
+
+            for (reps = 0, t0 = now_ms(); (ms = now_ms() - t0) < MIN_MS; reps++)
+                fields = run_rows(buf, len, &rows);
+            report("rows", RT_LevelName(level), len, ms, reps, rows, fields);
+            if (rows != refRows || fields != refFields) {
+                printf("  MISMATCH\n");
+                status = 1;
+            }
+        }
+        free(buf);
+    }
+    free(pos);
+    return status;
+}
@@ -0,0 +1,304 @@
+/* scanbench.c
+ * Filtered scans: caller-side filtering vs predicates in the page loop.
+ *
+ * One table is bulk-loaded into a slotted and a PAX heap file. Each
+ * file is then scanned with a condition such as "year = 1989 and
+ * CGPA >= 8" and a projection to a few columns, two ways:
+ *   rec   - HF_GetNextRec returns every record; the caller splits it,
+ *           checks the condition and copies out the projected columns
+ *   rows  - HF_OpenFileScanEx + HF_GetNextRows: the page loop checks
+ *           the condition and only matching rows are copied, projected,
+ *           into a batch
+ * Each scan runs for at least MIN_MS. Both ways must return the same
+ * number of rows and the same checksum of the projected bytes.
+ *
+ * Usage: scanbench [-b poolSize] [-w cond,cond,...] [-c col,col,...] [table.txt]
+ *   -b  buffer pool size              (default 100)
+ *   -w  conditions "col op value", op one of = != < <= > >=; a value
+ *       that parses as a number is compared as a number
+ *                                     (default 1=1989,6>=8 for gradsum)
+ *   -c  projected columns             (default 0,1,6; none = whole records)
+ *   table defaults to ../../data/gradsum.txt
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "hf.h"
+#include "pftypes.h"
+#include "benchutil.h"
+
+#define MAX_LINE  4096
+#define MIN_MS    200.0     // run each scan for at least this long
+
+static const char *heapFile = "scanbench.hf";
+
+// most ';'-separated columns of any line
+static int count_columns(const char *path) {
+    FILE *fp = fopen(path, "r");
+    char line[MAX_LINE];
+    int most = 1;
+    if (!fp)
+        return -1;
+    while (fgets(line, sizeof(line), fp)) {
+        int n = 1;
+        for (char *p = line; *p; p++)
+            if (*p == ';')
+                n++;
+        if (n > most)
+            most = n;
+    }
+    fclose(fp);
+    return most;
+}
+
+// "6>=8" -> col 6, HF_GE, numeric 8
+static int parse_pred(char *text, HF_Pred *p) {
+    static const char *ops[] = { "!=", "<=", ">=", "=", "<", ">" };
+    static const HF_CompOp codes[] = { HF_NE, HF_LE, HF_GE, HF_EQ, HF_LT, HF_GT };
+    char *end;
+
+    p->col = (int)strtol(text, &end, 10);
+    if (end == text)
+        return -1;
+    for (int i = 0; i < 6; i++) {
+        size_t n = strlen(ops[i]);
+        if (strncmp(end, ops[i], n) == 0) {
+            char *num;
+            p->op = codes[i];
+            p->str = end + n;
+            p->strLen = (int)strlen(p->str);
+            p->num = strtod(p->str, &num);
+            p->numeric = p->strLen > 0 && *num == '\0';
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int load(const char *path, HF_FileOptions *opts) {
+    HF_LineSource src;
+    int n;
+
+    PF_DestroyFile((char *)heapFile);
+    if (HF_CreateFileEx((char *)heapFile, opts) != HFE_OK) {
+        PF_PrintError("HF_CreateFileEx");
+        return -1;
+    }
+    int fd = HF_OpenFile((char *)heapFile);
+    if (fd < 0) {
+        PF_PrintError("HF_OpenFile");
+        return -1;
+    }
+    if (!(src.fp = fopen(path, "r"))) {
+        perror(path);
+        HF_CloseFile(fd);
+        return -1;
+    }
+    int err = HF_BulkLoad(fd, HF_NextLine, &src, 100, NULL, &n);
+    fclose(src.fp);
+    HF_CloseFile(fd);
+    if (err != HFE_OK) {
+        printf("HF_BulkLoad error %d after %d records\n", err, n);
+        return -1;
+    }
+    return n;
+}
+
+// FNV-1a over the projected bytes, so both ways must agree exactly
+static unsigned hash_bytes(unsigned h, const char *p, int len) {
+    for (int i = 0; i < len; i++)
+        h = (h ^ (unsigned char)p[i]) * 16777619u;
+    return h;
+}
+
+// the same test as the page layer, done by the caller
+static int pred_match(const HF_Pred *p, const char *field, int len) {
+    char buf[64];
+    int cmp;
+    if (len == 0)
+        return 0;
+    if (p->numeric) {
+        char *end;
+        if (len >= (int)sizeof(buf))
+            return 0;
+        memcpy(buf, field, len);
+        buf[len] = '\0';
+        double v = strtod(buf, &end);
+        if (end == buf)
+            return 0;
+        cmp = v < p->num ? -1 : v > p->num;
+    } else {
+        cmp = memcmp(field, p->str, len < p->strLen ? len : p->strLen);
+        if (cmp == 0)
+            cmp = len - p->strLen;
+    }
+    switch (p->op) {
+    case HF_EQ: return cmp == 0;
+    case HF_NE: return cmp != 0;
+    case HF_LT: return cmp < 0;
+    case HF_LE: return cmp <= 0;
+    case HF_GT: return cmp > 0;
+    default:    return cmp >= 0;
+    }
+}
+
+// HF_GetNextRec + filtering and projecting in the caller
+static unsigned scan_rec(int fd, const HF_ScanSpec *spec, long *rows) {
+    static char out[MAX_LINE];
+    int start[HF_MAX_PROJ], flen[HF_MAX_PROJ];
+    unsigned sum = 0;
+    HF_Scan sc;
+    RID rid;
+    char *rec;
+    int len;
+
+    *rows = 0;
+    HF_OpenFileScan(fd, &sc);
+    while (HF_GetNextRec(fd, &sc, &rid, &rec, &len) == HFE_OK) {
+        int nf = 0, from = 0, k, n = 0;
+        for (int i = 0; i <= len && nf < HF_MAX_PROJ; i++)
+            if (i == len || rec[i] == ';') {
+                start[nf] = from;
+                flen[nf++] = i - from;
+                from = i + 1;
+            }
+        for (k = 0; k < spec->npreds; k++) {
+            const HF_Pred *p = &spec->preds[k];
+            if (p->col >= nf || !pred_match(p, rec + start[p->col], flen[p->col]))
+                break;
+        }
+        if (k < spec->npreds)
+            continue;
+        if (spec->nproj == 0) {
+            memcpy(out, rec, len);
+            n = len;
+        }
+        for (int j = 0; j < spec->nproj; j++) {
+            int c = spec->proj[j];
+            if (j > 0)
+                out[n++] = ';';
+            if (c < nf) {
+                memcpy(out + n, rec + start[c], flen[c]);
+                n += flen[c];
+            }
+        }
+        sum += hash_bytes(2166136261u, out, n);
+        (*rows)++;
+    }
+    HF_CloseFileScan(&sc);
+    return sum;
+}
+
+// HF_OpenFileScanEx + HF_GetNextRows
+static unsigned scan_rows(int fd, const HF_ScanSpec *spec, long *rows) {
+    static HF_RowBatch batch;
+    unsigned sum = 0;
+    HF_Scan sc;
+
+    *rows = 0;
+    if (HF_OpenFileScanEx(fd, &sc, spec) != HFE_OK)
+        return 0;
+    while (HF_GetNextRows(&sc, &batch) == HFE_OK) {
+        for (int i = 0; i < batch.n; i++)
+            sum += hash_bytes(2166136261u, batch.buf + batch.off[i], batch.len[i]);
+        *rows += batch.n;
+    }
+    HF_CloseFileScan(&sc);
+    return sum;
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = "../../data/gradsum.txt";
+    char defaultPreds[] = "1=1989,6>=8";
+    char defaultCols[] = "0,1,6";
+    char *predSpec = defaultPreds;
+    char *colSpec = defaultCols;
+    HF_ScanSpec spec;
+    int pool = 100;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "b:w:c:")) != -1) {
+        switch (opt) {
+        case 'b': pool = atoi(optarg); break;
+        case 'w': predSpec = optarg; break;
+        case 'c': colSpec = optarg; break;
+        default:
+            fprintf(stderr, "Usage: %s [-b poolSize] [-w cond,cond,...] "
+                    "[-c col,col,...] [table.txt]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind < argc)
+        path = argv[optind];
+    if (pool <= 0 || pool > PF_MAX_BUFS_LIMIT) {
+        fprintf(stderr, "pool size out of range (1..%d)\n", PF_MAX_BUFS_LIMIT);
+        return 1;
+    }
+
+    memset(&spec, 0, sizeof(spec));
+    for (char *p = strtok(predSpec, ","); p; p = strtok(NULL, ",")) {
+        if (spec.npreds == HF_MAX_PREDS || parse_pred(p, &spec.preds[spec.npreds]) < 0) {
+            fprintf(stderr, "bad condition: %s\n", p);
+            return 1;
+        }
+        spec.npreds++;
+    }
+    if (strcmp(colSpec, "none") != 0)
+        for (char *p = strtok(colSpec, ","); p && spec.nproj < HF_MAX_PROJ; p = strtok(NULL, ","))
+            spec.proj[spec.nproj++] = atoi(p);
+
+    int tableCols = count_columns(path);
+    if (tableCols < 0) {
+        perror(path);
+        return 1;
+    }
+    if (tableCols > HF_PAX_MAX_COLS)
+        tableCols = HF_PAX_MAX_COLS;
+
+    PF_Init();
+    PF_SetBufferSize(pool);
+    PF_SetReplacementPolicy(PF_REPL_LRU);
+
+    printf("scanbench: %s, pool=%d, %d conditions, %d columns projected\n",
+           path, pool, spec.npreds, spec.nproj);
+    printf("%-8s %8s %8s %12s %12s %8s\n", "layout", "rows", "matched",
+           "rec Mrow/s", "rows Mrow/s", "speedup");
+
+    int status = 0;
+    for (int layout = HF_LAYOUT_SLOTTED; layout <= HF_LAYOUT_PAX; layout++) {
+        HF_FileOptions opts = { .layout = layout, .ncols = tableCols, .sep = ';' };
+        unsigned sum[2];
+        double rate[2];
+        long matched[2] = { 0, 0 };
+        int total;
+
+        if ((total = load(path, &opts)) < 0)
+            return 1;
+        int fd = HF_OpenFile((char *)heapFile);
+        if (fd < 0) {
+            PF_PrintError("HF_OpenFile");
+            return 1;
+        }
+        for (int way = 0; way <= 1; way++) {
+            double t0, ms;
+            int reps;
+            for (reps = 0, t0 = now_ms(); (ms = now_ms() - t0) < MIN_MS; reps++)
+                sum[way] = way ? scan_rows(fd, &spec, &matched[way])
+                               : scan_rec(fd, &spec, &matched[way]);
+            rate[way] = total * (double)reps / ms / 1e3;
+        }
+        HF_CloseFile(fd);
+
+        printf("%-8s %8d %8ld %12.2f %12.2f %7.2fx", layout ? "pax" : "slotted",
+               total, matched[1], rate[0], rate[1], rate[1] / rate[0]);
+        if (matched[0] != matched[1] || sum[0] != sum[1]) {
+            printf("  MISMATCH (%ld rows by HF_GetNextRec)", matched[0]);
+            status = 1;
+        }
+        printf("\n");
+    }
+
+    PF_DestroyFile((char *)heapFile);
+    return status;
+}
@@ -0,0 +1,215 @@
+/* snapbench.c
+ * Read-only snapshots: opening, scanning and point reads, against the
+ * heap file they were made from.
+ *
+ * Each table is bulk loaded into a heap file, which is then turned
+ * into a snapshot (HF_WriteSnapshot). For both the bench prints the
+ * file size, the time to open and close the file (averaged over -o
+ * rounds), the time of a full scan (the best of -r), the time of a
+ * random point read by RID (averaged over -q reads) and the PF
+ * physical reads of all of it. The heap file goes through the buffer
+ * pool (-b pages); the snapshot is mmapped and makes no PF calls. The
+ * snapshot's scan and point reads are checked against the heap file.
+ *
+ * Usage: snapbench [-b poolSize] [-o opens] [-r scans] [-q reads]
+ *                  [-s seed] [table.txt ...]
+ *   -b  buffer pool size              (default 20)
+ *   -o  open/close rounds             (default 1000)
+ *   -r  full scans, the best counts   (default 5)
+ *   -q  point reads                   (default 100000)
+ *   -s  random seed                   (default 1)
+ *   tables default to ../../data/rollhist.txt and ../../data/crsfmdt.txt
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "hf.h"
+#include "pftypes.h"
+#include "benchutil.h"
+
+static const char *heapFile = "snapbench.hf";
+static const char *snapFile = "snapbench.snap";
+
+static long file_kb(const char *name) {
+    struct stat sb;
+    return stat(name, &sb) == 0 ? (long)(sb.st_size / 1024) : -1;
+}
+
+static void print_row(const char *name, long kb, double openUs, double scanMs, long bytes,
+                      double getUs, int reads) {
+    printf("%-6s %8ld %9.2f %9.2f %9.1f %9.3f %8d\n", name, kb, openUs, scanMs,
+           bytes / 1e3 / scanMs, getUs, reads);
+}
+
+int main(int argc, char *argv[]) {
+    static char *defaults[] = { "../../data/rollhist.txt", "../../data/crsfmdt.txt" };
+    char **tables = defaults;
+    int ntables = 2;
+    int pool = 20, opens = 1000, scans = 5, reads = 100000;
+    unsigned seed = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "b:o:r:q:s:")) != -1) {
+        switch (opt) {
+        case 'b': pool = atoi(optarg); break;
+        case 'o': opens = atoi(optarg); break;
+        case 'r': scans = atoi(optarg); break;
+        case 'q': reads = atoi(optarg); break;
+        case 's': seed = (unsigned)atoi(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-b poolSize] [-o opens] [-r scans] [-q reads] "
+                    "[-s seed] [table.txt ...]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind < argc) {
+        tables = argv + optind;
+        ntables = argc - optind;
+    }
+    if (pool <= 0 || pool > PF_MAX_BUFS_LIMIT) {
+        fprintf(stderr, "pool size out of range (1..%d)\n", PF_MAX_BUFS_LIMIT);
+        return 1;
+    }
+    if (opens < 1 || scans < 1 || reads < 1) {
+        fprintf(stderr, "-o, -r and -q must be at least 1\n");
+        return 1;
+    }
+    srand(seed);
+
+    PF_Init();
+    PF_SetBufferSize(pool);
+    PF_SetReplacementPolicy(PF_REPL_LRU);
+
+    int status = 0;
+    for (int t = 0; t < ntables; t++) {
+        if (read_table(tables[t]) <= 0) {
+            fprintf(stderr, "cannot read %s\n", tables[t]);
+            return 1;
+        }
+
+        // 1. Load the heap file and convert it
+        PF_DestroyFile((char *)heapFile);
+        if (HF_CreateFile((char *)heapFile) != HFE_OK) {
+            PF_PrintError("HF_CreateFile");
+            return 1;
+        }
+        int fd = HF_OpenFile((char *)heapFile);
+        int next = 0, n;
+        RID *rids;
+        if (fd < 0 || HF_BulkLoad(fd, next_line, &next, 100, &rids, &n) != HFE_OK) {
+            PF_PrintError("HF_BulkLoad");
+            return 1;
+        }
+        double t0 = now_ms();
+        if (HF_WriteSnapshot(fd, (char *)snapFile) != HFE_OK) {
+            PF_PrintError("HF_WriteSnapshot");
+            return 1;
+        }
+        double convMs = now_ms() - t0;
+        int pages = PF_NumPages(fd);
+        HF_CloseFile(fd);
+
+        // the same random RIDs for both
+        RID *probe = malloc(reads * sizeof(RID));
+        for (int i = 0; i < reads; i++)
+            probe[i] = rids[rand() % n];
+
+        printf("%s: %d records, %d pages, snapshot written in %.1f ms, pool=%d\n",
+               tables[t], n, pages, convMs, pool);
+        printf("%-6s %8s %9s %9s %9s %9s %8s\n", "file", "KB", "open us", "scan ms",
+               "MB/s", "get us", "reads");
+
+        // 2. The heap file
+        HF_Scan scan;
+        RID rid;
+        char *rec;
+        int len;
+        long bytes = 0;
+        double best = 1e30;
+        PF_ResetStats();
+        t0 = now_ms();
+        for (int i = 0; i < opens; i++) {
+            fd = HF_OpenFile((char *)heapFile);
+            HF_CloseFile(fd);
+        }
+        double openUs = (now_ms() - t0) * 1e3 / opens;
+        fd = HF_OpenFile((char *)heapFile);
+        for (int r = 0; r < scans; r++) {
+            bytes = 0;
+            t0 = now_ms();
+            HF_OpenFileScan(fd, &scan);
+            while (HF_GetNextRec(fd, &scan, &rid, &rec, &len) == HFE_OK)
+                bytes += len;
+            HF_CloseFileScan(&scan);
+            if (now_ms() - t0 < best)
+                best = now_ms() - t0;
+        }
+        t0 = now_ms();
+        for (int i = 0; i < reads; i++)
+            HF_GetRec(fd, probe[i], &rec, &len);
+        double getUs = (now_ms() - t0) * 1e3 / reads;
+        print_row("heap", file_kb(heapFile), openUs, best, bytes, getUs,
+                  PF_stats.physicalReads);
+
+        // 3. The snapshot
+        HF_Snapshot snap;
+        HF_SnapScan ss;
+        long snapBytes = 0;
+        PF_ResetStats();
+        t0 = now_ms();
+        for (int i = 0; i < opens; i++) {
+            if (HF_OpenSnapshot((char *)snapFile, &snap) != HFE_OK) {
+                PF_PrintError("HF_OpenSnapshot");
+                return 1;
+            }
+            HF_CloseSnapshot(&snap);
+        }
+        openUs = (now_ms() - t0) * 1e3 / opens;
+        HF_OpenSnapshot((char *)snapFile, &snap);
+        best = 1e30;
+        for (int r = 0; r < scans; r++) {
+            snapBytes = 0;
+            t0 = now_ms();
+            HF_SnapOpenScan(&ss);
+            while (HF_SnapGetNext(&snap, &ss, &rid, &rec, &len) == HFE_OK)
+                snapBytes += len;
+            if (now_ms() - t0 < best)
+                best = now_ms() - t0;
+        }
+        t0 = now_ms();
+        for (int i = 0; i < reads; i++)
+            HF_SnapGetRec(&snap, probe[i], &rec, &len);
+        getUs = (now_ms() - t0) * 1e3 / reads;
+        print_row("snap", file_kb(snapFile), openUs, best, snapBytes, getUs,
+                  PF_stats.physicalReads);
+
+        // 4. Every record must read the same from both
+        int wrong = 0;
+        for (int i = 0; i < n; i++) {
+            char *hrec, *srec;
+            int hlen, slen;
+            if (HF_GetRec(fd, rids[i], &hrec, &hlen) != HFE_OK ||
+                HF_SnapGetRec(&snap, rids[i], &srec, &slen) != HFE_OK || hlen != slen ||
+                memcmp(hrec, srec, hlen) != 0)
+                wrong++;
+        }
+        if (wrong || snapBytes != bytes) {
+            printf("WRONG: %d records differ, scanned %ld bytes against %ld\n", wrong,
+                   snapBytes, bytes);
+            status = 1;
+        }
+        printf("\n");
+        HF_CloseSnapshot(&snap);
+        HF_CloseFile(fd);
+        free(rids);
+        free(probe);
+        for (int i = 0; i < nlines; i++)
+            free(lines[i]);
+    }
+
+    PF_DestroyFile((char *)heapFile);
+    unlink(snapFile);
+    return status;
+}
@@ -3,16 +3,183 @@
 #include <string.h>
 #include <sys/stat.h>
 #include <math.h>
+#include "hf.h"
+#include "pftypes.h"
+#include "rowtok.h"
+#include "tuple.h"
+#include "benchutil.h"
 
-#define PF_PAGE_SIZE 1020      // same as in pf.h
+#define SLOT_BYTES   ((int)sizeof(HF_SlotEntry))    // one per record
+#define PAGE_HDR     ((int)sizeof(HF_PageHeader))
+#define SCAN_MS      200.0     // run each scan for at least this long
+#define DICT_RATIO   8         // dictionary: at most 1 value per 8 rows
 
-// Remove trailing newline / carriage return
-static void rstrip(char *s) {
-    size_t n = strlen(s);
-    while (n > 0 && (s[n-1] == '\n' || s[n-1] == '\r')) {
-        s[n-1] = '\0';
-        n--;
+// slotted pages needed to store records of the given lengths in order
+static long slotted_pages(const int *lens, long n) {
+    long pages = 0;
+    int freeBytes = 0;
+    for (long i = 0; i < n; i++) {
+        if (pages == 0 || lens[i] + SLOT_BYTES > freeBytes) {
+            pages++;
+            freeBytes = PF_PAGE_SIZE - PAGE_HDR;
+        }
+        freeBytes -= lens[i] + SLOT_BYTES;
+    }
+    return pages;
+}
+
+// HF_LAYOUT_FIXED pages needed for n records padded to recLen bytes
+static long fixed_pages(int recLen, long n) {
+    if (recLen < 1 || recLen > HF_FIXED_MAX_LEN)
+        return -1;
+    int perPage = HF_FixedPage_Capacity(recLen);
+    return (n + perPage - 1) / perPage;
+}
+
+// sum of every value of the rows that fit the schema, parsed from text
+static double scan_text(const TT_Schema *s, const char *data, long len, int allFields) {
+    double sum = 0;
+    RT_Row row;
+    for (long off = 0; off < len; ) {
+        const char *base = data + off;
+        off += RT_NextRow(base, len - off, ';', &row);
+        if (row.nfields != s->nfields)
+            continue;
+        int n = allFields ? s->nfields : 1;
+        for (int i = 0; i < n; i++) {
+            if (row.flen[i] == 0)
+                continue;
+            const char *p = base + row.start[i];
+            switch (s->type[i]) {
+            case TT_INT:   sum += strtol(p, NULL, 10); break;
+            case TT_FLOAT: sum += strtod(p, NULL); break;
+            default:       sum += row.flen[i]; break;
+            }
+        }
     }
+    return sum;
+}
+
+// the rows of the text that fit a schema, encoded back to back
+typedef struct {
+    char *buf;
+    long *offs;         // offset of each tuple in buf
+    int *lens;          // tuple lengths
+    int *rowLens;       // text lengths of the same rows
+    long n;
+    long long bytes;
+    long skipped;       // rows that do not fit the schema
+    long mismatched;    // rows that did not decode to the same text
+} TupleSet;
+
+static void free_tuples(TupleSet *ts) {
+    free(ts->buf);
+    free(ts->offs);
+    free(ts->lens);
+    free(ts->rowLens);
+}
+
+static int encode_all(const TT_Schema *s, const char *data, long dataLen,
+                      long numRows, int maxLen, TupleSet *ts) {
+    int hdr = s->bitmapSize + s->fixedSize + 2 * s->nvar;
+    char *decoded = malloc(maxLen + 1);
+    RT_Row row;
+
+    memset(ts, 0, sizeof(TupleSet));
+    ts->buf = malloc(numRows * (long long)hdr + dataLen + 1);
+    ts->offs = malloc(numRows * sizeof(long));
+    ts->lens = malloc(numRows * sizeof(int));
+    ts->rowLens = malloc(numRows * sizeof(int));
+    if (!decoded || !ts->buf || !ts->offs || !ts->lens || !ts->rowLens) {
+        free(decoded);
+        free_tuples(ts);
+        return -1;
+    }
+
+    for (long off = 0; off < dataLen; ) {
+        const char *base = data + off;
+        off += RT_NextRow(base, dataLen - off, ';', &row);
+        int n = TT_EncodeText(s, base, row.len, ts->buf + ts->bytes, hdr + row.len);
+        if (n < 0) {
+            ts->skipped++;      // e.g. the header line
+            continue;
+        }
+        // check the round trip while we are here
+        int dlen = TT_DecodeText(s, ts->buf + ts->bytes, decoded, maxLen);
+        if (dlen != row.len || memcmp(decoded, base, dlen) != 0)
+            ts->mismatched++;
+        ts->offs[ts->n] = ts->bytes;
+        ts->lens[ts->n] = n;
+        ts->rowLens[ts->n] = row.len;
+        ts->n++;
+        ts->bytes += n;
+    }
+    free(decoded);
+    return 0;
+}
+
+// the same sum, read from the encoded tuples
+static double scan_tuples(const TT_Schema *s, const TupleSet *ts, int allFields) {
+    double sum = 0;
+    int n = allFields ? s->nfields : 1;
+    for (long t = 0; t < ts->n; t++) {
+        const char *tup = ts->buf + ts->offs[t];
+        for (int i = 0; i < n; i++) {
+            int iv, len;
+            double fv;
+            const char *sv;
+            switch (s->type[i]) {
+            case TT_INT:
+                if (TT_GetInt(s, tup, i, &iv) == TT_OK) sum += iv;
+                break;
+            case TT_FLOAT:
+                if (TT_GetFloat(s, tup, i, &fv) == TT_OK) sum += fv;
+                break;
+            default:
+                if (TT_GetString(s, tup, i, &sv, &len) == TT_OK) sum += len;
+                break;
+            }
+        }
+    }
+    return sum;
+}
+
+// rows whose field f is the given value: text, string tuples, code tuples
+static long match_text(const TT_Schema *s, const char *data, long len, int f,
+                       const char *val, int vlen) {
+    long count = 0;
+    RT_Row row;
+    for (long off = 0; off < len; ) {
+        const char *base = data + off;
+        off += RT_NextRow(base, len - off, ';', &row);
+        if (row.nfields == s->nfields && row.flen[f] == vlen && vlen > 0 &&
+            memcmp(base + row.start[f], val, vlen) == 0)
+            count++;
+    }
+    return count;
+}
+
+static long match_tuples(const TT_Schema *s, const TupleSet *ts, int f,
+                         const char *val, int vlen) {
+    long count = 0;
+    for (long t = 0; t < ts->n; t++) {
+        const char *sv;
+        int len;
+        if (TT_GetString(s, ts->buf + ts->offs[t], f, &sv, &len) == TT_OK &&
+            len == vlen && memcmp(sv, val, vlen) == 0)
+            count++;
+    }
+    return count;
+}
+
+static long match_codes(const TT_Schema *s, const TupleSet *ts, int f, int code) {
+    long count = 0;
+    for (long t = 0; t < ts->n; t++) {
+        int c;
+        if (TT_GetCode(s, ts->buf + ts->offs[t], f, &c) == TT_OK && c == code)
+            count++;
+    }
+    return count;
 }
 
 int main(int argc, char *argv[]) {
@@ -34,23 +201,28 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
-    char *line = NULL;
-    size_t bufsize = 0;
-    ssize_t len;
+    // read the whole file; the row tokenizer finds the line ends
+    fseek(fp, 0, SEEK_END);
+    long dataLen = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char *data = malloc(dataLen > 0 ? dataLen : 1);
+    if (!data || (long)fread(data, 1, dataLen, fp) != dataLen) {
+        perror("read student.txt");
+        return 1;
+    }
+    fclose(fp);
 
     long long numRecords = 0;
     long long totalBytes = 0;      // sum of lengths WITHOUT newline
     int maxLen = 0;
 
-    while ((len = getline(&line, &bufsize, fp)) != -1) {
-        rstrip(line);
-        int L = (int)strlen(line);
+    RT_Row row;
+    for (long off = 0; off < dataLen; ) {
+        off += RT_NextRow(data + off, dataLen - off, ';', &row);
         numRecords++;
-        totalBytes += L;
-        if (L > maxLen) maxLen = L;
+        totalBytes += row.len;
+        if (row.len > maxLen) maxLen = row.len;
     }
-    free(line);
-    fclose(fp);
 
     if (numRecords == 0) {
         fprintf(stderr, "student.txt seems to be empty.\n");
@@ -73,20 +245,20 @@ int main(int argc, char *argv[]) {
     }
 
     long long hfBytes = st.st_size;
-    double hfPages   = (double)hfBytes / (double)PF_PAGE_SIZE;
+    long hfPages     = (long)(hfBytes / (long long)sizeof(PFfpage));
 
     double utilSlotted = (double)totalBytes / (double)hfBytes;
 
     printf("=== Slotted-page file (%s) ===\n", student_hf);
     printf("File size on disk        : %lld bytes\n", hfBytes);
-    printf("Approx. number of PF pages: %.2f (page size = %d bytes)\n",
+    printf("Number of PF pages       : %ld (page size = %d bytes)\n",
            hfPages, PF_PAGE_SIZE);
     printf("Space utilisation (slotted) = total_data / file_size = %.4f (%.2f%%)\n\n",
            utilSlotted, utilSlotted * 100.0);
 
     // ------------ 3. Static-record variants for given record sizes -------------
     printf("=== Static record layouts (for comparison) ===\n");
-    printf("Assuming file size = numRecords * recSize (simple fixed-length packing)\n\n");
+    printf("Each record padded to recSize bytes on fixed-length pages (HF_LAYOUT_FIXED)\n\n");
 
     for (int i = 3; i < argc; i++) {
         int recSize = atoi(argv[i]);
@@ -95,16 +267,144 @@ int main(int argc, char *argv[]) {
             continue;
         }
 
-        long long staticBytes = numRecords * (long long)recSize;
-        double staticPages = ceil((double)staticBytes / (double)PF_PAGE_SIZE);
+        long staticPages = fixed_pages(recSize, numRecords);
+        if (staticPages < 0) {
+            printf("[recSize=%d] Skipping (more than a page)\n", recSize);
+            continue;
+        }
+        long long staticBytes = staticPages * (long long)sizeof(PFfpage);
         double utilStatic = (double)totalBytes / (double)staticBytes;
 
-        printf("--- recSize = %d bytes ---\n", recSize);
+        printf("--- recSize = %d bytes (%d per page) ---\n", recSize,
+               HF_FixedPage_Capacity(recSize));
         printf("Static file size         : %lld bytes\n", staticBytes);
-        printf("Approx. PF pages         : %.0f\n", staticPages);
+        printf("PF pages                 : %ld\n", staticPages);
         printf("Space utilisation (static) = total_data / file_size = %.4f (%.2f%%)\n\n",
                utilStatic, utilStatic * 100.0);
     }
 
+    // ------------ 4. Binary tuples with a schema (tuple.c) ---------------------
+    TT_Schema schema, dschema;
+    TT_Dict dict;
+    TupleSet plain, coded;
+    char spec[TT_MAX_FIELDS * 4];
+    if (TT_InferSchema(&schema, data, dataLen) != TT_OK) {
+        fprintf(stderr, "could not infer a schema from %s\n", student_txt);
+        return 1;
+    }
+    // dictionary for string fields with at most one value per DICT_RATIO rows
+    dschema = schema;
+    int ncoded = TT_DictBuild(&dschema, &dict, data, dataLen,
+                              (int)(numRecords / DICT_RATIO));
+    if (ncoded < 0 ||
+        encode_all(&schema, data, dataLen, numRecords, maxLen, &plain) != 0 ||
+        encode_all(&dschema, data, dataLen, numRecords, maxLen, &coded) != 0) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    long long textBytes = 0, dictBytes = 0;
+    long dictValues = 0;
+    for (long t = 0; t < plain.n; t++)
+        textBytes += plain.rowLens[t];
+    for (int i = 0; i < dschema.nfields; i++) {
+        // values plus a 2-byte length each
+        dictBytes += dict.field[i].dataLen + 2LL * dict.field[i].ncodes;
+        dictValues += dict.field[i].ncodes;
+    }
+    long ntuples = plain.n;
+
+    printf("=== Binary tuples (tuple.c) ===\n");
+    TT_SchemaSpec(&schema, spec, sizeof(spec));
+    printf("Inferred schema          : %s (%d fields, %d strings)\n",
+           spec, schema.nfields, schema.nvar);
+    TT_SchemaSpec(&dschema, spec, sizeof(spec));
+    printf("With dictionary          : %s (%d strings as codes, %ld values)\n",
+           spec, ncoded, dictValues);
+    printf("Rows encoded / skipped   : %ld / %ld (round-trip mismatches: %ld)\n",
+           ntuples, plain.skipped, plain.mismatched + coded.mismatched);
+    printf("%-25s: %10lld bytes (%6.2f per row) %6ld slotted pages\n", "Text",
+           textBytes, (double)textBytes / ntuples, slotted_pages(plain.rowLens, ntuples));
+    printf("%-25s: %10lld bytes (%6.2f per row) %6ld slotted pages\n", "Binary",
+           plain.bytes, (double)plain.bytes / ntuples, slotted_pages(plain.lens, ntuples));
+    printf("%-25s: %10lld bytes (%6.2f per row) %6ld slotted pages\n",
+           "Binary + dictionary", coded.bytes + dictBytes,
+           (double)(coded.bytes + dictBytes) / ntuples, slotted_pages(coded.lens, ntuples));
+    // the coded tuples padded to the longest, on fixed-length pages
+    int longest = 0;
+    for (long t = 0; t < ntuples; t++)
+        if (coded.lens[t] > longest)
+            longest = coded.lens[t];
+    long fpages = fixed_pages(longest, ntuples);
+    if (fpages >= 0)
+        printf("%-25s: %10lld bytes (%6.2f per row) %6ld fixed pages\n",
+               "Binary + dict., fixed", (long long)longest * ntuples + dictBytes,
+               (double)((long long)longest * ntuples + dictBytes) / ntuples, fpages);
+    printf("(slots are %d bytes; the dictionary takes %lld bytes)\n\n",
+           SLOT_BYTES, dictBytes);
+
+    // ------------ 5. Scan speed ----------------------------------------------
+    printf("=== Scan speed, Mrows/s (each scan repeated for at least %.0f ms) ===\n",
+           SCAN_MS);
+    printf("%-24s %10s %10s %10s\n", "", "text", "binary", "dictionary");
+    for (int allFields = 1; allFields >= 0; allFields--) {
+        double t0, ms, sum[3] = { 0, 0, 0 }, rate[3];
+        int reps;
+
+        for (reps = 0, t0 = now_ms(); (ms = now_ms() - t0) < SCAN_MS; reps++)
+            sum[0] = scan_text(&schema, data, dataLen, allFields);
+        rate[0] = ntuples * (double)reps / ms / 1e3;
+        for (reps = 0, t0 = now_ms(); (ms = now_ms() - t0) < SCAN_MS; reps++)
+            sum[1] = scan_tuples(&schema, &plain, allFields);
+        rate[1] = ntuples * (double)reps / ms / 1e3;
+        for (reps = 0, t0 = now_ms(); (ms = now_ms() - t0) < SCAN_MS; reps++)
+            sum[2] = scan_tuples(&dschema, &coded, allFields);
+        rate[2] = ntuples * (double)reps / ms / 1e3;
+
+        printf("%-24s %10.2f %10.2f %10.2f%s\n",
+               allFields ? "all fields" : "field 0", rate[0], rate[1], rate[2],
+               sum[0] == sum[1] && sum[0] == sum[2] ? "" : "  SUM MISMATCH");
+    }
+
+    // predicate "field = value" on the first dictionary field, with the
+    // value of the first row: strings compared as bytes, or codes as ints
+    int pf = -1;
+    for (int i = 0; i < dschema.nfields && pf < 0; i++)
+        if (dschema.type[i] == TT_CODE)
+            pf = i;
+    if (pf >= 0 && ntuples > 0) {
+        const char *val;
+        int vlen;
+        long count[3] = { 0, 0, 0 };
+        double t0, ms, rate[3];
+        int reps;
+        char label[64];
+
+        if (TT_GetString(&dschema, coded.buf, pf, &val, &vlen) != TT_OK) {
+            val = "";
+            vlen = 0;
+        }
+        int code = TT_DictLookup(&dict, pf, val, vlen);
+
+        for (reps = 0, t0 = now_ms(); (ms = now_ms() - t0) < SCAN_MS; reps++)
+            count[0] = match_text(&schema, data, dataLen, pf, val, vlen);
+        rate[0] = ntuples * (double)reps / ms / 1e3;
+        for (reps = 0, t0 = now_ms(); (ms = now_ms() - t0) < SCAN_MS; reps++)
+            count[1] = match_tuples(&schema, &plain, pf, val, vlen);
+        rate[1] = ntuples * (double)reps / ms / 1e3;
+        for (reps = 0, t0 = now_ms(); (ms = now_ms() - t0) < SCAN_MS; reps++)
+            count[2] = match_codes(&dschema, &coded, pf, code);
+        rate[2] = ntuples * (double)reps / ms / 1e3;
+
+        snprintf(label, sizeof(label), "field %d = \"%.*s\"", pf, vlen > 10 ? 10 : vlen, val);
+        printf("%-24s %10.2f %10.2f %10.2f   (%ld rows%s)\n", label,
+               rate[0], rate[1], rate[2], count[0],
+               count[0] == count[1] && count[0] == count[2] ? "" : ", COUNT MISMATCH");
+    }
+
+    free_tuples(&plain);
+    free_tuples(&coded);
+    TT_DictFree(&dict);
+    free(data);
     return 0;
 }
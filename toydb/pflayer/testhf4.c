@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pf.h"
+#include "hf.h"
+
+#define TEST_FILE_HF "testhf4.data"
+#define NUM_RECORDS 2000 // Enough short records to fill a few pages
+
+// The record of row i: short (under sizeof(RID) bytes) or grown
+static int makeRecord(char *record, int i, int grown) {
+    if (grown) {
+        return sprintf(record, "Record %d grew well past its slot.", i);
+    }
+    return sprintf(record, "%d", i % 1000);
+}
+
+// Checks every record through its RID; returns the number that are wrong
+static int checkRecords(int fd, RID *rids, int grown) {
+    char record[100];
+    char *recordData;
+    int recordLen;
+    int wrong = 0;
+
+    for (int i = 0; i < NUM_RECORDS; i++) {
+        int len = makeRecord(record, i, grown);
+        if (HF_GetRec(fd, rids[i], &recordData, &recordLen) != HFE_OK ||
+            recordLen != len || memcmp(recordData, record, len) != 0) {
+            wrong++;
+        }
+    }
+    return wrong;
+}
+
+// Scans the file; returns the number of records found
+static int countRecords(int fd) {
+    HF_Scan scan;
+    RID rid;
+    char *recordData;
+    int recordLen;
+    int found = 0;
+
+    if (HF_OpenFileScan(fd, &scan) != HFE_OK) {
+        PF_PrintError("HF_OpenFileScan");
+        exit(1);
+    }
+    while (HF_GetNextRec(fd, &scan, &rid, &recordData, &recordLen) == HFE_OK) {
+        found++;
+    }
+    HF_CloseFileScan(&scan);
+    return found;
+}
+
+int main() {
+    int fd;
+    int error;
+    char record[100];
+    RID *rids = malloc(sizeof(RID) * NUM_RECORDS);
+    int recordLen;
+    int i;
+    int failures = 0;
+
+    printf("Starting HF update forwarding test (testhf4)...\n\n");
+
+    // 1. Init PF layer
+    PF_Init();
+
+    // 2. Create and Open file
+    if ((error = HF_CreateFile(TEST_FILE_HF)) != HFE_OK) {
+        PF_PrintError("HF_CreateFile");
+        exit(1);
+    }
+    if ((fd = HF_OpenFile(TEST_FILE_HF)) < 0) {
+        PF_PrintError("HF_OpenFile");
+        exit(1);
+    }
+    printf("Created and opened file: %s (fd: %d)\n", TEST_FILE_HF, fd);
+
+    // 3. Insert short records, so the pages are full of them
+    printf("Inserting %d short records...\n", NUM_RECORDS);
+    for (i = 0; i < NUM_RECORDS; i++) {
+        recordLen = makeRecord(record, i, 0);
+        if ((error = HF_InsertRec(fd, record, recordLen, &rids[i])) != HFE_OK) {
+            printf("Error inserting record %d (code: %d)\n", i, error);
+            exit(1);
+        }
+    }
+    printf("Successfully inserted %d records.\n\n", NUM_RECORDS);
+
+    // 4. Grow every record: most no longer fit their page and are
+    //    forwarded, keeping their RIDs
+    printf("Growing every record...\n");
+    for (i = 0; i < NUM_RECORDS; i++) {
+        recordLen = makeRecord(record, i, 1);
+        if ((error = HF_UpdateRec(fd, rids[i], record, recordLen)) != HFE_OK) {
+            printf("  *** ERROR: updating record %d (code: %d) ***\n", i, error);
+            failures++;
+        }
+    }
+    int wrong = checkRecords(fd, rids, 1);
+    int found = countRecords(fd);
+    printf("Records wrong by RID: %d, found by the scan: %d\n\n", wrong, found);
+    failures += wrong + (found != NUM_RECORDS);
+
+    // 5. Close and reopen the file; the forwards are on the pages
+    printf("Reopening the file...\n");
+    if ((error = HF_CloseFile(fd)) != HFE_OK) {
+        PF_PrintError("HF_CloseFile");
+        exit(1);
+    }
+    if ((fd = HF_OpenFile(TEST_FILE_HF)) < 0) {
+        PF_PrintError("HF_OpenFile");
+        exit(1);
+    }
+    wrong = checkRecords(fd, rids, 1);
+    printf("Records wrong by RID: %d\n\n", wrong);
+    failures += wrong;
+
+    // 6. Shrink them back: a forwarded record that fits comes home
+    printf("Shrinking every record...\n");
+    for (i = 0; i < NUM_RECORDS; i++) {
+        recordLen = makeRecord(record, i, 0);
+        if ((error = HF_UpdateRec(fd, rids[i], record, recordLen)) != HFE_OK) {
+            printf("  *** ERROR: updating record %d (code: %d) ***\n", i, error);
+            failures++;
+        }
+    }
+    wrong = checkRecords(fd, rids, 0);
+    found = countRecords(fd);
+    printf("Records wrong by RID: %d, found by the scan: %d\n\n", wrong, found);
+    failures += wrong + (found != NUM_RECORDS);
+
+    // 7. Check the result
+    printf("--- Update Summary ---\n");
+    if (failures == 0) {
+        printf("SUCCESS! Every record kept its RID through the updates.\n\n");
+    } else {
+        printf("FAILURE! %d checks failed.\n\n", failures);
+    }
+
+    // 8. Clean up
+    if ((error = HF_CloseFile(fd)) != HFE_OK) {
+        PF_PrintError("HF_CloseFile");
+        exit(1);
+    }
+    if ((error = PF_DestroyFile(TEST_FILE_HF)) != PFE_OK) {
+        PF_PrintError("PF_DestroyFile");
+        exit(1);
+    }
+
+    printf("HF update forwarding test complete. Cleaned up files.\n");
+    free(rids);
+    return failures != 0;
+}
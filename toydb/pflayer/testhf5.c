@@ -0,0 +1,194 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pf.h"
+#include "hf.h"
+
+#define TEST_FILE_HF "testhf5.data"
+#define NUM_RECORDS 3000
+
+static RID *rids;           // Where each record is, as the callbacks say
+static int *alive;          // Records not deleted
+static int relocations;
+static int clashes;         // Moves onto a RID another record still had
+
+// The record of row i: a key, then some text
+static int makeRecord(char *record, int i) {
+    return sprintf(record, "%d;record %d of the vacuum test", (i * 7919) % NUM_RECORDS, i);
+}
+
+// HF_RelocFn: each move is applied as it comes
+static void relocate(void *ctx, RID oldRid, RID newRid) {
+    int moved = -1;
+    (void)ctx;
+
+    relocations++;
+    for (int i = 0; i < NUM_RECORDS; i++) {
+        if (!alive[i]) {
+            continue;
+        }
+        if (rids[i].pageNum == newRid.pageNum && rids[i].slotNum == newRid.slotNum) {
+            clashes++;
+        }
+        if (rids[i].pageNum == oldRid.pageNum && rids[i].slotNum == oldRid.slotNum) {
+            moved = i;
+        }
+    }
+    if (moved < 0) {
+        printf("  *** ERROR: no record at RID (Page %d, Slot %d) ***\n",
+               oldRid.pageNum, oldRid.slotNum);
+        clashes++;
+        return;
+    }
+    rids[moved] = newRid;
+}
+
+// Checks every live record through its RID and counts them with a
+// scan; returns the number of checks that failed
+static int checkRecords(int fd, const char *when) {
+    char record[100];
+    char *recordData;
+    int recordLen;
+    int wrong = 0, live = 0, found = 0;
+    HF_Scan scan;
+    RID rid;
+
+    for (int i = 0; i < NUM_RECORDS; i++) {
+        if (!alive[i]) {
+            continue;
+        }
+        live++;
+        int len = makeRecord(record, i);
+        if (HF_GetRec(fd, rids[i], &recordData, &recordLen) != HFE_OK ||
+            recordLen != len || memcmp(recordData, record, len) != 0) {
+            wrong++;
+        }
+    }
+    if (HF_OpenFileScan(fd, &scan) != HFE_OK) {
+        PF_PrintError("HF_OpenFileScan");
+        exit(1);
+    }
+    while (HF_GetNextRec(fd, &scan, &rid, &recordData, &recordLen) == HFE_OK) {
+        found++;
+    }
+    HF_CloseFileScan(&scan);
+    printf("%s: %d records wrong by RID, %d found by the scan (%d live)\n",
+           when, wrong, found, live);
+    return wrong + (found != live);
+}
+
+int main() {
+    int fd;
+    int error;
+    char record[100];
+    int recordLen;
+    int i;
+    int failures = 0;
+    HF_FileOptions opts;
+    HF_VacuumStats stats;
+
+    rids = malloc(sizeof(RID) * NUM_RECORDS);
+    alive = malloc(sizeof(int) * NUM_RECORDS);
+    printf("Starting HF vacuum and recluster test (testhf5)...\n\n");
+
+    // 1. Init PF layer
+    PF_Init();
+
+    // 2. Create and Open a file clustered on column 0
+    memset(&opts, 0, sizeof(opts));
+    opts.layout = HF_LAYOUT_SLOTTED;
+    opts.sep = ';';
+    opts.cluster = 1;
+    opts.clusterCol = 0;
+    opts.clusterFill = HF_CLUSTER_FILL;
+    if ((error = HF_CreateFileEx(TEST_FILE_HF, &opts)) != HFE_OK) {
+        printf("HF_CreateFileEx error %d\n", error);
+        exit(1);
+    }
+    if ((fd = HF_OpenFile(TEST_FILE_HF)) < 0) {
+        PF_PrintError("HF_OpenFile");
+        exit(1);
+    }
+    printf("Created and opened file: %s (fd: %d)\n", TEST_FILE_HF, fd);
+
+    // 3. Insert the records, keys out of order
+    printf("Inserting %d records...\n", NUM_RECORDS);
+    for (i = 0; i < NUM_RECORDS; i++) {
+        recordLen = makeRecord(record, i);
+        if ((error = HF_InsertRec(fd, record, recordLen, &rids[i])) != HFE_OK) {
+            printf("Error inserting record %d (code: %d)\n", i, error);
+            exit(1);
+        }
+        alive[i] = 1;
+    }
+    printf("Successfully inserted %d records.\n\n", NUM_RECORDS);
+
+    // 4. Recluster; records move onto RIDs others had
+    memset(&stats, 0, sizeof(stats));
+    if ((error = HF_Recluster(fd, relocate, NULL, &stats)) != HFE_OK) {
+        printf("HF_Recluster error %d\n", error);
+        exit(1);
+    }
+    printf("Recluster: %d records moved, %d relocations reported\n",
+           stats.recordsMoved, relocations);
+    failures += checkRecords(fd, "After the recluster");
+
+    // 5. Delete two records in three, so most pages are sparse
+    for (i = 0; i < NUM_RECORDS; i++) {
+        if (i % 3 != 0) {
+            if ((error = HF_DeleteRec(fd, rids[i])) != HFE_OK) {
+                printf("Error deleting record %d (code: %d)\n", i, error);
+                exit(1);
+            }
+            alive[i] = 0;
+        }
+    }
+    printf("Deleted two records in three.\n");
+
+    // 6. Vacuum; the callback follows the records that move
+    relocations = 0;
+    memset(&stats, 0, sizeof(stats));
+    if ((error = HF_Vacuum(fd, HF_VACUUM_SPARSE, relocate, NULL, &stats)) != HFE_OK) {
+        printf("HF_Vacuum error %d\n", error);
+        exit(1);
+    }
+    printf("Vacuum: %d records moved, %d pages freed, %d relocations reported\n",
+           stats.recordsMoved, stats.pagesFreed, relocations);
+    failures += checkRecords(fd, "After the vacuum");
+
+    // 7. Close and reopen the file
+    if ((error = HF_CloseFile(fd)) != HFE_OK) {
+        PF_PrintError("HF_CloseFile");
+        exit(1);
+    }
+    if ((fd = HF_OpenFile(TEST_FILE_HF)) < 0) {
+        PF_PrintError("HF_OpenFile");
+        exit(1);
+    }
+    failures += checkRecords(fd, "After reopening");
+    printf("\n");
+
+    // 8. Check the result
+    printf("--- Vacuum Summary ---\n");
+    failures += clashes;
+    if (failures == 0) {
+        printf("SUCCESS! The callbacks kept track of every record.\n\n");
+    } else {
+        printf("FAILURE! %d checks failed (%d bad relocations).\n\n", failures, clashes);
+    }
+
+    // 9. Clean up
+    if ((error = HF_CloseFile(fd)) != HFE_OK) {
+        PF_PrintError("HF_CloseFile");
+        exit(1);
+    }
+    if ((error = PF_DestroyFile(TEST_FILE_HF)) != PFE_OK) {
+        PF_PrintError("PF_DestroyFile");
+        exit(1);
+    }
+
+    printf("HF vacuum and recluster test complete. Cleaned up files.\n");
+    free(rids);
+    free(alive);
+    return failures != 0;
+}
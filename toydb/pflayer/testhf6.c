@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "pf.h"
+#include "hf.h"
+
+#define TEST_FILE_HF "testhf6.data"
+#define TEST_FILE_SNAP "testhf6.snap"
+#define NUM_RECORDS 1000
+
+int main() {
+    int fd;
+    int error;
+    char record[100];
+    RID rid;
+    RID *rids = malloc(sizeof(RID) * NUM_RECORDS);
+    char *recordData;
+    int recordLen;
+    int i;
+    int failures = 0;
+
+    printf("Starting HF snapshot test (testhf6)...\n\n");
+
+    // 1. Init PF layer
+    PF_Init();
+
+    // 2. Create and Open file
+    if ((error = HF_CreateFile(TEST_FILE_HF)) != HFE_OK) {
+        PF_PrintError("HF_CreateFile");
+        exit(1);
+    }
+    if ((fd = HF_OpenFile(TEST_FILE_HF)) < 0) {
+        PF_PrintError("HF_OpenFile");
+        exit(1);
+    }
+    printf("Created and opened file: %s (fd: %d)\n", TEST_FILE_HF, fd);
+
+    // 3. Insert records, and delete every fifth
+    printf("Inserting %d records...\n", NUM_RECORDS);
+    for (i = 0; i < NUM_RECORDS; i++) {
+        sprintf(record, "This is record number %d.", i);
+        if ((error = HF_InsertRec(fd, record, strlen(record), &rids[i])) != HFE_OK) {
+            printf("Error inserting record %d (code: %d)\n", i, error);
+            exit(1);
+        }
+    }
+    for (i = 0; i < NUM_RECORDS; i += 5) {
+        HF_DeleteRec(fd, rids[i]);
+    }
+    printf("Inserted %d records and deleted every fifth.\n\n", NUM_RECORDS);
+
+    // 4. Write the snapshot, and open it
+    if ((error = HF_WriteSnapshot(fd, TEST_FILE_SNAP)) != HFE_OK) {
+        printf("HF_WriteSnapshot error %d\n", error);
+        exit(1);
+    }
+    HF_Snapshot snap;
+    if ((error = HF_OpenSnapshot(TEST_FILE_SNAP, &snap)) != HFE_OK) {
+        printf("HF_OpenSnapshot error %d\n", error);
+        exit(1);
+    }
+    printf("Opened snapshot %s: %d records\n", TEST_FILE_SNAP, snap.numRecs);
+
+    // 5. Every record reads back by its RID, as in the heap file
+    for (i = 0; i < NUM_RECORDS; i++) {
+        sprintf(record, "This is record number %d.", i);
+        error = HF_SnapGetRec(&snap, rids[i], &recordData, &recordLen);
+        if (i % 5 == 0) {
+            if (error != HFE_INVALIDSLOT) {
+                printf("  *** ERROR: found deleted record %d ***\n", i);
+                failures++;
+            }
+        } else if (error != HFE_OK || recordLen != (int)strlen(record) ||
+                   memcmp(recordData, record, recordLen) != 0) {
+            printf("  *** ERROR: record %d is wrong ***\n", i);
+            failures++;
+        }
+    }
+
+    // 6. A scan finds the live records once each, in RID order
+    HF_SnapScan scan;
+    RID last = { -1, -1 };
+    int recordsFound = 0;
+    HF_SnapOpenScan(&scan);
+    while (HF_SnapGetNext(&snap, &scan, &rid, &recordData, &recordLen) == HFE_OK) {
+        if (rid.pageNum < last.pageNum ||
+            (rid.pageNum == last.pageNum && rid.slotNum <= last.slotNum)) {
+            printf("  *** ERROR: scan out of RID order ***\n");
+            failures++;
+        }
+        last = rid;
+        recordsFound++;
+    }
+    printf("Snapshot scan found %d records\n", recordsFound);
+    if (recordsFound != snap.numRecs || recordsFound != NUM_RECORDS - NUM_RECORDS / 5) {
+        failures++;
+    }
+    long size = snap.size;
+    HF_CloseSnapshot(&snap);
+
+    // 7. A snapshot cut short is refused at open
+    if (truncate(TEST_FILE_SNAP, size / 2) != 0) {
+        perror("truncate");
+        exit(1);
+    }
+    if ((error = HF_OpenSnapshot(TEST_FILE_SNAP, &snap)) == HFE_OK) {
+        printf("  *** ERROR: opened a truncated snapshot ***\n");
+        HF_CloseSnapshot(&snap);
+        failures++;
+    } else {
+        printf("Truncated snapshot refused (code: %d)\n\n", error);
+    }
+
+    // 8. Check the result
+    printf("--- Snapshot Summary ---\n");
+    if (failures == 0) {
+        printf("SUCCESS! The snapshot matches the heap file.\n\n");
+    } else {
+        printf("FAILURE! %d checks failed.\n\n", failures);
+    }
+
+    // 9. Clean up
+    if ((error = HF_CloseFile(fd)) != HFE_OK) {
+        PF_PrintError("HF_CloseFile");
+        exit(1);
+    }
+    if ((error = PF_DestroyFile(TEST_FILE_HF)) != PFE_OK) {
+        PF_PrintError("PF_DestroyFile");
+        exit(1);
+    }
+    unlink(TEST_FILE_SNAP);
+
+    printf("HF snapshot test complete. Cleaned up files.\n");
+    free(rids);
+    return failures != 0;
+}
@@ -2,11 +2,14 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include "pftypes.h"
 #include "pf.h"
 
 #define FILE1   "file1"
 #define FILE2   "file2"
+#define FILE3   "file3"
+#define SEGPAGES 4	/* pages per segment of FILE3 */
 
 /* PF-layer functions we call from pf.c */
 int PF_CreateFile(char *fname);
@@ -23,6 +26,7 @@ int PF_GetNextPage(int fd, int *pagenum, char **pagebuf);
 void writefile(char *fname);
 void readfile(char *fname);
 void printfile(int fd);
+void tablespacefile(char *fname);
 
 int main(void)
 {
@@ -30,7 +34,6 @@ int error;
 int i;
 int pagenum;
 char *buf;
-int *buf1,*buf2;
 int fd1,fd2;
 
     PF_ResetStats(); 
@@ -306,6 +309,9 @@ int fd1,fd2;
 		exit(1);
 	}
 
+	/* the same through a tablespace */
+	tablespacefile(FILE3);
+
 	/* print the buffer */
 	printf("buffer:\n");
 	/* PFbufPrint(); */
@@ -380,8 +386,6 @@ void readfile(fname)
 char *fname;
 {
 int error;
-int *buf;
-int pagenum;
 int fd;
 
 	printf("opening %s\n",fname);
@@ -419,3 +423,72 @@ int pagenum;
 	printf("eof reached\n");
 
 }
+
+/**************************************************************
+Create fname as a tablespace of SEGPAGES-page segments, fill
+it like writefile() does, check that every page reads back
+with its number and that the pages past the first segment
+went to segment files, then destroy it.
+*************************************************************/
+void tablespacefile(fname)
+char *fname;
+{
+int error;
+char *buf;
+char segname[64];
+int pagenum;
+int npages;
+int fd;
+
+	if ((error=PF_CreateTablespace(fname,SEGPAGES,NULL,0))!= PFE_OK){
+		PF_PrintError("create tablespace");
+		exit(1);
+	}
+	printf("%s created, %d pages per segment\n",fname,SEGPAGES);
+
+	writefile(fname);
+
+	if ((fd=PF_OpenFile(fname))<0){
+		PF_PrintError("open tablespace");
+		exit(1);
+	}
+	npages = 0;
+	pagenum = -1;
+	while ((error=PF_GetNextPage(fd,&pagenum,&buf))== PFE_OK){
+		if (*((int *)buf) != pagenum){
+			printf("page %d of %s holds %d\n",pagenum,fname,*((int *)buf));
+			exit(1);
+		}
+		npages++;
+		if ((error=PF_UnfixPage(fd,pagenum,FALSE))!= PFE_OK){
+			PF_PrintError("unfix");
+			exit(1);
+		}
+	}
+	if (error != PFE_EOF || npages != PF_MAX_BUFS){
+		printf("read %d pages of %s, wrote %d\n",npages,fname,PF_MAX_BUFS);
+		exit(1);
+	}
+	if ((error=PF_CloseFile(fd))!= PFE_OK){
+		PF_PrintError("close tablespace");
+		exit(1);
+	}
+	printf("read back %d pages of %s\n",npages,fname);
+
+	/* the last page is in segment (PF_MAX_BUFS-1)/SEGPAGES */
+	sprintf(segname,"%s.%d",fname,(PF_MAX_BUFS-1)/SEGPAGES);
+	if (PF_MAX_BUFS > SEGPAGES && access(segname,F_OK) != 0){
+		printf("segment %s is missing\n",segname);
+		exit(1);
+	}
+
+	if ((error=PF_DestroyFile(fname))!= PFE_OK){
+		PF_PrintError("destroy tablespace");
+		exit(1);
+	}
+	if (access(segname,F_OK) == 0 || access(fname,F_OK) == 0){
+		printf("%s is still there after destroy\n",fname);
+		exit(1);
+	}
+	printf("%s destroyed\n",fname);
+}
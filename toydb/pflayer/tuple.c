@@ -0,0 +1,734 @@
+#include "tuple.h"
+#include "rowtok.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+/*
+ * Helpers to find the parts of a tuple.
+ */
+static int TT_VarTableOff(const TT_Schema *s) {
+    return s->bitmapSize + s->fixedSize;
+}
+
+static int TT_VarDataOff(const TT_Schema *s) {
+    return s->bitmapSize + s->fixedSize + s->nvar * (int)sizeof(uint16_t);
+}
+
+static int TT_VarEnd(const TT_Schema *s, const char *tuple, int k) {
+    uint16_t end;
+    memcpy(&end, tuple + TT_VarTableOff(s) + k * sizeof(uint16_t), sizeof(end));
+    return end;
+}
+
+/*
+ * Parses a 32-bit integer from exactly n bytes of text.
+ * Returns 0, or -1 if the text is not a plain integer.
+ */
+static int TT_ParseInt(const char *p, int n, int *value) {
+    long long v = 0;
+    int neg = 0;
+    int i = 0;
+
+    if (n > 0 && p[0] == '-') {
+        neg = 1;
+        i = 1;
+    }
+    if (i == n || n - i > 10) {
+        return -1;
+    }
+    for (; i < n; i++) {
+        if (p[i] < '0' || p[i] > '9') {
+            return -1;
+        }
+        v = v * 10 + (p[i] - '0');
+    }
+    if (neg) {
+        v = -v;
+    }
+    if (v < INT32_MIN || v > INT32_MAX) {
+        return -1;
+    }
+    *value = (int)v;
+    return 0;
+}
+
+/*
+ * Parses a decimal number with at most scale decimals from exactly n
+ * bytes of text, as the integer value * 10^scale.
+ * Returns 0, or -1 if the text is not such a number or does not fit.
+ */
+static int TT_ParseScaled(const char *p, int n, int scale, int *value) {
+    long long v = 0;
+    int neg = 0;
+    int digits = 0;
+    int decimals = -1;  // -1 until the '.'
+    int i = 0;
+
+    if (n > 0 && p[0] == '-') {
+        neg = 1;
+        i = 1;
+    }
+    for (; i < n; i++) {
+        if (p[i] == '.' && decimals < 0) {
+            decimals = 0;
+            continue;
+        }
+        if (p[i] < '0' || p[i] > '9' || ++digits > 18) {
+            return -1;
+        }
+        if (decimals >= 0 && ++decimals > scale) {
+            return -1;
+        }
+        v = v * 10 + (p[i] - '0');
+    }
+    if (digits == 0) {
+        return -1;
+    }
+    for (decimals = decimals < 0 ? 0 : decimals; decimals < scale; decimals++) {
+        v *= 10;
+    }
+    if (neg) {
+        v = -v;
+    }
+    if (v < INT32_MIN || v > INT32_MAX) {
+        return -1;
+    }
+    *value = (int)v;
+    return 0;
+}
+
+static double TT_Pow10(int scale) {
+    double f = 1;
+    while (scale-- > 0) {
+        f *= 10;
+    }
+    return f;
+}
+
+/*
+ * Dictionary of one field: a growable array of values plus an open
+ * addressing hash table from value to code.
+ */
+static unsigned TT_Hash(const char *p, int n) {
+    unsigned h = 2166136261u;   // FNV-1a
+    for (int i = 0; i < n; i++) {
+        h = (h ^ (unsigned char)p[i]) * 16777619u;
+    }
+    return h;
+}
+
+static void TT_FieldDictFree(TT_FieldDict *d) {
+    free(d->off);
+    free(d->len);
+    free(d->data);
+    free(d->hash);
+    memset(d, 0, sizeof(TT_FieldDict));
+}
+
+// slot of the value in d->hash: its entry, or the empty entry to use
+static int TT_FieldDictSlot(const TT_FieldDict *d, const char *p, int n) {
+    int mask = d->hashSize - 1;
+    int h = (int)(TT_Hash(p, n) & mask);
+
+    while (d->hash[h] != 0) {
+        int c = d->hash[h] - 1;
+        if (d->len[c] == n && memcmp(d->data + d->off[c], p, n) == 0) {
+            break;
+        }
+        h = (h + 1) & mask;
+    }
+    return h;
+}
+
+static int TT_FieldDictFind(const TT_FieldDict *d, const char *p, int n) {
+    if (d->hashSize == 0) {
+        return -1;
+    }
+    return d->hash[TT_FieldDictSlot(d, p, n)] - 1;
+}
+
+/*
+ * Returns the code of the value, adding it if it is new and fewer
+ * than maxCodes values are there. Returns -1 if it is new and there is
+ * no room, or -2 if out of memory.
+ */
+static int TT_FieldDictAdd(TT_FieldDict *d, const char *p, int n, int maxCodes) {
+    int code = TT_FieldDictFind(d, p, n);
+
+    if (code >= 0) {
+        return code;
+    }
+    if (d->ncodes >= maxCodes) {
+        return -1;
+    }
+
+    // 1. Keep the hash table at most half full
+    if (2 * (d->ncodes + 1) > d->hashSize) {
+        int oldSize = d->hashSize;
+        int *old = d->hash;
+        d->hashSize = oldSize ? 2 * oldSize : 64;
+        d->hash = calloc(d->hashSize, sizeof(int));
+        if (d->hash == NULL) {
+            d->hash = old;
+            d->hashSize = oldSize;
+            return -2;
+        }
+        for (int c = 0; c < d->ncodes; c++) {
+            d->hash[TT_FieldDictSlot(d, d->data + d->off[c], d->len[c])] = c + 1;
+        }
+        free(old);
+    }
+
+    // 2. Room for the value
+    if (d->ncodes == d->codeCap) {
+        int cap = d->codeCap ? 2 * d->codeCap : 32;
+        int *off = realloc(d->off, cap * sizeof(int));
+        if (off == NULL) return -2;
+        d->off = off;
+        int *len = realloc(d->len, cap * sizeof(int));
+        if (len == NULL) return -2;
+        d->len = len;
+        d->codeCap = cap;
+    }
+    if (d->dataLen + n > d->dataCap) {
+        int cap = d->dataCap ? d->dataCap : 256;
+        while (d->dataLen + n > cap) {
+            cap *= 2;
+        }
+        char *data = realloc(d->data, cap);
+        if (data == NULL) return -2;
+        d->data = data;
+        d->dataCap = cap;
+    }
+
+    // 3. Add it
+    code = d->ncodes++;
+    memcpy(d->data + d->dataLen, p, n);
+    d->off[code] = d->dataLen;
+    d->len[code] = n;
+    d->dataLen += n;
+    d->hash[TT_FieldDictSlot(d, p, n)] = code + 1;
+    return code;
+}
+
+/*
+ * Fills in the derived layout of a schema whose types are set.
+ */
+static void TT_SchemaLayout(TT_Schema *s) {
+    s->bitmapSize = (s->nfields + 7) / 8;
+    s->fixedSize = 0;
+    s->nvar = 0;
+    for (int i = 0; i < s->nfields; i++) {
+        switch (s->type[i]) {
+        case TT_INT:
+        case TT_FLOAT:
+            s->width[i] = 4;
+            // fall through
+        case TT_CODE:
+            s->pos[i] = s->fixedSize;
+            s->fixedSize += s->width[i];
+            break;
+        default:
+            s->width[i] = 0;
+            s->pos[i] = s->nvar++;
+            break;
+        }
+    }
+}
+
+int TT_SchemaInit(TT_Schema *schema, const char *spec) {
+    memset(schema, 0, sizeof(TT_Schema));
+    for (const char *p = spec; *p; p++) {
+        if (schema->nfields == TT_MAX_FIELDS) {
+            return TT_EBADSPEC;
+        }
+        int i = schema->nfields;
+        switch (*p) {
+        case 'i':
+            schema->type[i] = TT_INT;
+            break;
+        case 's':
+            schema->type[i] = TT_STRING;
+            break;
+        case 'f':
+            schema->type[i] = TT_FLOAT;
+            while (p[1] >= '0' && p[1] <= '9') {
+                schema->scale[i] = schema->scale[i] * 10 + (*++p - '0');
+            }
+            break;
+        default:
+            return TT_EBADSPEC;
+        }
+        schema->nfields++;
+    }
+    if (schema->nfields == 0) {
+        return TT_EBADSPEC;
+    }
+    TT_SchemaLayout(schema);
+    return TT_OK;
+}
+
+void TT_SchemaSpec(const TT_Schema *schema, char *spec, size_t cap) {
+    size_t n = 0;
+
+    for (int i = 0; i < schema->nfields && n + 4 < cap; i++) {
+        switch (schema->type[i]) {
+        case TT_INT:   spec[n++] = 'i'; break;
+        case TT_FLOAT: n += snprintf(spec + n, cap - n, "f%d", schema->scale[i]); break;
+        case TT_CODE:  spec[n++] = 'd'; break;
+        default:       spec[n++] = 's'; break;
+        }
+    }
+    if (cap > 0) {
+        spec[n < cap ? n : cap - 1] = '\0';
+    }
+}
+
+int TT_InferSchema(TT_Schema *schema, const char *buf, size_t len) {
+    int count[TT_MAX_FIELDS + 1] = { 0 };
+    int canInt[TT_MAX_FIELDS];
+    int canFloat[TT_MAX_FIELDS];
+    int seen[TT_MAX_FIELDS];
+    RT_Row row;
+    size_t off;
+    char text[64];
+
+    // 1. The field count most rows have
+    for (off = 0; off < len; ) {
+        off += RT_NextRow(buf + off, len - off, ';', &row);
+        count[row.nfields]++;
+    }
+    memset(schema, 0, sizeof(TT_Schema));
+    for (int n = 1; n <= TT_MAX_FIELDS; n++) {
+        if (count[n] > count[schema->nfields]) {
+            schema->nfields = n;
+        }
+    }
+    if (schema->nfields == 0) {
+        return TT_EBADSPEC;
+    }
+
+    // 2. Check which types every value of each field fits
+    for (int i = 0; i < schema->nfields; i++) {
+        canInt[i] = canFloat[i] = 1;
+        seen[i] = 0;
+        schema->scale[i] = -1;
+    }
+    for (off = 0; off < len; ) {
+        const char *base = buf + off;
+        off += RT_NextRow(buf + off, len - off, ';', &row);
+        if (row.nfields != schema->nfields) {
+            continue;
+        }
+        for (int i = 0; i < row.nfields; i++) {
+            const char *p = base + row.start[i];
+            int n = row.flen[i];
+            int iv;
+
+            if (n == 0) {
+                continue;   // NULL fits any type
+            }
+            seen[i] = 1;
+            if (canInt[i] && (TT_ParseInt(p, n, &iv) != 0 ||
+                snprintf(text, sizeof(text), "%d", iv) != n ||
+                memcmp(text, p, n) != 0)) {
+                canInt[i] = 0;
+            }
+            if (canFloat[i]) {
+                const char *dot = memchr(p, '.', n);
+                int scale = dot ? (int)(p + n - dot - 1) : -1;
+                if (scale < 0 || (schema->scale[i] >= 0 && scale != schema->scale[i]) ||
+                    TT_ParseScaled(p, n, scale, &iv) != 0 ||
+                    snprintf(text, sizeof(text), "%.*f", scale, iv / TT_Pow10(scale)) != n ||
+                    memcmp(text, p, n) != 0) {
+                    canFloat[i] = 0;
+                } else {
+                    schema->scale[i] = scale;
+                }
+            }
+        }
+    }
+
+    // 3. Pick the narrowest type that fits
+    for (int i = 0; i < schema->nfields; i++) {
+        if (seen[i] && canInt[i]) {
+            schema->type[i] = TT_INT;
+            schema->scale[i] = 0;
+        } else if (seen[i] && canFloat[i]) {
+            schema->type[i] = TT_FLOAT;
+        } else {
+            schema->type[i] = TT_STRING;
+            schema->scale[i] = 0;
+        }
+    }
+    TT_SchemaLayout(schema);
+    return TT_OK;
+}
+
+int TT_EncodeText(const TT_Schema *schema, const char *row, int rowLen,
+                  char *out, int cap) {
+    RT_Row r;
+    int varData = TT_VarDataOff(schema);
+    int varLen = 0;
+
+    // 1. Split the row and check its shape
+    RT_NextRow(row, rowLen, ';', &r);
+    if (r.nfields != schema->nfields) {
+        return TT_EBADROW;
+    }
+    if (varData > cap) {
+        return TT_ENOSPACE;
+    }
+    memset(out, 0, schema->bitmapSize + schema->fixedSize);
+
+    // 2. Encode the fields one by one
+    for (int i = 0; i < schema->nfields; i++) {
+        const char *p = row + r.start[i];
+        int n = r.flen[i];
+        char *fixed = out + schema->bitmapSize + schema->pos[i];
+        int iv;
+
+        if (n == 0) {
+            out[i / 8] |= 1 << (i % 8);
+        }
+        switch (schema->type[i]) {
+        case TT_INT:
+            if (n > 0) {
+                if (TT_ParseInt(p, n, &iv) != 0) {
+                    return TT_EBADROW;
+                }
+                memcpy(fixed, &iv, sizeof(iv));
+            }
+            break;
+        case TT_FLOAT:
+            if (n > 0) {
+                if (TT_ParseScaled(p, n, schema->scale[i], &iv) != 0) {
+                    return TT_EBADROW;
+                }
+                memcpy(fixed, &iv, sizeof(iv));
+            }
+            break;
+        case TT_CODE:
+            if (n > 0) {
+                int code = TT_FieldDictAdd(&schema->dict->field[i], p, n,
+                                           1 << (8 * schema->width[i]));
+                if (code < 0) {
+                    return code == -1 ? TT_EBADROW : TT_ENOSPACE;
+                }
+                if (schema->width[i] == 1) {
+                    *fixed = (char)code;
+                } else {
+                    uint16_t c16 = (uint16_t)code;
+                    memcpy(fixed, &c16, sizeof(c16));
+                }
+            }
+            break;
+        default: {
+            uint16_t end;
+            if (varData + varLen + n > cap || varLen + n > UINT16_MAX) {
+                return TT_ENOSPACE;
+            }
+            memcpy(out + varData + varLen, p, n);
+            varLen += n;
+            end = (uint16_t)varLen;
+            memcpy(out + TT_VarTableOff(schema) + schema->pos[i] * sizeof(uint16_t),
+                   &end, sizeof(end));
+            break;
+        }
+        }
+    }
+    return varData + varLen;
+}
+
+int TT_DecodeText(const TT_Schema *schema, const char *tuple, char *out, int cap) {
+    char text[64];
+    int n = 0;
+
+    for (int i = 0; i < schema->nfields; i++) {
+        int iv = 0;
+        double fv = 0;
+        const char *sv;
+        int len = 0;
+
+        if (i > 0) {
+            if (n + 1 > cap) return TT_ENOSPACE;
+            out[n++] = ';';
+        }
+        if (TT_IsNull(schema, tuple, i)) {
+            continue;
+        }
+        switch (schema->type[i]) {
+        case TT_INT:
+            TT_GetInt(schema, tuple, i, &iv);
+            len = snprintf(text, sizeof(text), "%d", iv);
+            sv = text;
+            break;
+        case TT_FLOAT:
+            TT_GetFloat(schema, tuple, i, &fv);
+            len = snprintf(text, sizeof(text), "%.*f", schema->scale[i], fv);
+            sv = text;
+            break;
+        default:
+            TT_GetString(schema, tuple, i, &sv, &len);
+            break;
+        }
+        if (len < 0 || n + len > cap) {
+            return TT_ENOSPACE;
+        }
+        memcpy(out + n, sv, len);
+        n += len;
+    }
+    return n;
+}
+
+int TT_IsNull(const TT_Schema *schema, const char *tuple, int field) {
+    (void)schema;
+    return (tuple[field / 8] >> (field % 8)) & 1;
+}
+
+int TT_GetInt(const TT_Schema *schema, const char *tuple, int field, int *value) {
+    if (TT_IsNull(schema, tuple, field)) {
+        return TT_NULL;
+    }
+    memcpy(value, tuple + schema->bitmapSize + schema->pos[field], sizeof(int));
+    return TT_OK;
+}
+
+int TT_GetFloat(const TT_Schema *schema, const char *tuple, int field, double *value) {
+    int scaled;
+
+    if (TT_IsNull(schema, tuple, field)) {
+        return TT_NULL;
+    }
+    memcpy(&scaled, tuple + schema->bitmapSize + schema->pos[field], sizeof(int));
+    *value = scaled / TT_Pow10(schema->scale[field]);
+    return TT_OK;
+}
+
+int TT_GetCode(const TT_Schema *schema, const char *tuple, int field, int *code) {
+    if (TT_IsNull(schema, tuple, field)) {
+        return TT_NULL;
+    }
+    const char *p = tuple + schema->bitmapSize + schema->pos[field];
+    if (schema->width[field] == 1) {
+        *code = (unsigned char)*p;
+    } else {
+        uint16_t c16;
+        memcpy(&c16, p, sizeof(c16));
+        *code = c16;
+    }
+    return TT_OK;
+}
+
+int TT_GetString(const TT_Schema *schema, const char *tuple, int field,
+                 const char **value, int *len) {
+    int k = schema->pos[field];
+    int start;
+
+    if (TT_IsNull(schema, tuple, field)) {
+        *len = 0;
+        return TT_NULL;
+    }
+    if (schema->type[field] == TT_CODE) {
+        const TT_FieldDict *d = &schema->dict->field[field];
+        int code;
+        TT_GetCode(schema, tuple, field, &code);
+        *value = d->data + d->off[code];
+        *len = d->len[code];
+        return TT_OK;
+    }
+    start = k > 0 ? TT_VarEnd(schema, tuple, k - 1) : 0;
+    *value = tuple + TT_VarDataOff(schema) + start;
+    *len = TT_VarEnd(schema, tuple, k) - start;
+    return TT_OK;
+}
+
+int TT_DictBuild(TT_Schema *schema, TT_Dict *dict, const char *buf, size_t len,
+                 int maxCodes) {
+    int keep[TT_MAX_FIELDS];
+    int nkeep = 0;
+    RT_Row row;
+
+    if (maxCodes > TT_MAX_CODES) {
+        maxCodes = TT_MAX_CODES;
+    }
+    memset(dict, 0, sizeof(TT_Dict));
+    for (int i = 0; i < schema->nfields; i++) {
+        keep[i] = schema->type[i] == TT_STRING;
+    }
+
+    // 1. Collect the values of every string field, dropping a field
+    //    as soon as it has too many
+    for (size_t off = 0; off < len; ) {
+        const char *base = buf + off;
+        off += RT_NextRow(base, len - off, ';', &row);
+        if (row.nfields != schema->nfields) {
+            continue;
+        }
+        for (int i = 0; i < row.nfields; i++) {
+            if (!keep[i] || row.flen[i] == 0) {
+                continue;
+            }
+            int code = TT_FieldDictAdd(&dict->field[i], base + row.start[i],
+                                       row.flen[i], maxCodes);
+            if (code == -2) {
+                TT_DictFree(dict);
+                return TT_ENOSPACE;
+            }
+            if (code == -1) {
+                keep[i] = 0;
+                TT_FieldDictFree(&dict->field[i]);
+            }
+        }
+    }
+
+    // 2. Switch the fields that stayed small to codes
+    for (int i = 0; i < schema->nfields; i++) {
+        if (keep[i] && dict->field[i].ncodes > 0) {
+            schema->type[i] = TT_CODE;
+            schema->width[i] = dict->field[i].ncodes <= 256 ? 1 : 2;
+            nkeep++;
+        } else {
+            TT_FieldDictFree(&dict->field[i]);
+        }
+    }
+    schema->dict = dict;
+    TT_SchemaLayout(schema);
+    return nkeep;
+}
+
+void TT_DictFree(TT_Dict *dict) {
+    for (int i = 0; i < TT_MAX_FIELDS; i++) {
+        TT_FieldDictFree(&dict->field[i]);
+    }
+}
+
+int TT_DictLookup(const TT_Dict *dict, int field, const char *value, int len) {
+    return TT_FieldDictFind(&dict->field[field], value, len);
+}
+
+/*
+ * TT_DictSave writes ints in host byte order:
+ *   magic, nfields, then type, scale and width of each field, then
+ *   for each TT_CODE field: ncodes, the length of each value in code
+ *   order, and the value bytes back to back
+ */
+#define TT_DICT_MAGIC 0x54544431   /* "TTD1" */
+
+static void TT_PutInt(char **p, int v) {
+    memcpy(*p, &v, sizeof(int));
+    *p += sizeof(int);
+}
+
+// 0 if fewer than an int's bytes are left before end
+static int TT_TakeInt(const char **p, const char *end, int *v) {
+    if (end - *p < (long)sizeof(int)) {
+        return 0;
+    }
+    memcpy(v, *p, sizeof(int));
+    *p += sizeof(int);
+    return 1;
+}
+
+int TT_DictSave(const TT_Schema *schema, char **data, int *len) {
+    int n = (2 + 3 * schema->nfields) * (int)sizeof(int);
+
+    for (int i = 0; i < schema->nfields; i++) {
+        if (schema->type[i] == TT_CODE) {
+            const TT_FieldDict *d = &schema->dict->field[i];
+            n += (1 + d->ncodes) * (int)sizeof(int) + d->dataLen;
+        }
+    }
+    char *out = malloc(n);
+    char *p = out;
+    if (out == NULL) {
+        return TT_ENOSPACE;
+    }
+    TT_PutInt(&p, TT_DICT_MAGIC);
+    TT_PutInt(&p, schema->nfields);
+    for (int i = 0; i < schema->nfields; i++) {
+        TT_PutInt(&p, schema->type[i]);
+        TT_PutInt(&p, schema->scale[i]);
+        TT_PutInt(&p, schema->width[i]);
+    }
+    for (int i = 0; i < schema->nfields; i++) {
+        if (schema->type[i] == TT_CODE) {
+            const TT_FieldDict *d = &schema->dict->field[i];
+            TT_PutInt(&p, d->ncodes);
+            for (int c = 0; c < d->ncodes; c++) {
+                TT_PutInt(&p, d->len[c]);
+            }
+            if (d->dataLen > 0) {
+                memcpy(p, d->data, d->dataLen);
+                p += d->dataLen;
+            }
+        }
+    }
+    *data = out;
+    *len = n;
+    return TT_OK;
+}
+
+int TT_DictLoad(TT_Schema *schema, TT_Dict *dict, const char *data, int len) {
+    const char *p = data;
+    const char *end = data + len;
+    int v;
+
+    memset(schema, 0, sizeof(TT_Schema));
+    memset(dict, 0, sizeof(TT_Dict));
+
+    // 1. The fields
+    if (!TT_TakeInt(&p, end, &v) || v != TT_DICT_MAGIC ||
+        !TT_TakeInt(&p, end, &schema->nfields) ||
+        schema->nfields < 1 || schema->nfields > TT_MAX_FIELDS) {
+        return TT_EBADSPEC;
+    }
+    for (int i = 0; i < schema->nfields; i++) {
+        if (!TT_TakeInt(&p, end, &v) || v < TT_INT || v > TT_CODE ||
+            !TT_TakeInt(&p, end, &schema->scale[i]) ||
+            !TT_TakeInt(&p, end, &schema->width[i]) ||
+            (v == TT_CODE && schema->width[i] != 1 && schema->width[i] != 2)) {
+            return TT_EBADSPEC;
+        }
+        schema->type[i] = (TT_Type)v;
+    }
+    TT_SchemaLayout(schema);
+    schema->dict = dict;
+
+    // 2. The values, added in code order so that every code stays
+    for (int i = 0; i < schema->nfields; i++) {
+        int ncodes;
+        if (schema->type[i] != TT_CODE) {
+            continue;
+        }
+        if (!TT_TakeInt(&p, end, &ncodes) || ncodes < 0 ||
+            ncodes > 1 << (8 * schema->width[i]) ||
+            end - p < (long)ncodes * (long)sizeof(int)) {
+            TT_DictFree(dict);
+            return TT_EBADSPEC;
+        }
+        const char *lens = p;
+        p += (long)ncodes * sizeof(int);
+        for (int c = 0; c < ncodes; c++) {
+            int n, code;
+            memcpy(&n, lens + c * sizeof(int), sizeof(int));
+            if (n < 0 || end - p < n) {
+                TT_DictFree(dict);
+                return TT_EBADSPEC;
+            }
+            code = TT_FieldDictAdd(&dict->field[i], p, n, TT_MAX_CODES);
+            if (code != c) {
+                TT_DictFree(dict);
+                return code == -2 ? TT_ENOSPACE : TT_EBADSPEC;
+            }
+            p += n;
+        }
+    }
+    if (p != end) {
+        TT_DictFree(dict);
+        return TT_EBADSPEC;
+    }
+    return TT_OK;
+}
@@ -0,0 +1,177 @@
+#ifndef TUPLE_H
+#define TUPLE_H
+
+#include <stddef.h>
+
+/*
+ * Binary tuple format for heap records.
+ *
+ * A table has a schema: a list of typed fields. A tuple is
+ *
+ *   [null bitmap][fixed area][var offset table][var data]
+ *
+ *   null bitmap   one bit per field, set if the field is NULL
+ *                 (an empty field in the text, e.g. ";;")
+ *   fixed area    4 bytes per TT_INT and TT_FLOAT field and 1 or 2
+ *                 bytes per TT_CODE field, in field order; space is
+ *                 kept even when the field is NULL. A TT_FLOAT is
+ *                 stored as value * 10^scale, so "12.50" with 2
+ *                 decimals is the integer 1250
+ *   offset table  one 2-byte end offset per TT_STRING field, counted
+ *                 from the start of the var data
+ *   var data      the string bytes, back to back, without terminators
+ *
+ * Each field's position comes from the schema (fixed fields) or from
+ * one or two offset table entries (strings), so any field can be read
+ * without looking at the others. Values are stored in host byte
+ * order; multi-byte values are not aligned and are read with memcpy.
+ *
+ * A TT_CODE field is a string field with few distinct values (such as
+ * "M", "BTECH" or a grade letter). The values are kept once in a
+ * per-file dictionary (TT_Dict) and the tuple holds a small code.
+ * Equal values have equal codes, so a predicate on such a field can
+ * compare codes without decoding.
+ */
+
+#define TT_MAX_FIELDS 64
+
+typedef enum {
+    TT_INT,         /* 32-bit signed integer */
+    TT_FLOAT,       /* Decimal with a fixed number of decimals */
+    TT_STRING,      /* Variable-length bytes */
+    TT_CODE         /* String stored as a dictionary code */
+} TT_Type;
+
+#define TT_MAX_CODES 65536   /* Codes are at most 2 bytes */
+
+/*
+ * Distinct values of one TT_CODE field; code i is the value at
+ * data + off[i], len[i] bytes long.
+ */
+typedef struct {
+    int ncodes;
+    int codeCap;            /* Room in off[] / len[] */
+    int *off;
+    int *len;
+    char *data;
+    int dataLen;
+    int dataCap;
+    int *hash;              /* Open addressing: code + 1, or 0 if empty */
+    int hashSize;           /* Power of two */
+} TT_FieldDict;
+
+typedef struct {
+    TT_FieldDict field[TT_MAX_FIELDS];
+} TT_Dict;
+
+typedef struct {
+    int nfields;
+    TT_Type type[TT_MAX_FIELDS];
+    int scale[TT_MAX_FIELDS];   /* Decimals of a TT_FLOAT field */
+    int width[TT_MAX_FIELDS];   /* Bytes of a fixed-area field */
+    int pos[TT_MAX_FIELDS];     /* Fixed area offset, or string index */
+    int bitmapSize;             /* Bytes of null bitmap */
+    int fixedSize;              /* Bytes of fixed area */
+    int nvar;                   /* Number of TT_STRING fields */
+    TT_Dict *dict;              /* Values of the TT_CODE fields, or NULL */
+} TT_Schema;
+
+/* Return codes (besides lengths / TT_OK) */
+#define TT_OK        0
+#define TT_NULL      1     /* The field is NULL; no value returned */
+#define TT_EBADROW  -1     /* Row does not match the schema */
+#define TT_ENOSPACE -2     /* Output buffer too small */
+#define TT_EBADSPEC -3     /* Bad schema description */
+
+/*
+ * Sets up a schema from a description with one letter per field:
+ * 'i' TT_INT, 's' TT_STRING, 'f' TT_FLOAT followed by the number of
+ * decimals (e.g. "f2"). Returns TT_OK or TT_EBADSPEC.
+ */
+int TT_SchemaInit(TT_Schema *schema, const char *spec);
+
+/*
+ * Writes the description of a schema (as taken by TT_SchemaInit).
+ * TT_CODE fields, which only TT_DictBuild makes, are written as 'd'.
+ */
+void TT_SchemaSpec(const TT_Schema *schema, char *spec, size_t cap);
+
+/*
+ * Guesses a schema from the ';'-separated rows in buf[0..len). The
+ * field count is the most common one; rows with another count (such
+ * as the "Database dummy - table ..." header) are ignored. A field is
+ * TT_INT or TT_FLOAT only if every non-empty value fits in 32 bits
+ * and turns back into exactly the same text, so TT_EncodeText and
+ * TT_DecodeText round-trip.
+ */
+int TT_InferSchema(TT_Schema *schema, const char *buf, size_t len);
+
+/*
+ * Encodes one ';'-separated text row (without its "\n") as a tuple.
+ * A TT_CODE value that is not in the dictionary yet is added to it.
+ * Returns the tuple length, TT_EBADROW if the row does not have the
+ * schema's field count, a value does not parse as its type or a
+ * TT_CODE field has no codes left, or TT_ENOSPACE if it does not fit
+ * in cap bytes.
+ */
+int TT_EncodeText(const TT_Schema *schema, const char *row, int rowLen,
+                  char *out, int cap);
+
+/*
+ * Turns a tuple back into a ';'-separated text row.
+ * Returns the text length or TT_ENOSPACE.
+ */
+int TT_DecodeText(const TT_Schema *schema, const char *tuple, char *out, int cap);
+
+/*
+ * Field access. Each returns TT_OK, or TT_NULL if the field is NULL.
+ * TT_GetString points *value into the tuple, or into the dictionary
+ * for a TT_CODE field (not terminated). TT_GetCode returns the code
+ * of a TT_CODE field.
+ */
+int TT_IsNull(const TT_Schema *schema, const char *tuple, int field);
+int TT_GetInt(const TT_Schema *schema, const char *tuple, int field, int *value);
+int TT_GetFloat(const TT_Schema *schema, const char *tuple, int field, double *value);
+int TT_GetString(const TT_Schema *schema, const char *tuple, int field,
+                 const char **value, int *len);
+int TT_GetCode(const TT_Schema *schema, const char *tuple, int field, int *code);
+
+/*
+ * Builds a dictionary for the rows in buf[0..len). Every TT_STRING
+ * field of the schema with at most maxCodes distinct values (and at
+ * most TT_MAX_CODES) becomes a TT_CODE field with 1-byte codes if it
+ * has up to 256 values and 2-byte codes otherwise; its values are
+ * kept in dict, which the schema then points to.
+ *
+ * Returns the number of fields turned into TT_CODE, or TT_ENOSPACE
+ * if out of memory. Free the dictionary with TT_DictFree.
+ */
+int TT_DictBuild(TT_Schema *schema, TT_Dict *dict, const char *buf, size_t len,
+                 int maxCodes);
+void TT_DictFree(TT_Dict *dict);
+
+/*
+ * The code of a value of a TT_CODE field, or -1 if the value is not in
+ * the dictionary (so no tuple has it). Used to turn "field = value"
+ * into a code compare.
+ */
+int TT_DictLookup(const TT_Dict *dict, int field, const char *value, int len);
+
+/*
+ * Writes a schema and its dictionary into one malloc'ed buffer, which
+ * the caller frees, so they can be kept with the tuples, e.g. as the
+ * heap file's dictionary (HF_SetDict). Returns TT_OK, or TT_ENOSPACE
+ * if out of memory.
+ */
+int TT_DictSave(const TT_Schema *schema, char **data, int *len);
+
+/*
+ * Sets up a schema and its dictionary from the bytes TT_DictSave
+ * wrote. Every value keeps its code, so tuples encoded before decode
+ * the same. Returns TT_OK, TT_EBADSPEC if data is not what TT_DictSave
+ * writes, or TT_ENOSPACE if out of memory. Free the dictionary with
+ * TT_DictFree.
+ */
+int TT_DictLoad(TT_Schema *schema, TT_Dict *dict, const char *data, int len);
+
+#endif // TUPLE_H
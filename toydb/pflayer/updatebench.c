@@ -0,0 +1,211 @@
+/* updatebench.c
+ * Record updates with HF_UpdateRec: in place or forwarded.
+ *
+ * The table is bulk-loaded, then each round updates every record (in
+ * random order) to its line plus a padding column that grows by -g
+ * bytes per round, and a last round puts the original lines back.
+ * After each round it prints the update rate, the file's pages, the
+ * forwarding slots left, and the time of a full scan. Every record
+ * must keep the RID it was loaded at: HF_GetRec on it and the full
+ * scan must both give the current version, and the scan must return
+ * each record exactly once.
+ *
+ * Usage: updatebench [-b poolSize] [-r rounds] [-g grow] [-F fill]
+ *                    [-s seed] [table.txt]
+ *   -b  buffer pool size              (default 20)
+ *   -r  growing rounds                (default 3)
+ *   -g  bytes added per round         (default 24)
+ *   -F  bulk-load fill factor, percent (default 100)
+ *   -s  random seed                   (default 1)
+ *   table defaults to ../../data/student.txt
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "hf.h"
+#include "pftypes.h"
+#include "benchutil.h"
+
+#define MAX_LINE  4096
+
+static const char *heapFile = "updatebench.hf";
+
+// version of line i after round r: the line, then r*grow padding bytes
+static int make_version(int i, int r, int grow, char *out) {
+    int len = lineLen[i];
+    memcpy(out, lines[i], len);
+    if (r > 0) {
+        out[len++] = ';';
+        for (int k = 0; k < r * grow; k++)
+            out[len++] = 'a' + (i + k) % 26;
+    }
+    return len;
+}
+
+// forwarding slots of the file, read page by page
+static int count_forwards(int fd) {
+    int pagenum = -1, n = 0;
+    char *pageBuf;
+    RID to;
+    while (PF_GetNextPage(fd, &pagenum, &pageBuf) == PFE_OK) {
+        HF_PageHeader *header = (HF_PageHeader *)pageBuf;
+        for (int s = 0; s < header->numSlots; s++)
+            if (HF_Page_GetForward(pageBuf, s, &to) == HFE_OK)
+                n++;
+        PF_UnfixPage(fd, pagenum, FALSE);
+    }
+    return n;
+}
+
+// full scan; every record once, at its own RID, in its round-r version
+static int check(int fd, RID *rids, int n, int r, int grow, double *scanMs) {
+    char *seen = calloc(n, 1);
+    char want[MAX_LINE * 2];
+    HF_Scan sc;
+    RID rid;
+    char *rec;
+    int len, bad = 0, found = 0;
+
+    // index of the record loaded at each RID: rids[] is in file order
+    double t0 = now_ms();
+    HF_OpenFileScan(fd, &sc);
+    while (HF_GetNextRec(fd, &sc, &rid, &rec, &len) == HFE_OK) {
+        int lo = 0, hi = n - 1, i = -1;
+        while (lo <= hi) {
+            int mid = (lo + hi) / 2;
+            if (rids[mid].pageNum < rid.pageNum ||
+                (rids[mid].pageNum == rid.pageNum && rids[mid].slotNum < rid.slotNum))
+                lo = mid + 1;
+            else if (rids[mid].pageNum == rid.pageNum && rids[mid].slotNum == rid.slotNum) {
+                i = mid;
+                break;
+            } else
+                hi = mid - 1;
+        }
+        if (i < 0 || seen[i] || len != make_version(i, r, grow, want) ||
+            memcmp(rec, want, len) != 0)
+            bad++;
+        else
+            seen[i] = 1;
+        found++;
+    }
+    HF_CloseFileScan(&sc);
+    *scanMs = now_ms() - t0;
+
+    for (int i = 0; i < n; i++) {
+        int wlen = make_version(i, r, grow, want);
+        if (HF_GetRec(fd, rids[i], &rec, &len) != HFE_OK || len != wlen ||
+            memcmp(rec, want, len) != 0)
+            bad++;
+    }
+    free(seen);
+    return found != n ? bad + 1 : bad;
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = "../../data/student.txt";
+    int pool = 20, rounds = 3, grow = 24, fill = 100;
+    unsigned seed = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "b:r:g:F:s:")) != -1) {
+        switch (opt) {
+        case 'b': pool = atoi(optarg); break;
+        case 'r': rounds = atoi(optarg); break;
+        case 'g': grow = atoi(optarg); break;
+        case 'F': fill = atoi(optarg); break;
+        case 's': seed = (unsigned)atoi(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-b poolSize] [-r rounds] [-g grow] [-F fill] "
+                    "[-s seed] [table.txt]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind < argc)
+        path = argv[optind];
+    if (pool <= 0 || pool > PF_MAX_BUFS_LIMIT) {
+        fprintf(stderr, "pool size out of range (1..%d)\n", PF_MAX_BUFS_LIMIT);
+        return 1;
+    }
+    if (rounds < 0 || grow < 0 || (long)rounds * grow + 1 >= MAX_LINE ||
+        fill <= 0 || fill > 100) {
+        fprintf(stderr, "-r and -g must not be negative (padding < %d bytes), "
+                "-F 1..100\n", MAX_LINE);
+        return 1;
+    }
+    if (read_table(path) <= 0) {
+        perror(path);
+        return 1;
+    }
+    srand(seed);
+
+    PF_Init();
+    PF_SetBufferSize(pool);
+    PF_SetReplacementPolicy(PF_REPL_LRU);
+
+    // 1. Load the table; rids[i] is where line i lives, for good
+    RID *rids;
+    int n, next = 0;
+    PF_DestroyFile((char *)heapFile);
+    if (HF_CreateFile((char *)heapFile) != HFE_OK) {
+        PF_PrintError("HF_CreateFile");
+        return 1;
+    }
+    int fd = HF_OpenFile((char *)heapFile);
+    if (fd < 0 || HF_BulkLoad(fd, next_line, &next, fill, &rids, &n) != HFE_OK) {
+        PF_PrintError("HF_BulkLoad");
+        return 1;
+    }
+    int *order = malloc(n * sizeof(int));
+    for (int i = 0; i < n; i++)
+        order[i] = i;
+
+    printf("updatebench: %s, %d records, +%d bytes per round, fill=%d%%, pool=%d\n",
+           path, n, grow, fill, pool);
+    printf("%6s %8s %10s %8s %9s %10s\n", "round", "padding", "kupd/s", "pages",
+           "forwards", "scan ms");
+
+    int status = 0;
+    double scanMs;
+    char rec[MAX_LINE * 2];
+    if (check(fd, rids, n, 0, grow, &scanMs) != 0) {
+        printf("load WRONG\n");
+        return 1;
+    }
+    printf("%6s %8d %10s %8d %9d %10.2f\n", "load", 0, "-", PF_NumPages(fd),
+           count_forwards(fd), scanMs);
+
+    // 2. Grow every record, round after round, then shrink them back
+    for (int round = 1; round <= rounds + 1; round++) {
+        int r = round <= rounds ? round : 0;
+        for (int i = n - 1; i > 0; i--) {
+            int j = rand() % (i + 1);
+            int t = order[i]; order[i] = order[j]; order[j] = t;
+        }
+        double t0 = now_ms();
+        for (int k = 0; k < n; k++) {
+            int i = order[k];
+            int len = make_version(i, r, grow, rec);
+            int err = HF_UpdateRec(fd, rids[i], rec, len);
+            if (err != HFE_OK) {
+                printf("HF_UpdateRec error %d on record %d\n", err, i);
+                return 1;
+            }
+        }
+        double ms = now_ms() - t0;
+
+        int bad = check(fd, rids, n, r, grow, &scanMs);
+        printf("%6d %8d %10.1f %8d %9d %10.2f", round, r * grow, n / ms, PF_NumPages(fd),
+               count_forwards(fd), scanMs);
+        if (bad) {
+            printf("  WRONG (%d records)", bad);
+            status = 1;
+        }
+        printf("\n");
+    }
+
+    HF_CloseFile(fd);
+    PF_DestroyFile((char *)heapFile);
+    return status;
+}
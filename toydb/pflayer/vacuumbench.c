@@ -0,0 +1,221 @@
+/* vacuumbench.c
+ * Vacuum of a heap file after mass deletes: pages reclaimed and
+ * scan time.
+ *
+ * The table is bulk-loaded and a random fraction of its records is
+ * deleted, which leaves many sparse pages. The file is then vacuumed,
+ * either with HF_Vacuum or by a background thread (HF_StartVacuum)
+ * while the main thread keeps scanning. Before and after, it prints
+ * the file's pages, the time of a full scan (repeated for at least
+ * MIN_MS) and the PF reads of one scan. Moved records are followed
+ * through the relocation callback, and every record left must still
+ * be found at its (new) RID.
+ *
+ * Usage: vacuumbench [-b poolSize] [-f percent] [-p sparsePct]
+ *                    [-t ms] [-s seed] [table.txt]
+ *   -b  buffer pool size              (default 20)
+ *   -f  percent of the records deleted (default 70)
+ *   -p  pages less full than this percent are emptied
+ *       (default HF_VACUUM_SPARSE)
+ *   -t  run a background vacuum for this many ms instead
+ *       of HF_Vacuum                   (default 0: HF_Vacuum)
+ *   -s  random seed                   (default 1)
+ *   table defaults to ../../data/student.txt
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "hf.h"
+#include "pftypes.h"
+#include "benchutil.h"
+
+#define MIN_MS    200.0     // run each scan for at least this long
+#define MAX_SLOTS (PF_PAGE_SIZE / (int)sizeof(HF_SlotEntry))
+
+static const char *heapFile = "vacuumbench.hf";
+
+// record at each (page, slot), so a relocation can find its owner
+static int *owner;
+static RID *rids;
+
+// HF_RelocFn: record owner[old] now lives at newRid
+static void relocate(void *ctx, RID oldRid, RID newRid) {
+    (void)ctx;
+    int r = owner[oldRid.pageNum * MAX_SLOTS + oldRid.slotNum];
+    owner[oldRid.pageNum * MAX_SLOTS + oldRid.slotNum] = -1;
+    owner[newRid.pageNum * MAX_SLOTS + newRid.slotNum] = r;
+    rids[r] = newRid;
+}
+
+// full scan; returns the records found and adds up their lengths
+static long scan(int fd, long *bytes) {
+    HF_Scan sc;
+    RID rid;
+    char *rec;
+    int len;
+    long n = 0;
+
+    *bytes = 0;
+    HF_OpenFileScan(fd, &sc);
+    while (HF_GetNextRec(fd, &sc, &rid, &rec, &len) == HFE_OK) {
+        *bytes += len;
+        n++;
+    }
+    HF_CloseFileScan(&sc);
+    return n;
+}
+
+// pages, scan time and reads of the file; checks the scan's records
+static int report(const char *when, int fd, long live, long expect) {
+    long found = 0, bytes = 0;
+    double t0, ms;
+    int reps;
+
+    PF_ResetStats();
+    for (reps = 0, t0 = now_ms(); (ms = now_ms() - t0) < MIN_MS; reps++)
+        found = scan(fd, &bytes);
+    printf("%-8s %8d %9ld %10.3f %10.0f", when, PF_NumPages(fd), found, ms / reps,
+           (double)PF_stats.physicalReads / reps);
+    if (found != live || bytes != expect) {
+        printf("  WRONG (expected %ld records, %ld bytes)\n", live, expect);
+        return 1;
+    }
+    printf("\n");
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = "../../data/student.txt";
+    int pool = 20, percent = 70, sparsePct = HF_VACUUM_SPARSE, bgMs = 0;
+    unsigned seed = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "b:f:p:t:s:")) != -1) {
+        switch (opt) {
+        case 'b': pool = atoi(optarg); break;
+        case 'f': percent = atoi(optarg); break;
+        case 'p': sparsePct = atoi(optarg); break;
+        case 't': bgMs = atoi(optarg); break;
+        case 's': seed = (unsigned)atoi(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-b poolSize] [-f percent] [-p sparsePct] "
+                    "[-t ms] [-s seed] [table.txt]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind < argc)
+        path = argv[optind];
+    if (pool <= 0 || pool > PF_MAX_BUFS_LIMIT) {
+        fprintf(stderr, "pool size out of range (1..%d)\n", PF_MAX_BUFS_LIMIT);
+        return 1;
+    }
+    if (percent < 0 || percent > 100 || sparsePct < 0 || sparsePct > 100 || bgMs < 0) {
+        fprintf(stderr, "-f and -p must be 0..100 and -t not negative\n");
+        return 1;
+    }
+    if (read_table(path) <= 0) {
+        perror(path);
+        return 1;
+    }
+    srand(seed);
+
+    PF_Init();
+    PF_SetBufferSize(pool);
+    PF_SetReplacementPolicy(PF_REPL_LRU);
+
+    // 1. Load the table; rids[i] is where line i lives
+    int n, next = 0;
+    PF_DestroyFile((char *)heapFile);
+    if (HF_CreateFile((char *)heapFile) != HFE_OK) {
+        PF_PrintError("HF_CreateFile");
+        return 1;
+    }
+    int fd = HF_OpenFile((char *)heapFile);
+    if (fd < 0 || HF_BulkLoad(fd, next_line, &next, 100, &rids, &n) != HFE_OK) {
+        PF_PrintError("HF_BulkLoad");
+        return 1;
+    }
+    int pages = PF_NumPages(fd);
+    owner = malloc((size_t)pages * MAX_SLOTS * sizeof(int));
+    for (int i = 0; i < pages * MAX_SLOTS; i++)
+        owner[i] = -1;
+    for (int i = 0; i < n; i++)
+        owner[rids[i].pageNum * MAX_SLOTS + rids[i].slotNum] = i;
+
+    // 2. Delete a random percent of the records
+    char *deleted = calloc(n, 1);
+    long live = n, expect = 0;
+    for (int i = 0; i < n; i++) {
+        if (rand() % 100 < percent) {
+            if (HF_DeleteRec(fd, rids[i]) != HFE_OK) {
+                PF_PrintError("HF_DeleteRec");
+                return 1;
+            }
+            owner[rids[i].pageNum * MAX_SLOTS + rids[i].slotNum] = -1;
+            deleted[i] = 1;
+            live--;
+        } else {
+            expect += lineLen[i];
+        }
+    }
+
+    printf("vacuumbench: %s, %d records, %ld left after deleting %d%%, "
+           "sparse < %d%%, pool=%d\n", path, n, live, percent, sparsePct, pool);
+    printf("%-8s %8s %9s %10s %10s\n", "", "pages", "records", "scan ms", "reads");
+    int status = report("before", fd, live, expect);
+
+    // 3. Vacuum, in one go or on a background thread
+    HF_VacuumStats vs;
+    int err;
+    double t0 = now_ms();
+    memset(&vs, 0, sizeof(vs));
+    if (bgMs == 0) {
+        err = HF_Vacuum(fd, sparsePct, relocate, NULL, &vs);
+    } else {
+        long bytes;
+        int scans = 0;
+        err = HF_StartVacuum(fd, 16, 1, sparsePct, relocate, NULL);
+        while (err == HFE_OK && now_ms() - t0 < bgMs) {
+            // scans go on meanwhile; each must see every record once
+            if (scan(fd, &bytes) != live || bytes != expect) {
+                printf("scan during vacuum WRONG\n");
+                status = 1;
+            }
+            scans++;
+            usleep(2000);
+        }
+        if (err == HFE_OK)
+            err = HF_StopVacuum(fd, &vs);
+        printf("%d scans ran beside the vacuum thread\n", scans);
+    }
+    double ms = now_ms() - t0;
+    if (err != HFE_OK) {
+        printf("vacuum error %d\n", err);
+        return 1;
+    }
+    printf("vacuum: %.2f ms, %d pages looked at, %d compacted, %d records moved, "
+           "%d pages freed, %d trimmed\n", ms, vs.pagesScanned, vs.pagesCompacted,
+           vs.recordsMoved, vs.pagesFreed, vs.pagesTrimmed);
+    status |= report("after", fd, live, expect);
+
+    // 4. Every record left is where the callbacks said it went
+    int bad = 0;
+    for (int i = 0; i < n; i++) {
+        char *rec;
+        int len;
+        if (deleted[i])
+            continue;
+        if (HF_GetRec(fd, rids[i], &rec, &len) != HFE_OK || len != lineLen[i] ||
+            memcmp(rec, lines[i], len) != 0)
+            bad++;
+    }
+    if (bad) {
+        printf("%d records not found at their RIDs\n", bad);
+        status = 1;
+    }
+
+    HF_CloseFile(fd);
+    PF_DestroyFile((char *)heapFile);
+    return status;
+}
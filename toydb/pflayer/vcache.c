@@ -0,0 +1,249 @@
+/* vcache.c: second-tier (victim) cache for the buffer manager.
+Pages evicted from the buffer pool are compressed with the page codec
+and kept here, within a memory budget, so that the next access to them
+does not have to go to the file. The interface routines are:
+PFvcacheInsert(), PFvcacheGet(), PFvcacheDelete(), PFvcacheReleaseFile()
+and PFvcacheSetSize().
+
+The cache is exclusive: a page is either in the buffer pool or here,
+never in both. PFvcacheGet() therefore removes the entry it returns. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pf.h"
+#include "pftypes.h"
+
+static PFvc_entry *PFvctbl[PF_VC_TBL_SIZE];	/* hash table */
+static PFvc_entry *PFvcfirst = NULL;	/* most recently inserted entry */
+static PFvc_entry *PFvclast = NULL;	/* least recently inserted entry */
+static long PFvcbudget = 0;		/* max # of bytes to use, 0 = off */
+static long PFvcused = 0;		/* # of bytes in use */
+
+/* # of bytes charged against the budget for entry "e" */
+#define PFvcCost(e)	((long)sizeof(PFvc_entry) + (e)->len)
+
+
+static PFvc_entry *PFvcacheFind(fd,page)
+int fd;		/* file descriptor */
+int page;	/* page number */
+/****************************************************************************
+SPECIFICATIONS:
+	Find the victim cache entry for page "page" of file "fd".
+
+RETURN VALUE:
+	The entry, or NULL if the page is not cached.
+*****************************************************************************/
+{
+PFvc_entry *entry;
+
+	for (entry = PFvctbl[PFvcHash(fd,page)]; entry != NULL;
+				entry = entry->nextentry)
+		if (entry->fd == fd && entry->page == page)
+			return(entry);
+	return(NULL);
+}
+
+
+static void PFvcacheRemove(entry)
+PFvc_entry *entry;	/* entry to remove */
+/****************************************************************************
+SPECIFICATIONS:
+	Unlink "entry" from its hash bucket and from the LRU list,
+	and free it.
+
+GLOBAL VARIABLES MODIFIED:
+	PFvctbl, PFvcfirst, PFvclast, PFvcused
+*****************************************************************************/
+{
+int bucket = PFvcHash(entry->fd,entry->page);
+
+	/* unlink from the hash bucket */
+	if (entry == PFvctbl[bucket])
+		PFvctbl[bucket] = entry->nextentry;
+	if (entry->preventry != NULL)
+		entry->preventry->nextentry = entry->nextentry;
+	if (entry->nextentry != NULL)
+		entry->nextentry->preventry = entry->preventry;
+
+	/* unlink from the LRU list */
+	if (entry == PFvcfirst)
+		PFvcfirst = entry->nextlru;
+	if (entry == PFvclast)
+		PFvclast = entry->prevlru;
+	if (entry->prevlru != NULL)
+		entry->prevlru->nextlru = entry->nextlru;
+	if (entry->nextlru != NULL)
+		entry->nextlru->prevlru = entry->prevlru;
+
+	PFvcused -= PFvcCost(entry);
+	free(entry->data);
+	free((char *)entry);
+}
+
+
+static void PFvcacheShrink(limit)
+long limit;	/* # of bytes the cache may use */
+/****************************************************************************
+SPECIFICATIONS:
+	Drop least recently inserted entries until at most "limit"
+	bytes are in use.
+*****************************************************************************/
+{
+	while (PFvclast != NULL && PFvcused > limit)
+		PFvcacheRemove(PFvclast);
+}
+
+
+int PFvcacheInsert(fd,page,fpage)
+int fd;		/* file descriptor */
+int page;	/* page number */
+PFfpage *fpage;	/* clean image of the page */
+/****************************************************************************
+SPECIFICATIONS:
+	Keep a compressed copy of "fpage", the page "page" of file "fd",
+	which is being evicted from the buffer pool. "fpage" must be
+	the same as the copy in the file. Older entries are dropped to
+	stay within the budget. Does nothing if the cache is turned off.
+
+RETURN VALUE:
+	PFE_OK	if no error (including when the page is not cached).
+	PFE_NOMEM if no memory.
+*****************************************************************************/
+{
+static char zbuf[sizeof(PFfpage)];	/* compression scratch area */
+PFvc_entry *entry;
+int len;
+int bucket;
+
+	if (PFvcbudget <= 0)
+		return(PFE_OK);
+
+	/* get rid of any older copy */
+	if ((entry = PFvcacheFind(fd,page)) != NULL)
+		PFvcacheRemove(entry);
+
+	/* compress; keep the raw image if it does not get smaller */
+	if ((len = PFcodecCompress((char *)fpage,sizeof(PFfpage),
+				zbuf,sizeof(PFfpage))) == 0)
+		len = sizeof(PFfpage);
+
+	if ((long)sizeof(PFvc_entry) + len > PFvcbudget)
+		/* would never fit */
+		return(PFE_OK);
+	PFvcacheShrink(PFvcbudget - (long)sizeof(PFvc_entry) - len);
+
+	if ((entry = (PFvc_entry *)malloc(sizeof(PFvc_entry))) == NULL ||
+			(entry->data = malloc(len)) == NULL){
+		free((char *)entry);
+		PFerrno = PFE_NOMEM;
+		return(PFerrno);
+	}
+	memcpy(entry->data,
+		len == sizeof(PFfpage) ? (char *)fpage : zbuf, len);
+	entry->fd = fd;
+	entry->page = page;
+	entry->len = len;
+
+	/* insert as head of its bucket */
+	bucket = PFvcHash(fd,page);
+	entry->nextentry = PFvctbl[bucket];
+	entry->preventry = NULL;
+	if (PFvctbl[bucket] != NULL)
+		PFvctbl[bucket]->preventry = entry;
+	PFvctbl[bucket] = entry;
+
+	/* insert as head of the LRU list */
+	entry->prevlru = NULL;
+	entry->nextlru = PFvcfirst;
+	if (PFvcfirst != NULL)
+		PFvcfirst->prevlru = entry;
+	PFvcfirst = entry;
+	if (PFvclast == NULL)
+		PFvclast = entry;
+
+	PFvcused += PFvcCost(entry);
+	return(PFE_OK);
+}
+
+
+int PFvcacheGet(fd,page,fpage)
+int fd;		/* file descriptor */
+int page;	/* page number */
+PFfpage *fpage;	/* where to put the page */
+/****************************************************************************
+SPECIFICATIONS:
+	If page "page" of file "fd" is in the victim cache, decompress
+	it into "fpage" and remove it from the cache.
+
+RETURN VALUE:
+	TRUE	if "fpage" has been filled in.
+	FALSE	if the page is not in the cache.
+*****************************************************************************/
+{
+PFvc_entry *entry;
+int ok;
+
+	if (PFvcfirst == NULL || (entry = PFvcacheFind(fd,page)) == NULL)
+		return(FALSE);
+
+	if (entry->len == sizeof(PFfpage)){
+		memcpy((char *)fpage,entry->data,sizeof(PFfpage));
+		ok = TRUE;
+	}
+	else	ok = PFcodecDecompress(entry->data,entry->len,(char *)fpage,
+				sizeof(PFfpage)) == sizeof(PFfpage);
+
+	/* either way, the entry is of no further use */
+	PFvcacheRemove(entry);
+	return(ok);
+}
+
+
+void PFvcacheDelete(fd,page)
+int fd;		/* file descriptor */
+int page;	/* page number */
+/****************************************************************************
+SPECIFICATIONS:
+	Forget page "page" of file "fd", if it is cached.
+*****************************************************************************/
+{
+PFvc_entry *entry;
+
+	if (PFvcfirst != NULL && (entry = PFvcacheFind(fd,page)) != NULL)
+		PFvcacheRemove(entry);
+}
+
+
+void PFvcacheReleaseFile(fd)
+int fd;		/* file descriptor */
+/****************************************************************************
+SPECIFICATIONS:
+	Forget all the pages of file "fd". Called when the file is
+	closed, since its file descriptor may be reused.
+
+IMPLEMENTATION NOTES:
+	A linear scan of the LRU list is performed.
+*****************************************************************************/
+{
+PFvc_entry *entry;
+PFvc_entry *next;
+
+	for (entry = PFvcfirst; entry != NULL; entry = next){
+		next = entry->nextlru;
+		if (entry->fd == fd)
+			PFvcacheRemove(entry);
+	}
+}
+
+
+void PFvcacheSetSize(bytes)
+long bytes;	/* new budget in bytes, 0 to turn the cache off */
+/****************************************************************************
+SPECIFICATIONS:
+	Set the memory budget of the victim cache, dropping entries
+	that no longer fit.
+*****************************************************************************/
+{
+	PFvcbudget = bytes > 0 ? bytes : 0;
+	PFvcacheShrink(PFvcbudget);
+}
@@ -0,0 +1,245 @@
+/* zonebench.c
+ * Zone maps: range scans that skip pages.
+ *
+ * The table is inserted one record at a time (HF_InsertRec) into three
+ * files:
+ *   plain     - in table order, without a zone map
+ *   zoned     - in table order, with a zone map on the key column
+ *   shuffled  - in random order, with the same zone map
+ * Each file then answers -q range queries "lo <= key < hi"
+ * (HF_GetNextRows, projected to the key) for windows that hold 0.1%,
+ * 1% and 10% of the keys, at the same random place for every file. For
+ * each window the bench prints the pages pinned per query (PF logical
+ * reads), the time per query and the rows matched, which must be the
+ * same for all files. Then 10% of the records are deleted at random,
+ * the same ones from every file, and the 1% window is run again.
+ *
+ * Usage: zonebench [-b poolSize] [-c col] [-q queries] [-s seed] [table.txt]
+ *   -b  buffer pool size              (default 100)
+ *   -c  key column                    (default 0: roll number)
+ *   -q  queries per window            (default 200)
+ *   -s  random seed                   (default 1)
+ *   table defaults to ../../data/student.txt
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "hf.h"
+#include "pftypes.h"
+#include "benchutil.h"
+
+#define NWIN      3
+#define NFILES    3
+#define DEL_PCT   10
+
+static const char *heapFile = "zonebench.hf";
+static const double winPct[NWIN] = { 0.1, 1, 10 };
+
+// the key column's numbers, sorted
+static double *keys;
+static int nkeys;
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+// the key column's numbers, as a numeric HF_Pred reads them
+static int read_keys(int col) {
+    keys = malloc(nlines * sizeof(double));
+    for (int i = 0; i < nlines; i++) {
+        const char *p = lines[i];
+        for (int c = 0; c < col && p; c++) {
+            p = strchr(p, ';');
+            if (p)
+                p++;
+        }
+        char *end;
+        double v = p ? strtod(p, &end) : 0;
+        if (!p || end == p || *p == ';')
+            continue;
+        keys[nkeys++] = v;
+    }
+    qsort(keys, nkeys, sizeof(double), cmp_double);
+    return nkeys;
+}
+
+// runs the queries of one window; returns the rows they matched
+static long queries(int fd, int col, const double *lo, const double *hi, int q,
+                    double *ms, double *reads) {
+    static HF_RowBatch batch;
+    HF_ScanSpec spec;
+    long rows = 0;
+
+    memset(&spec, 0, sizeof(spec));
+    spec.npreds = 2;
+    spec.preds[0].col = spec.preds[1].col = col;
+    spec.preds[0].numeric = spec.preds[1].numeric = 1;
+    spec.preds[0].op = HF_GE;
+    spec.preds[1].op = HF_LT;
+    spec.nproj = 1;
+    spec.proj[0] = col;
+
+    PF_ResetStats();
+    double t0 = now_ms();
+    for (int k = 0; k < q; k++) {
+        HF_Scan sc;
+        spec.preds[0].num = lo[k];
+        spec.preds[1].num = hi[k];
+        if (HF_OpenFileScanEx(fd, &sc, &spec) != HFE_OK)
+            return -1;
+        while (HF_GetNextRows(&sc, &batch) == HFE_OK)
+            rows += batch.n;
+        HF_CloseFileScan(&sc);
+    }
+    *ms = (now_ms() - t0) / q;
+    *reads = (double)PF_stats.logicalReads / q;
+    return rows;
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = "../../data/student.txt";
+    int pool = 100, col = 0, q = 200;
+    unsigned seed = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "b:c:q:s:")) != -1) {
+        switch (opt) {
+        case 'b': pool = atoi(optarg); break;
+        case 'c': col = atoi(optarg); break;
+        case 'q': q = atoi(optarg); break;
+        case 's': seed = (unsigned)atoi(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-b poolSize] [-c col] [-q queries] [-s seed] "
+                    "[table.txt]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind < argc)
+        path = argv[optind];
+    if (pool <= 0 || pool > PF_MAX_BUFS_LIMIT) {
+        fprintf(stderr, "pool size out of range (1..%d)\n", PF_MAX_BUFS_LIMIT);
+        return 1;
+    }
+    if (col < 0 || col >= HF_MAX_PROJ || q < 1) {
+        fprintf(stderr, "-c must be below %d, -q at least 1\n", HF_MAX_PROJ);
+        return 1;
+    }
+    if (read_table(path) <= 0) {
+        fprintf(stderr, "cannot read %s\n", path);
+        return 1;
+    }
+    if (read_keys(col) == 0) {
+        fprintf(stderr, "%s: column %d has no numbers\n", path, col);
+        return 1;
+    }
+    srand(seed);
+
+    PF_Init();
+    PF_SetBufferSize(pool);
+    PF_SetReplacementPolicy(PF_REPL_LRU);
+
+    // 1. The same insert order, query bounds and deletes for every file
+    int *order = malloc(nlines * sizeof(int));
+    int *gone = malloc(nlines * sizeof(int));
+    RID *rids = malloc(nlines * sizeof(RID));
+    double *lo = malloc((NWIN + 1) * q * sizeof(double));
+    double *hi = malloc((NWIN + 1) * q * sizeof(double));
+    for (int i = 0; i < nlines; i++) {
+        order[i] = i;
+        gone[i] = rand() % 100 < DEL_PCT;
+    }
+    for (int i = nlines - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        int t = order[i];
+        order[i] = order[j];
+        order[j] = t;
+    }
+    for (int w = 0; w <= NWIN; w++) {
+        int width = (int)(nkeys * winPct[w < NWIN ? w : 1] / 100);
+        if (width < 1)
+            width = 1;
+        for (int k = 0; k < q; k++) {
+            int at = rand() % (nkeys - width + 1);
+            lo[w * q + k] = keys[at];
+            hi[w * q + k] = at + width < nkeys ? keys[at + width] : keys[nkeys - 1] + 1;
+        }
+    }
+
+    printf("zonebench: %s, %d records, key column %d (%.0f..%.0f), %d queries per window, "
+           "pool=%d\n", path, nlines, col, keys[0], keys[nkeys - 1], q, pool);
+    printf("%-9s %6s %8s %8s %8s %12s %10s %11s\n", "file", "pages", "kins/s", "kdel/s",
+           "window", "reads/query", "ms/query", "rows/query");
+
+    long ref[NWIN + 1];
+    int status = 0;
+    for (int f = 0; f < NFILES; f++) {
+        static const char *names[NFILES] = { "plain", "zoned", "shuffled" };
+        HF_FileOptions opts = { .layout = HF_LAYOUT_SLOTTED, .sep = ';', .zoneCols = { col } };
+        long rows[NWIN + 1];
+        double ms[NWIN + 1], reads[NWIN + 1];
+
+        // 2. Insert the records one at a time
+        if (f > 0)
+            opts.nzone = 1;
+        PF_DestroyFile((char *)heapFile);
+        if (HF_CreateFileEx((char *)heapFile, &opts) != HFE_OK) {
+            PF_PrintError("HF_CreateFileEx");
+            return 1;
+        }
+        int fd = HF_OpenFile((char *)heapFile);
+        if (fd < 0) {
+            PF_PrintError("HF_OpenFile");
+            return 1;
+        }
+        double t0 = now_ms();
+        for (int k = 0; k < nlines; k++) {
+            int i = f == 2 ? order[k] : k;
+            int err = HF_InsertRec(fd, lines[i], lineLen[i], &rids[i]);
+            if (err != HFE_OK) {
+                printf("HF_InsertRec error %d on record %d\n", err, i);
+                return 1;
+            }
+        }
+        double insMs = now_ms() - t0;
+        int pages = PF_NumPages(fd);
+
+        // 3. The range queries
+        for (int w = 0; w < NWIN; w++)
+            rows[w] = queries(fd, col, lo + w * q, hi + w * q, q, &ms[w], &reads[w]);
+
+        // 4. Delete some records, then the 1% window again
+        int ndel = 0;
+        t0 = now_ms();
+        for (int i = 0; i < nlines; i++) {
+            if (gone[i] && HF_DeleteRec(fd, rids[i]) == HFE_OK)
+                ndel++;
+        }
+        double delMs = now_ms() - t0;
+        rows[NWIN] = queries(fd, col, lo + NWIN * q, hi + NWIN * q, q,
+                             &ms[NWIN], &reads[NWIN]);
+        HF_CloseFile(fd);
+
+        for (int w = 0; w <= NWIN; w++) {
+            char win[16];
+            snprintf(win, sizeof(win), w < NWIN ? "%g%%" : "%g%% -%d%%",
+                     winPct[w < NWIN ? w : 1], DEL_PCT);
+            if (w == 0)
+                printf("%-9s %6d %8.1f %8.1f", names[f], pages, nlines / insMs, ndel / delMs);
+            else
+                printf("%-9s %6s %8s %8s", "", "", "", "");
+            printf(" %8s %12.1f %10.3f %11.1f", win, reads[w], ms[w], (double)rows[w] / q);
+            if (f == 0) {
+                ref[w] = rows[w];
+            } else if (rows[w] != ref[w]) {
+                printf("  WRONG (plain: %ld rows)", ref[w]);
+                status = 1;
+            }
+            printf("\n");
+        }
+    }
+
+    PF_DestroyFile((char *)heapFile);
+    return status;
+}